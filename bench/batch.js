@@ -0,0 +1,39 @@
+// Headless fast-forward throughput: runFrames() with each render mode, with
+// and without audio, on a stopped emulation thread
+// Usage: node bench/batch.js <rom> [frames]
+const { Snes9xAddon } = require('../build/Release/snes9x_addon.node');
+
+const romPath = process.argv[2];
+const frames = parseInt(process.argv[3]) || 3000;
+
+if (!romPath) {
+    console.error('Usage: node bench/batch.js <rom> [frames]');
+    process.exit(1);
+}
+
+const emulator = new Snes9xAddon();
+if (!emulator.init() || !emulator.loadROM(romPath)) {
+    console.error(`Failed to load ${romPath}`);
+    process.exit(1);
+}
+
+const fixed = (value, digits) => value.toFixed(digits).padStart(8);
+
+(async () => {
+    // 'every' also delivers each frame; drop them right away
+    emulator.setVideoCallback((buffer) => emulator.releaseVideoFrame(buffer));
+
+    // Warm up past the boot screens
+    await emulator.runFrames(300, { render: 'none' });
+
+    console.log(`${frames} frames, real time ${emulator.getFrameRate().toFixed(2)} fps`);
+    console.log('render  audio       fps   mean us    max us  elapsed ms  rendered');
+    for (const audio of [false, true]) {
+        for (const render of ['none', 'last', 'every']) {
+            const result = await emulator.runFrames(frames, { render, audio });
+            console.log(`${render.padEnd(6)}  ${String(audio).padEnd(5)}  ${fixed(result.framesPerSecond, 0)}  ${fixed(result.frameUsMean, 1)}  ${fixed(result.frameUsMax, 1)}    ${fixed(result.elapsedMs, 1)}  ${String(result.rendered).padStart(8)}`);
+        }
+    }
+
+    emulator.deinit();
+})();
@@ -0,0 +1,63 @@
+// Incremental checkpoint cost: encoded bytes per checkpoint against the full
+// savestate, the changed bytes per memory region, the time to diff on the
+// emulation thread, and a round trip through encodeCheckpoint() /
+// applyStateDelta() compared with restoreCheckpoint()
+// Usage: node bench/checkpoints.js <rom> [checkpoints] [intervalFrames]
+const { Snes9xAddon } = require('../build/Release/snes9x_addon.node');
+
+const romPath = process.argv[2];
+const count = parseInt(process.argv[3]) || 120;
+const intervalFrames = parseInt(process.argv[4]) || 1;
+
+if (!romPath) {
+    console.error('Usage: node bench/checkpoints.js <rom> [checkpoints] [intervalFrames]');
+    process.exit(1);
+}
+
+const emulator = new Snes9xAddon();
+if (!emulator.init() || !emulator.loadROM(romPath)) {
+    console.error(`Failed to load ${romPath}`);
+    process.exit(1);
+}
+
+const kb = (bytes) => (bytes / 1024).toFixed(1).padStart(8);
+
+(async () => {
+    // Past the boot screens, so the checkpoints see gameplay
+    await emulator.runFrames(600, { render: 'none' });
+
+    const receiver = Buffer.alloc(emulator.getStateSize());
+    let sent = 0;
+    for (let i = 0; i < count; i++) {
+        await emulator.runFrames(intervalFrames, { render: 'last' });
+        const { checkpoint } = await emulator.checkpoint();
+        const encoded = emulator.encodeCheckpoint(checkpoint);
+        sent += encoded.length;
+        if (Snes9xAddon.applyStateDelta(receiver, encoded) !== checkpoint) {
+            console.error(`applyStateDelta failed at checkpoint ${checkpoint}`);
+            process.exit(1);
+        }
+    }
+
+    const stats = emulator.getCheckpointStats();
+    console.log(`state ${kb(stats.stateBytes)} KB, ${stats.checkpoints} checkpoints every ${intervalFrames} frames`);
+    console.log(`delta ${kb(stats.deltaBytesMean)} KB mean (${(100 * stats.deltaBytesMean / stats.stateBytes).toFixed(1)}% of a savestate), diff ${stats.diffUsMean.toFixed(0)} us mean, ${stats.diffUsMax.toFixed(0)} us max`);
+    console.log(`sent  ${kb(sent)} KB for base and deltas, held ${kb(stats.heldBytes)} KB`);
+    console.log('region        size   changed/checkpoint');
+    for (const [name, region] of Object.entries(stats.regions)) {
+        console.log(`${name.padEnd(10)} ${kb(region.size)} ${kb(region.totalBytes / Math.max(stats.checkpoints - 1, 1))}`);
+    }
+
+    // The receiver's copy is the newest checkpoint: loading either one and
+    // running on must give the same frames
+    await emulator.restoreCheckpoint(stats.last);
+    const restored = await emulator.runFrames(60, { render: 'last' });
+    await emulator.loadStateFromBuffer(receiver);
+    const received = await emulator.runFrames(60, { render: 'last' });
+    console.log(`receiver copy ${restored.frame.equals(received.frame) ? 'matches' : 'DIFFERS FROM'} restoreCheckpoint()`);
+
+    const start = process.hrtime.bigint();
+    emulator.compactCheckpoints(0);
+    console.log(`compacted ${stats.deltas} deltas in ${(Number(process.hrtime.bigint() - start) / 1e6).toFixed(2)} ms`);
+    emulator.deinit();
+})();
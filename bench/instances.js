@@ -0,0 +1,59 @@
+// Throughput benchmark: aggregate FPS of concurrent emulator instances
+// Usage: node bench/instances.js <rom> [maxInstances] [seconds]
+const os = require('os');
+const addon = require('../build/Release/snes9x_addon.node');
+
+const romPath = process.argv[2];
+const maxInstances = parseInt(process.argv[3]) || os.cpus().length;
+const seconds = parseFloat(process.argv[4]) || 5;
+const { Snes9xAddon } = addon;
+
+if (!romPath) {
+    console.error('Usage: node bench/instances.js <rom> [maxInstances] [seconds]');
+    process.exit(1);
+}
+
+// Every instance loads its own copy of the core; create them all up front
+const instances = [];
+for (let i = 0; i < maxInstances; i++) {
+    const emulator = new Snes9xAddon();
+    if (!emulator.init() || !emulator.loadROM(romPath)) {
+        console.error(`Instance ${i}: failed to load ${romPath}`);
+        process.exit(1);
+    }
+    // Frames back to back; no video callback, so this measures emulation only
+    emulator.setPacing({ mode: 'unthrottled' });
+    instances.push(emulator);
+}
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+async function run(count) {
+    const running = instances.slice(0, count);
+    for (const emulator of running) {
+        emulator.resetPacerStats();
+        emulator.startEmulationThread();
+    }
+    await sleep(seconds * 1000);
+    let frames = 0;
+    for (const emulator of running) {
+        emulator.stopEmulationThread();
+        frames += emulator.getPacerStats().frames;
+    }
+    return frames / seconds;
+}
+
+(async () => {
+    console.log(`${os.cpus().length} CPUs, ${Snes9xAddon.getInstanceCount()} core instances, ${seconds}s per run`);
+    let single = 0;
+    for (let count = 1; count <= maxInstances; count = count < maxInstances && count * 2 > maxInstances ? maxInstances : count * 2) {
+        const fps = await run(count);
+        if (count === 1) single = fps;
+        const scaling = fps / single;
+        console.log(`${String(count).padStart(3)} instances ${fps.toFixed(0).padStart(8)} fps aggregate` +
+                    ` ${(fps / count).toFixed(0).padStart(6)} fps each  ${scaling.toFixed(2)}x (${(scaling / count * 100).toFixed(0)}% efficiency)`);
+    }
+    for (const emulator of instances) {
+        emulator.deinit();
+    }
+})();
@@ -0,0 +1,42 @@
+// Port hooks the core expects from its frontend and the addon does not use.
+// The addon's core module leaves them unresolved (they are never called);
+// a static executable has to define them.
+#include "snes9x.h"
+#include "controls.h"
+#include "display.h"
+#include "conffile.h"
+#include <string>
+
+std::string S9xGetFilenameInc(std::string, enum s9x_getdirtype) {
+    return "";
+}
+
+const char* S9xStringInput(const char*) {
+    return nullptr;
+}
+
+void S9xToggleSoundChannel(int) {}
+
+bool S9xPollAxis(uint32, int16*) {
+    return false;
+}
+
+bool S9xPollButton(uint32, bool*) {
+    return false;
+}
+
+bool S9xPollPointer(uint32, int16*, int16*) {
+    return false;
+}
+
+void S9xHandlePortCommand(s9xcommand_t, int16, int16) {}
+
+bool8 S9xContinueUpdate(int, int) {
+    return TRUE;
+}
+
+void S9xParseArg(char**, int&, int) {}
+
+void S9xParsePortConfig(ConfigFile&, int) {}
+
+void S9xExit() {}
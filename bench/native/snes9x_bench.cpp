@@ -0,0 +1,827 @@
+// Standalone core benchmark: loads a ROM, optionally a savestate and an
+// input movie, and runs frames headless through the same Emulator interface
+// the addon uses, statically linked with the core, no Node involved.
+// Reports frames/s, the per-frame time distribution, instructions retired
+// (Linux perf counters), allocations, and hashes of the final machine state
+// so performance work can be checked for changed emulation. Every run
+// reloads the ROM; with --rom-cache through the addon's ROM cache, so the
+// first run's load is cold and the others warm. --dispatch both,
+// --idle-loops both and --render-thread both alternate the 65c816
+// dispatch, idle loop skipping and the render thread between runs, so the runs check each other;
+// --render-thread verify also compares every frame the worker draws with
+// the inline one. --tiles reports the tile cache traffic of each run and
+// then times the tile converters and the VRAM write path on the final VRAM.
+// Build: make -C bench/native
+// Usage: bench/native/build/snes9x_bench <rom> [options], see usage()
+#include "emulator.h"
+#include "rom_cache.h"
+#include "snes9x.h"
+#include "memmap.h"
+#include "ppu.h"
+#include "tile.h"
+#include "movie.h"
+#include "snapshot.h"
+#include "bapu/snes/snes.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+extern "C" Emulator* snes9x_create_emulator();
+
+// Allocation counting. With BENCH_WRAP_MALLOC the link wraps malloc, calloc
+// and realloc (GNU ld --wrap), which covers the core's C allocations as well;
+// operator new goes through malloc either way.
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> allocated_bytes(0);
+
+static void countAllocation(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+#ifdef BENCH_WRAP_MALLOC
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    countAllocation(size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    countAllocation(count * size);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+    countAllocation(size);
+    return __real_realloc(pointer, size);
+}
+}
+#endif
+
+void* operator new(size_t size) {
+#ifndef BENCH_WRAP_MALLOC
+    countAllocation(size);
+#endif
+    void* pointer = malloc(size ? size : 1);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    free(pointer);
+}
+
+// Instructions retired by this thread, user space only
+class InstructionCounter {
+public:
+    InstructionCounter() : fd(-1) {
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd < 0) {
+            error = std::string("perf_event_open: ") + strerror(errno);
+        }
+#else
+        error = "not supported on this platform";
+#endif
+    }
+
+    ~InstructionCounter() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    bool available() const { return fd >= 0; }
+    const std::string& unavailableReason() const { return error; }
+
+    void start() {
+#ifdef __linux__
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t stop() {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != (ssize_t)sizeof(count)) {
+            count = 0;
+        }
+#endif
+        return count;
+    }
+
+private:
+    int fd;
+    std::string error;
+};
+
+struct Options {
+    std::string rom;
+    std::string state;
+    std::string movie;
+    std::string expect;
+    int frames = 3000;
+    int warmup = 0;
+    int runs = 1;
+    BatchRender render = BatchRender::Every;
+    bool audio = true;
+    bool json = false;
+    bool rom_cache = false;
+    std::string dispatch = "default";   // call, threaded, both or default
+    std::string idle_loops = "off";     // on, off or both
+    std::string render_thread = "off";  // on, off, both or verify
+    bool tiles = false;
+};
+
+struct Hashes {
+    uint64_t ram;
+    uint64_t vram;
+    uint64_t aram;
+    uint64_t sram;
+    uint64_t frame;     // last rendered frame; 0 without rendering
+    uint64_t state;     // ram, vram, aram and sram together
+};
+
+struct RunResult {
+    bool ok;
+    std::string error;
+    double load_ms;
+    double elapsed_ms;
+    double frames_per_second;
+    ProfileTimes frame_us;
+    uint64_t instructions;
+    bool threaded;              // 65c816 dispatch of the run
+    bool skip_idle;
+    uint64_t cpu_instructions;  // 65c816 instructions
+    bool render_thread;         // frames drawn on the worker
+    bool render_verify;
+    RenderThreadStats render;   // over the timed frames
+    uint64_t vram_writes;       // inline drawing's tile cache traffic
+    uint64_t tile_invalidations;
+    uint64_t tile_conversions;
+    uint64_t idle_cycles;       // master cycles skipped in idle loops
+    double idle_share;          // of the master cycles of the timed frames
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    uint32_t movie_frame;       // movie position at the end, its length once ended
+    bool movie_ended;
+    Hashes hashes;
+};
+
+static const uint64_t kFnvOffset = 0xcbf29ce484222325ULL;
+
+static uint64_t fnv1a(const uint8_t* data, size_t size, uint64_t hash = kFnvOffset) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static std::string hex(uint64_t value) {
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+    return text;
+}
+
+static Hashes hashMachine(const std::vector<uint8_t>& frame) {
+    Hashes hashes = Hashes();
+    size_t sram_size = Memory.SRAMSize ? (1 << (Memory.SRAMSize + 3)) * 128 : 0;
+    hashes.ram = fnv1a(Memory.RAM, sizeof(Memory.RAM));
+    hashes.vram = fnv1a(Memory.VRAM, sizeof(Memory.VRAM));
+    hashes.aram = fnv1a(SNES::smp.apuram, 0x10000);
+    hashes.sram = sram_size ? fnv1a(Memory.SRAM, sram_size) : 0;
+    hashes.frame = frame.empty() ? 0 : fnv1a(frame.data(), frame.size());
+
+    uint64_t parts[] = { hashes.ram, hashes.vram, hashes.aram, hashes.sram };
+    hashes.state = fnv1a((const uint8_t*)parts, sizeof(parts));
+    return hashes;
+}
+
+static ProfileTimes summarize(std::vector<uint64_t>& nanos) {
+    ProfileTimes times = ProfileTimes();
+    if (nanos.empty()) {
+        return times;
+    }
+    std::sort(nanos.begin(), nanos.end());
+    uint64_t sum = 0;
+    for (uint64_t value : nanos) sum += value;
+    size_t last = nanos.size() - 1;
+    times.us_mean = sum / 1000.0 / nanos.size();
+    times.us_p50 = nanos[last * 50 / 100] / 1000.0;
+    times.us_p95 = nanos[last * 95 / 100] / 1000.0;
+    times.us_p99 = nanos[last * 99 / 100] / 1000.0;
+    times.us_max = nanos[last] / 1000.0;
+    return times;
+}
+
+// ROM, savestate and movie from scratch, so every run starts from the same
+// machine state
+static bool prepare(Emulator* emulator, const Options& options, double& load_ms, std::string& error) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool loaded = options.rom_cache ? RomCache::instance().loadROM(emulator, options.rom) : emulator->loadROM(options.rom);
+    load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!loaded) {
+        error = "Failed to load ROM " + options.rom;
+        return false;
+    }
+    if (!options.state.empty() && !emulator->loadStateFromFile(options.state)) {
+        error = "Failed to load savestate " + options.state;
+        return false;
+    }
+    if (!options.movie.empty()) {
+        // The movie starts from its own snapshot or from power-on
+        int result = S9xMovieOpen(options.movie.c_str(), TRUE);
+        if (result != SUCCESS) {
+            error = "Failed to open movie " + options.movie + " (" + std::to_string(result) + ")";
+            return false;
+        }
+    }
+    return true;
+}
+
+static RunResult run(Emulator* emulator, const Options& options, InstructionCounter& counter, int index) {
+    RunResult result = RunResult();
+    if (options.dispatch != "default") {
+        bool threaded = options.dispatch == "threaded" || (options.dispatch == "both" && index % 2 == 1);
+        if (!emulator->setThreadedDispatch(threaded)) {
+            result.error = "Threaded dispatch is not available in this build";
+            return result;
+        }
+    }
+    result.threaded = emulator->getThreadedDispatch();
+    // With several options alternating, each one switches after every
+    // combination of the ones before it
+    int period = options.dispatch == "both" ? 2 : 1;
+    result.skip_idle = options.idle_loops == "on" || (options.idle_loops == "both" && (index / period) % 2 == 0);
+    emulator->setSkipIdleLoops(result.skip_idle);
+    period *= options.idle_loops == "both" ? 2 : 1;
+    result.render_verify = options.render_thread == "verify";
+    result.render_thread = options.render_thread == "on" || result.render_verify ||
+                           (options.render_thread == "both" && (index / period) % 2 == 1);
+    emulator->setRenderThread(result.render_thread, result.render_verify);
+    if (!prepare(emulator, options, result.load_ms, result.error)) {
+        return result;
+    }
+    uint32_t movie_length = options.movie.empty() ? 0 : S9xMovieGetLength();
+    if (options.warmup > 0) {
+        emulator->runFrames(options.warmup, options.render, options.audio);
+    }
+
+    // Frame boundaries from the frame callback; the buffer is allocated up
+    // front so the timed loop allocates only what the emulator does
+    std::vector<uint64_t> frame_nanos(options.frames);
+    size_t frame_index = 0;
+    std::chrono::steady_clock::time_point last;
+    emulator->setFrameCallback([&]() {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (frame_index < frame_nanos.size()) {
+            frame_nanos[frame_index++] = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+        }
+        last = now;
+    });
+
+    uint64_t allocations_before = allocations.load();
+    uint64_t bytes_before = allocated_bytes.load();
+    CPUStats cpu_before = emulator->getCPUStats();
+    RenderThreadStats render_before = emulator->getRenderThreadStats();
+    uint64_t vram_writes = IPPU.VRAMWrites;
+    uint64_t tile_invalidations = IPPU.TileInvalidations;
+    uint64_t tile_conversions = IPPU.TileConversions;
+    counter.start();
+    last = std::chrono::steady_clock::now();
+    BatchResult batch = emulator->runFrames(options.frames, options.render, options.audio);
+    result.instructions = counter.stop();
+    CPUStats cpu_after = emulator->getCPUStats();
+    result.cpu_instructions = cpu_after.instructions - cpu_before.instructions;
+    result.idle_cycles = cpu_after.idle_loop_cycles - cpu_before.idle_loop_cycles;
+    result.vram_writes = IPPU.VRAMWrites - vram_writes;
+    result.tile_invalidations = IPPU.TileInvalidations - tile_invalidations;
+    result.tile_conversions = IPPU.TileConversions - tile_conversions;
+    RenderThreadStats render_after = emulator->getRenderThreadStats();
+    result.render = render_after;
+    result.render.frames = render_after.frames - render_before.frames;
+    result.render.batches = render_after.batches - render_before.batches;
+    result.render.split_batches = render_after.split_batches - render_before.split_batches;
+    result.render.redrawn_lines = render_after.redrawn_lines - render_before.redrawn_lines;
+    result.render.vram_blocks = render_after.vram_blocks - render_before.vram_blocks;
+    result.render.mismatched_frames = render_after.mismatched_frames - render_before.mismatched_frames;
+    if (result.render.frames) {
+        result.render.render_us_mean = (render_after.render_us_mean * render_after.frames -
+                                        render_before.render_us_mean * render_before.frames) / result.render.frames;
+        result.render.wait_us_mean = (render_after.wait_us_mean * render_after.frames -
+                                      render_before.wait_us_mean * render_before.frames) / result.render.frames;
+    }
+    uint64_t cycles = (uint64_t)options.frames * Timings.H_Max * Timings.V_Max;
+    result.idle_share = cycles ? (double)result.idle_cycles / cycles : 0.0;
+    result.allocations = allocations.load() - allocations_before;
+    result.allocated_bytes = allocated_bytes.load() - bytes_before;
+    emulator->setFrameCallback(nullptr);
+
+    if (batch.frames != options.frames) {
+        result.error = "Emulation stopped";
+        return result;
+    }
+    frame_nanos.resize(frame_index);
+    result.ok = true;
+    result.elapsed_ms = batch.elapsed_ms;
+    result.frames_per_second = batch.frames_per_second;
+    result.frame_us = summarize(frame_nanos);
+    if (!options.movie.empty()) {
+        result.movie_ended = !S9xMovieActive();
+        result.movie_frame = result.movie_ended ? movie_length : S9xMovieGetFrameCounter();
+        S9xMovieStop(TRUE);
+    }
+    result.hashes = hashMachine(batch.frame);
+    return result;
+}
+
+// Tile converter and VRAM write timings, on the VRAM the last run ended with
+struct TileConverterResult {
+    const char* name;
+    int tiles;
+    double plain_per_second;    // conversions/s, C converter
+    double vector_per_second;
+    bool identical;             // same pixels and blank flags for every tile
+};
+
+struct TileResult {
+    const char* kernel;
+    TileConverterResult converters[7];
+    double write_ns;            // a byte through $2118/$2119, marking included
+    double mark_ns;             // marking a written address dirty
+    double flags_ns;            // the eleven flag stores it replaced
+    double flush_us;            // dropping the tiles of a whole dirty VRAM
+    double sparse_flush_us;     // ... of one write in every 64 bytes
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static TileResult benchTiles() {
+    static const char* names[7] = { "2bpp", "4bpp", "8bpp", "2bpp hires even", "2bpp hires odd",
+                                    "4bpp hires even", "4bpp hires odd" };
+    static const int shifts[7] = { 4, 5, 6, 4, 4, 5, 5 };
+    const int passes = 64;
+    TileResult result = TileResult();
+    result.kernel = S9xTileConverterName();
+
+    for (int type = 0; type < 7; type++) {
+        TileConverterResult& r = result.converters[type];
+        S9xTileConverter plain = S9xGetTileConverter(type, FALSE);
+        S9xTileConverter vector = S9xGetTileConverter(type, TRUE);
+        int tiles = 0x10000 >> shifts[type];
+        std::vector<uint8_t> expected(tiles * 64), actual(tiles * 64);
+        r.name = names[type];
+        r.tiles = tiles;
+        r.identical = true;
+        for (int n = 0; n < tiles; n++) {
+            uint8_t blank = plain(&expected[n * 64], n << shifts[type], n & 0x3ff);
+            r.identical = r.identical && vector(&actual[n * 64], n << shifts[type], n & 0x3ff) == blank;
+        }
+        r.identical = r.identical && expected == actual;
+
+        S9xTileConverter kernels[2] = { plain, vector };
+        double* rates[2] = { &r.plain_per_second, &r.vector_per_second };
+        for (int k = 0; k < 2; k++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int pass = 0; pass < passes; pass++) {
+                for (int n = 0; n < tiles; n++) {
+                    kernels[k](&actual[n * 64], n << shifts[type], n & 0x3ff);
+                }
+            }
+            *rates[k] = (double)passes * tiles / secondsSince(start);
+        }
+    }
+
+    // A 64 KB VRAM DMA of what VRAM already holds, word increments, so the
+    // machine state is unchanged
+    std::vector<uint8_t> vram(Memory.VRAM, Memory.VRAM + 0x10000);
+    bool8 block = Settings.BlockInvalidVRAMAccess;
+    Settings.BlockInvalidVRAMAccess = FALSE;
+    S9xSetPPU(0x80, 0x2115);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        S9xSetPPU(0x00, 0x2116);
+        S9xSetPPU(0x00, 0x2117);
+        for (int address = 0; address < 0x10000; address += 2) {
+            S9xSetPPU(vram[address], 0x2118);
+            S9xSetPPU(vram[address + 1], 0x2119);
+        }
+    }
+    result.write_ns = secondsSince(start) * 1e9 / (passes * 65536.0);
+    Settings.BlockInvalidVRAMAccess = block;
+
+    start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (uint32 address = 0; address < 0x10000; address++) {
+            S9xTileDirty(address);
+        }
+    }
+    result.mark_ns = secondsSince(start) * 1e9 / (passes * 65536.0);
+
+    start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        memset(IPPU.TileDirty, 0xff, sizeof(IPPU.TileDirty));
+        S9xInvalidateDirtyTiles();
+    }
+    result.flush_us = secondsSince(start) * 1e6 / passes;
+
+    start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (uint32 address = 0; address < 0x10000; address += 64) {
+            S9xTileDirty(address);
+        }
+        S9xInvalidateDirtyTiles();
+    }
+    result.sparse_flush_us = secondsSince(start) * 1e6 / passes;
+
+    // The flags a VRAM write used to clear, on scratch copies of the caches
+    std::vector<uint8_t> flags[7];
+    for (int type = 0; type < 7; type++) {
+        flags[type].assign(0x10000 >> shifts[type], TRUE);
+    }
+    start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (uint32 address = 0; address < 0x10000; address++) {
+            flags[TILE_2BIT][address >> 4] = FALSE;
+            flags[TILE_4BIT][address >> 5] = FALSE;
+            flags[TILE_8BIT][address >> 6] = FALSE;
+            flags[TILE_2BIT_EVEN][address >> 4] = FALSE;
+            flags[TILE_2BIT_EVEN][((address >> 4) - 1) & (MAX_2BIT_TILES - 1)] = FALSE;
+            flags[TILE_2BIT_ODD][address >> 4] = FALSE;
+            flags[TILE_2BIT_ODD][((address >> 4) - 1) & (MAX_2BIT_TILES - 1)] = FALSE;
+            flags[TILE_4BIT_EVEN][address >> 5] = FALSE;
+            flags[TILE_4BIT_EVEN][((address >> 5) - 1) & (MAX_4BIT_TILES - 1)] = FALSE;
+            flags[TILE_4BIT_ODD][address >> 5] = FALSE;
+            flags[TILE_4BIT_ODD][((address >> 5) - 1) & (MAX_4BIT_TILES - 1)] = FALSE;
+        }
+        flags[pass % 7][0] = TRUE;
+    }
+    result.flags_ns = secondsSince(start) * 1e9 / (passes * 65536.0);
+    return result;
+}
+
+static void printTiles(const Options& options, const std::vector<RunResult>& results, const TileResult& tiles) {
+    for (size_t i = 0; i < results.size(); i++) {
+        const RunResult& r = results[i];
+        printf("run %zu tiles: %.0f VRAM writes, %.1f 16-byte units invalidated, %.1f tiles converted a frame\n",
+               i + 1, (double)r.vram_writes / options.frames, (double)r.tile_invalidations / options.frames,
+               (double)r.tile_conversions / options.frames);
+    }
+    printf("tile converters (%s)      tiles   C Mconv/s  %-4s Mconv/s  speedup  same\n", tiles.kernel, tiles.kernel);
+    for (const TileConverterResult& c : tiles.converters) {
+        printf("  %-22s  %5d  %11.1f  %12.1f  %6.2fx  %s\n", c.name, c.tiles, c.plain_per_second / 1e6,
+               c.vector_per_second / 1e6, c.vector_per_second / c.plain_per_second, c.identical ? "yes" : "NO");
+    }
+    printf("VRAM write: %.2f ns through $2118/$2119, marking %.2f ns (eleven flag stores %.2f ns), "
+           "64 KB dirty dropped in %.2f us, one write per 64 bytes in %.2f us\n", tiles.write_ns, tiles.mark_ns,
+           tiles.flags_ns, tiles.flush_us, tiles.sparse_flush_us);
+}
+
+static bool tilesIdentical(const TileResult& tiles) {
+    for (const TileConverterResult& c : tiles.converters) {
+        if (!c.identical) return false;
+    }
+    return true;
+}
+
+static const char* renderName(BatchRender render) {
+    switch (render) {
+        case BatchRender::None:  return "none";
+        case BatchRender::Last:  return "last";
+        case BatchRender::Every: return "every";
+    }
+    return "every";
+}
+
+static const char* renderThreadName(const RunResult& r) {
+    return r.render_verify ? "verify" : r.render_thread ? "thread" : "inline";
+}
+
+static void printText(const Options& options, const std::vector<RunResult>& results, const InstructionCounter& counter,
+                      bool deterministic, bool expected, bool rendered) {
+    printf("%s: %d frames, render %s, audio %s%s%s%s\n", options.rom.c_str(), options.frames, renderName(options.render),
+           options.audio ? "on" : "off", options.movie.empty() ? "" : ", movie ", options.movie.c_str(),
+           options.rom_cache ? ", ROM cache" : "");
+    printf("run  dispatch  idle  draw    load ms  frames/s    mean     p50     p95     p99     max  65c816/frame  Mops/s  idle skip  instr/frame  allocs    bytes  state\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const RunResult& r = results[i];
+        std::string instructions = counter.available() ? std::to_string(r.instructions / options.frames) : "-";
+        // The default table loop does not count 65c816 instructions
+        std::string cpu_per_frame = r.cpu_instructions ? std::to_string(r.cpu_instructions / options.frames) : "-";
+        char mops[32] = "-";
+        if (r.cpu_instructions)
+            snprintf(mops, sizeof(mops), "%.1f", r.cpu_instructions / r.elapsed_ms / 1000.0);
+        printf("%3zu  %-8s  %-4s  %-6s  %7.2f  %8.1f  %6.0f  %6.0f  %6.0f  %6.0f  %6.0f  %12s  %6s  %8.1f%%  %11s  %6llu  %7llu  %s\n", i + 1,
+               r.threaded ? "threaded" : "call", r.skip_idle ? "on" : "off", renderThreadName(r), r.load_ms, r.frames_per_second, r.frame_us.us_mean, r.frame_us.us_p50,
+               r.frame_us.us_p95, r.frame_us.us_p99, r.frame_us.us_max, cpu_per_frame.c_str(),
+               mops, r.idle_share * 100.0, instructions.c_str(), (unsigned long long)r.allocations,
+               (unsigned long long)r.allocated_bytes, hex(r.hashes.state).c_str());
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const RenderThreadStats& t = results[i].render;
+        if (!results[i].render_thread) continue;
+        printf("run %zu render thread: %llu frames, %llu batches (%llu split), %llu lines redrawn, %llu VRAM KB, "
+               "worker %.0f us/frame, waited %.0f us/frame, %llu mismatched\n", i + 1, (unsigned long long)t.frames,
+               (unsigned long long)t.batches, (unsigned long long)t.split_batches, (unsigned long long)t.redrawn_lines,
+               (unsigned long long)t.vram_blocks, t.render_us_mean, t.wait_us_mean, (unsigned long long)t.mismatched_frames);
+    }
+    const Hashes& h = results.back().hashes;
+    printf("ram %s  vram %s  aram %s  sram %s  frame %s\n", hex(h.ram).c_str(), hex(h.vram).c_str(),
+           hex(h.aram).c_str(), hex(h.sram).c_str(), hex(h.frame).c_str());
+    if (!counter.available()) {
+        printf("instructions unavailable: %s\n", counter.unavailableReason().c_str());
+    }
+    if (!options.movie.empty() && results.back().movie_ended) {
+        printf("movie ended after %u frames\n", results.back().movie_frame);
+    }
+    if (!deterministic) {
+        printf("NOT DETERMINISTIC: runs ended in different states\n");
+    }
+    if (!expected) {
+        printf("STATE MISMATCH: expected %s\n", options.expect.c_str());
+    }
+    if (!rendered) {
+        printf("RENDER MISMATCH: the render thread drew frames that differ from the inline ones\n");
+    }
+}
+
+static std::string jsonString(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+static void printJSON(FILE* out, const Options& options, const std::vector<RunResult>& results, const InstructionCounter& counter,
+                      bool deterministic, bool expected, bool rendered, const TileResult* tiles) {
+    fprintf(out, "{\"rom\":%s,\"state\":%s,\"movie\":%s,\"frames\":%d,\"warmup\":%d,\"render\":\"%s\",\"audio\":%s,\"romCache\":%s,",
+           jsonString(options.rom).c_str(), options.state.empty() ? "null" : jsonString(options.state).c_str(),
+           options.movie.empty() ? "null" : jsonString(options.movie).c_str(), options.frames, options.warmup,
+           renderName(options.render), options.audio ? "true" : "false", options.rom_cache ? "true" : "false");
+#ifdef BENCH_WRAP_MALLOC
+    fprintf(out, "\"allocationsCounted\":\"malloc\",");
+#else
+    fprintf(out, "\"allocationsCounted\":\"new\",");
+#endif
+    if (counter.available()) {
+        fprintf(out, "\"instructionsUnavailable\":null,");
+    } else {
+        fprintf(out, "\"instructionsUnavailable\":%s,", jsonString(counter.unavailableReason()).c_str());
+    }
+    fprintf(out, "\"runs\":[");
+    for (size_t i = 0; i < results.size(); i++) {
+        const RunResult& r = results[i];
+        const Hashes& h = r.hashes;
+        fprintf(out, "%s{\"dispatch\":\"%s\",\"loadMs\":%.3f,\"elapsedMs\":%.3f,\"framesPerSecond\":%.2f,", i ? "," : "",
+                r.threaded ? "threaded" : "call", r.load_ms, r.elapsed_ms, r.frames_per_second);
+        fprintf(out, "\"cpuInstructions\":%llu,\"cpuMops\":%.2f,", (unsigned long long)r.cpu_instructions,
+                r.cpu_instructions / r.elapsed_ms / 1000.0);
+        fprintf(out, "\"skipIdleLoops\":%s,\"idleLoopCycles\":%llu,\"idleCycleShare\":%.4f,", r.skip_idle ? "true" : "false",
+                (unsigned long long)r.idle_cycles, r.idle_share);
+        fprintf(out, "\"renderThread\":\"%s\",", renderThreadName(r));
+        if (r.render_thread) {
+            fprintf(out, "\"renderThreadStats\":{\"frames\":%llu,\"batches\":%llu,\"splitBatches\":%llu,\"redrawnLines\":%llu,"
+                    "\"vramBlocks\":%llu,\"mismatchedFrames\":%llu,\"renderUsMean\":%.2f,\"waitUsMean\":%.2f},",
+                    (unsigned long long)r.render.frames, (unsigned long long)r.render.batches,
+                    (unsigned long long)r.render.split_batches, (unsigned long long)r.render.redrawn_lines,
+                    (unsigned long long)r.render.vram_blocks, (unsigned long long)r.render.mismatched_frames,
+                    r.render.render_us_mean, r.render.wait_us_mean);
+        }
+        if (tiles) {
+            fprintf(out, "\"vramWrites\":%llu,\"tileInvalidations\":%llu,\"tileConversions\":%llu,",
+                    (unsigned long long)r.vram_writes, (unsigned long long)r.tile_invalidations,
+                    (unsigned long long)r.tile_conversions);
+        }
+        fprintf(out, "\"frameUs\":{\"mean\":%.2f,\"p50\":%.2f,\"p95\":%.2f,\"p99\":%.2f,\"max\":%.2f},",
+               r.frame_us.us_mean, r.frame_us.us_p50, r.frame_us.us_p95, r.frame_us.us_p99, r.frame_us.us_max);
+        if (counter.available()) {
+            fprintf(out, "\"instructions\":%llu,\"instructionsPerFrame\":%llu,", (unsigned long long)r.instructions,
+                   (unsigned long long)(r.instructions / options.frames));
+        } else {
+            fprintf(out, "\"instructions\":null,\"instructionsPerFrame\":null,");
+        }
+        fprintf(out, "\"allocations\":%llu,\"allocatedBytes\":%llu,", (unsigned long long)r.allocations,
+               (unsigned long long)r.allocated_bytes);
+        if (!options.movie.empty()) {
+            fprintf(out, "\"movieFrame\":%u,\"movieEnded\":%s,", r.movie_frame, r.movie_ended ? "true" : "false");
+        }
+        fprintf(out, "\"hashes\":{\"state\":\"%s\",\"ram\":\"%s\",\"vram\":\"%s\",\"aram\":\"%s\",\"sram\":\"%s\",\"frame\":\"%s\"}}",
+               hex(h.state).c_str(), hex(h.ram).c_str(), hex(h.vram).c_str(), hex(h.aram).c_str(),
+               hex(h.sram).c_str(), hex(h.frame).c_str());
+    }
+    fprintf(out, "],\"deterministic\":%s,\"renderMatches\":%s", deterministic ? "true" : "false", rendered ? "true" : "false");
+    if (tiles) {
+        fprintf(out, ",\"tiles\":{\"kernel\":\"%s\",\"converters\":[", tiles->kernel);
+        for (int i = 0; i < 7; i++) {
+            const TileConverterResult& c = tiles->converters[i];
+            fprintf(out, "%s{\"name\":\"%s\",\"tiles\":%d,\"plainPerSecond\":%.0f,\"vectorPerSecond\":%.0f,\"identical\":%s}",
+                    i ? "," : "", c.name, c.tiles, c.plain_per_second, c.vector_per_second, c.identical ? "true" : "false");
+        }
+        fprintf(out, "],\"writeNs\":%.3f,\"markNs\":%.3f,\"flagsNs\":%.3f,\"flushUs\":%.3f,\"sparseFlushUs\":%.3f}",
+                tiles->write_ns, tiles->mark_ns, tiles->flags_ns, tiles->flush_us, tiles->sparse_flush_us);
+    }
+    if (!options.expect.empty()) {
+        fprintf(out, ",\"expected\":%s,\"matchesExpected\":%s", jsonString(options.expect).c_str(), expected ? "true" : "false");
+    }
+    fprintf(out, "}\n");
+}
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: snes9x_bench <rom> [options]\n"
+            "  --frames N        frames to time (3000)\n"
+            "  --warmup N        frames to run first, untimed (0)\n"
+            "  --state FILE      savestate to start from, e.g. lib/quicksave.sav\n"
+            "  --movie FILE      input movie (.smv) to replay; starts from its own snapshot\n"
+            "  --render MODE     none, last or every (every)\n"
+            "  --no-audio        discard audio instead of mixing it\n"
+            "  --runs N          repeat from the same start; the runs must end in the same state (1)\n"
+            "  --expect HASH     final state hash to match, from an earlier run\n"
+            "  --rom-cache       load through the ROM cache (cold first run, warm after)\n"
+            "  --dispatch MODE   65c816 dispatch: call, threaded, or both alternating between runs\n"
+            "  --idle-loops MODE skip idle loop iterations: on, off, or both alternating between runs (off)\n"
+            "  --render-thread MODE  draw on a worker thread: on, off, both alternating between runs, or verify\n"
+            "                    (worker and inline both draw and every frame is compared) (off)\n"
+            "  --tiles           tile cache traffic per run, then tile converter and VRAM write timings\n"
+            "  --json            one JSON object on stdout\n"
+            "Exit status: 0 ok, 1 setup failed, 2 runs differ, the state hash does not match, verify found\n"
+            "             a frame the render thread drew differently or a vector tile converter differs\n"
+            "             from the C one\n");
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--frames" && has_value) {
+            options.frames = atoi(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            options.warmup = atoi(argv[++i]);
+        } else if (arg == "--state" && has_value) {
+            options.state = argv[++i];
+        } else if (arg == "--movie" && has_value) {
+            options.movie = argv[++i];
+        } else if (arg == "--render" && has_value) {
+            std::string mode = argv[++i];
+            if (mode == "none") {
+                options.render = BatchRender::None;
+            } else if (mode == "last") {
+                options.render = BatchRender::Last;
+            } else if (mode == "every") {
+                options.render = BatchRender::Every;
+            } else {
+                return false;
+            }
+        } else if (arg == "--no-audio") {
+            options.audio = false;
+        } else if (arg == "--runs" && has_value) {
+            options.runs = atoi(argv[++i]);
+        } else if (arg == "--expect" && has_value) {
+            options.expect = argv[++i];
+        } else if (arg == "--tiles") {
+            options.tiles = true;
+        } else if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--rom-cache") {
+            options.rom_cache = true;
+        } else if (arg == "--idle-loops" && has_value) {
+            options.idle_loops = argv[++i];
+            if (options.idle_loops != "on" && options.idle_loops != "off" && options.idle_loops != "both") {
+                return false;
+            }
+        } else if (arg == "--render-thread" && has_value) {
+            options.render_thread = argv[++i];
+            if (options.render_thread != "on" && options.render_thread != "off" && options.render_thread != "both" &&
+                options.render_thread != "verify") {
+                return false;
+            }
+        } else if (arg == "--dispatch" && has_value) {
+            options.dispatch = argv[++i];
+            if (options.dispatch != "call" && options.dispatch != "threaded" && options.dispatch != "both") {
+                return false;
+            }
+        } else if (arg[0] != '-' && options.rom.empty()) {
+            options.rom = arg;
+        } else {
+            return false;
+        }
+    }
+    return !options.rom.empty() && options.frames > 0 && options.warmup >= 0 && options.runs > 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 1;
+    }
+
+    // The core reports on stdout; with --json it goes to stderr instead, so
+    // stdout carries only the result
+    FILE* json_out = stdout;
+    if (options.json) {
+        json_out = fdopen(dup(STDOUT_FILENO), "w");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    Emulator* emulator = snes9x_create_emulator();
+    if (!emulator->init()) {
+        fprintf(stderr, "Emulator init failed\n");
+        return 1;
+    }
+    // Runs must not leave a changed .srm behind for the next one
+    emulator->setSRAMWrites(false);
+
+    InstructionCounter counter;
+    std::vector<RunResult> results;
+    for (int i = 0; i < options.runs; i++) {
+        RunResult result = run(emulator, options, counter, i);
+        if (!result.ok) {
+            fprintf(stderr, "%s\n", result.error.c_str());
+            emulator->deinit();
+            delete emulator;
+            return 1;
+        }
+        results.push_back(result);
+    }
+    TileResult tiles = TileResult();
+    if (options.tiles) {
+        tiles = benchTiles();
+    }
+    emulator->deinit();
+    delete emulator;
+
+    bool deterministic = true;
+    for (const RunResult& result : results) {
+        deterministic = deterministic && result.hashes.state == results[0].hashes.state &&
+                        result.hashes.frame == results[0].hashes.frame;
+    }
+    bool expected = options.expect.empty() || options.expect == hex(results.back().hashes.state);
+    bool rendered = true;
+    for (const RunResult& result : results) {
+        rendered = rendered && result.render.mismatched_frames == 0;
+    }
+
+    bool converted = !options.tiles || tilesIdentical(tiles);
+
+    if (options.json) {
+        printJSON(json_out, options, results, counter, deterministic, expected, rendered, options.tiles ? &tiles : nullptr);
+    } else {
+        printText(options, results, counter, deterministic, expected, rendered);
+        if (options.tiles) {
+            printTiles(options, results, tiles);
+        }
+        if (!converted) {
+            printf("TILE MISMATCH: a vector tile converter differs from the C one\n");
+        }
+    }
+    return deterministic && expected && rendered && converted ? 0 : 2;
+}
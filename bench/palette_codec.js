@@ -0,0 +1,116 @@
+// Palette + deflate codec: bytes per frame and encode time per zlib level on
+// a recorded gameplay corpus, against raw frames and plain deflate of RGB565
+// Usage: node bench/palette_codec.js <rom> [frames] [corpusFile]
+// An existing corpusFile is replayed instead of recording; a new one is saved.
+const fs = require('fs');
+const zlib = require('zlib');
+const { performance } = require('perf_hooks');
+const { Snes9xAddon } = require('../build/Release/snes9x_addon.node');
+
+const romPath = process.argv[2];
+const frameCount = parseInt(process.argv[3]) || 600;
+const corpusPath = process.argv[4];
+const levels = [1, 3, 6, 9];
+
+if (!romPath && !(corpusPath && fs.existsSync(corpusPath))) {
+    console.error('Usage: node bench/palette_codec.js <rom> [frames] [corpusFile]');
+    process.exit(1);
+}
+
+// Corpus file: per frame u16 width, u16 height, then width * height RGB565 pixels
+function loadCorpus(path) {
+    const data = fs.readFileSync(path);
+    const frames = [];
+    for (let offset = 0; offset + 4 <= data.length;) {
+        const width = data.readUInt16LE(offset);
+        const height = data.readUInt16LE(offset + 2);
+        const size = width * height * 2;
+        frames.push({ width, height, pixels: data.subarray(offset + 4, offset + 4 + size) });
+        offset += 4 + size;
+    }
+    return frames;
+}
+
+function saveCorpus(path, frames) {
+    const parts = [];
+    for (const { width, height, pixels } of frames) {
+        const header = Buffer.alloc(4);
+        header.writeUInt16LE(width, 0);
+        header.writeUInt16LE(height, 2);
+        parts.push(header, pixels);
+    }
+    fs.writeFileSync(path, Buffer.concat(parts));
+}
+
+// Real-time run with raw RGB565 frames, copied out of the pool
+function record() {
+    return new Promise((resolve) => {
+        const emulator = new Snes9xAddon();
+        if (!emulator.init() || !emulator.loadROM(romPath)) {
+            console.error(`Failed to load ${romPath}`);
+            process.exit(1);
+        }
+        const frames = [];
+        emulator.setVideoFormat('rgb565');
+        emulator.setVideoEncoding({ mode: 'raw' });
+        emulator.setVideoCallback((buffer, width, height, stride) => {
+            if (frames.length < frameCount) {
+                const pixels = Buffer.alloc(width * height * 2);
+                for (let y = 0; y < height; y++) {
+                    buffer.copy(pixels, y * width * 2, y * stride, y * stride + width * 2);
+                }
+                frames.push({ width, height, pixels });
+            }
+            emulator.releaseVideoFrame(buffer);
+            if (frames.length === frameCount) {
+                emulator.stopEmulationThread();
+                emulator.deinit();
+                resolve(frames);
+            }
+        });
+        emulator.startEmulationThread();
+    });
+}
+
+function time(fn) {
+    const start = performance.now();
+    const result = fn();
+    return { result, us: (performance.now() - start) * 1000 };
+}
+
+(async () => {
+    let frames;
+    if (corpusPath && fs.existsSync(corpusPath)) {
+        frames = loadCorpus(corpusPath);
+    } else {
+        frames = await record();
+        if (corpusPath) saveCorpus(corpusPath, frames);
+    }
+    const pixels = frames.reduce((sum, f) => sum + f.width * f.height, 0);
+    console.log(`${frames.length} frames, ${frames[0].width}x${frames[0].height}`);
+    console.log(`raw rgb24           ${(pixels * 3 / frames.length / 1024).toFixed(1).padStart(7)} KB/frame`);
+
+    let deflateBytes = 0, deflateUs = 0;
+    for (const { pixels } of frames) {
+        const { result, us } = time(() => zlib.deflateSync(pixels, { level: 1 }));
+        deflateBytes += result.length;
+        deflateUs += us;
+    }
+    console.log(`rgb565 deflate -1   ${(deflateBytes / frames.length / 1024).toFixed(1).padStart(7)} KB/frame ${(deflateUs / frames.length).toFixed(0).padStart(6)} us/frame`);
+
+    const encoder = new Snes9xAddon();
+    for (const level of levels) {
+        let bytes = 0, totalUs = 0, maxUs = 0, colors = 0, direct = 0;
+        for (const { width, height, pixels } of frames) {
+            const { result, us } = time(() => encoder.encodePaletteFrame(pixels, width, height, width * 2, 'rgb24', level));
+            bytes += result.length;
+            totalUs += us;
+            maxUs = Math.max(maxUs, us);
+            colors += result.readUInt16LE(12);
+            if (result[1] & 0x01) direct++;
+        }
+        console.log(`palette-deflate -${level}  ${(bytes / frames.length / 1024).toFixed(1).padStart(7)} KB/frame` +
+                    ` ${(totalUs / frames.length).toFixed(0).padStart(6)} us/frame (max ${maxUs.toFixed(0)})` +
+                    `  ${(colors / Math.max(frames.length - direct, 1)).toFixed(1)} colours, ${direct} direct`);
+    }
+})();
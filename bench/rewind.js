@@ -0,0 +1,43 @@
+// Rewind capture cost: per-frame snapshot time on the emulation thread,
+// delta time on the helper thread and history bytes per captured second
+// Usage: node bench/rewind.js <rom> [seconds] [intervalFrames] [budgetMB]
+const { Snes9xAddon } = require('../build/Release/snes9x_addon.node');
+
+const romPath = process.argv[2];
+const seconds = parseFloat(process.argv[3]) || 10;
+const intervalFrames = parseInt(process.argv[4]) || 2;
+const budgetBytes = (parseFloat(process.argv[5]) || 32) * 1024 * 1024;
+
+if (!romPath) {
+    console.error('Usage: node bench/rewind.js <rom> [seconds] [intervalFrames] [budgetMB]');
+    process.exit(1);
+}
+
+const emulator = new Snes9xAddon();
+if (!emulator.init() || !emulator.loadROM(romPath)) {
+    console.error(`Failed to load ${romPath}`);
+    process.exit(1);
+}
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+(async () => {
+    await emulator.setRewind({ budgetBytes, intervalFrames });
+    // Real-time pacing, so stats reflect 60 Hz play rather than a flat-out run
+    emulator.startEmulationThread();
+    await sleep(seconds * 1000);
+
+    const stats = emulator.getRewindStats();
+    console.log(`state ${(stats.stateBytes / 1024).toFixed(0)} KB, every ${stats.intervalFrames} frames, ring ${(stats.capacityBytes / 1048576).toFixed(1)} MB`);
+    console.log(`capture  mean ${stats.captureUsMean.toFixed(0).padStart(6)} us  max ${stats.captureUsMax.toFixed(0).padStart(6)} us  (emulation thread)`);
+    console.log(`delta    mean ${stats.deltaUsMean.toFixed(0).padStart(6)} us  max ${stats.deltaUsMax.toFixed(0).padStart(6)} us  (helper thread)`);
+    console.log(`${stats.captures} captures, ${stats.coalesced} coalesced, ${stats.entries} kept over ${stats.spanSeconds.toFixed(1)}s`);
+    console.log(`${(stats.bytesPerSecond / 1024).toFixed(1)} KB per captured second, ${(stats.capacityBytes / Math.max(stats.bytesPerSecond, 1)).toFixed(0)}s fit in the ring`);
+
+    const start = process.hrtime.bigint();
+    const rewound = await emulator.rewind(60 * Math.min(5, seconds / 2));
+    console.log(`rewound ${rewound} frames in ${(Number(process.hrtime.bigint() - start) / 1e6).toFixed(1)} ms`);
+
+    emulator.stopEmulationThread();
+    emulator.deinit();
+})();
@@ -0,0 +1,49 @@
+// Run-ahead cost per game: for each number of frames, the time of the real
+// frame, the snapshot/restore and the hidden frames, and what every extra
+// frame of run-ahead costs, on one instance and with a second instance
+// Usage: node bench/run_ahead.js <rom> [secondsPerSetting] [maxFrames]
+const { Snes9xAddon } = require('../build/Release/snes9x_addon.node');
+
+const romPath = process.argv[2];
+const seconds = parseFloat(process.argv[3]) || 3;
+const maxFrames = parseInt(process.argv[4]) || 4;
+
+if (!romPath) {
+    console.error('Usage: node bench/run_ahead.js <rom> [secondsPerSetting] [maxFrames]');
+    process.exit(1);
+}
+
+const emulator = new Snes9xAddon();
+if (!emulator.init() || !emulator.loadROM(romPath)) {
+    console.error(`Failed to load ${romPath}`);
+    process.exit(1);
+}
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+const us = (value) => value.toFixed(0).padStart(6);
+
+(async () => {
+    // Frames are delivered but dropped right away
+    emulator.setVideoCallback((buffer) => emulator.releaseVideoFrame(buffer));
+    emulator.startEmulationThread();
+    await sleep(1000);
+
+    const frameBudget = 1e6 / emulator.getFrameRate();
+    console.log(`frame budget ${frameBudget.toFixed(0)} us`);
+    console.log('mode     N   frame    save   ahead    load  per extra frame     max  failed');
+    for (const secondInstance of [false, true]) {
+        for (let frames = 1; frames <= maxFrames; frames++) {
+            if (!await emulator.setRunAhead({ frames, secondInstance })) {
+                console.error(`setRunAhead(${frames}) failed`);
+                continue;
+            }
+            await sleep(seconds * 1000);
+            const stats = emulator.getRunAheadStats();
+            console.log(`${(secondInstance ? 'second' : 'single').padEnd(6)} ${String(frames).padStart(3)}  ${us(stats.frameUsMean)}  ${us(stats.saveUsMean)}  ${us(stats.aheadUsMean)}  ${us(stats.loadUsMean)}  ${us(stats.extraFrameUsMean)}           ${us(stats.runUsMax)}  ${String(stats.failed).padStart(6)}`);
+        }
+    }
+
+    await emulator.setRunAhead({ frames: 0 });
+    emulator.stopEmulationThread();
+    emulator.deinit();
+})();
@@ -0,0 +1,63 @@
+// Vectorized environment throughput: env-steps/sec of VectorEnv.step() as
+// the number of environments grows, with random actions
+// Usage: node bench/vector_env.js <rom> [maxEnvs] [secondsPerRun] [frameSkip] [scale] [greyscale]
+const os = require('os');
+const { VectorEnv } = require('../build/Release/snes9x_addon.node');
+
+const romPath = process.argv[2];
+const maxEnvs = parseInt(process.argv[3]) || os.cpus().length * 2;
+const seconds = parseFloat(process.argv[4]) || 5;
+const frameSkip = parseInt(process.argv[5]) || 4;
+const scale = parseInt(process.argv[6]) || 2;
+const greyscale = process.argv[7] !== '0';
+
+if (!romPath) {
+    console.error('Usage: node bench/vector_env.js <rom> [maxEnvs] [secondsPerRun] [frameSkip] [scale] [greyscale]');
+    process.exit(1);
+}
+
+// B, Y, Select, Start, Up, Down, Left, Right, A, X, L, R
+const buttons = [0x8000, 0x4000, 0x2000, 0x1000, 0x0800, 0x0400, 0x0200, 0x0100, 0x0080, 0x0040, 0x0020, 0x0010];
+
+async function run(count) {
+    const env = new VectorEnv({ count });
+    if (!env.loadROM(romPath)) {
+        throw new Error(`Failed to load ${romPath}`);
+    }
+    env.configure({ ports: 1, frameSkip, scale, greyscale });
+
+    // Past the boot screens, then every episode starts from there
+    const actions = new Uint16Array(count);
+    for (let i = 0; i < 600 / frameSkip; i++) {
+        await env.step(actions);
+    }
+    env.setResetState(0);
+    await env.reset();
+    env.resetStats();
+
+    const end = Date.now() + seconds * 1000;
+    let steps = 0;
+    while (Date.now() < end) {
+        for (let i = 0; i < count; i++) {
+            actions[i] = buttons[Math.floor(Math.random() * buttons.length)];
+        }
+        await env.step(actions);
+        steps++;
+    }
+    const stats = env.getStats();
+    env.close();
+    return { wall: steps * count / seconds, stats };
+}
+
+(async () => {
+    const shape = { width: 256 / scale, height: 224 / scale, channels: greyscale ? 1 : 3 };
+    console.log(`${os.cpus().length} CPUs, frameSkip ${frameSkip}, observation ${shape.width}x${shape.height}x${shape.channels}, ${seconds}s per run`);
+    console.log(' envs threads  env-steps/s  frames/s  step us  env step us  scaling');
+    let single = 0;
+    for (let count = 1; count <= maxEnvs; count *= 2) {
+        const { wall, stats } = await run(count);
+        if (count === 1) single = wall;
+        console.log(`${String(count).padStart(5)} ${String(stats.threads).padStart(7)}  ${wall.toFixed(0).padStart(11)}  ${(wall * frameSkip).toFixed(0).padStart(8)}` +
+                    `  ${stats.stepUsMean.toFixed(0).padStart(7)}  ${stats.envStepUsMean.toFixed(0).padStart(11)}  ${(wall / single).toFixed(2).padStart(6)}x`);
+    }
+})();
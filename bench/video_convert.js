@@ -0,0 +1,52 @@
+// Microbenchmark: native RGB565 conversion vs the original JS loop
+// Usage: node bench/video_convert.js [iterations]
+const { performance } = require('perf_hooks');
+const addon = require('../build/Release/snes9x_addon.node');
+const { convertRGB565ToRGB24 } = require('../lib/utils');
+
+const iterations = parseInt(process.argv[2]) || 2000;
+const { Snes9xAddon } = addon;
+
+// GFX.Screen rows are always 512 pixels apart (GFX.RealPPL)
+const SCREEN_PPL = 512;
+const sizes = [
+    { name: '256x224', width: 256, height: 224 },
+    { name: '512x448 (hi-res interlace)', width: 512, height: 448 },
+];
+
+function makeFrame(width, height) {
+    const stride = SCREEN_PPL * 2;
+    const frame = Buffer.alloc(stride * height);
+    for (let i = 0; i < frame.length; i += 2) {
+        frame.writeUInt16LE((i * 2654435761) & 0xFFFF, i);
+    }
+    return { frame, stride };
+}
+
+function time(fn) {
+    for (let i = 0; i < 50; i++) fn();
+    const start = performance.now();
+    for (let i = 0; i < iterations; i++) fn();
+    return (performance.now() - start) * 1000 / iterations;
+}
+
+console.log(`Native kernel: ${Snes9xAddon.getVideoKernel()}, ${iterations} iterations`);
+
+for (const { name, width, height } of sizes) {
+    const { frame, stride } = makeFrame(width, height);
+
+    const expected = convertRGB565ToRGB24(frame, width, height, stride);
+    const actual = Snes9xAddon.convertFrame(frame, width, height, stride, 'rgb24');
+    if (!expected.equals(actual)) {
+        console.error(`${name}: native rgb24 output differs from the JS converter`);
+        process.exit(1);
+    }
+
+    const jsUs = time(() => convertRGB565ToRGB24(frame, width, height, stride));
+    console.log(`${name}`);
+    console.log(`  js rgb24        ${jsUs.toFixed(1).padStart(8)} us/frame`);
+    for (const format of ['rgb24', 'rgba', 'bgra', 'rgb565']) {
+        const us = time(() => Snes9xAddon.convertFrame(frame, width, height, stride, format));
+        console.log(`  native ${format.padEnd(8)} ${us.toFixed(1).padStart(8)} us/frame (${(jsUs / us).toFixed(1)}x)`);
+    }
+}
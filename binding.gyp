@@ -1,12 +1,21 @@
 {
+  "variables": {
+    "profiler%": 0
+  },
   "targets": [
     {
-      "target_name": "snes9x_addon",
+      "target_name": "snes9x_core",
       "cflags!": [ "-fno-exceptions" ],
       "cflags_cc!": [ "-fno-exceptions" ],
       "sources": [
-        "src/addon.cpp",
         "src/emulator_wrapper.cpp",
+        "src/video_convert.cpp",
+        "src/tile_delta.cpp",
+        "src/palette_codec.cpp",
+        "src/input_queue.cpp",
+        "src/frame_pacer.cpp",
+        "src/rewind_buffer.cpp",
+        "src/profiler.cpp",
         "src/directory_setup.cpp",
         "src/core/apu/apu.cpp",
         "src/core/apu/bapu/dsp/sdsp.cpp",
@@ -40,6 +49,7 @@
         "src/core/obc1.cpp",
         "src/core/msu1.cpp",
         "src/core/ppu.cpp",
+        "src/core/renderthread.cpp",
         "src/core/stream.cpp",
         "src/core/sa1.cpp",
         "src/core/sa1cpu.cpp",
@@ -51,6 +61,7 @@
         "src/core/seta011.cpp",
         "src/core/seta018.cpp",
         "src/core/snapshot.cpp",
+        "src/core/statemanager.cpp",
         "src/core/snes9x.cpp",
         "src/core/spc7110.cpp",
         "src/core/spc7110dec.cpp",
@@ -77,7 +88,6 @@
         "src/core/jma/winout.cpp"
       ],
       "include_dirs": [
-        "<!@(node -p \"require('node-addon-api').include\")",
         "src/core",
         "src/core/apu",
         "src/core/apu/bapu",
@@ -90,7 +100,6 @@
         "src/core/jma"
       ],
       "defines": [
-        "NAPI_DISABLE_CPP_EXCEPTIONS",
         "USE_THREADS",
         "ZLIB",
         "HAVE_STDINT_H",
@@ -98,9 +107,15 @@
         "SNES9X_NODEJS"
       ],
       "conditions": [
+        ["profiler==1", {
+          "defines": [
+            "SNES9X_PROFILER"
+          ]
+        }],
         ["OS=='linux'", {
           "libraries": [
-            "-lpthread"
+            "-lpthread",
+            "-Wl,-Bsymbolic"
           ],
           "defines": [
             "__LINUX__"
@@ -110,7 +125,8 @@
           "xcode_settings": {
             "GCC_ENABLE_CPP_EXCEPTIONS": "YES",
             "CLANG_CXX_LIBRARY": "libc++",
-            "MACOSX_DEPLOYMENT_TARGET": "10.7"
+            "MACOSX_DEPLOYMENT_TARGET": "10.7",
+            "GCC_SYMBOLS_PRIVATE_EXTERN": "YES"
           },
           "defines": [
             "__MACOSX__"
@@ -134,6 +150,70 @@
           ]
         }]
       ],
+      "cflags_cc": [
+        "-std=c++17",
+        "-Wall",
+        "-Wextra",
+        "-O2",
+        "-fvisibility=hidden",
+        "-fvisibility-inlines-hidden"
+      ],
+      "cflags": [
+        "-O2",
+        "-fvisibility=hidden"
+      ]
+    },
+    {
+      "target_name": "snes9x_addon",
+      "dependencies": [ "snes9x_core" ],
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "sources": [
+        "src/addon.cpp",
+        "src/emulator_loader.cpp",
+        "src/frame_pool.cpp",
+        "src/shared_memory.cpp",
+        "src/env_pool.cpp",
+        "src/checkpoint_chain.cpp",
+        "src/rom_cache.cpp",
+        "src/frame_pacer.cpp",
+        "src/profiler.cpp",
+        "src/video_convert.cpp",
+        "src/palette_codec.cpp",
+        "src/audio_rendition.cpp"
+      ],
+      "include_dirs": [
+        "<!@(node -p \"require('node-addon-api').include\")"
+      ],
+      "defines": [
+        "NAPI_DISABLE_CPP_EXCEPTIONS"
+      ],
+      "conditions": [
+        ["OS=='linux'", {
+          "libraries": [
+            "-lpthread",
+            "-ldl",
+            "-lrt"
+          ]
+        }],
+        ["OS=='mac'", {
+          "xcode_settings": {
+            "GCC_ENABLE_CPP_EXCEPTIONS": "YES",
+            "CLANG_CXX_LIBRARY": "libc++",
+            "MACOSX_DEPLOYMENT_TARGET": "10.7"
+          }
+        }],
+        ["OS=='win'", {
+          "msvs_settings": {
+            "VCCLCompilerTool": {
+              "ExceptionHandling": 1
+            }
+          },
+          "defines": [
+            "NOMINMAX"
+          ]
+        }]
+      ],
       "cflags_cc": [
         "-std=c++17",
         "-Wall",
@@ -1,6 +1,9 @@
 const EmulatorInterface = require('./emulator_interface');
+const fs = require('fs');
 const path = require('path');
 
+const QUICKSAVE_PATH = path.join(__dirname, 'quicksave.sav');
+
 class EmulatorHandler {
     constructor(callbacks = {}) {
         this.emulator = new EmulatorInterface();
@@ -9,17 +12,43 @@ class EmulatorHandler {
             process.exit(1);
         }
 
+        // The addon converts RGB565 to RGB24 natively before handing frames over.
+        // VIDEO_ENCODING=tile-delta sends only the 16x16 tiles that changed since
+        // the previous frame instead of whole frames
+        this.emulator.setVideoFormat('rgb24');
+        if (process.env.VIDEO_ENCODING) {
+            this.emulator.setVideoEncoding({ mode: process.env.VIDEO_ENCODING, tileSize: 16, keyframeInterval: 120 });
+        }
+
+        // Rewind history ('rewind' control messages), off unless
+        // REWIND_BUDGET_MB is set: it snapshots the machine every
+        // REWIND_INTERVAL_FRAMES frames (2). Applies once a ROM loads
+        const rewindBudgetMB = parseInt(process.env.REWIND_BUDGET_MB) || 0;
+        if (rewindBudgetMB > 0) {
+            this.emulator.setRewind({
+                budgetBytes: rewindBudgetMB * 1024 * 1024,
+                intervalFrames: parseInt(process.env.REWIND_INTERVAL_FRAMES) || 2
+            });
+        }
+
+        // Run-ahead hides the game's own input lag (fighting games have 2-4
+        // frames of it); RUN_AHEAD_FRAMES picks the default, 'runAhead'
+        // control messages change it per game
+        const runAheadFrames = parseInt(process.env.RUN_AHEAD_FRAMES) || 0;
+        if (runAheadFrames > 0) {
+            this.setRunAhead(runAheadFrames, process.env.RUN_AHEAD_SECOND_INSTANCE === '1');
+        }
+
         // Store callbacks
         this.onVideo = callbacks.onVideo;
         this.onAudio = callbacks.onAudio;
+        this.onAudioRendition = callbacks.onAudioRendition;
         this.onRomLoaded = callbacks.onRomLoaded;
 
         // Set up event handlers
-        this.emulator.on('video', (buffer, width, height, stride, frameRate) => {
+        this.emulator.on('video', (buffer, width, height, stride, frameRate, encoding) => {
             if (this.onVideo) {
-                // Convert RGB565 to RGB24 for web
-                const rgb24 = this.convertRGB565ToRGB24(buffer, width, height, stride);
-                this.onVideo(rgb24, width, height, frameRate);
+                this.onVideo(buffer, width, height, frameRate, encoding);
             }
         });
 
@@ -29,11 +58,24 @@ class EmulatorHandler {
             }
         });
 
-        this.emulator.on('romLoaded', () => {
+        this.emulator.on('audioRendition', (rendition, buffer, samples) => {
+            if (this.onAudioRendition) {
+                this.onAudioRendition(rendition, buffer, samples);
+            }
+        });
+
+        // Quicksave contents, read from disk on the first ROM load only
+        this.quicksave = undefined;
+        // In-memory savestates keyed by slot ('saveState'/'loadState' control messages)
+        this.states = new Map();
+
+        this.emulator.on('romLoaded', async () => {
             console.log('ROM loaded, loading quicksave...');
-            // Load quicksave immediately after ROM loads
-            const quicksavePath = path.join(__dirname, 'quicksave.sav');
-            const quicksaveLoaded = this.emulator.loadStateFromFile(quicksavePath);
+            // Snapshots of the previous ROM do not apply to this one
+            this.releaseStates();
+
+            const quicksave = this.getQuicksave();
+            const quicksaveLoaded = quicksave ? await this.emulator.loadStateFromBuffer(quicksave) : false;
             if (quicksaveLoaded) {
                 console.log('Quicksave loaded successfully');
             } else {
@@ -48,12 +90,82 @@ class EmulatorHandler {
         });
     }
 
+    getQuicksave() {
+        if (this.quicksave === undefined) {
+            try {
+                this.quicksave = fs.readFileSync(QUICKSAVE_PATH);
+            } catch (error) {
+                this.quicksave = null;
+            }
+        }
+        return this.quicksave;
+    }
+
+    // Snapshot into memory under slot, replacing (and releasing) the previous one
+    async saveStateToMemory(slot = 0) {
+        const buffer = await this.emulator.saveStateToBuffer();
+        if (!buffer) {
+            return false;
+        }
+        const previous = this.states.get(slot);
+        if (previous) {
+            this.emulator.releaseStateBuffer(previous);
+        }
+        this.states.set(slot, buffer);
+        return true;
+    }
+
+    loadStateFromMemory(slot = 0) {
+        const buffer = this.states.get(slot);
+        return buffer ? this.emulator.loadStateFromBuffer(buffer) : Promise.resolve(false);
+    }
+
+    releaseStates() {
+        for (const buffer of this.states.values()) {
+            this.emulator.releaseStateBuffer(buffer);
+        }
+        this.states.clear();
+    }
+
+    setRunAhead(frames, secondInstance = false) {
+        try {
+            return this.emulator.setRunAhead({ frames, secondInstance });
+        } catch (error) {
+            console.error('Failed to set run-ahead:', error.message);
+            return Promise.resolve(false);
+        }
+    }
+
     loadROM(filename) {
         return this.emulator.loadROM(filename);
     }
 
-    // Handle control input
-    handleControlInput(data) {
+    // An audio client that names a rate (?rate=44100&format=f32&channels=2)
+    // gets its own native rendition, shared with clients asking for the same
+    // one, for as long as the socket stays open
+    attachAudioRendition(ws, params) {
+        if (!params.has('rate')) {
+            return;
+        }
+        try {
+            ws.audioRendition = this.emulator.addAudioRendition({
+                sampleRate: parseInt(params.get('rate')),
+                format: params.get('format') || 'f32',
+                channels: parseInt(params.get('channels')) || 2
+            });
+        } catch (error) {
+            console.error('Unsupported audio rendition:', error.message);
+            ws.close(1008, error.message);
+            return;
+        }
+        ws.on('close', () => this.emulator.removeAudioRendition(ws.audioRendition));
+    }
+
+    // Handle control input. source names the transport ('websocket',
+    // 'rabbitmq') for the input latency stats; seq and timestamp come from
+    // the sender.
+    handleControlInput(data, source = 'local') {
+        const meta = { source, sequence: data.seq, timestamp: data.timestamp };
         if (data.type === 'input') {
             const { port, buttons } = data;
             
@@ -72,45 +184,31 @@ class EmulatorHandler {
             if (buttons.left) buttonMask |= 0x200;  // SNES_LEFT_MASK
             if (buttons.right) buttonMask |= 0x100; // SNES_RIGHT_MASK
             
-            this.emulator?.setButtonState(port || 0, buttonMask);
+            this.emulator?.setButtonState(port || 0, buttonMask, meta);
             
         } else if (data.type === 'mouse') {
             const { port, x, y, left, right } = data;
-            this.emulator?.setMousePosition(port || 0, x, y);
+            this.emulator?.setMousePosition(port || 0, x, y, meta);
             if (left !== undefined || right !== undefined) {
-                this.emulator?.setMouseButtons(port || 0, left || false, right || false);
+                this.emulator?.setMouseButtons(port || 0, left || false, right || false, meta);
             }
         } else if (data.type === 'reset') {
             this.emulator?.reset();
         } else if (data.type === 'pause') {
             this.emulator?.setPaused(data.paused !== undefined ? data.paused : true);
+        } else if (data.type === 'saveState') {
+            this.saveStateToMemory(data.slot);
+        } else if (data.type === 'loadState') {
+            this.loadStateFromMemory(data.slot);
+        } else if (data.type === 'rewind') {
+            this.emulator?.rewind(data.frames || 60);
+        } else if (data.type === 'runAhead') {
+            this.setRunAhead(data.frames || 0, data.secondInstance === true);
+        } else if (data.type === 'keyframe') {
+            this.emulator?.requestKeyframe();
         }
     }
 
-    // Convert RGB565 to RGB24
-    convertRGB565ToRGB24(buffer, width, height, stride) {
-        const rgb24 = Buffer.allocUnsafe(width * height * 3);
-        const source = new Uint16Array(buffer.buffer, buffer.byteOffset, buffer.length / 2);
-        
-        for (let y = 0; y < height; y++) {
-            for (let x = 0; x < width; x++) {
-                const srcIdx = y * (stride / 2) + x;
-                const dstIdx = (y * width + x) * 3;
-                
-                const pixel = source[srcIdx];
-                const r = ((pixel >> 11) & 0x1F) << 3;
-                const g = ((pixel >> 5) & 0x3F) << 2;
-                const b = (pixel & 0x1F) << 3;
-                
-                rgb24[dstIdx] = r;
-                rgb24[dstIdx + 1] = g;
-                rgb24[dstIdx + 2] = b;
-            }
-        }
-        
-        return rgb24;
-    }
-
     // Expose emulator methods for convenience
     getEmulator() {
         return this.emulator;
@@ -12,15 +12,29 @@ class EmulatorInterface extends EventEmitter {
         this.frameRate = 60.0;
         
         // Set up callbacks
-        this.addon.setVideoCallback((buffer, width, height, stride, frameRate) => {
+        // encoding is 'raw' or 'tile-delta'; a tile-delta buffer is a complete
+        // packet (see src/tile_delta.h) rather than a frame of pixels
+        this.addon.setVideoCallback((buffer, width, height, stride, frameRate, encoding) => {
             this.frameWidth = width;
             this.frameHeight = height;
             this.frameRate = frameRate;
-            this.emit('video', buffer, width, height, stride, frameRate);
+            this.emit('video', buffer, width, height, stride, frameRate, encoding);
+            // The buffer is a pooled native frame slot; listeners that need the
+            // pixels after returning must copy them
+            this.addon.releaseVideoFrame(buffer);
         });
         
-        this.addon.setAudioCallback((buffer, samples) => {
-            this.emit('audio', buffer, samples);
+        // samples is the number of sample frames in the packet. The buffer is
+        // a pooled native slot that is reused as soon as the listeners return,
+        // so they must copy it if they keep it. rendition is 0 for the mixed
+        // interleaved stereo s16 stream; packets of an addAudioRendition()
+        // stream are complete packets (see src/audio_rendition.h).
+        this.addon.setAudioCallback((buffer, samples, rendition) => {
+            if (rendition) {
+                this.emit('audioRendition', rendition, buffer, samples);
+            } else {
+                this.emit('audio', buffer, samples);
+            }
         });
     }
 
@@ -118,16 +132,271 @@ class EmulatorInterface extends EventEmitter {
         return false;
     }
 
-    setButtonState(port, buttons) {
-        this.addon.setButtonState(port, buttons);
+    // In-memory savestates, applied at the next frame boundary so they are
+    // safe while the emulation thread runs. saveStateToBuffer() resolves
+    // with a pooled Buffer (or null without a ROM); hand it back with
+    // releaseStateBuffer() once done with it instead of waiting for GC.
+    saveStateToBuffer() {
+        if (this.romLoaded) {
+            return this.addon.saveStateToBuffer();
+        }
+        return Promise.resolve(null);
+    }
+
+    // The buffer must stay unmodified until the promise settles
+    loadStateFromBuffer(buffer) {
+        if (this.romLoaded) {
+            return this.addon.loadStateFromBuffer(buffer);
+        }
+        return Promise.resolve(false);
+    }
+
+    releaseStateBuffer(buffer) {
+        return this.addon.releaseStateBuffer(buffer);
+    }
+
+    getStateSize() {
+        return this.addon.getStateSize();
+    }
+
+    // options: { budgetBytes, intervalFrames }; a budget of 0 disables rewind
+    setRewind(options = {}) {
+        return this.addon.setRewind(options);
+    }
+
+    // Resolves with the number of frames actually rewound
+    rewind(frames) {
+        if (this.romLoaded) {
+            return this.addon.rewind(frames);
+        }
+        return Promise.resolve(0);
+    }
+
+    rewindTo(timestampMs) {
+        if (this.romLoaded) {
+            return this.addon.rewindTo(timestampMs);
+        }
+        return Promise.resolve(0);
+    }
+
+    getRewindStats() {
+        return this.addon.getRewindStats();
+    }
+
+    // Incremental checkpoint at the next frame boundary: only the 4 KB
+    // blocks of the savestate that changed since the previous one are kept.
+    // Resolves { checkpoint, base, bytes, blocks }, or null without a ROM
+    checkpoint() {
+        if (this.romLoaded) {
+            return this.addon.checkpoint();
+        }
+        return Promise.resolve(null);
+    }
+
+    restoreCheckpoint(checkpoint) {
+        if (this.romLoaded) {
+            return this.addon.restoreCheckpoint(checkpoint);
+        }
+        return Promise.resolve(false);
+    }
+
+    // Buffer for a receiver: the base in full, later checkpoints as their
+    // changed blocks, applied in order with Snes9xAddon.applyStateDelta()
+    encodeCheckpoint(checkpoint) {
+        return this.addon.encodeCheckpoint(checkpoint);
+    }
+
+    // options: { maxDeltas }; past that many deltas the oldest ones are
+    // folded into the base
+    setCheckpoints(options = {}) {
+        this.addon.setCheckpoints(options);
+    }
+
+    compactCheckpoints(maxDeltas) {
+        this.addon.compactCheckpoints(maxDeltas);
+    }
+
+    resetCheckpoints() {
+        this.addon.resetCheckpoints();
+    }
+
+    // Bytes per checkpoint, chain length and changed bytes per memory region
+    getCheckpointStats() {
+        return this.addon.getCheckpointStats();
+    }
+
+    // options: { frames, secondInstance }; frames 0 disables run-ahead
+    setRunAhead(options) {
+        return this.addon.setRunAhead(options);
+    }
+
+    // extraFrameUsMean is the CPU cost of each frame of run-ahead
+    getRunAheadStats() {
+        return this.addon.getRunAheadStats();
+    }
+
+    // Runs frames as fast as possible; options: { render: 'none' | 'last' |
+    // 'every', audio }. Resolves with timing stats and the last frame, or
+    // null without a ROM
+    runFrames(frames, options = {}) {
+        if (this.romLoaded) {
+            return this.addon.runFrames(frames, options);
+        }
+        return Promise.resolve(null);
+    }
+
+    // options: { enabled, traceEvents }; resolves false in a build without
+    // the profiler
+    setProfiling(options = {}) {
+        return this.addon.setProfiling(options);
+    }
+
+    // Per subsystem (cpu, smp, dsp, ppu, superfx, sa1, output): mean and
+    // percentile microseconds per frame over the last frames, and share
+    getProfileStats() {
+        return this.addon.getProfileStats();
+    }
+
+    resetProfileStats() {
+        this.addon.resetProfileStats();
+    }
+
+    // Resolves with Chrome trace-event JSON of the segments kept so far
+    getProfileTrace() {
+        return this.addon.getProfileTrace();
+    }
+
+    // Computed-goto 65c816 dispatch instead of the opcode tables (off by
+    // default), from the next frame; false when the core was built without it
+    setThreadedDispatch(enabled) {
+        return this.addon.setThreadedDispatch(enabled);
+    }
+
+    // Skips idle loop iterations up to the next event (off by default), from
+    // the next frame; the emulation is the same either way
+    setSkipIdleLoops(enabled) {
+        this.addon.setSkipIdleLoops(enabled);
+    }
+
+    // { threadedDispatch, skipIdleLoops, instructions, frames, idleLoopSkips,
+    // idleLoopCycles, idleLoopInstructions, idleCycleShare }: 65c816
+    // instructions executed and idle loop cycles skipped since the ROM loaded
+    getCPUStats() {
+        return this.addon.getCPUStats();
+    }
+
+    // Draws frames on a worker thread while emulation carries on (off by
+    // default), from the next frame; frames are the same as drawn inline.
+    // verify draws inline as well and counts frames that differ
+    setRenderThread(enabled, verify = false) {
+        this.addon.setRenderThread(enabled, verify);
+    }
+
+    // { enabled, verify, frames, batches, splitBatches, redrawnLines,
+    // vramBlocks, mismatchedFrames, renderUsMean, waitUsMean }
+    getRenderThreadStats() {
+        return this.addon.getRenderThreadStats();
+    }
+
+    // Input is queued and applied right before the next frame. meta is
+    // optional: { source: 'local' | 'websocket' | 'rabbitmq', sequence,
+    // timestamp } with the sender's sequence number and Date.now()
+    setButtonState(port, buttons, meta) {
+        this.addon.setButtonState(port, buttons, meta);
+    }
+
+    setMousePosition(port, x, y, meta) {
+        this.addon.setMousePosition(port, x, y, meta);
+    }
+
+    setMouseButtons(port, left, right, meta) {
+        this.addon.setMouseButtons(port, left, right, meta);
+    }
+
+    // Per transport: queue and render latency of applied input, stale and
+    // overflowed events, plus the latest events one by one
+    getInputStats() {
+        return this.addon.getInputStats();
+    }
+
+    resetInputStats() {
+        this.addon.resetInputStats();
+    }
+
+    // Output format of video frames: 'rgb565', 'rgb24', 'rgba' or 'bgra'
+    setVideoFormat(format) {
+        this.addon.setVideoFormat(format);
+    }
+
+    getVideoFormat() {
+        return this.addon.getVideoFormat();
+    }
+
+    // { mode: 'raw' | 'tile-delta' | 'palette-deflate', tileSize: 8 | 16,
+    //   keyframeInterval, level: zlib level 1-9 for palette-deflate }
+    setVideoEncoding(options) {
+        this.addon.setVideoEncoding(options);
+    }
+
+    // The next tile-delta frame carries every tile, e.g. for a new viewer
+    requestKeyframe() {
+        this.addon.requestKeyframe();
+    }
+
+    getVideoEncoderStats() {
+        return this.addon.getVideoEncoderStats();
+    }
+
+    // Frame pool counters; slotAllocations stays constant in steady state
+    getVideoPoolStats() {
+        return this.addon.getVideoPoolStats();
+    }
+
+    // { video: 'coalesce' | 'drop-oldest', videoQueueDepth } - audio is never dropped
+    setDeliveryPolicy(policy) {
+        this.addon.setDeliveryPolicy(policy);
+    }
+
+    getDeliveryStats() {
+        return this.addon.getDeliveryStats();
+    }
+
+    // Audio packet length in milliseconds (1-50, default 10)
+    setAudioPacketDuration(ms) {
+        this.addon.setAudioPacketDuration(ms);
+    }
+
+    getAudioStats() {
+        return this.addon.getAudioStats();
+    }
+
+    // { sampleRate, format: 's16' | 'f32', channels: 1 | 2 } -> rendition id.
+    // Resampled and converted natively on the audio packet thread; callers
+    // asking for the same rendition get the same id and share the work.
+    addAudioRendition(options) {
+        return this.addon.addAudioRendition(options);
+    }
+
+    // Drops one reference taken by addAudioRendition()
+    removeAudioRendition(id) {
+        return this.addon.removeAudioRendition(id);
+    }
+
+    getAudioRenditionStats() {
+        return this.addon.getAudioRenditionStats();
+    }
+
+    // { mode: 'clock' | 'audio' | 'unthrottled', spinUs, maxCatchUpFrames }
+    setPacing(options) {
+        this.addon.setPacing(options);
     }
 
-    setMousePosition(port, x, y) {
-        this.addon.setMousePosition(port, x, y);
+    getPacerStats() {
+        return this.addon.getPacerStats();
     }
 
-    setMouseButtons(port, left, right) {
-        this.addon.setMouseButtons(port, left, right);
+    resetPacerStats() {
+        this.addon.resetPacerStats();
     }
 
     startEmulationThread() {
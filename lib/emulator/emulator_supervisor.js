@@ -0,0 +1,235 @@
+const addon = require('../../build/Release/snes9x_addon.node');
+const { EventEmitter } = require('events');
+const { fork } = require('child_process');
+const os = require('os');
+const path = require('path');
+
+// Largest frame the core produces (512x478 hi-res interlace) at 4 bytes per pixel
+const MAX_VIDEO_FRAME_BYTES = 512 * 478 * 4;
+// Up to 50 ms of 48 kHz stereo s16, as for the in-process audio pool
+const MAX_AUDIO_PACKET_BYTES = 48000 * 50 / 1000 * 2 * 2;
+
+// Settings replayed on a replacement worker, latest call wins
+const STICKY_METHODS = ['setVideoFormat', 'setPacing', 'setAudioPacketDuration', 'setPaused'];
+
+let nextSupervisorId = 0;
+
+// Runs one emulator in a child process pinned to a CPU.
+//
+// Video frames and audio packets travel through shared-memory rings owned by
+// this process; only method calls use the IPC channel. The worker writes a
+// savestate into shared memory every snapshotInterval frames, and when it
+// crashes a replacement reloads the ROM, resumes from that snapshot and
+// replays the last settings. Events match EmulatorInterface ('video',
+// 'audio', 'romLoaded') plus 'restart' and 'failed'. Buffers handed to
+// 'video' and 'audio' listeners point into shared memory and are only valid
+// until the listeners return.
+class EmulatorSupervisor extends EventEmitter {
+    constructor(options = {}) {
+        super();
+        const id = nextSupervisorId++;
+        const cpus = os.availableParallelism ? os.availableParallelism() : os.cpus().length;
+        const base = `/snes9x-${process.pid}-${id}`;
+
+        this.options = {
+            cpu: options.cpu !== undefined ? options.cpu : id % cpus,
+            snapshotInterval: options.snapshotInterval || 60,
+            videoSlots: options.videoSlots || 4,
+            audioSlots: options.audioSlots || 32,
+            maxRestarts: options.maxRestarts !== undefined ? options.maxRestarts : 5,
+            restartWindowMs: options.restartWindowMs || 60000,
+            restartDelayMs: options.restartDelayMs !== undefined ? options.restartDelayMs : 250
+        };
+        this.names = {
+            video: `${base}-video`,
+            audio: `${base}-audio`,
+            snapshot: `${base}-state`
+        };
+
+        this.videoChannel = new addon.SharedFrameChannel(this.names.video, this.options.videoSlots, MAX_VIDEO_FRAME_BYTES);
+        this.audioChannel = new addon.SharedFrameChannel(this.names.audio, this.options.audioSlots, MAX_AUDIO_PACKET_BYTES);
+        this.videoChannel.start((buffer, info) => {
+            this.emit('video', buffer, info.width, info.height, info.stride, info.frameRate);
+        });
+        this.audioChannel.start((buffer, info) => {
+            this.emit('audio', buffer, info.samples);
+        });
+
+        this.child = null;
+        this.closed = false;
+        this.nextCallId = 0;
+        this.pending = new Map();
+        this.rom = null;
+        this.running = false;
+        this.sticky = new Map();
+        this.restartTimes = [];
+        this.available = this.spawn();
+        this.available.catch(() => {});
+    }
+
+    // Resolves once the worker is up and, after a restart, restored
+    spawn() {
+        return new Promise((resolve, reject) => {
+            const config = {
+                video: this.names.video,
+                audio: this.names.audio,
+                snapshot: this.names.snapshot,
+                snapshotInterval: this.options.snapshotInterval,
+                cpu: this.options.cpu
+            };
+            const child = fork(path.join(__dirname, 'emulator_worker.js'), [JSON.stringify(config)], {
+                serialization: 'advanced'
+            });
+            this.child = child;
+
+            child.on('message', (message) => {
+                if (message.type === 'ready') {
+                    resolve();
+                    return;
+                }
+                const call = this.pending.get(message.id);
+                if (!call) return;
+                this.pending.delete(message.id);
+                if (message.type === 'error') {
+                    call.reject(new Error(message.message));
+                } else {
+                    call.resolve(message.value);
+                }
+            });
+
+            child.on('exit', (code, signal) => {
+                if (this.child === child) this.child = null;
+                for (const call of this.pending.values()) {
+                    call.reject(new Error('Emulator worker exited'));
+                }
+                this.pending.clear();
+                reject(new Error(`Emulator worker exited (${signal || code})`));
+                if (!this.closed) {
+                    this.handleCrash(code, signal);
+                }
+            });
+        });
+    }
+
+    handleCrash(code, signal) {
+        // Slots the dead worker was writing would otherwise stay busy
+        this.videoChannel.recover();
+        this.audioChannel.recover();
+
+        const now = Date.now();
+        this.restartTimes = this.restartTimes.filter((time) => now - time < this.options.restartWindowMs);
+        if (this.restartTimes.length >= this.options.maxRestarts) {
+            this.emit('failed', { code, signal, restarts: this.restartTimes.length });
+            return;
+        }
+        this.restartTimes.push(now);
+
+        this.available = new Promise((resolve) => setTimeout(resolve, this.options.restartDelayMs))
+            .then(() => this.spawn())
+            .then(() => this.restore())
+            .then((frame) => {
+                this.emit('restart', { code, signal, restarts: this.restartTimes.length, frame });
+            });
+        // Failures surface through the next call, or another exit
+        this.available.catch(() => {});
+    }
+
+    async restore() {
+        let frame = false;
+        if (this.rom) {
+            await this.invoke('reloadROM', [this.rom.method, this.rom.args]);
+            frame = await this.invoke('restoreSnapshot', []);
+        }
+        for (const [method, args] of this.sticky) {
+            await this.invoke(method, args);
+        }
+        if (this.running) {
+            await this.invoke('startEmulationThread', []);
+        }
+        return frame;
+    }
+
+    invoke(method, args) {
+        return new Promise((resolve, reject) => {
+            if (!this.child || !this.child.connected) {
+                reject(new Error('Emulator worker is not running'));
+                return;
+            }
+            const id = this.nextCallId++;
+            this.pending.set(id, { resolve, reject });
+            this.child.send({ type: 'call', id, method, args });
+        });
+    }
+
+    // Calls a worker method once the worker is available; resolves with its result
+    async call(method, ...args) {
+        if (this.closed) throw new Error('Supervisor is closed');
+        await this.available;
+        const value = await this.invoke(method, args);
+
+        if (STICKY_METHODS.includes(method)) {
+            this.sticky.set(method, args);
+        } else if ((method === 'loadROM' || method === 'loadROMMem') && value) {
+            this.rom = { method, args };
+            this.emit('romLoaded', method === 'loadROM' ? args[0] : (args[1] || 'Memory ROM'));
+        } else if (method === 'startEmulationThread') {
+            this.running = true;
+        } else if (method === 'stopEmulationThread') {
+            this.running = false;
+        }
+        return value;
+    }
+
+    // Fire-and-forget for input; dropped while the worker restarts
+    send(method, ...args) {
+        if (this.child && this.child.connected) {
+            this.child.send({ type: 'call', method, args });
+        }
+    }
+
+    loadROM(filename) {
+        return this.call('loadROM', filename);
+    }
+
+    startEmulationThread() {
+        return this.call('startEmulationThread');
+    }
+
+    stopEmulationThread() {
+        return this.call('stopEmulationThread');
+    }
+
+    // meta is timed from the worker's receipt of the call
+    setButtonState(port, buttons, meta) {
+        this.send('setButtonState', port, buttons, meta);
+    }
+
+    setMousePosition(port, x, y, meta) {
+        this.send('setMousePosition', port, x, y, meta);
+    }
+
+    setMouseButtons(port, left, right, meta) {
+        this.send('setMouseButtons', port, left, right, meta);
+    }
+
+    getTransportStats() {
+        return {
+            video: this.videoChannel.getStats(),
+            audio: this.audioChannel.getStats(),
+            restarts: this.restartTimes.length
+        };
+    }
+
+    close() {
+        this.closed = true;
+        if (this.child) {
+            this.child.kill();
+            this.child = null;
+        }
+        this.videoChannel.close();
+        this.audioChannel.close();
+        addon.SharedFrameChannel.removeSnapshot(this.names.snapshot);
+    }
+}
+
+module.exports = EmulatorSupervisor;
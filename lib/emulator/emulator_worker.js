@@ -0,0 +1,106 @@
+// Worker process entry for EmulatorSupervisor. Runs one emulator, publishes
+// frames and audio packets into the shared rings named in the config and
+// answers method calls sent over the IPC channel.
+const addon = require('../../build/Release/snes9x_addon.node');
+
+const config = JSON.parse(process.argv[2]);
+
+if (typeof config.cpu === 'number' && !addon.Snes9xAddon.setCpuAffinity(config.cpu)) {
+    console.warn(`Emulator worker: could not pin to CPU ${config.cpu}`);
+}
+
+const emulator = new addon.Snes9xAddon();
+if (!emulator.init()) {
+    console.error('Emulator worker: failed to initialize emulator');
+    process.exit(2);
+}
+emulator.attachSharedOutput({ video: config.video, audio: config.audio });
+
+let running = false;
+
+// Loading a ROM or a snapshot requires a stopped emulation thread
+function whileStopped(fn) {
+    const wasRunning = running;
+    if (wasRunning) emulator.stopEmulationThread();
+    try {
+        return fn();
+    } finally {
+        if (wasRunning) emulator.startEmulationThread();
+    }
+}
+
+// A ROM loaded by the user starts the snapshot segment over, so a crash
+// before its first snapshot cannot resume the previous game; the
+// supervisor's reload after a crash keeps the snapshot to restore
+function afterROMLoad(loaded, keepSnapshot = false) {
+    if (loaded) {
+        emulator.enableSharedSnapshots(config.snapshot, config.snapshotInterval, keepSnapshot);
+    }
+    return loaded;
+}
+
+const loaders = {
+    loadROM: (filename) => emulator.loadROM(filename),
+    // Structured clone delivers Buffers as plain Uint8Arrays
+    loadROMMem: (data, name = '') =>
+        emulator.loadROMMem(Buffer.from(data.buffer, data.byteOffset, data.byteLength), name)
+};
+
+const handlers = {
+    loadROM: (filename) => whileStopped(() => afterROMLoad(loaders.loadROM(filename))),
+    loadROMMem: (data, name) => whileStopped(() => afterROMLoad(loaders.loadROMMem(data, name))),
+    reloadROM: (method, args) => whileStopped(() => afterROMLoad(loaders[method](...args), true)),
+    restoreSnapshot: () => whileStopped(() => emulator.restoreSharedSnapshot(config.snapshot)),
+    startEmulationThread: () => {
+        emulator.startEmulationThread();
+        running = true;
+    },
+    stopEmulationThread: () => {
+        emulator.stopEmulationThread();
+        running = false;
+    },
+    getFrameInfo: () => ({
+        width: emulator.getFrameWidth(),
+        height: emulator.getFrameHeight(),
+        frameRate: emulator.getFrameRate()
+    })
+};
+
+const forwarded = [
+    'isROMLoaded', 'reset', 'softReset', 'setPaused', 'isPaused',
+    'saveState', 'loadState', 'saveStateToFile', 'loadStateFromFile',
+    'setButtonState', 'setMousePosition', 'setMouseButtons', 'getInputStats', 'resetInputStats',
+    'setVideoFormat', 'getVideoFormat', 'setAudioPacketDuration', 'getAudioStats',
+    'setPacing', 'getPacerStats', 'resetPacerStats', 'getProfileStats', 'resetProfileStats',
+    'setThreadedDispatch', 'setSkipIdleLoops', 'getCPUStats',
+    'setRenderThread', 'getRenderThreadStats'
+];
+for (const method of forwarded) {
+    handlers[method] = (...args) => emulator[method](...args);
+}
+
+// { type: 'call', id, method, args } -> { type: 'result' | 'error', id, ... }
+// Calls without an id (input) get no reply.
+process.on('message', (message) => {
+    if (!message || message.type !== 'call') return;
+
+    const handler = handlers[message.method];
+    let reply;
+    try {
+        if (!handler) throw new Error(`Unknown method ${message.method}`);
+        reply = { type: 'result', id: message.id, value: handler(...(message.args || [])) };
+    } catch (error) {
+        reply = { type: 'error', id: message.id, message: error.message };
+    }
+    if (message.id !== undefined) {
+        process.send(reply);
+    }
+});
+
+// The front-end going away takes the worker with it
+process.on('disconnect', () => {
+    emulator.stopEmulationThread();
+    process.exit(0);
+});
+
+process.send({ type: 'ready' });
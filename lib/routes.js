@@ -3,7 +3,7 @@ const path = require('path');
 // Preset filename for save/load state to/from file
 const SAVESTATE_FILENAME = path.join(__dirname, 'quicksave.sav');
 
-function setupRoutes(app, emulatorHandler) {
+function setupRoutes(app, emulatorHandler, wsServer) {
     // API Routes
     app.get('/api/status', (req, res) => {
         res.json({
@@ -13,6 +13,44 @@ function setupRoutes(app, emulatorHandler) {
         });
     });
 
+    app.get('/api/stats', (req, res) => {
+        res.json({
+            delivery: emulatorHandler.getEmulator().getDeliveryStats(),
+            videoPool: emulatorHandler.getEmulator().getVideoPoolStats(),
+            audio: emulatorHandler.getEmulator().getAudioStats(),
+            audioRenditions: emulatorHandler.getEmulator().getAudioRenditionStats(),
+            pacer: emulatorHandler.getEmulator().getPacerStats(),
+            input: emulatorHandler.getEmulator().getInputStats(),
+            rewind: emulatorHandler.getEmulator().getRewindStats(),
+            runAhead: emulatorHandler.getEmulator().getRunAheadStats(),
+            videoEncoder: emulatorHandler.getEmulator().getVideoEncoderStats(),
+            profile: emulatorHandler.getEmulator().getProfileStats(),
+            cpu: emulatorHandler.getEmulator().getCPUStats(),
+            websocket: wsServer?.getStats()
+        });
+    });
+
+    // { enabled, traceEvents }: per-subsystem frame profiling, see /api/stats
+    app.post('/api/profile', async (req, res) => {
+        const { enabled = true, traceEvents = 0 } = req.body || {};
+        try {
+            const result = await emulatorHandler.getEmulator().setProfiling({ enabled, traceEvents });
+            res.json({ success: result });
+        } catch (error) {
+            res.status(400).json({ error: error.message });
+        }
+    });
+
+    // Chrome trace-event JSON of the segments kept since the last download
+    app.get('/api/profile/trace', async (req, res) => {
+        try {
+            const trace = await emulatorHandler.getEmulator().getProfileTrace();
+            res.type('application/json').attachment('snes9x-trace.json').send(trace);
+        } catch (error) {
+            res.status(500).json({ error: error.message });
+        }
+    });
+
     app.get('/api/admin-enabled', (req, res) => {
         const adminEnabled = process.env.ADMIN_ENABLED === 'true' || process.env.ADMIN_ENABLED === '1';
         res.json({ adminEnabled });
@@ -8,7 +8,7 @@ const rabbitmq = require('./rabbitmq');
 const setupRoutes = require('./routes');
 const EmulatorHandler = require('./emulator/emulator_handler');
 const WebSocketServer = require('./websocket/websockets_server');   
-const webSocketConsumers = require('./websocket/websocket_consumers');
+const webSocketConsumersFactory = require('./websocket/websocket_consumers');
 const webSocketPublishersFactory = require('./websocket/websocket_publishers'); 
 const { WS_PATHS } = require('./websocket/ws_consts');
 
@@ -19,28 +19,42 @@ const server = http.createServer(app);
 app.use(express.static(path.join(__dirname, '../public')));
 app.use(express.json());
 
-// Setup WebSocket server
-const { publishers: wsPublishers } = new WebSocketServer(server, webSocketConsumers, webSocketPublishersFactory);
+// Setup WebSocket server. A new video viewer needs a keyframe before the
+// tile deltas mean anything. An audio client may ask for its own rendition
+// with ?rate=44100&format=f32&channels=2.
+const wsServer = new WebSocketServer(
+    server,
+    webSocketConsumersFactory((data) => emulatorHandler.handleControlInput(data, 'websocket')),
+    webSocketPublishersFactory,
+    {
+        [WS_PATHS.VIDEO]: () => emulatorHandler.getEmulator().requestKeyframe(),
+        [WS_PATHS.AUDIO]: (ws, url) => emulatorHandler.attachAudioRendition(ws, url.searchParams),
+    }
+);
+const { publishers: wsPublishers } = wsServer;
 
 const emulatorHandler = new EmulatorHandler({
-    onVideo: (buffer, width, height, frameRate) => {
-        wsPublishers[WS_PATHS.VIDEO]({rgb24: buffer, width, height, frameRate});
+    onVideo: (buffer, width, height, frameRate, encoding) => {
+        wsPublishers[WS_PATHS.VIDEO]({rgb24: buffer, width, height, frameRate, encoding});
     },
     onAudio: (buffer, samples) => {
         wsPublishers[WS_PATHS.AUDIO]({buffer, samples});
     },
+    onAudioRendition: (rendition, buffer, samples) => {
+        wsPublishers[WS_PATHS.AUDIO]({buffer, samples, rendition});
+    },
     onRomLoaded: () => {
         wsPublishers[WS_PATHS.ROM_LOADED]();
     },
 });
 
 rabbitmq.startRabbitMQConsumer({
-    control: (data) => emulatorHandler.handleControlInput(data),
+    control: (data) => emulatorHandler.handleControlInput(data, 'rabbitmq'),
 }).then(() => {
     console.log('RabbitMQ consumer started');
 });
 // Setup routes
-setupRoutes(app, emulatorHandler);
+setupRoutes(app, emulatorHandler, wsServer);
 
 
 // Start server
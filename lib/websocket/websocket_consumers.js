@@ -1,12 +1,12 @@
-const webSocketConsumers = {
+const webSocketConsumersFactory = (routeHandler) => ({
     '/control': (message) => {
         try {
             const data = JSON.parse(message);
-            this.handleControlInput(data);
+            routeHandler(data);
         } catch (error) {
             console.error('Error parsing control message:', error);
         }
     }
-}
+})
 
-module.exports = webSocketConsumers;
\ No newline at end of file
+module.exports = webSocketConsumersFactory;
\ No newline at end of file
@@ -1,6 +1,12 @@
 const { WS_PATHS } = require('./ws_consts');
-const webSocketPublishersFactory = (send) => ({
-    [WS_PATHS.VIDEO]: ({rgb24, width, height, frameRate}) => {
+const webSocketPublishersFactory = (send, sendWhere) => ({
+    [WS_PATHS.VIDEO]: ({rgb24, width, height, frameRate, encoding}) => {
+        if (encoding === 'tile-delta' || encoding === 'palette-deflate') {
+            // Already a complete packet (type 0x03 / 0x04); copied because the native
+            // slot is reused once the listeners return
+            send(WS_PATHS.VIDEO, Buffer.from(rgb24), { binary: true });
+            return;
+        }
         send(WS_PATHS.VIDEO, Buffer.concat([
             Buffer.from([0x01]), // Frame type
             Buffer.from(new Uint32Array([width, height]).buffer),
@@ -8,8 +14,14 @@ const webSocketPublishersFactory = (send) => ({
         ]), { binary: true });
     },
 
-    [WS_PATHS.AUDIO]: ({buffer, samples}) => {
-        send(WS_PATHS.AUDIO, Buffer.concat([
+    // Clients that asked for a rendition get only its packets (type 0x05,
+    // built natively); the others get the mixed 48 kHz s16 stream
+    [WS_PATHS.AUDIO]: ({buffer, samples, rendition}) => {
+        if (rendition) {
+            sendWhere(WS_PATHS.AUDIO, (ws) => ws.audioRendition === rendition, Buffer.from(buffer), { binary: true });
+            return;
+        }
+        sendWhere(WS_PATHS.AUDIO, (ws) => ws.audioRendition === undefined, Buffer.concat([
             Buffer.from([0x02]), // Audio type
             Buffer.from(new Uint32Array([samples]).buffer),
             buffer
@@ -1,10 +1,13 @@
-
 const WebSocket = require('ws');
 const { WS_PATHS } = require('./ws_consts');
 const wsPathSet = new Set(Object.values(WS_PATHS));
 class WebSocketServer {
-    constructor(server, consumers, publisherFactory) {
+    // onConnect: optional { [path]: (ws, url) => {} }, called for every new client
+    constructor(server, consumers, publisherFactory, onConnect = {}) {
         this.clients = Object.fromEntries(Object.values(WS_PATHS).map(path => [path, new Set()]));
+        // Bytes sent per path, for the per-viewer bandwidth in getStats()
+        this.bytesSent = Object.fromEntries(Object.values(WS_PATHS).map(path => [path, 0]));
+        this.statsSince = Date.now();
         this.wss = new WebSocket.Server({ server });
         this.wss.on('error', (error) => {
             console.error('WebSocket error:', error);
@@ -21,16 +24,43 @@ class WebSocketServer {
                 ws.on('close', () => {
                     this.clients[pathname].delete(ws);
                 });
+                onConnect[pathname]?.(ws, url);
             }
 
         });
-        this.publishers = publisherFactory((path, ...message) => {
+        // sendWhere only reaches the clients of path accepted by filter
+        const sendWhere = (path, filter, ...message) => {
+            const size = typeof message[0] === 'string' ? Buffer.byteLength(message[0]) : message[0].length;
             this.clients[path].forEach(ws => {
-                ws.send(...message);
+                if (filter(ws)) {
+                    this.bytesSent[path] += size;
+                    ws.send(...message);
+                }
             });
-        });
+        };
+        this.publishers = publisherFactory((path, ...message) => sendWhere(path, () => true, ...message), sendWhere);
+    }
+
+    // Per path: connected clients and bytes per second sent to each of them
+    // since the previous call
+    getStats() {
+        const now = Date.now();
+        const seconds = Math.max(now - this.statsSince, 1) / 1000;
+        const stats = {};
+        for (const path of Object.keys(this.clients)) {
+            const clients = this.clients[path].size;
+            const bytesPerSecond = this.bytesSent[path] / seconds;
+            stats[path] = {
+                clients,
+                bytesPerSecond,
+                bytesPerSecondPerViewer: clients ? bytesPerSecond / clients : 0
+            };
+            this.bytesSent[path] = 0;
+        }
+        this.statsSince = now;
+        return stats;
     }
 
 }
 
-module.exports = WebSocketServer;
\ No newline at end of file
+module.exports = WebSocketServer;
@@ -10,6 +10,15 @@ class Snes9xClient {
         this.frameCount = 0;
         this.lastFpsTime = Date.now();
         this.adminEnabled = false;
+
+        // Tile-delta video: the reconstructed frame and the sequence number
+        // of the last packet applied to it
+        this.frameImage = null;
+        this.lastVideoSeq = -1;
+        this.keyframePending = false;
+        this.inputSequence = 0;
+        // Palette-deflate video: frames waiting on DecompressionStream
+        this.paletteDecode = Promise.resolve();
         
         // Audio setup
         this.audioContext = null;
@@ -175,6 +184,8 @@ class Snes9xClient {
         this.videoWS.binaryType = 'arraybuffer';
         this.videoWS.onopen = () => {
             console.log('Video WebSocket connected');
+            // The server sends a keyframe to every new viewer
+            this.frameImage = null;
         };
         this.videoWS.onmessage = (event) => {
             this.handleVideoFrame(event.data);
@@ -198,8 +209,10 @@ class Snes9xClient {
         const protocol = window.location.protocol === 'https:' ? 'wss:' : 'ws:';
         const host = window.location.host;
 
-        // Connect audio WebSocket
-        this.audioWS = new WebSocket(`${protocol}//${host}/audio`);
+        // Connect audio WebSocket. The server resamples to the AudioContext
+        // rate and sends planar float, ready for copyToChannel()
+        const rendition = `rate=${this.audioSampleRate}&format=f32&channels=2`;
+        this.audioWS = new WebSocket(`${protocol}//${host}/audio?${rendition}`);
         this.audioWS.binaryType = 'arraybuffer';
         this.audioWS.onopen = () => {
             console.log('Audio WebSocket connected');
@@ -220,10 +233,20 @@ class Snes9xClient {
     }
 
     handleVideoFrame(data) {
+        if (data.byteLength < 1) {
+            return;
+        }
         const view = new DataView(data);
         const type = view.getUint8(0);
         
-        if (type === 0x01) { // Video frame
+        if (type === 0x03) { // Tile-delta frame
+            this.handleTileDeltaFrame(data, view);
+        } else if (type === 0x04) { // Palette + deflate frame
+            // Inflating is asynchronous; chain frames so they draw in order
+            this.paletteDecode = this.paletteDecode
+                .then(() => this.handlePaletteFrame(data, view))
+                .catch((error) => console.error('Palette frame decode error:', error));
+        } else if (type === 0x01) { // Video frame
             const width = view.getUint32(1, true);
             const height = view.getUint32(5, true);
             const rgb24Data = new Uint8Array(data, 9);
@@ -245,19 +268,159 @@ class Snes9xClient {
             }
             
             this.ctx.putImageData(imageData, 0, 0);
-            
-            // Update FPS
-            this.frameCount++;
-            const now = Date.now();
-            if (now - this.lastFpsTime >= 1000) {
-                document.getElementById('fps').textContent = this.frameCount;
-                this.frameCount = 0;
-                this.lastFpsTime = now;
+            this.frameDrawn(width, height);
+        }
+    }
+
+    // Packet layout is documented in src/tile_delta.h: an 18-byte header,
+    // the changed tile indices, then their pixels in index order
+    handleTileDeltaFrame(data, view) {
+        const keyframe = (view.getUint8(1) & 0x01) !== 0;
+        const tileSize = view.getUint8(2);
+        const bpp = view.getUint8(3);
+        const width = view.getUint16(4, true);
+        const height = view.getUint16(6, true);
+        const seq = view.getUint32(8, true);
+        const baseSeq = view.getUint32(12, true);
+        const count = view.getUint16(16, true);
+
+        if (!keyframe && (!this.frameImage || baseSeq !== this.lastVideoSeq)) {
+            // Missed a packet (or joined late): wait for a keyframe
+            this.requestKeyframe();
+            return;
+        }
+
+        if (keyframe) {
+            this.keyframePending = false;
+            if (!this.frameImage || this.frameImage.width !== width || this.frameImage.height !== height) {
+                this.frameImage = this.ctx.createImageData(width, height);
+            }
+            if (this.canvas.width !== width || this.canvas.height !== height) {
+                this.canvas.width = width;
+                this.canvas.height = height;
             }
-            
-            document.getElementById('width').textContent = width;
-            document.getElementById('height').textContent = height;
         }
+
+        const pixels = this.frameImage.data;
+        const bytes = new Uint8Array(data);
+        const tilesPerRow = Math.ceil(width / tileSize);
+        let offset = 18 + count * 2;
+        for (let i = 0; i < count; i++) {
+            const index = view.getUint16(18 + i * 2, true);
+            const x0 = (index % tilesPerRow) * tileSize;
+            const y0 = Math.floor(index / tilesPerRow) * tileSize;
+            const w = Math.min(tileSize, width - x0);
+            const h = Math.min(tileSize, height - y0);
+            for (let y = 0; y < h; y++) {
+                let dst = ((y0 + y) * width + x0) * 4;
+                for (let x = 0; x < w; x++) {
+                    if (bpp === 2) { // rgb565
+                        const pixel = bytes[offset] | (bytes[offset + 1] << 8);
+                        pixels[dst] = (pixel >> 11) << 3;
+                        pixels[dst + 1] = ((pixel >> 5) & 0x3F) << 2;
+                        pixels[dst + 2] = (pixel & 0x1F) << 3;
+                    } else { // rgb24 or rgba
+                        pixels[dst] = bytes[offset];
+                        pixels[dst + 1] = bytes[offset + 1];
+                        pixels[dst + 2] = bytes[offset + 2];
+                    }
+                    pixels[dst + 3] = 255;
+                    offset += bpp;
+                    dst += 4;
+                }
+            }
+        }
+
+        this.lastVideoSeq = seq;
+        this.ctx.putImageData(this.frameImage, 0, 0);
+        this.frameDrawn(width, height);
+    }
+
+    // Packet layout is documented in src/palette_codec.h: a 20-byte header,
+    // the palette, then a zlib stream of 8-bit indices (RGB565 when direct)
+    async handlePaletteFrame(data, view) {
+        const direct = (view.getUint8(1) & 0x01) !== 0;
+        const bpp = view.getUint8(2);
+        const width = view.getUint16(4, true);
+        const height = view.getUint16(6, true);
+        const paletteSize = view.getUint16(12, true);
+        const deflatedSize = view.getUint32(16, true);
+        const paletteOffset = 20;
+        const streamOffset = paletteOffset + (direct ? 0 : paletteSize * bpp);
+
+        const stream = new Blob([new Uint8Array(data, streamOffset, deflatedSize)])
+            .stream().pipeThrough(new DecompressionStream('deflate'));
+        const inflated = new Uint8Array(await new Response(stream).arrayBuffer());
+
+        if (!this.frameImage || this.frameImage.width !== width || this.frameImage.height !== height) {
+            this.frameImage = this.ctx.createImageData(width, height);
+        }
+        if (this.canvas.width !== width || this.canvas.height !== height) {
+            this.canvas.width = width;
+            this.canvas.height = height;
+        }
+
+        const pixels = this.frameImage.data;
+        const count = width * height;
+        if (direct) {
+            for (let i = 0; i < count; i++) {
+                const pixel = inflated[i * 2] | (inflated[i * 2 + 1] << 8);
+                pixels[i * 4] = (pixel >> 11) << 3;
+                pixels[i * 4 + 1] = ((pixel >> 5) & 0x3F) << 2;
+                pixels[i * 4 + 2] = (pixel & 0x1F) << 3;
+                pixels[i * 4 + 3] = 255;
+            }
+        } else {
+            // Expand the palette to RGBA once, then copy one word per pixel
+            const bytes = new Uint8Array(data);
+            const palette = new Uint32Array(paletteSize);
+            const entry = new Uint8Array(palette.buffer);
+            for (let i = 0; i < paletteSize; i++) {
+                const offset = paletteOffset + i * bpp;
+                if (bpp === 2) { // rgb565
+                    const pixel = bytes[offset] | (bytes[offset + 1] << 8);
+                    entry[i * 4] = (pixel >> 11) << 3;
+                    entry[i * 4 + 1] = ((pixel >> 5) & 0x3F) << 2;
+                    entry[i * 4 + 2] = (pixel & 0x1F) << 3;
+                } else { // rgb24 or rgba
+                    entry[i * 4] = bytes[offset];
+                    entry[i * 4 + 1] = bytes[offset + 1];
+                    entry[i * 4 + 2] = bytes[offset + 2];
+                }
+                entry[i * 4 + 3] = 255;
+            }
+            const words = new Uint32Array(pixels.buffer, pixels.byteOffset, count);
+            for (let i = 0; i < count; i++) {
+                words[i] = palette[inflated[i]];
+            }
+        }
+
+        this.ctx.putImageData(this.frameImage, 0, 0);
+        this.frameDrawn(width, height);
+    }
+
+    requestKeyframe() {
+        if (this.keyframePending) {
+            return;
+        }
+        this.keyframePending = true;
+        this.sendControl({ type: 'keyframe' });
+        // Ask again if the request or its answer got lost
+        setTimeout(() => { this.keyframePending = false; }, 1000);
+    }
+
+    frameDrawn(width, height) {
+        // Update FPS
+        this.frameCount++;
+        const now = Date.now();
+        if (now - this.lastFpsTime >= 1000) {
+            document.getElementById('fps').textContent = this.frameCount;
+            this.frameCount = 0;
+            this.lastFpsTime = now;
+        }
+        
+        document.getElementById('width').textContent = width;
+        document.getElementById('height').textContent = height;
     }
 
     handleAudioData(data) {
@@ -265,10 +428,15 @@ class Snes9xClient {
             return;
         }
 
+        if (data.byteLength < 12) {
+            return;
+        }
         const view = new DataView(data);
         const type = view.getUint8(0);
         
-        if (type === 0x02) { // Audio data
+        if (type === 0x05) { // Audio rendition, layout in src/audio_rendition.h
+            this.handleAudioRendition(data, view);
+        } else if (type === 0x02) { // Audio data
             // Parse audio message: [type(1)] [samples(4)] [audio_data(...)]
             const samples = view.getUint32(1, true); // Little-endian
             const audioDataOffset = 5; // 1 byte type + 4 bytes samples count
@@ -303,6 +471,33 @@ class Snes9xClient {
         }
     }
 
+    handleAudioRendition(data, view) {
+        const format = view.getUint8(1);
+        const channels = view.getUint8(2);
+        const sampleRate = view.getUint32(4, true);
+        const frames = view.getUint32(8, true);
+        const bytesPerSample = format === 1 ? 4 : 2;
+        if (frames === 0 || data.byteLength < 12 + frames * channels * bytesPerSample) {
+            return;
+        }
+
+        const audioBuffer = this.audioContext.createBuffer(channels, frames, sampleRate);
+        if (format === 1) { // f32 planar: the samples start 4-byte aligned
+            for (let channel = 0; channel < channels; channel++) {
+                audioBuffer.copyToChannel(new Float32Array(data, 12 + channel * frames * 4, frames), channel);
+            }
+        } else { // s16 interleaved
+            const samples = new Int16Array(data, 12, frames * channels);
+            for (let channel = 0; channel < channels; channel++) {
+                const output = audioBuffer.getChannelData(channel);
+                for (let i = 0; i < frames; i++) {
+                    output[i] = samples[i * channels + channel] / 32768.0;
+                }
+            }
+        }
+        this.queueAudioBuffer(audioBuffer);
+    }
+
     queueAudioBuffer(audioBuffer) {
         if (!this.audioContext || this.audioContext.state === 'closed') {
             return;
@@ -364,10 +559,14 @@ class Snes9xClient {
     }
 
     sendButtonState() {
+        // seq and timestamp let the server order input that races across
+        // transports and measure its latency
         this.sendControl({
             type: 'input',
             port: this.selectedPlayer,
-            buttons: { ...this.buttons }
+            buttons: { ...this.buttons },
+            seq: ++this.inputSequence,
+            timestamp: Date.now()
         });
     }
 
@@ -1,8 +1,185 @@
 #include <napi.h>
-#include "emulator_wrapper.h"
+#include "emulator_loader.h"
+#include "video_convert.h"
+#include "palette_codec.h"
+#include "audio_rendition.h"
+#include "frame_pool.h"
+#include "shared_memory.h"
+#include "env_pool.h"
+#include "checkpoint_chain.h"
+#include "rom_cache.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <memory>
 #include <vector>
+#include <cstring>
+
+// Number of preallocated video frame slots (triple buffering)
+static const int kVideoPoolSlots = 3;
+
+// Slots needed beyond the pending queue: one being written by the emulation
+// thread and one held by JS
+static const int kVideoPoolSpareSlots = 2;
+
+// Audio packet slots (20 packets of up to 50 ms at 48 kHz stereo s16)
+static const int kAudioPoolSlots = 20;
+static const size_t kMaxAudioPacketBytes = 48000 * 50 / 1000 * 2 * sizeof(int16_t);
+
+// Audio rendition packets: up to 50 ms of f32 stereo at the highest rate
+static const int kRenditionPoolSlots = FramePool::kMaxSlots;
+static const size_t kMaxRenditionPacketBytes = AudioRenditionStage::kHeaderBytes +
+    ((size_t)AudioRenditionStage::kMaxSampleRate * 50 / 1000 + 2) * 2 * sizeof(float);
+
+// Scratch slots for saveStateToBuffer(), sized to the loaded ROM's snapshot
+static const int kStatePoolSlots = 2;
+
+// Default rewind settings: 32 MB of deltas, a snapshot every other frame
+static const size_t kDefaultRewindBudget = 32 * 1024 * 1024;
+static const int kDefaultRewindInterval = 2;
+
+// Profiler trace cap: 24 bytes per segment, about 2000 segments per frame
+static const int64_t kMaxProfileTraceEvents = 16 * 1024 * 1024;
+
+// A pending state operation (savestate to/from a Buffer, rewind, run-ahead
+// setting, frame batch, profiler setting or trace, checkpoint). Runs on the
+// emulation thread at a frame boundary, then settles its promise on the JS
+// thread.
+struct StateRequest {
+    enum class Kind {
+        Save,
+        Load,
+        SetRewind,
+        Rewind,
+        RewindTo,
+        SetRunAhead,
+        RunFrames,
+        SetProfiling,
+        TakeProfileTrace,
+        Checkpoint,
+        RestoreCheckpoint
+    };
+
+    StateRequest(Napi::Env env, Kind kind)
+        : deferred(Napi::Promise::Deferred::New(env))
+        , kind(kind)
+        , slot(nullptr)
+        , data(nullptr)
+        , size(0)
+        , argument(0)
+        , interval(0)
+        , instance(nullptr)
+        , render(BatchRender::None)
+        , audio(false)
+        , enabled(false)
+        , checkpoints(nullptr)
+        , checkpoint(0)
+        , ok(false)
+        , result(0)
+    {
+    }
+
+    Napi::Promise::Deferred deferred;
+    Kind kind;
+    FramePool::Slot* slot;                          // pooled save destination
+    Napi::Reference<Napi::Buffer<uint8_t>> buffer;  // load source, or save destination without a free slot
+    uint8_t* data;
+    size_t size;
+    int64_t argument;   // frames, timestamp or rewind budget
+    int interval;
+    Emulator* instance; // run-ahead instance
+    BatchRender render;
+    bool audio;
+    BatchResult batch;
+    bool enabled;       // profiling
+    ProfileTrace trace;
+    CheckpointChain* checkpoints;
+    uint64_t checkpoint;
+    CheckpointChain::Stats checkpoint_stats;    // right after the checkpoint was added
+    bool ok;
+    int result;         // frames rewound
+};
+
+static const char* videoEncodingName(VideoEncoding encoding) {
+    switch (encoding) {
+        case VideoEncoding::TileDelta:      return "tile-delta";
+        case VideoEncoding::PaletteDeflate: return "palette-deflate";
+        default:                            return "raw";
+    }
+}
+
+static const char* kInputSourceNames[kInputSourceCount] = { "local", "websocket", "rabbitmq" };
+
+// Optional { source, sequence, timestamp } sent along with an input event
+static InputStamp parseInputStamp(const Napi::CallbackInfo& info, size_t index) {
+    InputStamp stamp;
+    if (info.Length() <= index || !info[index].IsObject()) {
+        return stamp;
+    }
+    
+    Napi::Object meta = info[index].As<Napi::Object>();
+    if (meta.Has("source") && meta.Get("source").IsString()) {
+        std::string name = meta.Get("source").As<Napi::String>().Utf8Value();
+        for (int i = 0; i < kInputSourceCount; i++) {
+            if (name == kInputSourceNames[i]) {
+                stamp.source = static_cast<InputSource>(i);
+            }
+        }
+    }
+    if (meta.Has("sequence") && meta.Get("sequence").IsNumber()) {
+        stamp.sequence = meta.Get("sequence").As<Napi::Number>().Uint32Value();
+    }
+    if (meta.Has("timestamp") && meta.Get("timestamp").IsNumber()) {
+        stamp.client_time_ms = meta.Get("timestamp").As<Napi::Number>().DoubleValue();
+    }
+    return stamp;
+}
+
+static void FinalizeSlot(napi_env env, void* data, void* hint) {
+    FramePool::finalize(static_cast<uint8_t*>(data), static_cast<uint32_t>(reinterpret_cast<uintptr_t>(hint)));
+}
+
+// Identifies the slot generation a Buffer was made for, so releasing a
+// Buffer whose slot was already released and reused is a no-op
+static napi_type_tag SlotTag(const FramePool::Slot* slot, uint32_t generation) {
+    napi_type_tag tag;
+    tag.lower = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(slot->pool));
+    tag.upper = (static_cast<uint64_t>(slot->index) << 32) | generation;
+    return tag;
+}
+
+// External Buffer over size bytes of a pool slot; it holds a pool reference
+// until it is collected. Null on failure, the slot is then still the caller's.
+static napi_value NewSlotBuffer(napi_env env, FramePool::Slot* slot, size_t size) {
+    uint32_t generation = slot->pool->retain(slot);
+    napi_value value;
+    napi_status status = napi_create_external_buffer(env, size, slot->data, FinalizeSlot,
+                                                     reinterpret_cast<void*>(static_cast<uintptr_t>(generation)), &value);
+    if (status != napi_ok) {
+        slot->pool->unref();
+        return nullptr;
+    }
+    napi_type_tag tag = SlotTag(slot, generation);
+    napi_type_tag_object(env, value, &tag);
+    return value;
+}
+
+// Explicit release of a Buffer from NewSlotBuffer(): returns its slot to the
+// pool unless that already happened. The storage stays valid for the Buffer.
+static bool ReleaseSlotBuffer(napi_env env, FramePool* pool, const Napi::Buffer<uint8_t>& buffer) {
+    FramePool::Slot* slot = pool ? pool->slotFromData(buffer.Data()) : nullptr;
+    if (!slot) {
+        return false;
+    }
+    uint32_t generation = slot->generation.load();
+    napi_type_tag tag = SlotTag(slot, generation);
+    bool current = false;
+    if (napi_check_object_type_tag(env, buffer, &tag, &current) != napi_ok || !current) {
+        return false;
+    }
+    return pool->release(slot, generation);
+}
 
 class Snes9xAddon : public Napi::ObjectWrap<Snes9xAddon> {
 public:
@@ -12,11 +189,79 @@ public:
 
 private:
     static Napi::FunctionReference constructor;
-    EmulatorWrapper* emulator;
+    Emulator* emulator;
+
+    // Second instance for run-ahead, created on first use. It mirrors every
+    // ROM load, so the last ROM is kept for when it is created later.
+    Emulator* ahead_emulator;
+    std::string rom_path;
+    std::vector<uint8_t> rom_image;
+    std::string rom_name;
+    bool loadAheadROM(Emulator* target);
     
+    // Video frames are delivered from pool slots without an extra copy.
+    // The emulation thread queues filled slots in the pool (bounded, with
+    // drop-oldest or coalesce-to-latest overflow) and rings the typed TSFN
+    // only when no wake-up is outstanding, so the TSFN queue never grows
+    // past one entry and queueing a frame does not allocate.
+    static void CallVideoCallback(Napi::Env env, Napi::Function jsCallback, std::nullptr_t* context, FramePool* pool);
+    using VideoTSFN = Napi::TypedThreadSafeFunction<std::nullptr_t, FramePool, CallVideoCallback>;
+    FramePool* video_pool;
+
+    // Audio packets use the same slot pool with the no-drop policy: when JS
+    // falls behind the packets stay in the wrapper's audio ring instead
+    static void CallAudioCallback(Napi::Env env, Napi::Function jsCallback, std::nullptr_t* context, FramePool* pool);
+    using AudioTSFN = Napi::TypedThreadSafeFunction<std::nullptr_t, FramePool, CallAudioCallback>;
+    FramePool* audio_pool;
+
+    // Per-client renditions (rate, format, channels) of the mixed stream are
+    // made on the audio packet thread and delivered like packets, through
+    // their own pool so a slow rendition consumer never defers the mix
+    AudioRenditionStage audio_renditions;
+    FramePool* rendition_pool;
+
     // Thread-safe callbacks (using pointers to allow null check)
-    Napi::ThreadSafeFunction* video_tsfn;
-    Napi::ThreadSafeFunction* audio_tsfn;
+    VideoTSFN* video_tsfn;
+    AudioTSFN* audio_tsfn;
+    AudioTSFN* rendition_tsfn;
+
+    // In-memory savestates are applied at a frame boundary and settle their
+    // promise through this (unreferenced) TSFN. Saves are written straight
+    // into pool slots that JS receives as external Buffers.
+    static void CallStateCallback(Napi::Env env, Napi::Function jsCallback, std::nullptr_t* context, StateRequest* request);
+    using StateTSFN = Napi::TypedThreadSafeFunction<std::nullptr_t, StateRequest, CallStateCallback>;
+    StateTSFN* state_tsfn;
+    FramePool* state_pool;
+    Napi::Value queueStateRequest(Napi::Env env, StateRequest* request, bool from_batch_thread = false);
+
+    // runFrames() batches are handed to the emulator from this thread, so a
+    // batch run while the emulation thread is stopped does not block JS.
+    // Started with the first batch, it waits for the next one until the
+    // addon goes away; batch_busy keeps it to one batch at a time.
+    void batchLoop();
+    std::thread batch_thread;
+    std::mutex batch_mutex;
+    std::condition_variable batch_cv;
+    std::function<void()> batch_task;
+    bool batch_stop;
+    std::atomic<bool> batch_busy;
+
+    // Supervisor mode (worker process side): frames and packets go straight
+    // into the front-end's shared rings, and a savestate is written to
+    // shared memory every snapshot_interval frames for crash recovery
+    SharedRing* shared_video;
+    SharedRing* shared_audio;
+    SharedSnapshot* shared_snapshot;
+    int snapshot_interval;
+    uint64_t snapshot_frames;
+
+    // Incremental checkpoints (dirty 4 KB blocks of the snapshot), added at
+    // frame boundaries; started over on every ROM load
+    CheckpointChain checkpoints;
+
+    // encodePaletteFrame()'s codec; kept across calls for its colour table
+    // and zlib state, and per instance since it is not thread-safe
+    PaletteCodec palette_encoder;
 
     // Methods
     Napi::Value Init(const Napi::CallbackInfo& info);
@@ -33,9 +278,39 @@ private:
     Napi::Value LoadState(const Napi::CallbackInfo& info);
     Napi::Value SaveStateToFile(const Napi::CallbackInfo& info);
     Napi::Value LoadStateFromFile(const Napi::CallbackInfo& info);
+    Napi::Value GetStateSize(const Napi::CallbackInfo& info);
+    Napi::Value SaveStateToBuffer(const Napi::CallbackInfo& info);
+    Napi::Value LoadStateFromBuffer(const Napi::CallbackInfo& info);
+    Napi::Value ReleaseStateBuffer(const Napi::CallbackInfo& info);
+    Napi::Value SetRewind(const Napi::CallbackInfo& info);
+    Napi::Value Rewind(const Napi::CallbackInfo& info);
+    Napi::Value RewindTo(const Napi::CallbackInfo& info);
+    Napi::Value GetRewindStats(const Napi::CallbackInfo& info);
+    Napi::Value SetRunAhead(const Napi::CallbackInfo& info);
+    Napi::Value GetRunAheadStats(const Napi::CallbackInfo& info);
+    Napi::Value RunFrames(const Napi::CallbackInfo& info);
+    Napi::Value SetProfiling(const Napi::CallbackInfo& info);
+    Napi::Value GetProfileStats(const Napi::CallbackInfo& info);
+    Napi::Value ResetProfileStats(const Napi::CallbackInfo& info);
+    Napi::Value GetProfileTrace(const Napi::CallbackInfo& info);
+    Napi::Value SetThreadedDispatch(const Napi::CallbackInfo& info);
+    Napi::Value SetSkipIdleLoops(const Napi::CallbackInfo& info);
+    Napi::Value SetRenderThread(const Napi::CallbackInfo& info);
+    Napi::Value GetRenderThreadStats(const Napi::CallbackInfo& info);
+    Napi::Value GetCPUStats(const Napi::CallbackInfo& info);
+    Napi::Value Checkpoint(const Napi::CallbackInfo& info);
+    Napi::Value RestoreCheckpoint(const Napi::CallbackInfo& info);
+    Napi::Value EncodeCheckpoint(const Napi::CallbackInfo& info);
+    Napi::Value SetCheckpoints(const Napi::CallbackInfo& info);
+    Napi::Value CompactCheckpoints(const Napi::CallbackInfo& info);
+    Napi::Value ResetCheckpoints(const Napi::CallbackInfo& info);
+    Napi::Value GetCheckpointStats(const Napi::CallbackInfo& info);
+    static Napi::Value ApplyStateDelta(const Napi::CallbackInfo& info);
     Napi::Value SetButtonState(const Napi::CallbackInfo& info);
     Napi::Value SetMousePosition(const Napi::CallbackInfo& info);
     Napi::Value SetMouseButtons(const Napi::CallbackInfo& info);
+    Napi::Value GetInputStats(const Napi::CallbackInfo& info);
+    Napi::Value ResetInputStats(const Napi::CallbackInfo& info);
     Napi::Value GetFrameWidth(const Napi::CallbackInfo& info);
     Napi::Value GetFrameHeight(const Napi::CallbackInfo& info);
     Napi::Value GetFrameRate(const Napi::CallbackInfo& info);
@@ -43,6 +318,36 @@ private:
     Napi::Value StopEmulationThread(const Napi::CallbackInfo& info);
     Napi::Value SetVideoCallback(const Napi::CallbackInfo& info);
     Napi::Value SetAudioCallback(const Napi::CallbackInfo& info);
+    Napi::Value SetVideoFormat(const Napi::CallbackInfo& info);
+    Napi::Value GetVideoFormat(const Napi::CallbackInfo& info);
+    Napi::Value SetVideoEncoding(const Napi::CallbackInfo& info);
+    Napi::Value RequestKeyframe(const Napi::CallbackInfo& info);
+    Napi::Value GetVideoEncoderStats(const Napi::CallbackInfo& info);
+    Napi::Value ReleaseVideoFrame(const Napi::CallbackInfo& info);
+    Napi::Value GetVideoPoolStats(const Napi::CallbackInfo& info);
+    Napi::Value SetDeliveryPolicy(const Napi::CallbackInfo& info);
+    Napi::Value GetDeliveryStats(const Napi::CallbackInfo& info);
+    Napi::Value SetAudioPacketDuration(const Napi::CallbackInfo& info);
+    Napi::Value GetAudioStats(const Napi::CallbackInfo& info);
+    Napi::Value AddAudioRendition(const Napi::CallbackInfo& info);
+    Napi::Value RemoveAudioRendition(const Napi::CallbackInfo& info);
+    Napi::Value GetAudioRenditionStats(const Napi::CallbackInfo& info);
+    Napi::Value SetPacing(const Napi::CallbackInfo& info);
+    Napi::Value GetPacerStats(const Napi::CallbackInfo& info);
+    Napi::Value ResetPacerStats(const Napi::CallbackInfo& info);
+    Napi::Value AttachSharedOutput(const Napi::CallbackInfo& info);
+    Napi::Value EnableSharedSnapshots(const Napi::CallbackInfo& info);
+    Napi::Value RestoreSharedSnapshot(const Napi::CallbackInfo& info);
+    Napi::Value EncodePaletteFrame(const Napi::CallbackInfo& info);
+
+    // Static helpers
+    static Napi::Value ConvertFrame(const Napi::CallbackInfo& info);
+    static Napi::Value GetVideoKernel(const Napi::CallbackInfo& info);
+    static Napi::Value GetInstanceCount(const Napi::CallbackInfo& info);
+    static Napi::Value SetCpuAffinity(const Napi::CallbackInfo& info);
+    static Napi::Value SetRomCache(const Napi::CallbackInfo& info);
+    static Napi::Value GetRomCacheStats(const Napi::CallbackInfo& info);
+    static Napi::Value ClearRomCache(const Napi::CallbackInfo& info);
 };
 
 Napi::FunctionReference Snes9xAddon::constructor;
@@ -63,9 +368,38 @@ Napi::Object Snes9xAddon::Init(Napi::Env env, Napi::Object exports) {
         InstanceMethod("loadState", &Snes9xAddon::LoadState),
         InstanceMethod("saveStateToFile", &Snes9xAddon::SaveStateToFile),
         InstanceMethod("loadStateFromFile", &Snes9xAddon::LoadStateFromFile),
+        InstanceMethod("getStateSize", &Snes9xAddon::GetStateSize),
+        InstanceMethod("saveStateToBuffer", &Snes9xAddon::SaveStateToBuffer),
+        InstanceMethod("loadStateFromBuffer", &Snes9xAddon::LoadStateFromBuffer),
+        InstanceMethod("releaseStateBuffer", &Snes9xAddon::ReleaseStateBuffer),
+        InstanceMethod("setRewind", &Snes9xAddon::SetRewind),
+        InstanceMethod("rewind", &Snes9xAddon::Rewind),
+        InstanceMethod("rewindTo", &Snes9xAddon::RewindTo),
+        InstanceMethod("getRewindStats", &Snes9xAddon::GetRewindStats),
+        InstanceMethod("setRunAhead", &Snes9xAddon::SetRunAhead),
+        InstanceMethod("getRunAheadStats", &Snes9xAddon::GetRunAheadStats),
+        InstanceMethod("runFrames", &Snes9xAddon::RunFrames),
+        InstanceMethod("setProfiling", &Snes9xAddon::SetProfiling),
+        InstanceMethod("getProfileStats", &Snes9xAddon::GetProfileStats),
+        InstanceMethod("resetProfileStats", &Snes9xAddon::ResetProfileStats),
+        InstanceMethod("getProfileTrace", &Snes9xAddon::GetProfileTrace),
+        InstanceMethod("setThreadedDispatch", &Snes9xAddon::SetThreadedDispatch),
+        InstanceMethod("setSkipIdleLoops", &Snes9xAddon::SetSkipIdleLoops),
+        InstanceMethod("getCPUStats", &Snes9xAddon::GetCPUStats),
+        InstanceMethod("setRenderThread", &Snes9xAddon::SetRenderThread),
+        InstanceMethod("getRenderThreadStats", &Snes9xAddon::GetRenderThreadStats),
+        InstanceMethod("checkpoint", &Snes9xAddon::Checkpoint),
+        InstanceMethod("restoreCheckpoint", &Snes9xAddon::RestoreCheckpoint),
+        InstanceMethod("encodeCheckpoint", &Snes9xAddon::EncodeCheckpoint),
+        InstanceMethod("setCheckpoints", &Snes9xAddon::SetCheckpoints),
+        InstanceMethod("compactCheckpoints", &Snes9xAddon::CompactCheckpoints),
+        InstanceMethod("resetCheckpoints", &Snes9xAddon::ResetCheckpoints),
+        InstanceMethod("getCheckpointStats", &Snes9xAddon::GetCheckpointStats),
         InstanceMethod("setButtonState", &Snes9xAddon::SetButtonState),
         InstanceMethod("setMousePosition", &Snes9xAddon::SetMousePosition),
         InstanceMethod("setMouseButtons", &Snes9xAddon::SetMouseButtons),
+        InstanceMethod("getInputStats", &Snes9xAddon::GetInputStats),
+        InstanceMethod("resetInputStats", &Snes9xAddon::ResetInputStats),
         InstanceMethod("getFrameWidth", &Snes9xAddon::GetFrameWidth),
         InstanceMethod("getFrameHeight", &Snes9xAddon::GetFrameHeight),
         InstanceMethod("getFrameRate", &Snes9xAddon::GetFrameRate),
@@ -73,6 +407,35 @@ Napi::Object Snes9xAddon::Init(Napi::Env env, Napi::Object exports) {
         InstanceMethod("stopEmulationThread", &Snes9xAddon::StopEmulationThread),
         InstanceMethod("setVideoCallback", &Snes9xAddon::SetVideoCallback),
         InstanceMethod("setAudioCallback", &Snes9xAddon::SetAudioCallback),
+        InstanceMethod("setVideoFormat", &Snes9xAddon::SetVideoFormat),
+        InstanceMethod("getVideoFormat", &Snes9xAddon::GetVideoFormat),
+        InstanceMethod("setVideoEncoding", &Snes9xAddon::SetVideoEncoding),
+        InstanceMethod("requestKeyframe", &Snes9xAddon::RequestKeyframe),
+        InstanceMethod("getVideoEncoderStats", &Snes9xAddon::GetVideoEncoderStats),
+        InstanceMethod("releaseVideoFrame", &Snes9xAddon::ReleaseVideoFrame),
+        InstanceMethod("getVideoPoolStats", &Snes9xAddon::GetVideoPoolStats),
+        InstanceMethod("setDeliveryPolicy", &Snes9xAddon::SetDeliveryPolicy),
+        InstanceMethod("getDeliveryStats", &Snes9xAddon::GetDeliveryStats),
+        InstanceMethod("setAudioPacketDuration", &Snes9xAddon::SetAudioPacketDuration),
+        InstanceMethod("getAudioStats", &Snes9xAddon::GetAudioStats),
+        InstanceMethod("addAudioRendition", &Snes9xAddon::AddAudioRendition),
+        InstanceMethod("removeAudioRendition", &Snes9xAddon::RemoveAudioRendition),
+        InstanceMethod("getAudioRenditionStats", &Snes9xAddon::GetAudioRenditionStats),
+        InstanceMethod("setPacing", &Snes9xAddon::SetPacing),
+        InstanceMethod("getPacerStats", &Snes9xAddon::GetPacerStats),
+        InstanceMethod("resetPacerStats", &Snes9xAddon::ResetPacerStats),
+        InstanceMethod("attachSharedOutput", &Snes9xAddon::AttachSharedOutput),
+        InstanceMethod("enableSharedSnapshots", &Snes9xAddon::EnableSharedSnapshots),
+        InstanceMethod("restoreSharedSnapshot", &Snes9xAddon::RestoreSharedSnapshot),
+        InstanceMethod("encodePaletteFrame", &Snes9xAddon::EncodePaletteFrame),
+        StaticMethod("convertFrame", &Snes9xAddon::ConvertFrame),
+        StaticMethod("applyStateDelta", &Snes9xAddon::ApplyStateDelta),
+        StaticMethod("getVideoKernel", &Snes9xAddon::GetVideoKernel),
+        StaticMethod("getInstanceCount", &Snes9xAddon::GetInstanceCount),
+        StaticMethod("setCpuAffinity", &Snes9xAddon::SetCpuAffinity),
+        StaticMethod("setRomCache", &Snes9xAddon::SetRomCache),
+        StaticMethod("getRomCacheStats", &Snes9xAddon::GetRomCacheStats),
+        StaticMethod("clearRomCache", &Snes9xAddon::ClearRomCache),
     });
 
     constructor = Napi::Persistent(func);
@@ -83,13 +446,54 @@ Napi::Object Snes9xAddon::Init(Napi::Env env, Napi::Object exports) {
 
 Snes9xAddon::Snes9xAddon(const Napi::CallbackInfo& info) 
     : Napi::ObjectWrap<Snes9xAddon>(info)
-    , emulator(new EmulatorWrapper())
+    , emulator(nullptr)
+    , ahead_emulator(nullptr)
+    , video_pool(FramePool::create(kVideoPoolSlots))
+    , audio_pool(FramePool::create(kAudioPoolSlots, kMaxAudioPacketBytes))
+    , rendition_pool(FramePool::create(kRenditionPoolSlots, kMaxRenditionPacketBytes))
     , video_tsfn(nullptr)
     , audio_tsfn(nullptr)
+    , rendition_tsfn(nullptr)
+    , state_tsfn(nullptr)
+    , state_pool(nullptr)
+    , batch_stop(false)
+    , batch_busy(false)
+    , shared_video(nullptr)
+    , shared_audio(nullptr)
+    , shared_snapshot(nullptr)
+    , snapshot_interval(0)
+    , snapshot_frames(0)
 {
+    // Every addon object gets its own copy of the core, so several
+    // instances can run concurrently in one process
+    std::string error;
+    emulator = createEmulator(error);
+    if (!emulator) {
+        Napi::Error::New(info.Env(), error).ThrowAsJavaScriptException();
+        return;
+    }
+
+    // Unreferenced: a pending savestate must not keep the process alive
+    state_tsfn = new StateTSFN(StateTSFN::New(info.Env(), "StateCallback", 0, 1));
+    state_tsfn->Unref(info.Env());
 }
 
 Snes9xAddon::~Snes9xAddon() {
+    // A batch in progress settles before the thread-safe functions go away
+    if (batch_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex);
+            batch_stop = true;
+        }
+        batch_cv.notify_one();
+        batch_thread.join();
+    }
+
+    // Stop producing frames before the thread-safe functions go away
+    if (emulator) {
+        emulator->stopEmulationThread();
+    }
+
     // Release thread-safe functions if they were initialized
     if (video_tsfn) {
         video_tsfn->Release();
@@ -101,10 +505,56 @@ Snes9xAddon::~Snes9xAddon() {
         delete audio_tsfn;
         audio_tsfn = nullptr;
     }
+    if (rendition_tsfn) {
+        rendition_tsfn->Release();
+        delete rendition_tsfn;
+        rendition_tsfn = nullptr;
+    }
+    if (state_tsfn) {
+        state_tsfn->Release();
+        delete state_tsfn;
+        state_tsfn = nullptr;
+    }
     
+    // The primary first: deinit stops its run-ahead thread
     if (emulator) {
         emulator->deinit();
-        delete emulator;
+        destroyEmulator(emulator);
+    }
+    if (ahead_emulator) {
+        ahead_emulator->deinit();
+        destroyEmulator(ahead_emulator);
+    }
+
+    // Slots still held by JS keep the pool alive until their Buffers are released
+    if (video_pool) {
+        video_pool->destroy();
+        video_pool = nullptr;
+    }
+    if (audio_pool) {
+        audio_pool->destroy();
+        audio_pool = nullptr;
+    }
+    if (rendition_pool) {
+        rendition_pool->destroy();
+        rendition_pool = nullptr;
+    }
+    if (state_pool) {
+        state_pool->destroy();
+        state_pool = nullptr;
+    }
+
+    if (shared_video) {
+        shared_video->destroy();
+        shared_video = nullptr;
+    }
+    if (shared_audio) {
+        shared_audio->destroy();
+        shared_audio = nullptr;
+    }
+    if (shared_snapshot) {
+        shared_snapshot->destroy();
+        shared_snapshot = nullptr;
     }
 }
 
@@ -128,7 +578,14 @@ Napi::Value Snes9xAddon::LoadROM(const Napi::CallbackInfo& info) {
     }
     
     std::string filename = info[0].As<Napi::String>().Utf8Value();
-    bool result = emulator->loadROM(filename);
+    bool result = RomCache::instance().loadROM(emulator, filename);
+    if (result) {
+        rom_path = filename;
+        rom_image.clear();
+        rom_name.clear();
+        if (ahead_emulator) loadAheadROM(ahead_emulator);
+        checkpoints.reset();
+    }
     return Napi::Boolean::New(env, result);
 }
 
@@ -145,7 +602,14 @@ Napi::Value Snes9xAddon::LoadROMMem(const Napi::CallbackInfo& info) {
         ? info[1].As<Napi::String>().Utf8Value() 
         : "";
     
-    bool result = emulator->loadROMMem(buffer.Data(), buffer.Length(), name);
+    bool result = RomCache::instance().loadROMMem(emulator, buffer.Data(), buffer.Length(), name);
+    if (result) {
+        rom_path.clear();
+        rom_image.assign(buffer.Data(), buffer.Data() + buffer.Length());
+        rom_name = name;
+        if (ahead_emulator) loadAheadROM(ahead_emulator);
+        checkpoints.reset();
+    }
     return Napi::Boolean::New(env, result);
 }
 
@@ -239,175 +703,2522 @@ Napi::Value Snes9xAddon::LoadStateFromFile(const Napi::CallbackInfo& info) {
     return Napi::Boolean::New(env, result);
 }
 
-Napi::Value Snes9xAddon::SetButtonState(const Napi::CallbackInfo& info) {
+Napi::Value Snes9xAddon::GetStateSize(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), static_cast<double>(emulator->getStateSize()));
+}
+
+Napi::Value Snes9xAddon::queueStateRequest(Napi::Env env, StateRequest* request, bool from_batch_thread) {
+    Napi::Promise promise = request->deferred.Promise();
+    Emulator* target = emulator;
+    StateTSFN* tsfn = state_tsfn;
+    
+    // Always settles through the TSFN, so the promise resolves
+    // asynchronously whether or not the emulation thread is running
+    std::function<void()> task = [target, tsfn, request]() {
+        switch (request->kind) {
+        case StateRequest::Kind::Save:
+            request->ok = target->saveStateToMemory(request->data, request->size);
+            break;
+        case StateRequest::Kind::Load:
+            request->ok = target->loadStateFromMemory(request->data, request->size);
+            break;
+        case StateRequest::Kind::SetRewind:
+            request->ok = target->setRewind((size_t)request->argument, request->interval);
+            break;
+        case StateRequest::Kind::Rewind:
+            request->result = target->rewindFrames((int)request->argument);
+            break;
+        case StateRequest::Kind::RewindTo:
+            request->result = target->rewindToTime(request->argument);
+            break;
+        case StateRequest::Kind::SetRunAhead:
+            request->ok = target->setRunAhead((int)request->argument, request->instance);
+            break;
+        case StateRequest::Kind::RunFrames:
+            request->batch = target->runFrames((int)request->argument, request->render, request->audio);
+            break;
+        case StateRequest::Kind::SetProfiling:
+            request->ok = target->setProfiling(request->enabled, (size_t)request->argument);
+            break;
+        case StateRequest::Kind::TakeProfileTrace:
+            target->takeProfileTrace(request->trace);
+            break;
+        case StateRequest::Kind::Checkpoint: {
+            size_t size = target->getStateSize();
+            request->ok = size && target->saveStateToMemory(request->checkpoints->beginAdd(size), size);
+            if (request->ok) {
+                request->checkpoint = request->checkpoints->commitAdd();
+                request->checkpoint_stats = request->checkpoints->getStats();
+            }
+            break;
+        }
+        case StateRequest::Kind::RestoreCheckpoint: {
+            std::vector<uint8_t> state;
+            request->ok = request->checkpoints->restore(request->checkpoint, state) &&
+                          target->loadStateFromMemory(state.data(), state.size());
+            break;
+        }
+        }
+        tsfn->NonBlockingCall(request);
+    };
+
+    if (!from_batch_thread) {
+        emulator->runAtFrameBoundary(task);
+        return promise;
+    }
+
+    // With the emulation thread stopped the task runs on the batch thread;
+    // otherwise it is only queued from there
+    batch_busy = true;
+    {
+        std::lock_guard<std::mutex> lock(batch_mutex);
+        batch_task = [target, task]() { target->runAtFrameBoundary(task); };
+        if (!batch_thread.joinable()) {
+            batch_thread = std::thread(&Snes9xAddon::batchLoop, this);
+        }
+    }
+    batch_cv.notify_one();
+    return promise;
+}
+
+void Snes9xAddon::batchLoop() {
+    std::unique_lock<std::mutex> lock(batch_mutex);
+    for (;;) {
+        batch_cv.wait(lock, [this] { return batch_stop || batch_task; });
+        if (!batch_task) {
+            break;
+        }
+        std::function<void()> task = std::move(batch_task);
+        batch_task = nullptr;
+        lock.unlock();
+        task();
+        batch_busy = false;
+        lock.lock();
+    }
+}
+
+// saveStateToBuffer() -> Promise<Buffer | null>
+// Snapshot taken at the next frame boundary, written straight into a pooled
+// scratch slot. The Buffer stays valid until it is collected or handed to
+// releaseStateBuffer(); null when no ROM is loaded.
+Napi::Value Snes9xAddon::SaveStateToBuffer(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
+    StateRequest* request = new StateRequest(env, StateRequest::Kind::Save);
+    request->size = emulator->getStateSize();
     
-    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
-        Napi::TypeError::New(env, "Number, Number expected").ThrowAsJavaScriptException();
+    if (request->size == 0) {
+        Napi::Promise promise = request->deferred.Promise();
+        request->deferred.Resolve(env.Null());
+        delete request;
+        return promise;
+    }
+    
+    // Sized per ROM; Buffers still pointing into a replaced pool keep it alive
+    if (!state_pool || state_pool->slotSize() < request->size) {
+        if (state_pool) state_pool->destroy();
+        state_pool = FramePool::create(kStatePoolSlots, request->size);
+    }
+    
+    request->slot = state_pool ? state_pool->acquire(request->size) : nullptr;
+    if (request->slot) {
+        request->data = request->slot->data;
+    } else {
+        // Every scratch slot is still held by JS
+        Napi::Buffer<uint8_t> buffer = Napi::Buffer<uint8_t>::New(env, request->size);
+        request->buffer = Napi::Persistent(buffer);
+        request->data = buffer.Data();
+    }
+    return queueStateRequest(env, request);
+}
+
+// loadStateFromBuffer(buffer) -> Promise<Boolean>
+// Applied at the next frame boundary; the buffer must not be modified until
+// the promise settles.
+Napi::Value Snes9xAddon::LoadStateFromBuffer(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "Buffer expected").ThrowAsJavaScriptException();
         return env.Null();
     }
     
-    int port = info[0].As<Napi::Number>().Int32Value();
-    uint16_t buttons = info[1].As<Napi::Number>().Uint32Value();
-    emulator->setButtonState(port, buttons);
-    return env.Undefined();
+    Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    StateRequest* request = new StateRequest(env, StateRequest::Kind::Load);
+    request->buffer = Napi::Persistent(buffer);
+    request->data = buffer.Data();
+    request->size = buffer.Length();
+    return queueStateRequest(env, request);
 }
 
-Napi::Value Snes9xAddon::SetMousePosition(const Napi::CallbackInfo& info) {
+// Return a saveStateToBuffer() slot without waiting for GC. The Buffer must
+// not be used afterwards.
+Napi::Value Snes9xAddon::ReleaseStateBuffer(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
-    if (info.Length() < 3 || !info[0].IsNumber() || !info[1].IsNumber() || !info[2].IsNumber()) {
-        Napi::TypeError::New(env, "Number, Number, Number expected").ThrowAsJavaScriptException();
+    if (info.Length() < 1 || !info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "Buffer expected").ThrowAsJavaScriptException();
         return env.Null();
     }
     
-    int port = info[0].As<Napi::Number>().Int32Value();
-    int16_t x = info[1].As<Napi::Number>().Int32Value();
-    int16_t y = info[2].As<Napi::Number>().Int32Value();
-    emulator->setMousePosition(port, x, y);
-    return env.Undefined();
+    Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    bool released = ReleaseSlotBuffer(env, state_pool, buffer);
+    return Napi::Boolean::New(env, released);
 }
 
-Napi::Value Snes9xAddon::SetMouseButtons(const Napi::CallbackInfo& info) {
+// setRewind({ budgetBytes, intervalFrames }) -> Promise<Boolean>
+// Keeps a snapshot every intervalFrames frames as XOR deltas in a ring of
+// budgetBytes; a budget of 0 disables rewind and frees the ring. Settings made
+// before a ROM is loaded take effect when it loads.
+Napi::Value Snes9xAddon::SetRewind(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
-    if (info.Length() < 3 || !info[0].IsNumber() || !info[1].IsBoolean() || !info[2].IsBoolean()) {
-        Napi::TypeError::New(env, "Number, Boolean, Boolean expected").ThrowAsJavaScriptException();
+    double budget = static_cast<double>(kDefaultRewindBudget);
+    int interval = kDefaultRewindInterval;
+    if (info.Length() > 0 && !info[0].IsUndefined()) {
+        if (!info[0].IsObject()) {
+            Napi::TypeError::New(env, "Options object expected").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        Napi::Object options = info[0].As<Napi::Object>();
+        if (options.Has("budgetBytes")) {
+            budget = options.Get("budgetBytes").ToNumber().DoubleValue();
+        }
+        if (options.Has("intervalFrames")) {
+            interval = options.Get("intervalFrames").ToNumber().Int32Value();
+        }
+    }
+    
+    if (!(budget >= 0) || interval < 1) {
+        Napi::RangeError::New(env, "budgetBytes must be >= 0 and intervalFrames >= 1").ThrowAsJavaScriptException();
         return env.Null();
     }
     
-    int port = info[0].As<Napi::Number>().Int32Value();
-    bool left = info[1].As<Napi::Boolean>().Value();
-    bool right = info[2].As<Napi::Boolean>().Value();
-    emulator->setMouseButtons(port, left, right);
-    return env.Undefined();
+    StateRequest* request = new StateRequest(env, StateRequest::Kind::SetRewind);
+    request->argument = static_cast<int64_t>(budget);
+    request->interval = interval;
+    return queueStateRequest(env, request);
 }
 
-Napi::Value Snes9xAddon::GetFrameWidth(const Napi::CallbackInfo& info) {
+// rewind(frames) -> Promise<Number>
+// Steps back to the newest snapshot at least frames old (or the oldest one
+// kept) and resolves with the number of frames actually rewound.
+Napi::Value Snes9xAddon::Rewind(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
-    return Napi::Number::New(env, emulator->getFrameWidth());
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    StateRequest* request = new StateRequest(env, StateRequest::Kind::Rewind);
+    request->argument = info[0].As<Napi::Number>().Int32Value();
+    return queueStateRequest(env, request);
 }
 
-Napi::Value Snes9xAddon::GetFrameHeight(const Napi::CallbackInfo& info) {
+// rewindTo(timestampMs) -> Promise<Number>
+// As rewind(), to the newest snapshot taken at or before a Date.now() time.
+Napi::Value Snes9xAddon::RewindTo(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
-    return Napi::Number::New(env, emulator->getFrameHeight());
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    StateRequest* request = new StateRequest(env, StateRequest::Kind::RewindTo);
+    request->argument = info[0].As<Napi::Number>().Int64Value();
+    return queueStateRequest(env, request);
 }
 
-Napi::Value Snes9xAddon::GetFrameRate(const Napi::CallbackInfo& info) {
+Napi::Value Snes9xAddon::GetRewindStats(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
-    return Napi::Number::New(env, emulator->getFrameRate());
+    RewindStats stats = emulator->getRewindStats();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("enabled", stats.enabled);
+    result.Set("intervalFrames", stats.interval_frames);
+    result.Set("budgetBytes", static_cast<double>(stats.budget_bytes));
+    result.Set("capacityBytes", static_cast<double>(stats.capacity_bytes));
+    result.Set("usedBytes", static_cast<double>(stats.used_bytes));
+    result.Set("stateBytes", static_cast<double>(stats.state_bytes));
+    result.Set("entries", stats.entries);
+    result.Set("spanSeconds", stats.span_seconds);
+    result.Set("bytesPerSecond", stats.span_seconds > 0 ? stats.used_bytes / stats.span_seconds : 0.0);
+    result.Set("captures", static_cast<double>(stats.captures));
+    result.Set("coalesced", static_cast<double>(stats.coalesced));
+    result.Set("rewinds", static_cast<double>(stats.rewinds));
+    result.Set("captureUsMean", stats.capture_us_mean);
+    result.Set("captureUsMax", stats.capture_us_max);
+    result.Set("deltaUsMean", stats.delta_us_mean);
+    result.Set("deltaUsMax", stats.delta_us_max);
+    return result;
 }
 
-Napi::Value Snes9xAddon::StartEmulationThread(const Napi::CallbackInfo& info) {
-    emulator->startEmulationThread();
-    return info.Env().Undefined();
+bool Snes9xAddon::loadAheadROM(Emulator* target) {
+    if (!rom_path.empty()) {
+        return RomCache::instance().loadROM(target, rom_path);
+    }
+    if (!rom_image.empty()) {
+        return RomCache::instance().loadROMMem(target, rom_image.data(), rom_image.size(), rom_name);
+    }
+    return false;
 }
 
-Napi::Value Snes9xAddon::StopEmulationThread(const Napi::CallbackInfo& info) {
-    emulator->stopEmulationThread();
-    return info.Env().Undefined();
+// setRunAhead({ frames, secondInstance }) -> Promise<Boolean>
+// Shows every frame as it will look frames frames later (0-8, 0 disables),
+// assuming the input stays as it is, to hide the game's own input lag. By
+// default the extra frames run on the emulation thread around each real
+// one; with secondInstance they run on a second copy of the core on a
+// helper thread, so the emulation thread only adds a snapshot per frame.
+Napi::Value Snes9xAddon::SetRunAhead(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Options object expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Object options = info[0].As<Napi::Object>();
+    int frames = options.Has("frames") ? options.Get("frames").ToNumber().Int32Value() : 1;
+    bool second_instance = options.Has("secondInstance") && options.Get("secondInstance").ToBoolean().Value();
+    if (frames < 0 || frames > 8) {
+        Napi::RangeError::New(env, "frames must be 0-8").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    if (second_instance && frames > 0 && !ahead_emulator) {
+        std::string error;
+        Emulator* instance = createEmulator(error);
+        if (!instance) {
+            Napi::Error::New(env, error).ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        if (!instance->init()) {
+            destroyEmulator(instance);
+            Napi::Error::New(env, "Failed to initialize the run-ahead instance").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        instance->setSRAMWrites(false);
+        loadAheadROM(instance);
+        ahead_emulator = instance;
+    }
+
+    StateRequest* request = new StateRequest(env, StateRequest::Kind::SetRunAhead);
+    request->argument = frames;
+    request->instance = second_instance ? ahead_emulator : nullptr;
+    return queueStateRequest(env, request);
 }
 
-Napi::Value Snes9xAddon::SetVideoCallback(const Napi::CallbackInfo& info) {
+Napi::Value Snes9xAddon::GetRunAheadStats(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
-    
-    if (info.Length() < 1 || !info[0].IsFunction()) {
-        Napi::TypeError::New(env, "Function expected").ThrowAsJavaScriptException();
+    RunAheadStats stats = emulator->getRunAheadStats();
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("frames", stats.frames);
+    result.Set("secondInstance", stats.second_instance);
+    result.Set("runs", static_cast<double>(stats.runs));
+    result.Set("skipped", static_cast<double>(stats.skipped));
+    result.Set("coalesced", static_cast<double>(stats.coalesced));
+    result.Set("failed", static_cast<double>(stats.failed));
+    result.Set("frameUsMean", stats.frame_us_mean);
+    result.Set("saveUsMean", stats.save_us_mean);
+    result.Set("aheadUsMean", stats.ahead_us_mean);
+    result.Set("loadUsMean", stats.load_us_mean);
+    result.Set("extraFrameUsMean", stats.extra_frame_us_mean);
+    result.Set("runUsMax", stats.run_us_max);
+    return result;
+}
+
+// runFrames(count, { render: 'none' | 'last' | 'every', audio: false })
+//   -> Promise<{ frames, rendered, elapsedMs, framesPerSecond, frameUsMean,
+//                frameUsMax, frame: Buffer | null, width, height, stride, format }>
+// Runs count frames flat out at the next frame boundary, or on a helper
+// thread while the emulation thread is stopped. frame is the last rendered
+// frame, raw in the output pixel format; with 'every' all frames also go to
+// the video callback. One batch at a time.
+Napi::Value Snes9xAddon::RunFrames(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Number expected").ThrowAsJavaScriptException();
         return env.Null();
     }
-    
-    Napi::Function callback = info[0].As<Napi::Function>();
-    
-    // Release previous thread-safe function if exists
-    if (video_tsfn) {
-        video_tsfn->Release();
-        delete video_tsfn;
-        video_tsfn = nullptr;
+    int frames = info[0].As<Napi::Number>().Int32Value();
+    if (frames < 1) {
+        Napi::RangeError::New(env, "frames must be >= 1").ThrowAsJavaScriptException();
+        return env.Null();
     }
-    
-    // Create thread-safe function
-    video_tsfn = new Napi::ThreadSafeFunction(
-        Napi::ThreadSafeFunction::New(
-            env,
-            callback,
-            "VideoCallback",
-            0,  // Unlimited queue
-            1   // Initial thread count
-        )
-    );
-    
-    emulator->setVideoCallback([this](const uint16_t* data, int width, int height, int stride, double frameRate) {
-        if (!video_tsfn) return;
-        
-        // Copy video data for thread-safe access
-        size_t buffer_size = height * stride / sizeof(uint16_t);
-        std::vector<uint16_t> buffer_copy(data, data + buffer_size);
-        
-        // Call JavaScript callback via thread-safe function
-        video_tsfn->BlockingCall([buffer_copy, width, height, stride, frameRate](Napi::Env env, Napi::Function jsCallback) {
-            Napi::Buffer<uint16_t> buffer = Napi::Buffer<uint16_t>::Copy(env, buffer_copy.data(), buffer_copy.size());
-            jsCallback.Call({
-                buffer,
-                Napi::Number::New(env, width),
-                Napi::Number::New(env, height),
-                Napi::Number::New(env, stride),
-                Napi::Number::New(env, frameRate)
-            });
-        });
-    });
-    
-    return env.Undefined();
+
+    BatchRender render = BatchRender::Last;
+    bool audio = false;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object options = info[1].As<Napi::Object>();
+        if (options.Has("render")) {
+            std::string mode = options.Get("render").ToString().Utf8Value();
+            if (mode == "none") {
+                render = BatchRender::None;
+            } else if (mode == "every") {
+                render = BatchRender::Every;
+            } else if (mode != "last") {
+                Napi::TypeError::New(env, "render must be 'none', 'last' or 'every'").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+        }
+        if (options.Has("audio")) {
+            audio = options.Get("audio").ToBoolean().Value();
+        }
+    }
+
+    if (batch_busy) {
+        Napi::Error::New(env, "A batch is already running").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    StateRequest* request = new StateRequest(env, StateRequest::Kind::RunFrames);
+    request->argument = frames;
+    request->render = render;
+    request->audio = audio;
+    return queueStateRequest(env, request, true);
 }
 
-Napi::Value Snes9xAddon::SetAudioCallback(const Napi::CallbackInfo& info) {
+// setProfiling({ enabled, traceEvents }) -> Promise<Boolean>
+// Profiles every frame per subsystem (see profiler.h); traceEvents > 0 also
+// keeps that many timeline segments for getProfileTrace(). Resolves false
+// when the addon was built without the profiler.
+Napi::Value Snes9xAddon::SetProfiling(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
-    
-    if (info.Length() < 1 || !info[0].IsFunction()) {
-        Napi::TypeError::New(env, "Function expected").ThrowAsJavaScriptException();
+
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Options object expected").ThrowAsJavaScriptException();
         return env.Null();
     }
-    
-    Napi::Function callback = info[0].As<Napi::Function>();
-    
-    // Release previous thread-safe function if exists
-    if (audio_tsfn) {
-        audio_tsfn->Release();
-        delete audio_tsfn;
-        audio_tsfn = nullptr;
+    Napi::Object options = info[0].As<Napi::Object>();
+    bool enabled = !options.Has("enabled") || options.Get("enabled").ToBoolean().Value();
+    int64_t trace_events = options.Has("traceEvents") ? options.Get("traceEvents").ToNumber().Int64Value() : 0;
+    if (trace_events < 0 || trace_events > kMaxProfileTraceEvents) {
+        Napi::RangeError::New(env, "traceEvents out of range").ThrowAsJavaScriptException();
+        return env.Null();
     }
-    
-    // Create thread-safe function
-    audio_tsfn = new Napi::ThreadSafeFunction(
-        Napi::ThreadSafeFunction::New(
-            env,
-            callback,
-            "AudioCallback",
-            0,  // Unlimited queue
-            1   // Initial thread count
-        )
-    );
-    
-    emulator->setAudioCallback([this](const int16_t* data, int samples) {
-        if (!audio_tsfn) return;
-        
-        // Copy audio data for thread-safe access
-        std::vector<int16_t> buffer_copy(data, data + samples * 2); // Stereo
-        
-        // Call JavaScript callback via thread-safe function
-        audio_tsfn->BlockingCall([buffer_copy, samples](Napi::Env env, Napi::Function jsCallback) {
-            Napi::Buffer<int16_t> buffer = Napi::Buffer<int16_t>::Copy(env, buffer_copy.data(), buffer_copy.size());
-            jsCallback.Call({
-                buffer,
-                Napi::Number::New(env, samples)
-            });
-        });
-    });
-    
+
+    StateRequest* request = new StateRequest(env, StateRequest::Kind::SetProfiling);
+    request->enabled = enabled;
+    request->argument = trace_events;
+    return queueStateRequest(env, request);
+}
+
+static Napi::Object profileTimesObject(Napi::Env env, const ProfileTimes& times) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("usMean", times.us_mean);
+    result.Set("usP50", times.us_p50);
+    result.Set("usP95", times.us_p95);
+    result.Set("usP99", times.us_p99);
+    result.Set("usMax", times.us_max);
+    return result;
+}
+
+// getProfileStats() -> { compiled, enabled, clock, frames, window, frame,
+//                        subsystems: { cpu, smp, dsp, ppu, superfx, sa1, output },
+//                        traceEvents, traceDropped }
+// Percentiles cover the last window frames; each subsystem also has its
+// share of the frame time
+Napi::Value Snes9xAddon::GetProfileStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    ProfileStats stats = emulator->getProfileStats();
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("compiled", stats.compiled);
+    result.Set("enabled", stats.enabled);
+    result.Set("clock", stats.clock);
+    result.Set("frames", static_cast<double>(stats.frames));
+    result.Set("window", stats.window);
+    result.Set("frame", profileTimesObject(env, stats.frame));
+    Napi::Object subsystems = Napi::Object::New(env);
+    for (int s = 0; s < kProfileSubsystems; s++) {
+        Napi::Object entry = profileTimesObject(env, stats.subsystems[s]);
+        entry.Set("share", stats.share[s]);
+        subsystems.Set(profileSubsystemName((ProfileSubsystem)s), entry);
+    }
+    result.Set("subsystems", subsystems);
+    result.Set("traceEvents", static_cast<double>(stats.trace_events));
+    result.Set("traceDropped", static_cast<double>(stats.trace_dropped));
+    return result;
+}
+
+Napi::Value Snes9xAddon::ResetProfileStats(const Napi::CallbackInfo& info) {
+    emulator->resetProfileStats();
+    return info.Env().Undefined();
+}
+
+// getProfileTrace() -> Promise<String>
+// Chrome trace-event JSON of the segments kept since setProfiling() or the
+// previous call, for chrome://tracing or Perfetto
+Napi::Value Snes9xAddon::GetProfileTrace(const Napi::CallbackInfo& info) {
+    StateRequest* request = new StateRequest(info.Env(), StateRequest::Kind::TakeProfileTrace);
+    return queueStateRequest(info.Env(), request);
+}
+
+// setThreadedDispatch(enabled) -> Boolean
+// Computed-goto 65c816 dispatch or the opcode tables (the default), from
+// the next frame; false when the core was built without the former
+Napi::Value Snes9xAddon::SetThreadedDispatch(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsBoolean()) {
+        Napi::TypeError::New(env, "Boolean expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Boolean::New(env, emulator->setThreadedDispatch(info[0].As<Napi::Boolean>().Value()));
+}
+
+// setSkipIdleLoops(enabled)
+// Skips the iterations of idle loops up to the next event (off by
+// default), from the next frame; the machine state is the same either way
+Napi::Value Snes9xAddon::SetSkipIdleLoops(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsBoolean()) {
+        Napi::TypeError::New(env, "Boolean expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    emulator->setSkipIdleLoops(info[0].As<Napi::Boolean>().Value());
     return env.Undefined();
 }
 
+// getCPUStats() -> { threadedDispatch, skipIdleLoops, instructions, frames,
+//                    idleLoopSkips, idleLoopCycles, idleLoopInstructions,
+//                    idleCycleShare }
+// instructions: since this instance started; the idle loop figures since
+// the ROM was loaded, idleCycleShare of the master cycles of frames
+Napi::Value Snes9xAddon::GetCPUStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    CPUStats stats = emulator->getCPUStats();
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("threadedDispatch", stats.threaded_dispatch);
+    result.Set("skipIdleLoops", stats.skip_idle_loops);
+    result.Set("instructions", static_cast<double>(stats.instructions));
+    result.Set("frames", static_cast<double>(stats.frames));
+    result.Set("idleLoopSkips", static_cast<double>(stats.idle_loop_skips));
+    result.Set("idleLoopCycles", static_cast<double>(stats.idle_loop_cycles));
+    result.Set("idleLoopInstructions", static_cast<double>(stats.idle_loop_instructions));
+    result.Set("idleCycleShare", stats.idle_cycle_share);
+    return result;
+}
+
+// setRenderThread(enabled, verify = false)
+// Draws frames on a worker thread while emulation carries on (off by
+// default), from the next frame; frames are the same as drawn inline.
+// verify draws inline as well and counts frames that differ
+Napi::Value Snes9xAddon::SetRenderThread(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsBoolean() || (info.Length() > 1 && !info[1].IsBoolean() && !info[1].IsUndefined())) {
+        Napi::TypeError::New(env, "Boolean expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    bool verify = info.Length() > 1 && info[1].IsBoolean() && info[1].As<Napi::Boolean>().Value();
+    emulator->setRenderThread(info[0].As<Napi::Boolean>().Value(), verify);
+    return env.Undefined();
+}
+
+// getRenderThreadStats() -> { enabled, verify, frames, batches,
+//                             splitBatches, redrawnLines, vramBlocks,
+//                             mismatchedFrames, renderUsMean, waitUsMean }
+// Counters since this instance started; renderUsMean is the worker's time
+// per frame, waitUsMean the emulation thread's wait for it
+Napi::Value Snes9xAddon::GetRenderThreadStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    RenderThreadStats stats = emulator->getRenderThreadStats();
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("enabled", stats.enabled);
+    result.Set("verify", stats.verify);
+    result.Set("frames", static_cast<double>(stats.frames));
+    result.Set("batches", static_cast<double>(stats.batches));
+    result.Set("splitBatches", static_cast<double>(stats.split_batches));
+    result.Set("redrawnLines", static_cast<double>(stats.redrawn_lines));
+    result.Set("vramBlocks", static_cast<double>(stats.vram_blocks));
+    result.Set("mismatchedFrames", static_cast<double>(stats.mismatched_frames));
+    result.Set("renderUsMean", stats.render_us_mean);
+    result.Set("waitUsMean", stats.wait_us_mean);
+    return result;
+}
+
+static void FinalizeByteVector(napi_env env, void* data, void* hint) {
+    delete static_cast<std::vector<uint8_t>*>(hint);
+}
+
+// checkpoint() -> Promise<{ checkpoint, base, bytes, blocks } | null>
+// Snapshot at the next frame boundary, kept as the 4 KB blocks that changed
+// since the previous checkpoint (see checkpoint_chain.h). bytes is its
+// encoded size; the first checkpoint after a ROM load or reset is the base.
+// null without a ROM.
+Napi::Value Snes9xAddon::Checkpoint(const Napi::CallbackInfo& info) {
+    StateRequest* request = new StateRequest(info.Env(), StateRequest::Kind::Checkpoint);
+    request->checkpoints = &checkpoints;
+    return queueStateRequest(info.Env(), request);
+}
+
+// restoreCheckpoint(checkpoint) -> Promise<Boolean>
+// Rebuilds a held checkpoint from the base and the deltas after it and
+// loads it at the next frame boundary
+Napi::Value Snes9xAddon::RestoreCheckpoint(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    StateRequest* request = new StateRequest(env, StateRequest::Kind::RestoreCheckpoint);
+    request->checkpoints = &checkpoints;
+    request->checkpoint = info[0].As<Napi::Number>().Int64Value();
+    return queueStateRequest(env, request);
+}
+
+// encodeCheckpoint(checkpoint) -> Buffer | null
+// The base in full, any later checkpoint as its changed blocks, for a
+// receiver that applies them in order with Snes9xAddon.applyStateDelta()
+Napi::Value Snes9xAddon::EncodeCheckpoint(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::vector<uint8_t>* encoded = new std::vector<uint8_t>();
+    if (!checkpoints.encode(info[0].As<Napi::Number>().Int64Value(), *encoded)) {
+        delete encoded;
+        return env.Null();
+    }
+    napi_value value;
+    napi_status status = napi_create_external_buffer(env, encoded->size(), encoded->data(), FinalizeByteVector, encoded, &value);
+    if (status != napi_ok) {
+        delete encoded;
+        return env.Null();
+    }
+    return Napi::Value(env, value);
+}
+
+// setCheckpoints({ maxDeltas }): with maxDeltas > 0 every checkpoint past
+// that many deltas folds the oldest one into the base
+Napi::Value Snes9xAddon::SetCheckpoints(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Options object expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Object options = info[0].As<Napi::Object>();
+    int max_deltas = options.Has("maxDeltas") ? options.Get("maxDeltas").ToNumber().Int32Value() : 0;
+    if (max_deltas < 0) {
+        Napi::RangeError::New(env, "maxDeltas must not be negative").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    checkpoints.configure(max_deltas);
+    return env.Undefined();
+}
+
+// compactCheckpoints(maxDeltas): folds the oldest deltas into the base
+// until at most maxDeltas remain
+Napi::Value Snes9xAddon::CompactCheckpoints(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    checkpoints.compact(info[0].As<Napi::Number>().Int32Value());
+    return env.Undefined();
+}
+
+Napi::Value Snes9xAddon::ResetCheckpoints(const Napi::CallbackInfo& info) {
+    checkpoints.reset();
+    return info.Env().Undefined();
+}
+
+// getCheckpointStats() -> { checkpoints, first, last, deltas, compactions,
+//                           stateBytes, heldBytes, lastBytes, deltaBytesMean,
+//                           lastBlocks, diffUsMean, diffUsMax,
+//                           regions: { vram, ram, sram, registers, apu, other } }
+// Each region has its size in the snapshot and the bytes of its changed
+// blocks in the last checkpoint and over all deltas
+Napi::Value Snes9xAddon::GetCheckpointStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    CheckpointChain::Stats stats = checkpoints.getStats();
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("checkpoints", static_cast<double>(stats.checkpoints));
+    result.Set("first", static_cast<double>(stats.first));
+    result.Set("last", static_cast<double>(stats.last));
+    result.Set("deltas", stats.deltas);
+    result.Set("compactions", static_cast<double>(stats.compactions));
+    result.Set("stateBytes", static_cast<double>(stats.state_bytes));
+    result.Set("heldBytes", static_cast<double>(stats.held_bytes));
+    result.Set("lastBytes", static_cast<double>(stats.last_bytes));
+    result.Set("deltaBytesMean", stats.delta_bytes_mean);
+    result.Set("lastBlocks", stats.last_blocks);
+    result.Set("diffUsMean", stats.diff_us_mean);
+    result.Set("diffUsMax", stats.diff_us_max);
+    Napi::Object regions = Napi::Object::New(env);
+    for (const CheckpointChain::Region& region : stats.regions) {
+        Napi::Object entry = Napi::Object::New(env);
+        entry.Set("size", static_cast<double>(region.size));
+        entry.Set("lastBytes", static_cast<double>(region.last_bytes));
+        entry.Set("totalBytes", static_cast<double>(region.total_bytes));
+        regions.Set(region.name, entry);
+    }
+    result.Set("regions", regions);
+    return result;
+}
+
+// Snes9xAddon.applyStateDelta(state, encoded) -> checkpoint number | false
+// Patches a full savestate Buffer in place with an encodeCheckpoint()
+// result; state must hold the checkpoint before it (any state of the right
+// size for a base). false if the encoding is invalid or of another size.
+Napi::Value Snes9xAddon::ApplyStateDelta(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 2 || !info[0].IsBuffer() || !info[1].IsBuffer()) {
+        Napi::TypeError::New(env, "Buffer, Buffer expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Buffer<uint8_t> state = info[0].As<Napi::Buffer<uint8_t>>();
+    Napi::Buffer<uint8_t> encoded = info[1].As<Napi::Buffer<uint8_t>>();
+    int64_t checkpoint = applyStateDelta(encoded.Data(), encoded.Length(), state.Data(), state.Length());
+    if (checkpoint < 0) {
+        return Napi::Boolean::New(env, false);
+    }
+    return Napi::Number::New(env, static_cast<double>(checkpoint));
+}
+
+void Snes9xAddon::CallStateCallback(Napi::Env env, Napi::Function jsCallback, std::nullptr_t* context, StateRequest* request) {
+    // env is null while the TSFN is being torn down
+    if (env == nullptr) {
+        if (request->slot) request->slot->pool->release(request->slot);
+        request->buffer.SuppressDestruct();
+        delete request;
+        return;
+    }
+    
+    if (request->kind == StateRequest::Kind::Rewind || request->kind == StateRequest::Kind::RewindTo) {
+        request->deferred.Resolve(Napi::Number::New(env, request->result));
+    } else if (request->kind == StateRequest::Kind::TakeProfileTrace) {
+        request->deferred.Resolve(Napi::String::New(env, chromeTraceJSON(request->trace)));
+    } else if (request->kind == StateRequest::Kind::Checkpoint) {
+        if (!request->ok) {
+            request->deferred.Resolve(env.Null());
+        } else {
+            const CheckpointChain::Stats& stats = request->checkpoint_stats;
+            Napi::Object result = Napi::Object::New(env);
+            result.Set("checkpoint", static_cast<double>(request->checkpoint));
+            result.Set("base", request->checkpoint == stats.first);
+            result.Set("bytes", static_cast<double>(stats.last_bytes));
+            result.Set("blocks", stats.last_blocks);
+            request->deferred.Resolve(result);
+        }
+    } else if (request->kind == StateRequest::Kind::RunFrames) {
+        const BatchResult& batch = request->batch;
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("frames", batch.frames);
+        result.Set("rendered", static_cast<double>(batch.rendered));
+        result.Set("elapsedMs", batch.elapsed_ms);
+        result.Set("framesPerSecond", batch.frames_per_second);
+        result.Set("frameUsMean", batch.frame_us_mean);
+        result.Set("frameUsMax", batch.frame_us_max);
+        if (batch.frame.empty()) {
+            result.Set("frame", env.Null());
+        } else {
+            // The Buffer takes over the frame's storage
+            std::vector<uint8_t>* frame = new std::vector<uint8_t>(std::move(request->batch.frame));
+            napi_value value;
+            napi_status status = napi_create_external_buffer(env, frame->size(), frame->data(), FinalizeByteVector, frame, &value);
+            if (status == napi_ok) {
+                result.Set("frame", value);
+            } else {
+                delete frame;
+                result.Set("frame", env.Null());
+            }
+        }
+        result.Set("width", batch.width);
+        result.Set("height", batch.height);
+        result.Set("stride", batch.stride);
+        result.Set("format", pixelFormatName(batch.format));
+        request->deferred.Resolve(result);
+    } else if (request->kind != StateRequest::Kind::Save) {
+        request->deferred.Resolve(Napi::Boolean::New(env, request->ok));
+    } else if (!request->ok) {
+        if (request->slot) request->slot->pool->release(request->slot);
+        request->deferred.Resolve(env.Null());
+    } else if (request->slot) {
+        napi_value value = NewSlotBuffer(env, request->slot, request->size);
+        if (value) {
+            request->deferred.Resolve(value);
+        } else {
+            request->slot->pool->release(request->slot);
+            request->deferred.Resolve(env.Null());
+        }
+    } else {
+        request->deferred.Resolve(request->buffer.Value());
+    }
+    delete request;
+}
+
+Napi::Value Snes9xAddon::SetButtonState(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Number, Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int port = info[0].As<Napi::Number>().Int32Value();
+    uint16_t buttons = info[1].As<Napi::Number>().Uint32Value();
+    emulator->setButtonState(port, buttons, parseInputStamp(info, 2));
+    return env.Undefined();
+}
+
+Napi::Value Snes9xAddon::SetMousePosition(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsNumber() || !info[1].IsNumber() || !info[2].IsNumber()) {
+        Napi::TypeError::New(env, "Number, Number, Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int port = info[0].As<Napi::Number>().Int32Value();
+    int16_t x = info[1].As<Napi::Number>().Int32Value();
+    int16_t y = info[2].As<Napi::Number>().Int32Value();
+    emulator->setMousePosition(port, x, y, parseInputStamp(info, 3));
+    return env.Undefined();
+}
+
+Napi::Value Snes9xAddon::SetMouseButtons(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsNumber() || !info[1].IsBoolean() || !info[2].IsBoolean()) {
+        Napi::TypeError::New(env, "Number, Boolean, Boolean expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int port = info[0].As<Napi::Number>().Int32Value();
+    bool left = info[1].As<Napi::Boolean>().Value();
+    bool right = info[2].As<Napi::Boolean>().Value();
+    emulator->setMouseButtons(port, left, right, parseInputStamp(info, 3));
+    return env.Undefined();
+}
+
+Napi::Value Snes9xAddon::GetInputStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    InputStats stats = emulator->getInputStats();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("queued", static_cast<double>(stats.queued));
+    result.Set("capacity", static_cast<double>(stats.capacity));
+    result.Set("deferred", static_cast<double>(stats.deferred));
+    
+    // Per transport: received -> applied at a frame boundary (queue) and
+    // -> end of the first rendered frame with the event (render)
+    Napi::Object sources = Napi::Object::New(env);
+    for (int i = 0; i < kInputSourceCount; i++) {
+        const InputSourceStats& source = stats.sources[i];
+        Napi::Object entry = Napi::Object::New(env);
+        entry.Set("events", static_cast<double>(source.events));
+        entry.Set("stale", static_cast<double>(source.stale));
+        entry.Set("overflows", static_cast<double>(source.overflows));
+        entry.Set("clientMsMean", source.client_ms_mean);
+        entry.Set("queueUsMean", source.queue_us_mean);
+        entry.Set("queueUsMax", source.queue_us_max);
+        entry.Set("renderUsMean", source.render_us_mean);
+        entry.Set("renderUsP50", source.render_us_p50);
+        entry.Set("renderUsP99", source.render_us_p99);
+        entry.Set("renderUsMax", source.render_us_max);
+        sources.Set(kInputSourceNames[i], entry);
+    }
+    result.Set("sources", sources);
+    
+    Napi::Array recent = Napi::Array::New(env, stats.recent.size());
+    for (size_t i = 0; i < stats.recent.size(); i++) {
+        const InputRecord& record = stats.recent[i];
+        Napi::Object entry = Napi::Object::New(env);
+        entry.Set("source", kInputSourceNames[static_cast<int>(record.source)]);
+        entry.Set("port", record.port);
+        entry.Set("sequence", static_cast<double>(record.sequence));
+        entry.Set("clientMs", record.client_ms);
+        entry.Set("queueUs", record.queue_us);
+        entry.Set("renderUs", record.render_us);
+        recent.Set(i, entry);
+    }
+    result.Set("recent", recent);
+    return result;
+}
+
+Napi::Value Snes9xAddon::ResetInputStats(const Napi::CallbackInfo& info) {
+    emulator->resetInputStats();
+    return info.Env().Undefined();
+}
+
+Napi::Value Snes9xAddon::GetFrameWidth(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    return Napi::Number::New(env, emulator->getFrameWidth());
+}
+
+Napi::Value Snes9xAddon::GetFrameHeight(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    return Napi::Number::New(env, emulator->getFrameHeight());
+}
+
+Napi::Value Snes9xAddon::GetFrameRate(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    return Napi::Number::New(env, emulator->getFrameRate());
+}
+
+Napi::Value Snes9xAddon::StartEmulationThread(const Napi::CallbackInfo& info) {
+    emulator->startEmulationThread();
+    return info.Env().Undefined();
+}
+
+Napi::Value Snes9xAddon::StopEmulationThread(const Napi::CallbackInfo& info) {
+    emulator->stopEmulationThread();
+    return info.Env().Undefined();
+}
+
+Napi::Value Snes9xAddon::SetVideoCallback(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsFunction()) {
+        Napi::TypeError::New(env, "Function expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Function callback = info[0].As<Napi::Function>();
+    
+    // Release previous thread-safe function if exists
+    if (video_tsfn) {
+        video_tsfn->Release();
+        delete video_tsfn;
+        video_tsfn = nullptr;
+    }
+    
+    // Create thread-safe function
+    video_tsfn = new VideoTSFN(
+        VideoTSFN::New(
+            env,
+            callback,
+            "VideoCallback",
+            0,  // Unlimited queue, holds at most one wake-up
+            1   // Initial thread count
+        )
+    );
+    
+    if (!video_pool) {
+        Napi::Error::New(env, "Failed to allocate video frame pool").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    // Frames are converted straight into a free pool slot
+    emulator->setVideoBufferProvider([this](size_t size) -> uint8_t* {
+        FramePool::Slot* slot = video_pool->acquire(size);
+        return slot ? slot->data : nullptr;
+    });
+    
+    emulator->setVideoCallback([this](const VideoFrame& frame) {
+        FramePool* pool = video_pool;
+        FramePool::Slot* slot = pool->slotFromData(frame.data);
+        if (!slot) return;
+        
+        slot->frame = frame;
+        if (!video_tsfn) {
+            pool->release(slot);
+            return;
+        }
+        
+        // Never blocks: a full queue evicts its oldest frame instead. An
+        // evicted delta breaks the chain, so the next frame is a keyframe.
+        uint64_t drops = pool->queueDrops();
+        bool wake = pool->push(slot);
+        if (frame.encoding == VideoEncoding::TileDelta && pool->queueDrops() != drops) {
+            emulator->requestKeyframe();
+        }
+        if (wake) {
+            pool->ref();
+            if (video_tsfn->NonBlockingCall(pool) != napi_ok) {
+                pool->beginDrain();
+                pool->unref();
+            }
+        }
+    });
+    
+    return env.Undefined();
+}
+
+void Snes9xAddon::CallVideoCallback(Napi::Env env, Napi::Function jsCallback, std::nullptr_t* context, FramePool* pool) {
+    pool->beginDrain();
+    
+    FramePool::Slot* slot;
+    while ((slot = pool->pop()) != nullptr) {
+        // env is null while the TSFN is being torn down
+        if (env == nullptr || jsCallback.IsEmpty()) {
+            pool->release(slot);
+            continue;
+        }
+        
+        // Hand the slot memory to JS as an external Buffer. The finalizer returns
+        // the slot unless releaseVideoFrame() already did (tracked by generation).
+        const VideoFrame& frame = slot->frame;
+        napi_value value = NewSlotBuffer(env, slot, frame.size);
+        if (!value) {
+            pool->release(slot);
+            continue;
+        }
+        
+        jsCallback.Call({
+            value,
+            Napi::Number::New(env, frame.width),
+            Napi::Number::New(env, frame.height),
+            Napi::Number::New(env, frame.stride),
+            Napi::Number::New(env, frame.frame_rate),
+            Napi::String::New(env, videoEncodingName(frame.encoding))
+        });
+    }
+    
+    // Drop the reference taken when this wake-up was queued
+    pool->unref();
+}
+
+Napi::Value Snes9xAddon::SetAudioCallback(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsFunction()) {
+        Napi::TypeError::New(env, "Function expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Function callback = info[0].As<Napi::Function>();
+    
+    // Release previous thread-safe functions if they exist
+    if (audio_tsfn) {
+        audio_tsfn->Release();
+        delete audio_tsfn;
+        audio_tsfn = nullptr;
+    }
+    if (rendition_tsfn) {
+        rendition_tsfn->Release();
+        delete rendition_tsfn;
+        rendition_tsfn = nullptr;
+    }
+    
+    // Create thread-safe functions; renditions reach the same callback
+    audio_tsfn = new AudioTSFN(
+        AudioTSFN::New(
+            env,
+            callback,
+            "AudioCallback",
+            0,  // Unlimited queue, holds at most one wake-up
+            1   // Initial thread count
+        )
+    );
+    rendition_tsfn = new AudioTSFN(AudioTSFN::New(env, callback, "AudioRenditionCallback", 0, 1));
+    
+    if (!audio_pool || !rendition_pool) {
+        Napi::Error::New(env, "Failed to allocate audio packet pool").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    audio_pool->setPolicy(FramePool::DropPolicy::None, kAudioPoolSlots);
+    rendition_pool->setPolicy(FramePool::DropPolicy::None, kRenditionPoolSlots);
+    
+    // Packets are read out of the audio ring straight into a free slot
+    emulator->setAudioBufferProvider([this](size_t size) -> int16_t* {
+        FramePool::Slot* slot = audio_pool->acquire(size);
+        return slot ? reinterpret_cast<int16_t*>(slot->data) : nullptr;
+    });
+    
+    emulator->setAudioCallback([this](const int16_t* data, int frames) {
+        FramePool* pool = audio_pool;
+        FramePool::Slot* slot = pool->slotFromData(reinterpret_cast<const uint8_t*>(data));
+        if (!slot) return;
+        
+        if (rendition_tsfn && !audio_renditions.empty()) {
+            // A full rendition pool drops that rendition's packet; the mix
+            // itself is never held back for it
+            FramePool* renditions = rendition_pool;
+            audio_renditions.process(data, frames, emulator->getAudioStats().sample_rate,
+                [renditions](size_t size) -> uint8_t* {
+                    FramePool::Slot* rendition = renditions->acquire(size);
+                    return rendition ? rendition->data : nullptr;
+                },
+                [this, renditions](int id, uint8_t* packet, size_t size, int rendition_frames) {
+                    FramePool::Slot* rendition = renditions->slotFromData(packet);
+                    rendition->frame.size = size;
+                    rendition->sample_frames = rendition_frames;
+                    rendition->stream = id;
+                    if (renditions->push(rendition)) {
+                        renditions->ref();
+                        if (rendition_tsfn->NonBlockingCall(renditions) != napi_ok) {
+                            renditions->beginDrain();
+                            renditions->unref();
+                        }
+                    }
+                });
+        }
+        
+        slot->frame.size = frames * 2 * sizeof(int16_t);
+        slot->sample_frames = frames;
+        slot->stream = 0;
+        if (!audio_tsfn) {
+            pool->release(slot);
+            return;
+        }
+        
+        if (pool->push(slot)) {
+            pool->ref();
+            if (audio_tsfn->NonBlockingCall(pool) != napi_ok) {
+                pool->beginDrain();
+                pool->unref();
+            }
+        }
+    });
+    
+    return env.Undefined();
+}
+
+void Snes9xAddon::CallAudioCallback(Napi::Env env, Napi::Function jsCallback, std::nullptr_t* context, FramePool* pool) {
+    pool->beginDrain();
+    
+    FramePool::Slot* slot;
+    while ((slot = pool->pop()) != nullptr) {
+        if (env == nullptr || jsCallback.IsEmpty()) {
+            pool->release(slot);
+            continue;
+        }
+        
+        // Packets are small and JS typically forwards them at once, so the
+        // slot is returned right after the callback; listeners must copy
+        // the samples if they keep them
+        napi_value value = NewSlotBuffer(env, slot, slot->frame.size);
+        if (!value) {
+            pool->release(slot);
+            continue;
+        }
+        
+        jsCallback.Call({
+            value,
+            Napi::Number::New(env, slot->sample_frames),
+            Napi::Number::New(env, slot->stream)
+        });
+        pool->release(slot);
+    }
+    
+    pool->unref();
+}
+
+Napi::Value Snes9xAddon::SetVideoFormat(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    PixelFormat format;
+    if (!parsePixelFormat(info[0].As<Napi::String>().Utf8Value(), format)) {
+        Napi::TypeError::New(env, "Unknown pixel format (rgb565, rgb24, rgba, bgra)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    emulator->setVideoFormat(format);
+    return env.Undefined();
+}
+
+Napi::Value Snes9xAddon::GetVideoFormat(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    return Napi::String::New(env, pixelFormatName(emulator->getVideoFormat()));
+}
+
+// setVideoEncoding({ mode: 'raw' | 'tile-delta' | 'palette-deflate',
+//                    tileSize: 8 | 16, keyframeInterval: frames, level: 1-9 })
+Napi::Value Snes9xAddon::SetVideoEncoding(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Object expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Object options = info[0].As<Napi::Object>();
+    VideoEncoding encoding = VideoEncoding::TileDelta;
+    int tile_size = 16;
+    int keyframe_interval = 120;
+    int level = 1;
+    
+    if (options.Has("mode")) {
+        std::string name = options.Get("mode").As<Napi::String>().Utf8Value();
+        if (name == "raw") {
+            encoding = VideoEncoding::Raw;
+        } else if (name == "tile-delta") {
+            encoding = VideoEncoding::TileDelta;
+        } else if (name == "palette-deflate") {
+            encoding = VideoEncoding::PaletteDeflate;
+        } else {
+            Napi::TypeError::New(env, "Unknown video encoding (raw, tile-delta, palette-deflate)").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    if (options.Has("tileSize")) {
+        tile_size = options.Get("tileSize").As<Napi::Number>().Int32Value();
+    }
+    if (options.Has("keyframeInterval")) {
+        keyframe_interval = options.Get("keyframeInterval").As<Napi::Number>().Int32Value();
+    }
+    if (options.Has("level")) {
+        level = options.Get("level").As<Napi::Number>().Int32Value();
+    }
+    
+    if (!emulator->setVideoEncoding(encoding, tile_size, keyframe_interval, level)) {
+        Napi::RangeError::New(env, "tileSize must be 8 or 16, keyframeInterval >= 0 and level 1-9").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return env.Undefined();
+}
+
+Napi::Value Snes9xAddon::RequestKeyframe(const Napi::CallbackInfo& info) {
+    emulator->requestKeyframe();
+    return info.Env().Undefined();
+}
+
+Napi::Value Snes9xAddon::GetVideoEncoderStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    VideoEncoderStats stats = emulator->getVideoEncoderStats();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("mode", videoEncodingName(stats.encoding));
+    if (stats.encoding == VideoEncoding::PaletteDeflate) {
+        result.Set("level", stats.level);
+        result.Set("coalesced", static_cast<double>(stats.coalesced));
+        result.Set("directFrames", static_cast<double>(stats.direct_frames));
+        result.Set("colorsMean", stats.colors_mean);
+    } else {
+        result.Set("tileSize", stats.tile_size);
+        result.Set("keyframeInterval", stats.keyframe_interval);
+        result.Set("keyframes", static_cast<double>(stats.keyframes));
+        result.Set("tilesSent", static_cast<double>(stats.tiles_sent));
+        result.Set("tilesTotal", static_cast<double>(stats.tiles_total));
+    }
+    result.Set("frames", static_cast<double>(stats.frames));
+    result.Set("bytesOut", static_cast<double>(stats.bytes_out));
+    result.Set("rawBytes", static_cast<double>(stats.raw_bytes));
+    result.Set("bytesPerFrame", stats.frames ? static_cast<double>(stats.bytes_out) / stats.frames : 0.0);
+    result.Set("encodeUsMean", stats.encode_us_mean);
+    result.Set("encodeUsMax", stats.encode_us_max);
+    return result;
+}
+
+// Return a delivered frame's slot to the pool without waiting for GC.
+// The Buffer must not be used afterwards.
+Napi::Value Snes9xAddon::ReleaseVideoFrame(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "Buffer expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    bool released = ReleaseSlotBuffer(env, video_pool, buffer);
+    return Napi::Boolean::New(env, released);
+}
+
+Napi::Value Snes9xAddon::GetVideoPoolStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Object result = Napi::Object::New(env);
+    if (!video_pool) {
+        return result;
+    }
+    
+    FramePool::Stats stats = video_pool->getStats();
+    result.Set("slots", stats.slots);
+    result.Set("slotsInUse", stats.slots_in_use);
+    result.Set("slotAllocations", static_cast<double>(stats.slot_allocations));
+    result.Set("framesAcquired", static_cast<double>(stats.frames_acquired));
+    result.Set("framesDropped", static_cast<double>(stats.frames_dropped));
+    result.Set("framesReleased", static_cast<double>(stats.frames_released));
+    return result;
+}
+
+// setDeliveryPolicy({ video: 'coalesce' | 'drop-oldest', videoQueueDepth: n })
+// Audio always uses the no-drop policy.
+Napi::Value Snes9xAddon::SetDeliveryPolicy(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Object expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Object options = info[0].As<Napi::Object>();
+    FramePool::DropPolicy policy = FramePool::DropPolicy::Coalesce;
+    int depth = 1;
+    
+    if (options.Has("video")) {
+        std::string name = options.Get("video").ToString().Utf8Value();
+        if (name == "coalesce") {
+            policy = FramePool::DropPolicy::Coalesce;
+        } else if (name == "drop-oldest") {
+            policy = FramePool::DropPolicy::DropOldest;
+            depth = 2;
+        } else {
+            Napi::TypeError::New(env, "Unknown video policy (coalesce, drop-oldest)").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    if (options.Has("videoQueueDepth") && policy == FramePool::DropPolicy::DropOldest) {
+        depth = options.Get("videoQueueDepth").ToNumber().Int32Value();
+        if (depth < 1 || depth > FramePool::kMaxSlots - kVideoPoolSpareSlots) {
+            Napi::RangeError::New(env, "videoQueueDepth out of range").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    
+    // A deeper queue needs a bigger pool, which can only be swapped while
+    // the emulation thread is not producing frames
+    int slots = depth + kVideoPoolSpareSlots;
+    if (!video_pool || video_pool->slotCount() < slots) {
+        if (emulator->isRunning()) {
+            Napi::Error::New(env, "Stop the emulation thread before growing the video queue").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        FramePool* pool = FramePool::create(slots);
+        if (!pool) {
+            Napi::Error::New(env, "Failed to allocate video frame pool").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        if (video_pool) {
+            video_pool->destroy();
+        }
+        video_pool = pool;
+    }
+    
+    video_pool->setPolicy(policy, depth);
+    return env.Undefined();
+}
+
+Napi::Value Snes9xAddon::GetDeliveryStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Object result = Napi::Object::New(env);
+    
+    if (video_pool) {
+        FramePool::Stats stats = video_pool->getStats();
+        Napi::Object video = Napi::Object::New(env);
+        video.Set("policy", stats.policy == FramePool::DropPolicy::Coalesce ? "coalesce" : "drop-oldest");
+        video.Set("queueDepth", stats.queue_depth);
+        video.Set("queued", stats.queued);
+        video.Set("delivered", static_cast<double>(stats.frames_delivered));
+        // Evicted from a full queue plus frames that found no free slot
+        video.Set("dropped", static_cast<double>(stats.frames_evicted + stats.frames_dropped));
+        video.Set("coalesced", static_cast<double>(stats.frames_coalesced));
+        result.Set("video", video);
+    }
+    
+    if (audio_pool) {
+        FramePool::Stats stats = audio_pool->getStats();
+        Napi::Object audio = Napi::Object::New(env);
+        audio.Set("policy", "no-drop");
+        audio.Set("delivered", static_cast<double>(stats.frames_delivered));
+        audio.Set("queued", stats.queued);
+        // Packets held back in the audio ring because every slot was busy
+        audio.Set("deferred", static_cast<double>(emulator->getAudioStats().deferred));
+        result.Set("audio", audio);
+    }
+    return result;
+}
+
+Napi::Value Snes9xAddon::SetAudioPacketDuration(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    emulator->setAudioPacketDuration(info[0].As<Napi::Number>().Int32Value());
+    return env.Undefined();
+}
+
+Napi::Value Snes9xAddon::GetAudioStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    AudioStats stats = emulator->getAudioStats();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("sampleRate", stats.sample_rate);
+    result.Set("packetMs", stats.packet_ms);
+    result.Set("packetFrames", stats.packet_frames);
+    result.Set("fill", static_cast<double>(stats.fill));
+    result.Set("capacity", static_cast<double>(stats.capacity));
+    result.Set("packets", static_cast<double>(stats.packets));
+    result.Set("underruns", static_cast<double>(stats.underruns));
+    result.Set("overruns", static_cast<double>(stats.overruns));
+    result.Set("overrunFrames", static_cast<double>(stats.overrun_frames));
+    result.Set("deferred", static_cast<double>(stats.deferred));
+    return result;
+}
+
+// addAudioRendition({ sampleRate, format: 's16' | 'f32', channels: 1 | 2 }) -> id
+// s16 is interleaved, f32 planar; clients asking for the same rendition share it
+Napi::Value Snes9xAddon::AddAudioRendition(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Object expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Object options = info[0].As<Napi::Object>();
+    int sample_rate = emulator->getAudioStats().sample_rate;
+    AudioRenditionStage::SampleFormat format = AudioRenditionStage::SampleFormat::F32;
+    int channels = 2;
+    
+    if (options.Has("sampleRate")) {
+        sample_rate = options.Get("sampleRate").As<Napi::Number>().Int32Value();
+    }
+    if (options.Has("format")) {
+        std::string name = options.Get("format").As<Napi::String>().Utf8Value();
+        if (name == "s16") {
+            format = AudioRenditionStage::SampleFormat::S16;
+        } else if (name == "f32") {
+            format = AudioRenditionStage::SampleFormat::F32;
+        } else {
+            Napi::TypeError::New(env, "Unknown sample format (s16, f32)").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    if (options.Has("channels")) {
+        channels = options.Get("channels").As<Napi::Number>().Int32Value();
+    }
+    
+    int id = audio_renditions.add(sample_rate, format, channels);
+    if (id < 0) {
+        Napi::RangeError::New(env, "sampleRate must be 8000-96000 and channels 1 or 2").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Number::New(env, id);
+}
+
+// Drops one reference to a rendition; it stops once nobody uses it
+Napi::Value Snes9xAddon::RemoveAudioRendition(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    return Napi::Boolean::New(env, audio_renditions.remove(info[0].As<Napi::Number>().Int32Value()));
+}
+
+Napi::Value Snes9xAddon::GetAudioRenditionStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    AudioRenditionStage::Stats stats = audio_renditions.getStats();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("resamplers", stats.resamplers);
+    result.Set("packetsIn", static_cast<double>(stats.packets_in));
+    result.Set("resampleUsMean", stats.resample_us_mean);
+    result.Set("convertUsMean", stats.convert_us_mean);
+    result.Set("processUsMax", stats.process_us_max);
+    
+    Napi::Array renditions = Napi::Array::New(env, stats.renditions.size());
+    for (size_t i = 0; i < stats.renditions.size(); i++) {
+        const AudioRenditionStage::RenditionStats& entry = stats.renditions[i];
+        Napi::Object rendition = Napi::Object::New(env);
+        rendition.Set("id", entry.id);
+        rendition.Set("sampleRate", entry.sample_rate);
+        rendition.Set("format", entry.format == AudioRenditionStage::SampleFormat::F32 ? "f32" : "s16");
+        rendition.Set("channels", entry.channels);
+        rendition.Set("clients", entry.refs);
+        rendition.Set("packets", static_cast<double>(entry.packets));
+        rendition.Set("frames", static_cast<double>(entry.frames));
+        rendition.Set("dropped", static_cast<double>(entry.dropped));
+        renditions.Set(i, rendition);
+    }
+    result.Set("renditions", renditions);
+    return result;
+}
+
+Napi::Value Snes9xAddon::SetPacing(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Object expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Object options = info[0].As<Napi::Object>();
+    FramePacer& pacer = emulator->getFramePacer();
+    
+    if (options.Has("mode")) {
+        std::string name = options.Get("mode").As<Napi::String>().Utf8Value();
+        if (name == "clock") {
+            pacer.setMode(FramePacer::Mode::Clock);
+        } else if (name == "audio") {
+            pacer.setMode(FramePacer::Mode::Audio);
+        } else if (name == "unthrottled") {
+            pacer.setMode(FramePacer::Mode::Unthrottled);
+        } else {
+            Napi::TypeError::New(env, "Unknown pacing mode (clock, audio, unthrottled)").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+    }
+    if (options.Has("spinUs")) {
+        pacer.setSpinMicros(options.Get("spinUs").As<Napi::Number>().Int32Value());
+    }
+    if (options.Has("maxCatchUpFrames")) {
+        pacer.setMaxCatchUpFrames(options.Get("maxCatchUpFrames").As<Napi::Number>().Int32Value());
+    }
+    
+    return env.Undefined();
+}
+
+Napi::Value Snes9xAddon::GetPacerStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    FramePacer::Stats stats = emulator->getFramePacer().getStats();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("mode", stats.mode == FramePacer::Mode::Audio ? "audio" :
+                       stats.mode == FramePacer::Mode::Unthrottled ? "unthrottled" : "clock");
+    result.Set("targetFps", stats.target_fps);
+    result.Set("periodUs", stats.period_us);
+    result.Set("spinUs", stats.spin_us);
+    result.Set("maxCatchUpFrames", stats.max_catch_up_frames);
+    result.Set("frames", static_cast<double>(stats.frames));
+    result.Set("lateFrames", static_cast<double>(stats.late_frames));
+    result.Set("skippedRenders", static_cast<double>(stats.skipped_renders));
+    result.Set("resyncs", static_cast<double>(stats.resyncs));
+    
+    Napi::Object interval = Napi::Object::New(env);
+    interval.Set("meanUs", stats.mean_interval_us);
+    interval.Set("p50Us", stats.p50_interval_us);
+    interval.Set("p90Us", stats.p90_interval_us);
+    interval.Set("p99Us", stats.p99_interval_us);
+    interval.Set("maxUs", stats.max_interval_us);
+    result.Set("interval", interval);
+    
+    // Bucket i counts intervals in [i, i + 1) * bucketUs; the last one is open-ended
+    Napi::Array histogram = Napi::Array::New(env, stats.histogram.size());
+    for (size_t i = 0; i < stats.histogram.size(); i++) {
+        histogram.Set(i, static_cast<double>(stats.histogram[i]));
+    }
+    result.Set("bucketUs", FramePacer::kBucketMicros);
+    result.Set("histogram", histogram);
+    return result;
+}
+
+Napi::Value Snes9xAddon::ResetPacerStats(const Napi::CallbackInfo& info) {
+    emulator->getFramePacer().resetStats();
+    return info.Env().Undefined();
+}
+
+// attachSharedOutput({ video: name, audio: name })
+// Worker process side of supervisor mode: opens rings created by the
+// front-end and routes frames and packets into them instead of JS callbacks.
+Napi::Value Snes9xAddon::AttachSharedOutput(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Object expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Object options = info[0].As<Napi::Object>();
+    if (emulator->isRunning()) {
+        Napi::Error::New(env, "Stop the emulation thread before attaching shared output").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::string error;
+    if (options.Has("video") && options.Get("video").IsString()) {
+        SharedRing* ring = SharedRing::open(options.Get("video").As<Napi::String>().Utf8Value(), error);
+        if (!ring) {
+            Napi::Error::New(env, error).ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        if (shared_video) shared_video->destroy();
+        shared_video = ring;
+        
+        // A full ring means the front-end is behind; the frame is dropped
+        emulator->setVideoBufferProvider([this](size_t size) -> uint8_t* {
+            return shared_video->acquire(size);
+        });
+        emulator->setVideoCallback([this](const VideoFrame& frame) {
+            SharedRing::SlotInfo slot;
+            slot.kind = SharedRing::Video;
+            slot.size = frame.size;
+            slot.width = frame.width;
+            slot.height = frame.height;
+            slot.stride = frame.stride;
+            slot.format = static_cast<int32_t>(frame.format);
+            slot.frame_rate = frame.frame_rate;
+            slot.sample_frames = 0;
+            shared_video->publish(const_cast<uint8_t*>(frame.data), slot);
+        });
+    }
+    
+    if (options.Has("audio") && options.Get("audio").IsString()) {
+        SharedRing* ring = SharedRing::open(options.Get("audio").As<Napi::String>().Utf8Value(), error);
+        if (!ring) {
+            Napi::Error::New(env, error).ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        if (shared_audio) shared_audio->destroy();
+        shared_audio = ring;
+        
+        // A full ring leaves the samples in the wrapper's audio ring
+        emulator->setAudioBufferProvider([this](size_t size) -> int16_t* {
+            return reinterpret_cast<int16_t*>(shared_audio->acquire(size));
+        });
+        emulator->setAudioCallback([this](const int16_t* data, int frames) {
+            SharedRing::SlotInfo slot;
+            slot.kind = SharedRing::Audio;
+            slot.size = frames * 2 * sizeof(int16_t);
+            slot.width = 0;
+            slot.height = 0;
+            slot.stride = 0;
+            slot.format = 0;
+            slot.frame_rate = 0.0;
+            slot.sample_frames = frames;
+            shared_audio->publish(reinterpret_cast<uint8_t*>(const_cast<int16_t*>(data)), slot);
+        });
+    }
+    
+    return env.Undefined();
+}
+
+// enableSharedSnapshots(name, intervalFrames, keep = false)
+// Writes a savestate into the named segment at every intervalFrames-th frame
+// boundary. Needs a loaded ROM, since the snapshot size depends on it. A
+// snapshot already in the segment is dropped, as it may be of another game,
+// unless keep is set: a replacement worker reloading the same ROM keeps it
+// for restoreSharedSnapshot().
+Napi::Value Snes9xAddon::EnableSharedSnapshots(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "String, Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int interval = info[1].As<Napi::Number>().Int32Value();
+    if (interval < 1) {
+        Napi::RangeError::New(env, "Snapshot interval must be at least one frame").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (emulator->isRunning()) {
+        Napi::Error::New(env, "Stop the emulation thread before enabling snapshots").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    size_t size = emulator->getStateSize();
+    if (size == 0) {
+        Napi::Error::New(env, "No ROM loaded").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::string error;
+    SharedSnapshot* snapshot = SharedSnapshot::attach(info[0].As<Napi::String>().Utf8Value(), size, error);
+    if (!snapshot) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!(info.Length() > 2 && info[2].ToBoolean().Value())) {
+        snapshot->discard();
+    }
+    if (shared_snapshot) shared_snapshot->destroy();
+    shared_snapshot = snapshot;
+    snapshot_interval = interval;
+    snapshot_frames = 0;
+    
+    // Runs on the emulation thread between frames, so the state is consistent
+    emulator->setFrameCallback([this]() {
+        snapshot_frames++;
+        if (snapshot_frames % snapshot_interval != 0) {
+            return;
+        }
+        size_t state_size = emulator->getStateSize();
+        if (emulator->saveStateToMemory(shared_snapshot->beginWrite(), shared_snapshot->capacity())) {
+            shared_snapshot->commitWrite(state_size, snapshot_frames);
+        }
+    });
+    
+    return env.Undefined();
+}
+
+// restoreSharedSnapshot(name) -> frame number of the restored snapshot, or
+// false when the segment holds none. The snapshot is not checked against the
+// loaded ROM; enableSharedSnapshots() drops it when another game is loaded.
+Napi::Value Snes9xAddon::RestoreSharedSnapshot(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (emulator->isRunning()) {
+        Napi::Error::New(env, "Stop the emulation thread before restoring a snapshot").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    size_t size = emulator->getStateSize();
+    if (size == 0) {
+        return Napi::Boolean::New(env, false);
+    }
+    
+    std::string error;
+    SharedSnapshot* snapshot = SharedSnapshot::attach(info[0].As<Napi::String>().Utf8Value(), size, error);
+    if (!snapshot) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    const uint8_t* data;
+    size_t length;
+    uint64_t frame;
+    bool restored = snapshot->latest(data, length, frame) && emulator->loadStateFromMemory(data, length);
+    snapshot->destroy();
+    
+    if (!restored) {
+        return Napi::Boolean::New(env, false);
+    }
+    return Napi::Number::New(env, static_cast<double>(frame));
+}
+
+// convertFrame(rgb565Buffer, width, height, strideBytes, format) -> Buffer
+Napi::Value Snes9xAddon::ConvertFrame(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 5 || !info[0].IsBuffer() || !info[1].IsNumber() || !info[2].IsNumber() ||
+        !info[3].IsNumber() || !info[4].IsString()) {
+        Napi::TypeError::New(env, "Buffer, Number, Number, Number, String expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Buffer<uint8_t> source = info[0].As<Napi::Buffer<uint8_t>>();
+    int width = info[1].As<Napi::Number>().Int32Value();
+    int height = info[2].As<Napi::Number>().Int32Value();
+    int stride = info[3].As<Napi::Number>().Int32Value();
+    
+    PixelFormat format;
+    if (!parsePixelFormat(info[4].As<Napi::String>().Utf8Value(), format)) {
+        Napi::TypeError::New(env, "Unknown pixel format (rgb565, rgb24, rgba, bgra)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (width <= 0 || height <= 0 || stride < width * 2 || (stride & 1) ||
+        source.Length() < (size_t)stride * (height - 1) + width * 2) {
+        Napi::RangeError::New(env, "Frame dimensions exceed buffer").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    int dst_stride = width * pixelFormatBytesPerPixel(format);
+    Napi::Buffer<uint8_t> output = Napi::Buffer<uint8_t>::New(env, (size_t)dst_stride * height);
+    convertFrame(reinterpret_cast<const uint16_t*>(source.Data()), stride / 2, width, height,
+                 output.Data(), dst_stride, format);
+    return output;
+}
+
+// encodePaletteFrame(rgb565Buffer, width, height, strideBytes, format, level) -> Buffer
+// The palette-deflate codec on the calling thread, without CGRAM seeding
+Napi::Value Snes9xAddon::EncodePaletteFrame(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 6 || !info[0].IsBuffer() || !info[1].IsNumber() || !info[2].IsNumber() ||
+        !info[3].IsNumber() || !info[4].IsString() || !info[5].IsNumber()) {
+        Napi::TypeError::New(env, "Buffer, Number, Number, Number, String, Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Buffer<uint8_t> source = info[0].As<Napi::Buffer<uint8_t>>();
+    int width = info[1].As<Napi::Number>().Int32Value();
+    int height = info[2].As<Napi::Number>().Int32Value();
+    int stride = info[3].As<Napi::Number>().Int32Value();
+    
+    PixelFormat format;
+    if (!parsePixelFormat(info[4].As<Napi::String>().Utf8Value(), format)) {
+        Napi::TypeError::New(env, "Unknown pixel format (rgb565, rgb24, rgba, bgra)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF || stride < width * 2 || (stride & 1) ||
+        source.Length() < (size_t)stride * (height - 1) + width * 2) {
+        Napi::RangeError::New(env, "Frame dimensions exceed buffer").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (!palette_encoder.setLevel(info[5].As<Napi::Number>().Int32Value())) {
+        Napi::RangeError::New(env, "level must be 1-9").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::vector<uint8_t> packet(PaletteCodec::maxEncodedSize(width, height, format));
+    size_t size = palette_encoder.encode(reinterpret_cast<const uint16_t*>(source.Data()), stride / 2, width, height,
+                               nullptr, format, packet.data());
+    if (!size) {
+        Napi::Error::New(env, "deflate failed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Buffer<uint8_t>::Copy(env, packet.data(), size);
+}
+
+Napi::Value Snes9xAddon::GetVideoKernel(const Napi::CallbackInfo& info) {
+    return Napi::String::New(info.Env(), videoConvertKernel());
+}
+
+Napi::Value Snes9xAddon::GetInstanceCount(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), loadedEmulatorModules());
+}
+
+// setCpuAffinity(cpu) -> Boolean
+// Pins the calling thread and threads created afterwards (such as the
+// emulation thread); call before startEmulationThread(). Linux only.
+Napi::Value Snes9xAddon::SetCpuAffinity(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Number expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    return Napi::Boolean::New(env, setCurrentThreadAffinity(info[0].As<Napi::Number>().Int32Value()));
+}
+
+// setRomCache({ enabled, maxBytes }) -> undefined
+// Process-wide cache of prepared ROM images used by every loadROM() and
+// loadROMMem() (see rom_cache.h); on by default with a 256 MB budget.
+// Disabling it drops the held images.
+Napi::Value Snes9xAddon::SetRomCache(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Object expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Object options = info[0].As<Napi::Object>();
+    RomCache::Stats current = RomCache::instance().getStats();
+    bool enabled = options.Has("enabled") ? options.Get("enabled").ToBoolean().Value() : current.enabled;
+    double max_bytes = options.Has("maxBytes") ? options.Get("maxBytes").ToNumber().DoubleValue() : 0.0;
+    RomCache::instance().configure(enabled, max_bytes > 0 ? static_cast<size_t>(max_bytes) : 0);
+    return env.Undefined();
+}
+
+Napi::Value Snes9xAddon::GetRomCacheStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    RomCache::Stats stats = RomCache::instance().getStats();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("enabled", stats.enabled);
+    result.Set("entries", stats.entries);
+    result.Set("images", stats.images);
+    result.Set("imageBytes", static_cast<double>(stats.image_bytes));
+    result.Set("maxBytes", static_cast<double>(stats.max_bytes));
+    result.Set("hits", static_cast<double>(stats.hits));
+    result.Set("misses", static_cast<double>(stats.misses));
+    result.Set("shared", static_cast<double>(stats.shared));
+    result.Set("evictions", static_cast<double>(stats.evictions));
+    result.Set("uncached", static_cast<double>(stats.uncached));
+    result.Set("coldMsMean", stats.cold_ms_mean);
+    result.Set("warmMsMean", stats.warm_ms_mean);
+    result.Set("lastMs", stats.last_ms);
+    return result;
+}
+
+Napi::Value Snes9xAddon::ClearRomCache(const Napi::CallbackInfo& info) {
+    RomCache::instance().clear();
+    return info.Env().Undefined();
+}
+
+// Front-end side of supervisor mode: owns one shared ring and forwards what a
+// worker process publishes into it to a JS callback on the main thread.
+class SharedFrameChannel : public Napi::ObjectWrap<SharedFrameChannel> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    SharedFrameChannel(const Napi::CallbackInfo& info);
+    ~SharedFrameChannel();
+
+private:
+    // Same doorbell scheme as the in-process pools: the waiter thread rings
+    // the TSFN only when no wake-up is outstanding, and each call drains the
+    // ring's queue
+    static void CallFrameCallback(Napi::Env env, Napi::Function jsCallback, std::nullptr_t* context, SharedRing* ring);
+    using FrameTSFN = Napi::TypedThreadSafeFunction<std::nullptr_t, SharedRing, CallFrameCallback>;
+
+    SharedRing* ring;
+    FrameTSFN* tsfn;
+    std::thread waiter;
+    std::atomic<bool> waiting;
+
+    void stopWaiter();
+
+    Napi::Value Start(const Napi::CallbackInfo& info);
+    Napi::Value Stop(const Napi::CallbackInfo& info);
+    Napi::Value Recover(const Napi::CallbackInfo& info);
+    Napi::Value GetStats(const Napi::CallbackInfo& info);
+    Napi::Value Close(const Napi::CallbackInfo& info);
+
+    static Napi::Value RemoveSnapshot(const Napi::CallbackInfo& info);
+};
+
+Napi::Object SharedFrameChannel::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "SharedFrameChannel", {
+        InstanceMethod("start", &SharedFrameChannel::Start),
+        InstanceMethod("stop", &SharedFrameChannel::Stop),
+        InstanceMethod("recover", &SharedFrameChannel::Recover),
+        InstanceMethod("getStats", &SharedFrameChannel::GetStats),
+        InstanceMethod("close", &SharedFrameChannel::Close),
+        StaticMethod("removeSnapshot", &SharedFrameChannel::RemoveSnapshot),
+    });
+
+    exports.Set("SharedFrameChannel", func);
+    return exports;
+}
+
+// new SharedFrameChannel(name, slots, slotBytes)
+SharedFrameChannel::SharedFrameChannel(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<SharedFrameChannel>(info)
+    , ring(nullptr)
+    , tsfn(nullptr)
+    , waiting(false)
+{
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsString() || !info[1].IsNumber() || !info[2].IsNumber()) {
+        Napi::TypeError::New(env, "String, Number, Number expected").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    int slots = info[1].As<Napi::Number>().Int32Value();
+    int64_t slot_size = info[2].As<Napi::Number>().Int64Value();
+    if (slots < 1 || slots > SharedRing::kMaxSlots || slot_size <= 0) {
+        Napi::RangeError::New(env, "Slot count or size out of range").ThrowAsJavaScriptException();
+        return;
+    }
+    
+    std::string error;
+    ring = SharedRing::create(info[0].As<Napi::String>().Utf8Value(), slots, (size_t)slot_size, error);
+    if (!ring) {
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    }
+}
+
+SharedFrameChannel::~SharedFrameChannel() {
+    stopWaiter();
+    if (ring) {
+        ring->destroy();
+        ring = nullptr;
+    }
+}
+
+void SharedFrameChannel::stopWaiter() {
+    if (waiter.joinable()) {
+        waiting = false;
+        waiter.join();
+    }
+    if (tsfn) {
+        tsfn->Release();
+        delete tsfn;
+        tsfn = nullptr;
+    }
+}
+
+// start(callback) - callback(buffer, info) with info.kind 'video' (width,
+// height, stride, format, frameRate) or 'audio' (samples). The buffer points
+// into shared memory and is only valid during the callback.
+Napi::Value SharedFrameChannel::Start(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsFunction()) {
+        Napi::TypeError::New(env, "Function expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!ring) {
+        Napi::Error::New(env, "Channel is closed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    stopWaiter();
+    tsfn = new FrameTSFN(
+        FrameTSFN::New(
+            env,
+            info[0].As<Napi::Function>(),
+            "SharedFrameCallback",
+            0,  // Unlimited queue, holds at most one wake-up
+            1   // Initial thread count
+        )
+    );
+    
+    waiting = true;
+    SharedRing* channel_ring = ring;
+    FrameTSFN* channel_tsfn = tsfn;
+    waiter = std::thread([this, channel_ring, channel_tsfn]() {
+        uint32_t seen = 0;
+        // Short timeout so stop() never waits long for the join
+        while (waiting) {
+            uint32_t current = channel_ring->wait(seen, 100);
+            if (current == seen) {
+                continue;
+            }
+            seen = current;
+            if (channel_ring->requestNotify()) {
+                channel_ring->ref();
+                if (channel_tsfn->NonBlockingCall(channel_ring) != napi_ok) {
+                    channel_ring->beginDrain();
+                    channel_ring->unref();
+                }
+            }
+        }
+    });
+    
+    return env.Undefined();
+}
+
+static void FinalizeSharedSlot(napi_env env, void* data, void* hint) {
+    // Keeps the mapping alive, not the slot: its contents may change once
+    // the callback has returned
+    static_cast<SharedRing*>(hint)->unref();
+}
+
+void SharedFrameChannel::CallFrameCallback(Napi::Env env, Napi::Function jsCallback, std::nullptr_t* context, SharedRing* ring) {
+    ring->beginDrain();
+    
+    SharedRing::SlotInfo slot;
+    uint8_t* data;
+    int index;
+    while ((index = ring->pop(slot, data)) >= 0) {
+        if (env == nullptr || jsCallback.IsEmpty()) {
+            ring->release(index);
+            continue;
+        }
+        
+        napi_value value;
+        ring->ref();
+        napi_status status = napi_create_external_buffer(env, slot.size, data, FinalizeSharedSlot, ring, &value);
+        if (status != napi_ok) {
+            ring->unref();
+            ring->release(index);
+            continue;
+        }
+        
+        Napi::Object details = Napi::Object::New(env);
+        details.Set("sequence", static_cast<double>(slot.sequence));
+        if (slot.kind == SharedRing::Video) {
+            details.Set("kind", "video");
+            details.Set("width", slot.width);
+            details.Set("height", slot.height);
+            details.Set("stride", slot.stride);
+            details.Set("format", pixelFormatName(static_cast<PixelFormat>(slot.format)));
+            details.Set("frameRate", slot.frame_rate);
+        } else {
+            details.Set("kind", "audio");
+            details.Set("samples", slot.sample_frames);
+        }
+        
+        jsCallback.Call({ value, details });
+        ring->release(index);
+    }
+    
+    ring->unref();
+}
+
+Napi::Value SharedFrameChannel::Stop(const Napi::CallbackInfo& info) {
+    stopWaiter();
+    return info.Env().Undefined();
+}
+
+// Call after the worker process died, before starting its replacement
+Napi::Value SharedFrameChannel::Recover(const Napi::CallbackInfo& info) {
+    if (ring) {
+        ring->recoverProducer();
+    }
+    return info.Env().Undefined();
+}
+
+Napi::Value SharedFrameChannel::GetStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Object result = Napi::Object::New(env);
+    if (!ring) {
+        return result;
+    }
+    
+    SharedRing::Stats stats = ring->getStats();
+    result.Set("slots", stats.slots);
+    result.Set("slotsInUse", stats.slots_in_use);
+    result.Set("slotBytes", static_cast<double>(ring->slotSize()));
+    result.Set("published", static_cast<double>(stats.published));
+    result.Set("busy", static_cast<double>(stats.busy));
+    result.Set("delivered", static_cast<double>(stats.delivered));
+    result.Set("queued", stats.queued);
+    return result;
+}
+
+// Stops forwarding and removes the ring's name; Buffers still referencing
+// the mapping keep it alive until they are collected
+Napi::Value SharedFrameChannel::Close(const Napi::CallbackInfo& info) {
+    stopWaiter();
+    if (ring) {
+        ring->destroy();
+        ring = nullptr;
+    }
+    return info.Env().Undefined();
+}
+
+// removeSnapshot(name) - deletes a snapshot segment written by a worker
+Napi::Value SharedFrameChannel::RemoveSnapshot(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    SharedSnapshot::remove(info[0].As<Napi::String>().Utf8Value());
+    return env.Undefined();
+}
+
+// Batched training environments (see env_pool.h): many core instances
+// stepped together by a worker pool, with observations packed into one
+// Buffer and rewards read from work RAM.
+class VectorEnv : public Napi::ObjectWrap<VectorEnv> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    VectorEnv(const Napi::CallbackInfo& info);
+    ~VectorEnv();
+
+private:
+    // A step or reset in flight; the pool writes straight into its buffers
+    struct Request {
+        Napi::Promise::Deferred deferred;
+        bool step;
+        std::vector<uint16_t> actions;
+        std::vector<uint8_t>* observations;     // becomes the observations Buffer
+        std::vector<double> rewards;
+        std::vector<uint8_t> dones;
+
+        Request(Napi::Env env, bool step)
+            : deferred(Napi::Promise::Deferred::New(env))
+            , step(step)
+            , observations(new std::vector<uint8_t>())
+        {}
+        ~Request() { delete observations; }
+    };
+
+    static void CallDoneCallback(Napi::Env env, Napi::Function jsCallback, std::nullptr_t* context, Request* request);
+    using DoneTSFN = Napi::TypedThreadSafeFunction<std::nullptr_t, Request, CallDoneCallback>;
+
+    EnvPool* pool;
+    DoneTSFN* tsfn;
+    std::atomic<bool> busy;
+
+    bool checkIdle(Napi::Env env);
+    void close();
+
+    Napi::Value LoadROM(const Napi::CallbackInfo& info);
+    Napi::Value Configure(const Napi::CallbackInfo& info);
+    Napi::Value GetObservationShape(const Napi::CallbackInfo& info);
+    Napi::Value SetResetState(const Napi::CallbackInfo& info);
+    Napi::Value Reset(const Napi::CallbackInfo& info);
+    Napi::Value Step(const Napi::CallbackInfo& info);
+    Napi::Value GetStats(const Napi::CallbackInfo& info);
+    Napi::Value ResetStats(const Napi::CallbackInfo& info);
+    Napi::Value Close(const Napi::CallbackInfo& info);
+};
+
+Napi::Object VectorEnv::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "VectorEnv", {
+        InstanceMethod("loadROM", &VectorEnv::LoadROM),
+        InstanceMethod("configure", &VectorEnv::Configure),
+        InstanceMethod("getObservationShape", &VectorEnv::GetObservationShape),
+        InstanceMethod("setResetState", &VectorEnv::SetResetState),
+        InstanceMethod("reset", &VectorEnv::Reset),
+        InstanceMethod("step", &VectorEnv::Step),
+        InstanceMethod("getStats", &VectorEnv::GetStats),
+        InstanceMethod("resetStats", &VectorEnv::ResetStats),
+        InstanceMethod("close", &VectorEnv::Close),
+    });
+
+    exports.Set("VectorEnv", func);
+    return exports;
+}
+
+// new VectorEnv({ count, threads }) - threads 0 (default): one per core
+VectorEnv::VectorEnv(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<VectorEnv>(info)
+    , pool(nullptr)
+    , tsfn(nullptr)
+    , busy(false)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Options object expected").ThrowAsJavaScriptException();
+        return;
+    }
+    Napi::Object options = info[0].As<Napi::Object>();
+    int count = options.Has("count") ? options.Get("count").ToNumber().Int32Value() : 1;
+    int threads = options.Has("threads") ? options.Get("threads").ToNumber().Int32Value() : 0;
+    if (count < 1 || count > EnvPool::kMaxEnvs) {
+        Napi::RangeError::New(env, "count out of range").ThrowAsJavaScriptException();
+        return;
+    }
+
+    std::string error;
+    pool = new EnvPool();
+    if (!pool->create(count, threads, error)) {
+        delete pool;
+        pool = nullptr;
+        Napi::Error::New(env, error).ThrowAsJavaScriptException();
+        return;
+    }
+
+    // Unreferenced: a pending step must not keep the process alive
+    tsfn = new DoneTSFN(DoneTSFN::New(env, "VectorEnvCallback", 0, 1));
+    tsfn->Unref(env);
+}
+
+VectorEnv::~VectorEnv() {
+    close();
+}
+
+void VectorEnv::close() {
+    // Destroying the pool finishes a step in flight first
+    if (pool) {
+        pool->destroy();
+        delete pool;
+        pool = nullptr;
+    }
+    if (tsfn) {
+        tsfn->Release();
+        delete tsfn;
+        tsfn = nullptr;
+    }
+}
+
+bool VectorEnv::checkIdle(Napi::Env env) {
+    if (!pool) {
+        Napi::Error::New(env, "VectorEnv is closed").ThrowAsJavaScriptException();
+        return false;
+    }
+    if (busy) {
+        Napi::Error::New(env, "A step or reset is already running").ThrowAsJavaScriptException();
+        return false;
+    }
+    return true;
+}
+
+// loadROM(path) -> Boolean; loads every environment (blocking) and drops
+// the reset state
+Napi::Value VectorEnv::LoadROM(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "String expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!checkIdle(env)) {
+        return env.Null();
+    }
+    return Napi::Boolean::New(env, pool->loadROM(info[0].As<Napi::String>().Utf8Value()));
+}
+
+static bool parseRamValue(Napi::Object term, RamValue& value) {
+    if (!term.Has("address")) {
+        return false;
+    }
+    // Bus addresses of work RAM (0x7E0000-0x7FFFFF) or offsets into it
+    int64_t address = term.Get("address").ToNumber().Int64Value();
+    if (address >= 0x7E0000) {
+        address -= 0x7E0000;
+    }
+    if (address < 0 || address >= (int64_t)kWorkRAMSize) {
+        return false;
+    }
+    value.address = (uint32_t)address;
+    value.size = term.Has("size") ? term.Get("size").ToNumber().Int32Value() : 1;
+    value.is_signed = term.Has("signed") && term.Get("signed").ToBoolean().Value();
+    return true;
+}
+
+static bool parseCompare(const std::string& name, DoneTerm::Compare& compare) {
+    if (name == "==") {
+        compare = DoneTerm::Compare::Equal;
+    } else if (name == "!=") {
+        compare = DoneTerm::Compare::NotEqual;
+    } else if (name == "<") {
+        compare = DoneTerm::Compare::Less;
+    } else if (name == "<=") {
+        compare = DoneTerm::Compare::LessEqual;
+    } else if (name == ">") {
+        compare = DoneTerm::Compare::Greater;
+    } else if (name == ">=") {
+        compare = DoneTerm::Compare::GreaterEqual;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// configure({ ports, frameSkip, scale, greyscale, rewards, done }) -> Boolean
+//   rewards: [{ address, size, signed, scale, delta }] - reward is the sum
+//            of scale * value (or its change since the last step, delta)
+//   done:    [{ address, size, signed, op: '==' | '!=' | '<' | '<=' | '>' | '>=', value }]
+// Addresses are work RAM bus addresses (0x7E0000-0x7FFFFF) or offsets,
+// values little-endian of 1-4 bytes. scale (1, 2, 4 or 8) downsamples the
+// 256x224 observation; greyscale packs one byte per pixel instead of RGB24.
+Napi::Value VectorEnv::Configure(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Options object expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (!checkIdle(env)) {
+        return env.Null();
+    }
+    Napi::Object options = info[0].As<Napi::Object>();
+
+    EnvConfig config;
+    config.ports = options.Has("ports") ? options.Get("ports").ToNumber().Int32Value() : 1;
+    config.frame_skip = options.Has("frameSkip") ? options.Get("frameSkip").ToNumber().Int32Value() : 1;
+    config.scale = options.Has("scale") ? options.Get("scale").ToNumber().Int32Value() : 1;
+    config.greyscale = options.Has("greyscale") && options.Get("greyscale").ToBoolean().Value();
+
+    if (options.Has("rewards")) {
+        if (!options.Get("rewards").IsArray()) {
+            Napi::TypeError::New(env, "rewards must be an array").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        Napi::Array terms = options.Get("rewards").As<Napi::Array>();
+        for (uint32_t i = 0; i < terms.Length(); i++) {
+            Napi::Value entry = terms.Get(i);
+            RewardTerm term;
+            if (!entry.IsObject() || !parseRamValue(entry.As<Napi::Object>(), term.value)) {
+                return Napi::Boolean::New(env, false);
+            }
+            Napi::Object object = entry.As<Napi::Object>();
+            term.scale = object.Has("scale") ? object.Get("scale").ToNumber().DoubleValue() : 1.0;
+            term.delta = object.Has("delta") && object.Get("delta").ToBoolean().Value();
+            config.rewards.push_back(term);
+        }
+    }
+
+    if (options.Has("done")) {
+        if (!options.Get("done").IsArray()) {
+            Napi::TypeError::New(env, "done must be an array").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        Napi::Array terms = options.Get("done").As<Napi::Array>();
+        for (uint32_t i = 0; i < terms.Length(); i++) {
+            Napi::Value entry = terms.Get(i);
+            DoneTerm term;
+            if (!entry.IsObject() || !parseRamValue(entry.As<Napi::Object>(), term.value)) {
+                return Napi::Boolean::New(env, false);
+            }
+            Napi::Object object = entry.As<Napi::Object>();
+            std::string op = object.Has("op") ? object.Get("op").ToString().Utf8Value() : "==";
+            if (!parseCompare(op, term.compare)) {
+                return Napi::Boolean::New(env, false);
+            }
+            term.operand = object.Has("value") ? object.Get("value").ToNumber().Int64Value() : 0;
+            config.done.push_back(term);
+        }
+    }
+
+    return Napi::Boolean::New(env, pool->configure(config));
+}
+
+// getObservationShape() -> { width, height, channels, bytes } of one environment
+Napi::Value VectorEnv::GetObservationShape(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (!pool) {
+        return env.Null();
+    }
+    const EnvConfig& config = pool->getConfig();
+    Napi::Object shape = Napi::Object::New(env);
+    shape.Set("width", kObservationWidth / config.scale);
+    shape.Set("height", kObservationHeight / config.scale);
+    shape.Set("channels", config.greyscale ? 1 : 3);
+    shape.Set("bytes", static_cast<double>(pool->observationSize()));
+    return shape;
+}
+
+// setResetState([index | buffer]) -> Boolean
+// Snapshot reset() returns to: environment index's current state (default
+// 0), a savestate Buffer of the same ROM (saveStateToBuffer()), or null to
+// power-cycle instead
+Napi::Value VectorEnv::SetResetState(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (!checkIdle(env)) {
+        return env.Null();
+    }
+
+    if (info.Length() > 0 && info[0].IsBuffer()) {
+        Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+        return Napi::Boolean::New(env, pool->setResetState(buffer.Data(), buffer.Length()));
+    }
+    if (info.Length() > 0 && info[0].IsNull()) {
+        return Napi::Boolean::New(env, pool->setResetState(nullptr, 0));
+    }
+    int index = info.Length() > 0 && info[0].IsNumber() ? info[0].As<Napi::Number>().Int32Value() : 0;
+    return Napi::Boolean::New(env, pool->captureResetState(index));
+}
+
+// reset([indices]) -> Promise<{ observations }>
+// Resets the given environments (default: all) to the reset state and
+// resolves with their observations, packed in the order given
+Napi::Value VectorEnv::Reset(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (!checkIdle(env)) {
+        return env.Null();
+    }
+
+    std::vector<int> indices;
+    if (info.Length() > 0 && info[0].IsArray()) {
+        Napi::Array array = info[0].As<Napi::Array>();
+        for (uint32_t i = 0; i < array.Length(); i++) {
+            int index = array.Get(i).ToNumber().Int32Value();
+            if (index < 0 || index >= pool->size()) {
+                Napi::RangeError::New(env, "Environment index out of range").ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            indices.push_back(index);
+        }
+    }
+
+    Request* request = new Request(env, false);
+    size_t count = indices.empty() ? (size_t)pool->size() : indices.size();
+    request->observations->resize(count * pool->observationSize());
+
+    Napi::Promise promise = request->deferred.Promise();
+    DoneTSFN* done = tsfn;
+    std::atomic<bool>* running = &busy;
+    busy = true;
+    pool->reset(indices, request->observations->data(), [done, running, request]() {
+        *running = false;
+        done->NonBlockingCall(request);
+    });
+    return promise;
+}
+
+// step(actions) -> Promise<{ observations: Buffer, rewards: Float64Array, dones: Uint8Array }>
+// actions: Uint16Array or Array of count * ports button masks (environment
+// after environment), each held for frameSkip frames
+Napi::Value VectorEnv::Step(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (!checkIdle(env)) {
+        return env.Null();
+    }
+
+    size_t expected = (size_t)pool->size() * pool->getConfig().ports;
+    Request* request = new Request(env, true);
+    if (info.Length() > 0 && info[0].IsTypedArray() &&
+        info[0].As<Napi::TypedArray>().TypedArrayType() == napi_uint16_array) {
+        Napi::Uint16Array actions = info[0].As<Napi::Uint16Array>();
+        request->actions.assign(actions.Data(), actions.Data() + actions.ElementLength());
+    } else if (info.Length() > 0 && info[0].IsArray()) {
+        Napi::Array actions = info[0].As<Napi::Array>();
+        request->actions.resize(actions.Length());
+        for (uint32_t i = 0; i < actions.Length(); i++) {
+            request->actions[i] = (uint16_t)actions.Get(i).ToNumber().Uint32Value();
+        }
+    } else {
+        delete request;
+        Napi::TypeError::New(env, "Uint16Array or Array expected").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (request->actions.size() != expected) {
+        delete request;
+        Napi::RangeError::New(env, "Expected count * ports actions").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    request->observations->resize((size_t)pool->size() * pool->observationSize());
+    request->rewards.resize(pool->size());
+    request->dones.resize(pool->size());
+
+    Napi::Promise promise = request->deferred.Promise();
+    DoneTSFN* done = tsfn;
+    std::atomic<bool>* running = &busy;
+    busy = true;
+    pool->step(request->actions.data(), request->observations->data(), request->rewards.data(),
+               request->dones.data(), [done, running, request]() {
+        *running = false;
+        done->NonBlockingCall(request);
+    });
+    return promise;
+}
+
+void VectorEnv::CallDoneCallback(Napi::Env env, Napi::Function jsCallback, std::nullptr_t* context, Request* request) {
+    // env is null while the TSFN is being torn down
+    if (env == nullptr) {
+        delete request;
+        return;
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    // The Buffer takes over the observations' storage
+    std::vector<uint8_t>* observations = request->observations;
+    napi_value value;
+    if (napi_create_external_buffer(env, observations->size(), observations->data(), FinalizeByteVector,
+                                    observations, &value) == napi_ok) {
+        request->observations = nullptr;
+        result.Set("observations", value);
+    } else {
+        result.Set("observations", Napi::Buffer<uint8_t>::Copy(env, observations->data(), observations->size()));
+    }
+
+    if (request->step) {
+        size_t count = request->rewards.size();
+        Napi::Float64Array rewards = Napi::Float64Array::New(env, count);
+        Napi::Uint8Array dones = Napi::Uint8Array::New(env, count);
+        memcpy(rewards.Data(), request->rewards.data(), count * sizeof(double));
+        memcpy(dones.Data(), request->dones.data(), count);
+        result.Set("rewards", rewards);
+        result.Set("dones", dones);
+    }
+    request->deferred.Resolve(result);
+    delete request;
+}
+
+Napi::Value VectorEnv::GetStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (!pool) {
+        return env.Null();
+    }
+
+    EnvPool::Stats stats = pool->getStats();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("envs", stats.envs);
+    result.Set("threads", stats.threads);
+    result.Set("steps", static_cast<double>(stats.steps));
+    result.Set("envSteps", static_cast<double>(stats.env_steps));
+    result.Set("resets", static_cast<double>(stats.resets));
+    result.Set("envStepsPerSecond", stats.env_steps_per_second);
+    result.Set("stepUsMean", stats.step_us_mean);
+    result.Set("stepUsMax", stats.step_us_max);
+    result.Set("envStepUsMean", stats.env_step_us_mean);
+    return result;
+}
+
+Napi::Value VectorEnv::ResetStats(const Napi::CallbackInfo& info) {
+    if (pool) {
+        pool->resetStats();
+    }
+    return info.Env().Undefined();
+}
+
+// close() - waits for a step in flight, then unloads every instance
+Napi::Value VectorEnv::Close(const Napi::CallbackInfo& info) {
+    close();
+    return info.Env().Undefined();
+}
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
-    return Snes9xAddon::Init(env, exports);
+    Snes9xAddon::Init(env, exports);
+    SharedFrameChannel::Init(env, exports);
+    return VectorEnv::Init(env, exports);
 }
 
 NODE_API_MODULE(snes9x_addon, Init)
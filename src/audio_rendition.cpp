@@ -0,0 +1,209 @@
+#include "audio_rendition.h"
+#include "util.h"
+#include <chrono>
+#include <cstring>
+
+// Resampler input capacity in samples: several 50 ms packets at 48 kHz
+// stereo, since each packet is drained right after it is pushed
+static const int kResamplerSamples = 16384;
+
+static size_t bytesPerSample(AudioRenditionStage::SampleFormat format) {
+    return format == AudioRenditionStage::SampleFormat::F32 ? sizeof(float) : sizeof(int16_t);
+}
+
+AudioRenditionStage::AudioRenditionStage()
+    : next_id(1)
+    , packets_in(0)
+    , resample_ns_sum(0)
+    , convert_ns_sum(0)
+    , process_ns_max(0)
+{
+}
+
+size_t AudioRenditionStage::maxPacketBytes(int packet_ms, int sample_rate, SampleFormat format, int channels) {
+    // One frame of slack: the resampler's fractional position can yield an
+    // extra output frame on some packets
+    size_t frames = (size_t)sample_rate * packet_ms / 1000 + 2;
+    return kHeaderBytes + frames * channels * bytesPerSample(format);
+}
+
+int AudioRenditionStage::add(int sample_rate, SampleFormat format, int channels) {
+    if (sample_rate < kMinSampleRate || sample_rate > kMaxSampleRate || channels < 1 || channels > 2) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    RateGroup* group = nullptr;
+    for (RateGroup& candidate : groups) {
+        if (candidate.sample_rate == sample_rate) {
+            group = &candidate;
+            break;
+        }
+    }
+    if (!group) {
+        groups.emplace_back();
+        group = &groups.back();
+        group->sample_rate = sample_rate;
+        group->input_rate = 0;
+        group->resampler.reset(new Resampler(kResamplerSamples));
+    }
+
+    for (Rendition& rendition : group->renditions) {
+        if (rendition.format == format && rendition.channels == channels) {
+            rendition.refs++;
+            return rendition.id;
+        }
+    }
+
+    Rendition rendition = Rendition();
+    rendition.id = next_id++;
+    rendition.format = format;
+    rendition.channels = channels;
+    rendition.refs = 1;
+    group->renditions.push_back(rendition);
+    return rendition.id;
+}
+
+bool AudioRenditionStage::remove(int id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t g = 0; g < groups.size(); g++) {
+        std::vector<Rendition>& renditions = groups[g].renditions;
+        for (size_t r = 0; r < renditions.size(); r++) {
+            if (renditions[r].id != id) {
+                continue;
+            }
+            if (--renditions[r].refs == 0) {
+                renditions.erase(renditions.begin() + r);
+                if (renditions.empty()) {
+                    groups.erase(groups.begin() + g);
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AudioRenditionStage::empty() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return groups.empty();
+}
+
+void AudioRenditionStage::process(const int16_t* input, int frames, int input_rate,
+                                  const Provider& provider, const Sink& sink) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (groups.empty() || frames <= 0 || input_rate <= 0) {
+        return;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    uint64_t resample_ns = 0;
+
+    for (RateGroup& group : groups) {
+        Clock::time_point resample_start = Clock::now();
+        Resampler& resampler = *group.resampler;
+        if (group.input_rate != input_rate) {
+            group.input_rate = input_rate;
+            resampler.clear();
+            resampler.time_ratio((double)input_rate / group.sample_rate);
+        }
+        if (!resampler.push(const_cast<int16_t*>(input), frames * 2)) {
+            // Only if a previous packet was not drained; start over
+            resampler.clear();
+            resampler.push(const_cast<int16_t*>(input), frames * 2);
+        }
+        int samples = resampler.avail() & ~1;
+        group.output.resize(samples);
+        if (samples) {
+            resampler.read(group.output.data(), samples);
+        }
+        resample_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - resample_start).count();
+
+        int output_frames = samples / 2;
+        if (!output_frames) {
+            continue;
+        }
+        for (Rendition& rendition : group.renditions) {
+            size_t size = kHeaderBytes + (size_t)output_frames * rendition.channels * bytesPerSample(rendition.format);
+            uint8_t* destination = provider(size);
+            if (!destination) {
+                rendition.dropped++;
+                continue;
+            }
+            write(rendition, group.sample_rate, group.output.data(), output_frames, destination);
+            rendition.packets++;
+            rendition.frames += output_frames;
+            sink(rendition.id, destination, size, output_frames);
+        }
+    }
+
+    uint64_t total_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    packets_in++;
+    resample_ns_sum += resample_ns;
+    convert_ns_sum += total_ns - resample_ns;
+    recordMax(process_ns_max, total_ns);
+}
+
+void AudioRenditionStage::write(const Rendition& rendition, int sample_rate, const int16_t* samples,
+                                int frames, uint8_t* dst) const {
+    dst[0] = kRenditionPacketType;
+    dst[1] = (uint8_t)rendition.format;
+    dst[2] = (uint8_t)rendition.channels;
+    dst[3] = 0;
+    writeU32(dst + 4, (uint32_t)sample_rate);
+    writeU32(dst + 8, (uint32_t)frames);
+
+    // Packets start on slot boundaries, so the samples after the 12-byte
+    // header are 4-byte aligned
+    uint8_t* out = dst + kHeaderBytes;
+    if (rendition.format == SampleFormat::S16) {
+        int16_t* s16 = reinterpret_cast<int16_t*>(out);
+        if (rendition.channels == 2) {
+            memcpy(s16, samples, (size_t)frames * 2 * sizeof(int16_t));
+        } else {
+            for (int i = 0; i < frames; i++) {
+                s16[i] = (int16_t)((samples[i * 2] + samples[i * 2 + 1]) >> 1);
+            }
+        }
+    } else {
+        const float scale = 1.0f / 32768.0f;
+        float* left = reinterpret_cast<float*>(out);
+        if (rendition.channels == 2) {
+            float* right = left + frames;
+            for (int i = 0; i < frames; i++) {
+                left[i] = samples[i * 2] * scale;
+                right[i] = samples[i * 2 + 1] * scale;
+            }
+        } else {
+            for (int i = 0; i < frames; i++) {
+                left[i] = (samples[i * 2] + samples[i * 2 + 1]) * (scale * 0.5f);
+            }
+        }
+    }
+}
+
+AudioRenditionStage::Stats AudioRenditionStage::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats = Stats();
+    stats.resamplers = (int)groups.size();
+    stats.packets_in = packets_in;
+    stats.resample_us_mean = stats.packets_in ? (double)resample_ns_sum.load() / stats.packets_in / 1000.0 : 0.0;
+    stats.convert_us_mean = stats.packets_in ? (double)convert_ns_sum.load() / stats.packets_in / 1000.0 : 0.0;
+    stats.process_us_max = (double)process_ns_max.load() / 1000.0;
+    for (const RateGroup& group : groups) {
+        for (const Rendition& rendition : group.renditions) {
+            RenditionStats entry;
+            entry.id = rendition.id;
+            entry.sample_rate = group.sample_rate;
+            entry.format = rendition.format;
+            entry.channels = rendition.channels;
+            entry.refs = rendition.refs;
+            entry.packets = rendition.packets;
+            entry.frames = rendition.frames;
+            entry.dropped = rendition.dropped;
+            stats.renditions.push_back(entry);
+        }
+    }
+    return stats;
+}
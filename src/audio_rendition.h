@@ -0,0 +1,118 @@
+#ifndef AUDIO_RENDITION_H
+#define AUDIO_RENDITION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "core/apu/resampler.h"
+
+// Per-client audio renditions of the emulator's stereo s16 stream.
+//
+// A rendition is a sample rate, a sample format and a channel count. The
+// DSP output is not re-run: every packet of the mixed stream is fed to one
+// Resampler (the core's Hermite resampler) per distinct output rate, and
+// only the format conversion runs per rendition. Renditions are reference
+// counted, so clients asking for the same output share one stream.
+//
+// Packet layout, little-endian:
+//   0  u8   kRenditionPacketType (0x05)
+//   1  u8   sample format (SampleFormat)
+//   2  u8   channels (1: mono downmix, 2: stereo)
+//   3  u8   reserved
+//   4  u32  sample rate
+//   8  u32  sample frames
+//   12      S16: interleaved samples; F32: planar, all of channel 0 first
+//
+// process() runs on the audio packet thread; add(), remove() and getStats()
+// may be called from anywhere.
+class AudioRenditionStage {
+public:
+    enum class SampleFormat : uint8_t {
+        S16 = 0,
+        F32 = 1
+    };
+
+    static const uint8_t kRenditionPacketType = 0x05;
+    static const size_t kHeaderBytes = 12;
+    static const int kMinSampleRate = 8000;
+    static const int kMaxSampleRate = 96000;
+
+    // Destination for a packet of the given size; nullptr drops the packet
+    typedef std::function<uint8_t*(size_t)> Provider;
+    typedef std::function<void(int id, uint8_t* packet, size_t size, int frames)> Sink;
+
+    struct RenditionStats {
+        int id;
+        int sample_rate;
+        SampleFormat format;
+        int channels;
+        int refs;
+        uint64_t packets;
+        uint64_t frames;
+        uint64_t dropped;       // no destination when the packet was ready
+    };
+
+    struct Stats {
+        int resamplers;
+        uint64_t packets_in;
+        double resample_us_mean;    // per input packet, all rates
+        double convert_us_mean;     // per input packet, all renditions
+        double process_us_max;
+        std::vector<RenditionStats> renditions;
+    };
+
+    AudioRenditionStage();
+
+    // Largest packet for packet_ms of audio at the given output
+    static size_t maxPacketBytes(int packet_ms, int sample_rate, SampleFormat format, int channels);
+
+    // Returns the rendition id (> 0), or -1 for an unsupported rendition.
+    // Adding an existing rendition returns its id and takes a reference.
+    int add(int sample_rate, SampleFormat format, int channels);
+    bool remove(int id);
+    bool empty() const;
+
+    // Audio packet thread: convert one packet of interleaved stereo s16 at
+    // input_rate into every rendition
+    void process(const int16_t* input, int frames, int input_rate,
+                 const Provider& provider, const Sink& sink);
+
+    Stats getStats() const;
+
+private:
+    struct Rendition {
+        int id;
+        SampleFormat format;
+        int channels;
+        int refs;
+        uint64_t packets;
+        uint64_t frames;
+        uint64_t dropped;
+    };
+
+    // Renditions sharing an output rate share its resampler
+    struct RateGroup {
+        int sample_rate;
+        int input_rate;
+        std::unique_ptr<Resampler> resampler;
+        std::vector<int16_t> output;
+        std::vector<Rendition> renditions;
+    };
+
+    void write(const Rendition& rendition, int sample_rate, const int16_t* samples, int frames, uint8_t* dst) const;
+
+    mutable std::mutex mutex;
+    std::vector<RateGroup> groups;
+    int next_id;
+
+    std::atomic<uint64_t> packets_in;
+    std::atomic<uint64_t> resample_ns_sum;
+    std::atomic<uint64_t> convert_ns_sum;
+    std::atomic<uint64_t> process_ns_max;
+};
+
+#endif // AUDIO_RENDITION_H
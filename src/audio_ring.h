@@ -0,0 +1,112 @@
+#ifndef AUDIO_RING_H
+#define AUDIO_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Lock-free single-producer/single-consumer ring buffer.
+//
+// Indices grow monotonically and are masked on access, so capacity is rounded
+// up to a power of two and full/empty never need a spare element. The
+// producer may write straight into ring memory with produce(), which is how
+// the APU mixes samples without an intermediate buffer.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t min_capacity = 0) {
+        resize(min_capacity);
+    }
+
+    // Not thread-safe; only call while neither side is active
+    void resize(size_t min_capacity) {
+        size_t capacity = 1;
+        while (capacity < min_capacity) capacity <<= 1;
+        buffer.assign(capacity, T());
+        mask = capacity - 1;
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    size_t readAvailable() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    size_t writeAvailable() const {
+        return capacity() - readAvailable();
+    }
+
+    // Producer: fill(ptr, count) is called for up to two contiguous regions
+    // covering count elements, then the elements are published. Returns the
+    // number of elements produced (0 if there is not enough room).
+    template <typename Fill>
+    size_t produce(size_t count, Fill fill) {
+        size_t write = head.load(std::memory_order_relaxed);
+        size_t read = tail.load(std::memory_order_acquire);
+        if (capacity() - (write - read) < count) {
+            return 0;
+        }
+
+        size_t offset = write & mask;
+        size_t first = count < capacity() - offset ? count : capacity() - offset;
+        if (first) fill(&buffer[offset], first);
+        if (count > first) fill(&buffer[0], count - first);
+
+        head.store(write + count, std::memory_order_release);
+        return count;
+    }
+
+    size_t write(const T* data, size_t count) {
+        return produce(count, [&data](T* dst, size_t n) {
+            memcpy(dst, data, n * sizeof(T));
+            data += n;
+        });
+    }
+
+    // Consumer: copies exactly count elements, or nothing if fewer are queued
+    bool readExact(T* dst, size_t count) {
+        size_t read = tail.load(std::memory_order_relaxed);
+        size_t write = head.load(std::memory_order_acquire);
+        if (write - read < count) {
+            return false;
+        }
+
+        size_t offset = read & mask;
+        size_t first = count < capacity() - offset ? count : capacity() - offset;
+        memcpy(dst, &buffer[offset], first * sizeof(T));
+        if (count > first) memcpy(dst + first, &buffer[0], (count - first) * sizeof(T));
+
+        tail.store(read + count, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: the oldest element without removing it, nullptr when empty
+    const T* peek() const {
+        size_t read = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == read) {
+            return nullptr;
+        }
+        return &buffer[read & mask];
+    }
+
+    // Consumer: remove the element returned by peek()
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: drop everything currently queued
+    void clear() {
+        tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    std::vector<T> buffer;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head;   // written by the producer
+    alignas(64) std::atomic<size_t> tail;   // written by the consumer
+};
+
+#endif // AUDIO_RING_H
@@ -0,0 +1,327 @@
+#include "checkpoint_chain.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+// Encoding: little-endian header, then for a delta the block indices and
+// the blocks, for a base the whole snapshot
+static const uint8_t kMagic[4] = { 'S', '9', 'X', 'C' };
+static const uint32_t kVersion = 1;
+static const uint32_t kFlagBase = 1;
+static const size_t kHeaderSize = 32;
+
+static const char* const kRegionNames[] = { "vram", "ram", "sram", "registers", "apu", "other" };
+static const int kRegionOther = 5;
+
+static void put32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void put64(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t get32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) value |= (uint32_t)in[i] << (8 * i);
+    return value;
+}
+
+static uint64_t get64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) value |= (uint64_t)in[i] << (8 * i);
+    return value;
+}
+
+static int regionOfSection(const uint8_t* name) {
+    if (!memcmp(name, "VRA", 3)) return 0;
+    if (!memcmp(name, "RAM", 3)) return 1;
+    if (!memcmp(name, "SRA", 3)) return 2;
+    if (!memcmp(name, "FIL", 3)) return 3;
+    if (!memcmp(name, "SND", 3)) return 4;
+    return kRegionOther;
+}
+
+CheckpointChain::CheckpointChain()
+    : max_deltas(0)
+{
+    reset();
+}
+
+void CheckpointChain::configure(int max) {
+    std::lock_guard<std::mutex> lock(mutex);
+    max_deltas = std::max(0, max);
+    if (max_deltas) {
+        compactLocked(max_deltas);
+    }
+}
+
+void CheckpointChain::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    base.clear();
+    base.shrink_to_fit();
+    newest.clear();
+    newest.shrink_to_fit();
+    deltas.clear();
+    base_checkpoint = 0;
+    next_checkpoint = 0;
+    block_region.clear();
+    regions.clear();
+    checkpoints = 0;
+    compactions = 0;
+    delta_count = 0;
+    delta_bytes_sum = 0;
+    last_bytes = 0;
+    last_blocks = 0;
+    diff_ns_sum = 0;
+    diff_ns_max = 0;
+}
+
+size_t CheckpointChain::blockBytes(uint32_t block) const {
+    return std::min(kBlockSize, newest.size() - (size_t)block * kBlockSize);
+}
+
+// Sections are "#!s9xsnp:NNNN\n" and then NAM:LLLLLL: headers followed by
+// LLLLLL bytes (a packed big-endian length after "------" when longer)
+void CheckpointChain::parseRegions() {
+    regions.clear();
+    for (const char* name : kRegionNames) {
+        Region region = { name, 0, 0, 0 };
+        regions.push_back(region);
+    }
+    size_t size = newest.size();
+    std::vector<uint8_t> byte_region(size, kRegionOther);
+
+    const uint8_t* state = newest.data();
+    const uint8_t* line_end = (const uint8_t*)memchr(state, '\n', std::min<size_t>(size, 32));
+    size_t offset = line_end ? line_end - state + 1 : size;
+    while (offset + 11 <= size && state[offset + 3] == ':' && state[offset + 10] == ':') {
+        size_t length;
+        if (state[offset + 4] == '-') {
+            length = ((size_t)state[offset + 6] << 24) | ((size_t)state[offset + 7] << 16) |
+                     ((size_t)state[offset + 8] << 8) | state[offset + 9];
+        } else {
+            char digits[7];
+            memcpy(digits, state + offset + 4, 6);
+            digits[6] = 0;
+            length = (size_t)atoi(digits);
+        }
+        size_t end = std::min(size, offset + 11 + length);
+        int region = regionOfSection(state + offset);
+        std::fill(byte_region.begin() + offset, byte_region.begin() + end, (uint8_t)region);
+        offset = end;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        regions[byte_region[i]].size++;
+    }
+    // A block straddling two sections counts for the one at its middle
+    size_t blocks = (size + kBlockSize - 1) / kBlockSize;
+    block_region.resize(blocks);
+    for (size_t b = 0; b < blocks; b++) {
+        block_region[b] = byte_region[std::min(size - 1, b * kBlockSize + kBlockSize / 2)];
+    }
+}
+
+uint8_t* CheckpointChain::beginAdd(size_t size) {
+    capture.resize(size);
+    return capture.data();
+}
+
+uint64_t CheckpointChain::commitAdd() {
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint8_t* state = capture.data();
+    size_t size = capture.size();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t checkpoint = next_checkpoint++;
+    checkpoints++;
+
+    if (base.empty() || size != newest.size()) {
+        base.assign(state, state + size);
+        newest = base;
+        base_checkpoint = checkpoint;
+        deltas.clear();
+        parseRegions();
+        for (Region& region : regions) {
+            region.last_bytes = 0;
+        }
+        last_bytes = kHeaderSize + size;
+        last_blocks = (int)block_region.size();
+        return checkpoint;
+    }
+
+    Delta delta;
+    for (Region& region : regions) {
+        region.last_bytes = 0;
+    }
+    size_t blocks = block_region.size();
+    for (uint32_t b = 0; b < blocks; b++) {
+        size_t offset = (size_t)b * kBlockSize;
+        size_t bytes = blockBytes(b);
+        if (memcmp(newest.data() + offset, state + offset, bytes) == 0) {
+            continue;
+        }
+        memcpy(newest.data() + offset, state + offset, bytes);
+        delta.blocks.push_back(b);
+        delta.data.insert(delta.data.end(), state + offset, state + offset + bytes);
+        regions[block_region[b]].last_bytes += bytes;
+        regions[block_region[b]].total_bytes += bytes;
+    }
+
+    last_blocks = (int)delta.blocks.size();
+    last_bytes = kHeaderSize + delta.blocks.size() * 4 + delta.data.size();
+    delta_count++;
+    delta_bytes_sum += last_bytes;
+    deltas.push_back(std::move(delta));
+    if (max_deltas) {
+        compactLocked(max_deltas);
+    }
+
+    uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    diff_ns_sum += nanos;
+    diff_ns_max = std::max(diff_ns_max, nanos);
+    return checkpoint;
+}
+
+void CheckpointChain::applyDelta(const Delta& delta, std::vector<uint8_t>& state) const {
+    const uint8_t* data = delta.data.data();
+    for (uint32_t block : delta.blocks) {
+        size_t bytes = blockBytes(block);
+        memcpy(state.data() + (size_t)block * kBlockSize, data, bytes);
+        data += bytes;
+    }
+}
+
+bool CheckpointChain::restore(uint64_t checkpoint, std::vector<uint8_t>& state) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (base.empty() || checkpoint < base_checkpoint || checkpoint >= next_checkpoint) {
+        return false;
+    }
+    if (checkpoint == next_checkpoint - 1) {
+        state = newest;
+        return true;
+    }
+    state = base;
+    for (uint64_t c = base_checkpoint; c < checkpoint; c++) {
+        applyDelta(deltas[c - base_checkpoint], state);
+    }
+    return true;
+}
+
+void CheckpointChain::compact(int max) {
+    std::lock_guard<std::mutex> lock(mutex);
+    compactLocked(std::max(0, max));
+}
+
+void CheckpointChain::compactLocked(size_t max) {
+    while (deltas.size() > max) {
+        applyDelta(deltas.front(), base);
+        deltas.pop_front();
+        base_checkpoint++;
+        compactions++;
+    }
+}
+
+void CheckpointChain::encodeBlocks(uint64_t checkpoint, uint32_t count, const uint32_t* blocks,
+                                   const uint8_t* data, std::vector<uint8_t>& out) const {
+    bool is_base = blocks == nullptr;
+    size_t data_bytes = 0;
+    if (is_base) {
+        data_bytes = newest.size();
+    } else {
+        for (uint32_t i = 0; i < count; i++) data_bytes += blockBytes(blocks[i]);
+    }
+
+    out.resize(kHeaderSize + (size_t)count * 4 + data_bytes);
+    uint8_t* p = out.data();
+    memcpy(p, kMagic, 4);
+    put32(p + 4, kVersion);
+    put32(p + 8, (uint32_t)newest.size());
+    put32(p + 12, (uint32_t)kBlockSize);
+    put64(p + 16, checkpoint);
+    put32(p + 24, count);
+    put32(p + 28, is_base ? kFlagBase : 0);
+    p += kHeaderSize;
+    for (uint32_t i = 0; i < count; i++, p += 4) {
+        put32(p, blocks[i]);
+    }
+    memcpy(p, data, data_bytes);
+}
+
+bool CheckpointChain::encode(uint64_t checkpoint, std::vector<uint8_t>& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (base.empty() || checkpoint < base_checkpoint || checkpoint >= next_checkpoint) {
+        return false;
+    }
+    if (checkpoint == base_checkpoint) {
+        encodeBlocks(checkpoint, 0, nullptr, base.data(), out);
+        return true;
+    }
+    const Delta& delta = deltas[checkpoint - base_checkpoint - 1];
+    encodeBlocks(checkpoint, (uint32_t)delta.blocks.size(), delta.blocks.data(), delta.data.data(), out);
+    return true;
+}
+
+CheckpointChain::Stats CheckpointChain::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats = Stats();
+    stats.checkpoints = checkpoints;
+    stats.first = base_checkpoint;
+    stats.last = next_checkpoint ? next_checkpoint - 1 : 0;
+    stats.deltas = (int)deltas.size();
+    stats.compactions = compactions;
+    stats.state_bytes = newest.size();
+    stats.held_bytes = base.size() + newest.size();
+    for (const Delta& delta : deltas) {
+        stats.held_bytes += delta.blocks.size() * 4 + delta.data.size();
+    }
+    stats.last_bytes = last_bytes;
+    stats.delta_bytes_mean = delta_count ? (double)delta_bytes_sum / delta_count : 0.0;
+    stats.last_blocks = last_blocks;
+    stats.diff_us_mean = delta_count ? diff_ns_sum / 1000.0 / delta_count : 0.0;
+    stats.diff_us_max = diff_ns_max / 1000.0;
+    stats.regions = regions;
+    return stats;
+}
+
+int64_t applyStateDelta(const uint8_t* encoded, size_t size, uint8_t* state, size_t state_size) {
+    if (size < kHeaderSize || memcmp(encoded, kMagic, 4) != 0 || get32(encoded + 4) != kVersion ||
+        get32(encoded + 8) != state_size || get32(encoded + 12) != CheckpointChain::kBlockSize) {
+        return -1;
+    }
+    uint64_t checkpoint = get64(encoded + 16);
+    uint32_t count = get32(encoded + 24);
+    const uint8_t* p = encoded + kHeaderSize;
+    size_t remaining = size - kHeaderSize;
+
+    if (get32(encoded + 28) & kFlagBase) {
+        if (remaining != state_size) return -1;
+        memcpy(state, p, state_size);
+        return (int64_t)checkpoint;
+    }
+
+    const size_t block_size = CheckpointChain::kBlockSize;
+    size_t blocks = (state_size + block_size - 1) / block_size;
+    if (remaining < (size_t)count * 4) return -1;
+    const uint8_t* indices = p;
+    const uint8_t* data = p + (size_t)count * 4;
+    remaining -= (size_t)count * 4;
+
+    // Validate everything before touching state
+    size_t needed = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t block = get32(indices + 4 * i);
+        if (block >= blocks || (i && block <= get32(indices + 4 * (i - 1)))) return -1;
+        needed += std::min(block_size, state_size - (size_t)block * block_size);
+    }
+    if (needed != remaining) return -1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t block = get32(indices + 4 * i);
+        size_t bytes = std::min(block_size, state_size - (size_t)block * block_size);
+        memcpy(state + (size_t)block * block_size, data, bytes);
+        data += bytes;
+    }
+    return (int64_t)checkpoint;
+}
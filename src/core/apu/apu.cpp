@@ -12,6 +12,7 @@
 #include "../snapshot.h"
 #include "../display.h"
 #include "resampler.h"
+#include "../../profiler.h"
 
 #include "bapu/snes/snes.hpp"
 
@@ -270,6 +271,7 @@ void S9xAPUSetReferenceTime(int32 cpucycles)
 
 void S9xAPUExecute(void)
 {
+    S9X_PROFILE_SCOPE(SMP);
     int cycles = S9xAPUGetClock(CPU.Cycles);
     spc::remainder = S9xAPUGetClockRemainder(CPU.Cycles);
     SNES::smp.clock -= cycles;
@@ -281,7 +283,10 @@ void S9xAPUExecute(void)
 void S9xAPUEndScanline(void)
 {
     S9xAPUExecute();
-    SNES::dsp.synchronize();
+    {
+        S9X_PROFILE_SCOPE(DSP);
+        SNES::dsp.synchronize();
+    }
 
     if (spc::resampler.space_filled() >= APU_SAMPLE_BLOCK)
         S9xLandSamples();
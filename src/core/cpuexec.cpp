@@ -19,165 +19,470 @@
 
 static inline void S9xReschedule (void);
 
-void S9xMainLoop (void)
-{
-	#define CHECK_FOR_IRQ_CHANGE() \
-	if (Timings.IRQFlagChanging) \
+#define CHECK_FOR_IRQ_CHANGE() \
+if (Timings.IRQFlagChanging) \
+{ \
+	if (Timings.IRQFlagChanging & IRQ_TRIGGER_NMI) \
 	{ \
-		if (Timings.IRQFlagChanging & IRQ_TRIGGER_NMI) \
-		{ \
-			CPU.NMIPending = TRUE; \
-			Timings.NMITriggerPos = CPU.Cycles + 6; \
-		} \
-		if (Timings.IRQFlagChanging & IRQ_CLEAR_FLAG) \
-			ClearIRQ(); \
-		else if (Timings.IRQFlagChanging & IRQ_SET_FLAG) \
-			SetIRQ(); \
-		Timings.IRQFlagChanging = IRQ_NONE; \
+		CPU.NMIPending = TRUE; \
+		Timings.NMITriggerPos = CPU.Cycles + 6; \
+	} \
+	if (Timings.IRQFlagChanging & IRQ_CLEAR_FLAG) \
+		ClearIRQ(); \
+	else if (Timings.IRQFlagChanging & IRQ_SET_FLAG) \
+		SetIRQ(); \
+	Timings.IRQFlagChanging = IRQ_NONE; \
+}
+
+// Interrupts and the other per-instruction events, before the next opcode.
+// FALSE when the loop has to stop (end of frame, debugger).
+static inline bool8 S9xCheckEvents (void)
+{
+	if (CPU.NMIPending)
+	{
+		#ifdef DEBUGGER
+		if (Settings.TraceHCEvent)
+		    S9xTraceFormattedMessage ("Comparing %d to %d\n", Timings.NMITriggerPos, CPU.Cycles);
+		#endif
+		if (Timings.NMITriggerPos <= CPU.Cycles)
+		{
+			CPU.NMIPending = FALSE;
+			Timings.NMITriggerPos = 0xffff;
+			if (CPU.WaitingForInterrupt)
+			{
+				CPU.WaitingForInterrupt = FALSE;
+				Registers.PCw++;
+				CPU.Cycles += TWO_CYCLES + ONE_DOT_CYCLE / 2;
+				while (CPU.Cycles >= CPU.NextEvent)
+					S9xDoHEventProcessing();
+			}
+
+			CHECK_FOR_IRQ_CHANGE();
+			S9xOpcode_NMI();
+		}
 	}
 
-	if (CPU.Flags & SCAN_KEYS_FLAG)
+	if (CPU.Cycles >= Timings.NextIRQTimer)
 	{
-		CPU.Flags &= ~SCAN_KEYS_FLAG;
-		S9xMovieUpdate();
+		#ifdef DEBUGGER
+		S9xTraceMessage ("Timer triggered\n");
+		#endif
+
+		S9xUpdateIRQPositions(false);
+		CPU.IRQLine = TRUE;
 	}
 
-	for (;;)
+	if (CPU.IRQLine || CPU.IRQExternal)
 	{
-		if (CPU.NMIPending)
+		if (CPU.WaitingForInterrupt)
 		{
-			#ifdef DEBUGGER
-			if (Settings.TraceHCEvent)
-			    S9xTraceFormattedMessage ("Comparing %d to %d\n", Timings.NMITriggerPos, CPU.Cycles);
-			#endif
-			if (Timings.NMITriggerPos <= CPU.Cycles)
-			{
-				CPU.NMIPending = FALSE;
-				Timings.NMITriggerPos = 0xffff;
-				if (CPU.WaitingForInterrupt)
-				{
-					CPU.WaitingForInterrupt = FALSE;
-					Registers.PCw++;
-					CPU.Cycles += TWO_CYCLES + ONE_DOT_CYCLE / 2;
-					while (CPU.Cycles >= CPU.NextEvent)
-						S9xDoHEventProcessing();
-				}
-
-				CHECK_FOR_IRQ_CHANGE();
-				S9xOpcode_NMI();
-			}
+			CPU.WaitingForInterrupt = FALSE;
+			Registers.PCw++;
+			CPU.Cycles += TWO_CYCLES + ONE_DOT_CYCLE / 2;
+			while (CPU.Cycles >= CPU.NextEvent)
+				S9xDoHEventProcessing();
 		}
 
-		if (CPU.Cycles >= Timings.NextIRQTimer)
+		if (!CheckFlag(IRQ))
 		{
-			#ifdef DEBUGGER
-			S9xTraceMessage ("Timer triggered\n");
-			#endif
-
-			S9xUpdateIRQPositions(false);
-			CPU.IRQLine = TRUE;
+			/* The flag pushed onto the stack is the new value */
+			CHECK_FOR_IRQ_CHANGE();
+			S9xOpcode_IRQ();
 		}
+	}
 
-		if (CPU.IRQLine || CPU.IRQExternal)
-		{
-			if (CPU.WaitingForInterrupt)
-			{
-				CPU.WaitingForInterrupt = FALSE;
-				Registers.PCw++;
-				CPU.Cycles += TWO_CYCLES + ONE_DOT_CYCLE / 2;
-				while (CPU.Cycles >= CPU.NextEvent)
-					S9xDoHEventProcessing();
-			}
+	/* Change IRQ flag for instructions that set it only on last cycle */
+	CHECK_FOR_IRQ_CHANGE();
 
-			if (!CheckFlag(IRQ))
+#ifdef DEBUGGER
+	if ((CPU.Flags & BREAK_FLAG) && !(CPU.Flags & SINGLE_STEP_FLAG))
+	{
+		for (int Break = 0; Break != 6; Break++)
+		{
+			if (S9xBreakpoint[Break].Enabled &&
+				S9xBreakpoint[Break].Bank == Registers.PB &&
+				S9xBreakpoint[Break].Address == Registers.PCw)
 			{
-				/* The flag pushed onto the stack is the new value */
-				CHECK_FOR_IRQ_CHANGE();
-				S9xOpcode_IRQ();
+				if (S9xBreakpoint[Break].Enabled == 2)
+					S9xBreakpoint[Break].Enabled = TRUE;
+				else
+					CPU.Flags |= DEBUG_MODE_FLAG;
 			}
 		}
+	}
 
-		/* Change IRQ flag for instructions that set it only on last cycle */
-		CHECK_FOR_IRQ_CHANGE();
+	if (CPU.Flags & DEBUG_MODE_FLAG)
+		return (FALSE);
 
-	#ifdef DEBUGGER
-		if ((CPU.Flags & BREAK_FLAG) && !(CPU.Flags & SINGLE_STEP_FLAG))
-		{
-			for (int Break = 0; Break != 6; Break++)
+	if (CPU.Flags & TRACE_FLAG)
+		S9xTrace();
+
+	if (CPU.Flags & SINGLE_STEP_FLAG)
+	{
+		CPU.Flags &= ~SINGLE_STEP_FLAG;
+		CPU.Flags |= DEBUG_MODE_FLAG;
+	}
+#endif
+
+	if (CPU.Flags & SCAN_KEYS_FLAG)
+	{
+		return (FALSE);
+	}
+
+	return (TRUE);
+}
+
+#ifdef S9X_THREADED_DISPATCH
+bool8 S9xMainLoopEvents (void)
+{
+	return (S9xCheckEvents());
+}
+#endif
+
+// Idle loops: a short loop closed by a backward branch, JMP or WAI whose
+// body only reads work RAM or ROM cannot change anything but CPU.Cycles
+// until the next event. When it is seen twice in the same state with no
+// event in between, its remaining iterations before the next event are
+// skipped at once: same registers, CPU.Cycles advanced by whole
+// iterations, so events, DMA and the APU see the same cycle counts.
+
+enum
+{
+	IDLE_NONE,
+	IDLE_IMPLIED,
+	IDLE_IMMEDIATE,
+	IDLE_DIRECT,
+	IDLE_DIRECT_X,
+	IDLE_DIRECT_Y,
+	IDLE_ABSOLUTE,
+	IDLE_ABSOLUTE_X,
+	IDLE_ABSOLUTE_Y,
+	IDLE_LONG,
+	IDLE_LONG_X
+};
+
+static struct
+{
+	bool8	Valid;
+	uint16	Address;	// of the closing instruction
+	uint32	ProgramCounter;
+	pair	P, A, X, Y, D, S;
+	uint8	DB;
+	uint8	Flags[4];
+	uint8	OpenBus;
+	bool8	WaitingForInterrupt;
+	int32	Cycles;
+	int32	Limit;
+	uint64	Instructions;
+}	IdleLoop;
+
+static int IdleLoopMode (uint8 op)
+{
+	switch (op)
+	{
+		// NOP, CLC, SEC, CLV, transfers, INX/INY/DEX/DEY, INC/DEC A, XBA, shifts of A
+		case 0xea: case 0x18: case 0x38: case 0xb8: case 0xaa: case 0xa8: case 0x8a: case 0x98:
+		case 0x9b: case 0xbb: case 0xe8: case 0xc8: case 0xca: case 0x88: case 0x1a: case 0x3a:
+		case 0xeb: case 0x0a: case 0x4a: case 0x2a: case 0x6a:
+			return (IDLE_IMPLIED);
+
+		// ORA, AND, EOR, LDA, CMP, BIT, LDX, LDY, CPX, CPY
+		case 0x09: case 0x29: case 0x49: case 0xa9: case 0xc9: case 0x89: case 0xa2: case 0xa0: case 0xe0: case 0xc0:
+			return (IDLE_IMMEDIATE);
+		case 0x05: case 0x25: case 0x45: case 0xa5: case 0xc5: case 0x24: case 0xa6: case 0xa4: case 0xe4: case 0xc4:
+			return (IDLE_DIRECT);
+		case 0x15: case 0x35: case 0x55: case 0xb5: case 0xd5: case 0x34: case 0xb4:
+			return (IDLE_DIRECT_X);
+		case 0xb6:
+			return (IDLE_DIRECT_Y);
+		case 0x0d: case 0x2d: case 0x4d: case 0xad: case 0xcd: case 0x2c: case 0xae: case 0xac: case 0xec: case 0xcc:
+			return (IDLE_ABSOLUTE);
+		case 0x1d: case 0x3d: case 0x5d: case 0xbd: case 0xdd: case 0x3c: case 0xbc:
+			return (IDLE_ABSOLUTE_X);
+		case 0x19: case 0x39: case 0x59: case 0xb9: case 0xd9: case 0xbe:
+			return (IDLE_ABSOLUTE_Y);
+		case 0x0f: case 0x2f: case 0x4f: case 0xaf: case 0xcf:
+			return (IDLE_LONG);
+		case 0x1f: case 0x3f: case 0x5f: case 0xbf: case 0xdf:
+			return (IDLE_LONG_X);
+	}
+
+	return (IDLE_NONE);
+}
+
+// LDX, LDY, CPX and CPY are as wide as the index registers
+static inline bool8 IdleLoopIndexWidth (uint8 op)
+{
+	switch (op)
+	{
+		case 0xa2: case 0xa6: case 0xb6: case 0xae: case 0xbe:
+		case 0xa0: case 0xa4: case 0xb4: case 0xac: case 0xbc:
+		case 0xe0: case 0xe4: case 0xec: case 0xc0: case 0xc4: case 0xcc:
+			return (TRUE);
+	}
+
+	return (FALSE);
+}
+
+// Plain memory: work RAM, ROM; not I/O, SRAM handlers or special chips
+static inline bool8 IdleLoopReadable (uint32 Address)
+{
+	return (Memory.Map[(Address & 0xffffff) >> MEMMAP_SHIFT] >= (uint8 *) CMemory::MAP_LAST);
+}
+
+static bool8 IdleLoopOperand (int mode, const uint8 *operand, bool8 wide)
+{
+	uint32	index = 0;
+	uint32	address;
+
+	if (mode == IDLE_DIRECT_X || mode == IDLE_ABSOLUTE_X || mode == IDLE_LONG_X)
+		index = Registers.X.W;
+	else
+	if (mode == IDLE_DIRECT_Y || mode == IDLE_ABSOLUTE_Y)
+		index = Registers.Y.W;
+
+	switch (mode)
+	{
+		case IDLE_DIRECT:
+		case IDLE_DIRECT_X:
+		case IDLE_DIRECT_Y:
+			// Bank 0, with and without the emulation mode page wrap
+			for (uint32 i = 0; i <= (uint32) wide; i++)
 			{
-				if (S9xBreakpoint[Break].Enabled &&
-					S9xBreakpoint[Break].Bank == Registers.PB &&
-					S9xBreakpoint[Break].Address == Registers.PCw)
-				{
-					if (S9xBreakpoint[Break].Enabled == 2)
-						S9xBreakpoint[Break].Enabled = TRUE;
-					else
-						CPU.Flags |= DEBUG_MODE_FLAG;
-				}
+				if (!IdleLoopReadable((Registers.D.W + operand[0] + index + i) & 0xffff) ||
+					!IdleLoopReadable((Registers.D.W & 0xff00) | ((operand[0] + index + i) & 0xff)))
+					return (FALSE);
 			}
-		}
 
-		if (CPU.Flags & DEBUG_MODE_FLAG)
+			return (TRUE);
+
+		case IDLE_ABSOLUTE:
+		case IDLE_ABSOLUTE_X:
+		case IDLE_ABSOLUTE_Y:
+			address = ICPU.ShiftedDB + (operand[0] | (operand[1] << 8)) + index;
 			break;
 
-		if (CPU.Flags & TRACE_FLAG)
-			S9xTrace();
+		case IDLE_LONG:
+		case IDLE_LONG_X:
+			address = (operand[0] | (operand[1] << 8) | (operand[2] << 16)) + index;
+			break;
 
-		if (CPU.Flags & SINGLE_STEP_FLAG)
-		{
-			CPU.Flags &= ~SINGLE_STEP_FLAG;
-			CPU.Flags |= DEBUG_MODE_FLAG;
-		}
-	#endif
+		default:
+			return (TRUE);
+	}
+
+	return (IdleLoopReadable(address) && (!wide || IdleLoopReadable(address + 1)));
+}
+
+// The body from Target up to the closing instruction at Address, in the
+// current state: count is the number of instructions of one iteration
+static bool8 IdleLoopBody (uint16 Target, uint16 Address, uint64 count)
+{
+	static const uint8	OperandBytes[] = { 0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3 };
+	uint64	instructions = 1;
+
+	if (Target > Address || Address - Target > 32 || (Target & ~MEMMAP_MASK) != ((Address + 3) & ~MEMMAP_MASK))
+		return (FALSE);
+
+	for (uint16 pc = Target; pc != Address; instructions++)
+	{
+		uint8	op = CPU.PCBase[pc];
+		int		mode = IdleLoopMode(op);
+		bool8	wide = IdleLoopIndexWidth(op) ? !CheckIndex() : !CheckMemory();
+		uint8	bytes = OperandBytes[mode];
+
+		if (mode == IDLE_NONE)
+			return (FALSE);
+		if (mode == IDLE_IMMEDIATE)
+			bytes = wide ? 2 : 1;
+		if (!IdleLoopOperand(mode, CPU.PCBase + pc + 1, wide) || pc + 1 + bytes > Address)
+			return (FALSE);
+
+		pc += 1 + bytes;
+	}
+
+	return (instructions == count);
+}
+
+static inline int32 IdleLoopLimit (void)
+{
+	int32	limit = CPU.NextEvent;
+
+	if (Timings.NextIRQTimer < limit)
+		limit = Timings.NextIRQTimer;
+	if (CPU.NMIPending && Timings.NMITriggerPos < limit)
+		limit = Timings.NMITriggerPos;
+
+	return (limit);
+}
+
+static inline bool8 IdleLoopSameState (void)
+{
+	return (IdleLoop.ProgramCounter == Registers.PBPC && IdleLoop.P.W == Registers.P.W && IdleLoop.A.W == Registers.A.W &&
+			IdleLoop.X.W == Registers.X.W && IdleLoop.Y.W == Registers.Y.W && IdleLoop.D.W == Registers.D.W &&
+			IdleLoop.S.W == Registers.S.W && IdleLoop.DB == Registers.DB && IdleLoop.Flags[0] == ICPU._Carry &&
+			IdleLoop.Flags[1] == ICPU._Zero && IdleLoop.Flags[2] == ICPU._Negative && IdleLoop.Flags[3] == ICPU._Overflow &&
+			IdleLoop.OpenBus == OpenBus && IdleLoop.WaitingForInterrupt == CPU.WaitingForInterrupt);
+}
+
+static void IdleLoopRecord (uint16 Address, int32 Limit)
+{
+	IdleLoop.Valid = TRUE;
+	IdleLoop.Address = Address;
+	IdleLoop.ProgramCounter = Registers.PBPC;
+	IdleLoop.P = Registers.P;
+	IdleLoop.A = Registers.A;
+	IdleLoop.X = Registers.X;
+	IdleLoop.Y = Registers.Y;
+	IdleLoop.D = Registers.D;
+	IdleLoop.S = Registers.S;
+	IdleLoop.DB = Registers.DB;
+	IdleLoop.Flags[0] = ICPU._Carry;
+	IdleLoop.Flags[1] = ICPU._Zero;
+	IdleLoop.Flags[2] = ICPU._Negative;
+	IdleLoop.Flags[3] = ICPU._Overflow;
+	IdleLoop.OpenBus = OpenBus;
+	IdleLoop.WaitingForInterrupt = CPU.WaitingForInterrupt;
+	IdleLoop.Cycles = CPU.Cycles;
+	IdleLoop.Limit = Limit;
+	IdleLoop.Instructions = ICPU.Instructions;
+}
+
+// After a closing instruction at Address went back to Registers.PCw
+void S9xIdleLoopCheck (uint16 Address)
+{
+	// Coprocessors run alongside and may write memory; a pending IRQ
+	// would be taken at the next instruction
+	if (Settings.SA1 || Settings.SuperFX || !CPU.PCBase || CPU.IRQLine || CPU.IRQExternal || Timings.IRQFlagChanging)
+	{
+		IdleLoop.Valid = FALSE;
+		return;
+	}
+
+	int32	limit = IdleLoopLimit();
+
+	// One iteration later in the same state, and no event could have run
+	if (!IdleLoop.Valid || IdleLoop.Address != Address || CPU.Cycles >= IdleLoop.Limit || !IdleLoopSameState())
+	{
+		IdleLoopRecord(Address, limit);
+		return;
+	}
+
+	int32	period = CPU.Cycles - IdleLoop.Cycles;
+	uint64	count = ICPU.Instructions - IdleLoop.Instructions;
+
+	if (period > 0 && IdleLoopBody(Registers.PCw, Address, count))
+	{
+		// Whole iterations that end before the limit
+		int32	iterations = (limit - 1 - CPU.Cycles) / period;
 
-		if (CPU.Flags & SCAN_KEYS_FLAG)
+		if (iterations > 0)
 		{
-			break;
+			CPU.Cycles += iterations * period;
+			ICPU.IdleLoopSkips++;
+			ICPU.IdleLoopCycles += (uint64) iterations * period;
+			ICPU.IdleLoopInstructions += iterations * count;
 		}
+	}
 
-		uint8				Op;
-		struct	SOpcodes	*Opcodes;
+	IdleLoopRecord(Address, limit);
+}
 
-		if (CPU.PCBase)
-		{
-			Op = CPU.PCBase[Registers.PCw];
-			CPU.Cycles += CPU.MemSpeed;
-			Opcodes = ICPU.S9xOpcodes;
+// One instruction through the opcode tables. FALSE when the CPU deadlocked.
+// Instruction counting and the idle loop check are compiled into the
+// IdleLoops variant only, which S9xMainLoop picks when SkipIdleLoops is on
+template <bool IdleLoops>
+static inline bool8 S9xExecuteInstruction (void)
+{
+	uint8				Op;
+	uint16				OpPC;
+	const struct SOpcodes	*Opcodes;
 
-			if (CPU.Cycles > 1000000)
-			{
-				Settings.StopEmulation = true;
-				CPU.Flags |= HALTED_FLAG;
-				S9xMessage(S9X_FATAL_ERROR, 0, "CPU is deadlocked");
-				return;
-			}
-		}
-		else
+	if (CPU.PCBase)
+	{
+		Op = CPU.PCBase[Registers.PCw];
+		CPU.Cycles += CPU.MemSpeed;
+		Opcodes = ICPU.S9xOpcodes;
+
+		if (CPU.Cycles > 1000000)
 		{
-			Op = S9xGetByte(Registers.PBPC);
-			OpenBus = Op;
-			Opcodes = S9xOpcodesSlow;
+			Settings.StopEmulation = true;
+			CPU.Flags |= HALTED_FLAG;
+			S9xMessage(S9X_FATAL_ERROR, 0, "CPU is deadlocked");
+			return (FALSE);
 		}
+	}
+	else
+	{
+		Op = S9xGetByte(Registers.PBPC);
+		OpenBus = Op;
+		Opcodes = S9xOpcodesSlow;
+	}
 
-		if ((Registers.PCw & MEMMAP_MASK) + ICPU.S9xOpLengths[Op] >= MEMMAP_BLOCK_SIZE)
-		{
-			uint8	*oldPCBase = CPU.PCBase;
+	if ((Registers.PCw & MEMMAP_MASK) + ICPU.S9xOpLengths[Op] >= MEMMAP_BLOCK_SIZE)
+	{
+		uint8	*oldPCBase = CPU.PCBase;
 
-			CPU.PCBase = S9xGetBasePointer(ICPU.ShiftedPB + ((uint16) (Registers.PCw + 4)));
-			if (oldPCBase != CPU.PCBase || (Registers.PCw & ~MEMMAP_MASK) == (0xffff & ~MEMMAP_MASK))
-				Opcodes = S9xOpcodesSlow;
-		}
+		CPU.PCBase = S9xGetBasePointer(ICPU.ShiftedPB + ((uint16) (Registers.PCw + 4)));
+		if (oldPCBase != CPU.PCBase || (Registers.PCw & ~MEMMAP_MASK) == (0xffff & ~MEMMAP_MASK))
+			Opcodes = S9xOpcodesSlow;
+	}
+
+	OpPC = Registers.PCw;
+	Registers.PCw++;
+	if (IdleLoops)
+		ICPU.Instructions++;
+	(*Opcodes[Op].S9xOpcode)();
 
-		Registers.PCw++;
-		(*Opcodes[Op].S9xOpcode)();
+	if (IdleLoops && S9X_IDLE_LOOP_OPCODE(Op) && Registers.PCw <= OpPC)
+		S9xIdleLoopCheck(OpPC);
 
-		if (Settings.SA1)
-			S9xSA1MainLoop();
+	if (Settings.SA1)
+		S9xSA1MainLoop();
+
+	return (TRUE);
+}
+
+template <bool IdleLoops>
+static void S9xMainLoopTables (void)
+{
+	for (;;)
+	{
+		if (!S9xCheckEvents())
+			break;
+
+		if (!S9xExecuteInstruction<IdleLoops>())
+			return;
 	}
 
 	S9xPackStatus();
 }
 
+void S9xMainLoop (void)
+{
+	if (CPU.Flags & SCAN_KEYS_FLAG)
+	{
+		CPU.Flags &= ~SCAN_KEYS_FLAG;
+		S9xMovieUpdate();
+	}
+
+	// Memory may have changed between frames (cheats, savestates)
+	IdleLoop.Valid = FALSE;
+
+#ifdef S9X_THREADED_DISPATCH
+	if (Settings.ThreadedDispatch)
+	{
+		S9xMainLoopThreaded();
+		return;
+	}
+#endif
+
+	if (Settings.SkipIdleLoops)
+		S9xMainLoopTables<true>();
+	else
+		S9xMainLoopTables<false>();
+}
+
 static inline void S9xReschedule (void)
 {
 	switch (CPU.WhichEvent)
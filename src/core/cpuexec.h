@@ -19,7 +19,7 @@ struct SOpcodes
 
 struct SICPU
 {
-	struct SOpcodes	*S9xOpcodes;
+	const struct SOpcodes	*S9xOpcodes;
 	uint8	*S9xOpLengths;
 	uint8	_Carry;
 	uint8	_Zero;
@@ -29,22 +29,41 @@ struct SICPU
 	uint32	ShiftedDB;
 	uint32	Frame;
 	uint32	FrameAdvanceCount;
+	uint64	Instructions;
+	uint64	IdleLoopSkips;
+	uint64	IdleLoopCycles;
+	uint64	IdleLoopInstructions;
 };
 
 extern struct SICPU		ICPU;
 
-extern struct SOpcodes	S9xOpcodesE1[256];
-extern struct SOpcodes	S9xOpcodesM1X1[256];
-extern struct SOpcodes	S9xOpcodesM1X0[256];
-extern struct SOpcodes	S9xOpcodesM0X1[256];
-extern struct SOpcodes	S9xOpcodesM0X0[256];
-extern struct SOpcodes	S9xOpcodesSlow[256];
+extern const struct SOpcodes	S9xOpcodesE1[256];
+extern const struct SOpcodes	S9xOpcodesM1X1[256];
+extern const struct SOpcodes	S9xOpcodesM1X0[256];
+extern const struct SOpcodes	S9xOpcodesM0X1[256];
+extern const struct SOpcodes	S9xOpcodesM0X0[256];
+extern const struct SOpcodes	S9xOpcodesSlow[256];
 extern uint8			S9xOpLengthsM1X1[256];
 extern uint8			S9xOpLengthsM1X0[256];
 extern uint8			S9xOpLengthsM0X1[256];
 extern uint8			S9xOpLengthsM0X0[256];
 
+// S9xMainLoop() dispatches through labels (computed goto) instead of the
+// opcode tables when Settings.ThreadedDispatch is set; GCC and Clang only
+#if defined(__GNUC__) && !defined(DEBUGGER) && !defined(S9X_NO_THREADED_DISPATCH)
+#define S9X_THREADED_DISPATCH
+#endif
+
+// Instructions that can close an idle loop (S9xIdleLoopCheck): branches,
+// BRA, JMP abs and WAI
+#define S9X_IDLE_LOOP_OPCODE(op)	(((op) & 0x1f) == 0x10 || (op) == 0x80 || (op) == 0x4c || (op) == 0xcb)
+
 void S9xMainLoop (void);
+void S9xIdleLoopCheck (uint16);
+#ifdef S9X_THREADED_DISPATCH
+void S9xMainLoopThreaded (void);
+bool8 S9xMainLoopEvents (void);
+#endif
 void S9xReset (void);
 void S9xSoftReset (void);
 void S9xDoHEventProcessing (void);
@@ -3407,7 +3407,7 @@ static void Op42 (void)
 
 /* CPU-S9xOpcodes Definitions ************************************************/
 
-struct SOpcodes S9xOpcodesM1X1[256] =
+const struct SOpcodes S9xOpcodesM1X1[256] =
 {
 	{ Op00 },        { Op01E0M1 },    { Op02 },        { Op03M1 },      { Op04M1 },
 	{ Op05M1 },      { Op06M1 },      { Op07M1 },      { Op08E0 },      { Op09M1 },
@@ -3463,7 +3463,7 @@ struct SOpcodes S9xOpcodesM1X1[256] =
 	{ OpFFM1 }
 };
 
-struct SOpcodes S9xOpcodesE1[256] =
+const struct SOpcodes S9xOpcodesE1[256] =
 {
 	{ Op00 },        { Op01E1 },      { Op02 },        { Op03M1 },      { Op04M1 },
 	{ Op05M1 },      { Op06M1 },      { Op07M1 },      { Op08E1 },      { Op09M1 },
@@ -3519,7 +3519,7 @@ struct SOpcodes S9xOpcodesE1[256] =
 	{ OpFFM1 }
 };
 
-struct SOpcodes S9xOpcodesM1X0[256] =
+const struct SOpcodes S9xOpcodesM1X0[256] =
 {
 	{ Op00 },        { Op01E0M1 },    { Op02 },        { Op03M1 },      { Op04M1 },
 	{ Op05M1 },      { Op06M1 },      { Op07M1 },      { Op08E0 },      { Op09M1 },
@@ -3575,7 +3575,7 @@ struct SOpcodes S9xOpcodesM1X0[256] =
 	{ OpFFM1 }
 };
 
-struct SOpcodes S9xOpcodesM0X0[256] =
+const struct SOpcodes S9xOpcodesM0X0[256] =
 {
 	{ Op00 },        { Op01E0M0 },    { Op02 },        { Op03M0 },      { Op04M0 },
 	{ Op05M0 },      { Op06M0 },      { Op07M0 },      { Op08E0 },      { Op09M0 },
@@ -3631,7 +3631,7 @@ struct SOpcodes S9xOpcodesM0X0[256] =
 	{ OpFFM0 }
 };
 
-struct SOpcodes S9xOpcodesM0X1[256] =
+const struct SOpcodes S9xOpcodesM0X1[256] =
 {
 	{ Op00 },        { Op01E0M0 },    { Op02 },        { Op03M0 },      { Op04M0 },
 	{ Op05M0 },      { Op06M0 },      { Op07M0 },      { Op08E0 },      { Op09M0 },
@@ -3687,7 +3687,7 @@ struct SOpcodes S9xOpcodesM0X1[256] =
 	{ OpFFM0 }
 };
 
-struct SOpcodes S9xOpcodesSlow[256] =
+const struct SOpcodes S9xOpcodesSlow[256] =
 {
 	{ Op00 },        { Op01Slow },    { Op02 },        { Op03Slow },    { Op04Slow },
 	{ Op05Slow },    { Op06Slow },    { Op07Slow },    { Op08Slow },    { Op09Slow },
@@ -3742,3 +3742,144 @@ struct SOpcodes S9xOpcodesSlow[256] =
 	{ OpFASlow },    { OpFB },        { OpFCSlow },    { OpFDSlow },    { OpFESlow },
 	{ OpFFSlow }
 };
+
+#if !defined(SA1_OPCODES) && defined(S9X_THREADED_DISPATCH)
+
+// S9xMainLoop() with computed goto: one label per opcode and table, each
+// calling its handler through the const table above, which the compiler
+// turns into a direct (usually inlined) call. Every label ends in its own
+// copy of the fetch and indirect jump, so the branch predictor sees
+// opcode-to-opcode transitions instead of one shared call site. Events are
+// only checked when one can be pending, and the fetch, deadlock and page
+// crossing logic is that of S9xMainLoop(), so both run the same machine.
+
+#define OP_ROW(X, T, h) \
+	X(T, h##0) X(T, h##1) X(T, h##2) X(T, h##3) X(T, h##4) X(T, h##5) X(T, h##6) X(T, h##7) \
+	X(T, h##8) X(T, h##9) X(T, h##A) X(T, h##B) X(T, h##C) X(T, h##D) X(T, h##E) X(T, h##F)
+
+#define OP_ROWS(X, T) \
+	OP_ROW(X, T, 0x0) OP_ROW(X, T, 0x1) OP_ROW(X, T, 0x2) OP_ROW(X, T, 0x3) \
+	OP_ROW(X, T, 0x4) OP_ROW(X, T, 0x5) OP_ROW(X, T, 0x6) OP_ROW(X, T, 0x7) \
+	OP_ROW(X, T, 0x8) OP_ROW(X, T, 0x9) OP_ROW(X, T, 0xA) OP_ROW(X, T, 0xB) \
+	OP_ROW(X, T, 0xC) OP_ROW(X, T, 0xD) OP_ROW(X, T, 0xE) OP_ROW(X, T, 0xF)
+
+#define OP_ADDRESS(T, op)	&&T##_##op,
+
+#define OP_LABEL(T, op) \
+T##_##op: \
+	S9xOpcodes##T[op].S9xOpcode(); \
+	if (S9X_IDLE_LOOP_OPCODE(op) && Settings.SkipIdleLoops && Registers.PCw <= OpPC) \
+		S9xIdleLoopCheck(OpPC); \
+	NEXT();
+
+#define EVENTS_PENDING() \
+	(CPU.NMIPending || CPU.IRQLine || CPU.IRQExternal || Timings.IRQFlagChanging || \
+	 CPU.Cycles >= Timings.NextIRQTimer || (CPU.Flags & SCAN_KEYS_FLAG))
+
+#define NEXT() \
+{ \
+	if (Settings.SA1) \
+		S9xSA1MainLoop(); \
+	if (EVENTS_PENDING() && !S9xMainLoopEvents()) \
+		goto stop; \
+	FETCH(); \
+}
+
+#define FETCH() \
+{ \
+	if (CPU.PCBase) \
+	{ \
+		Op = CPU.PCBase[Registers.PCw]; \
+		CPU.Cycles += CPU.MemSpeed; \
+		Opcodes = ICPU.S9xOpcodes; \
+		if (CPU.Cycles > 1000000) \
+			goto deadlock; \
+	} \
+	else \
+	{ \
+		Op = S9xGetByte(Registers.PBPC); \
+		OpenBus = Op; \
+		Opcodes = S9xOpcodesSlow; \
+	} \
+	if ((Registers.PCw & MEMMAP_MASK) + ICPU.S9xOpLengths[Op] >= MEMMAP_BLOCK_SIZE) \
+	{ \
+		uint8	*oldPCBase = CPU.PCBase; \
+		CPU.PCBase = S9xGetBasePointer(ICPU.ShiftedPB + ((uint16) (Registers.PCw + 4))); \
+		if (oldPCBase != CPU.PCBase || (Registers.PCw & ~MEMMAP_MASK) == (0xffff & ~MEMMAP_MASK)) \
+			Opcodes = S9xOpcodesSlow; \
+	} \
+	OpPC = Registers.PCw; \
+	Registers.PCw++; \
+	ICPU.Instructions++; \
+	if (Opcodes != Current) \
+	{ \
+		Current = Opcodes; \
+		Labels = LabelsFor(Opcodes, Tables); \
+	} \
+	goto *Labels[Op]; \
+}
+
+static inline void * const *LabelsFor (const struct SOpcodes *Opcodes, void * const (*Tables)[256])
+{
+	if (Opcodes == S9xOpcodesM1X1)
+		return (Tables[0]);
+	if (Opcodes == S9xOpcodesE1)
+		return (Tables[1]);
+	if (Opcodes == S9xOpcodesM1X0)
+		return (Tables[2]);
+	if (Opcodes == S9xOpcodesM0X1)
+		return (Tables[3]);
+	if (Opcodes == S9xOpcodesM0X0)
+		return (Tables[4]);
+	return (Tables[5]);
+}
+
+void S9xMainLoopThreaded (void)
+{
+	static void * const	Tables[6][256] =
+	{
+		{ OP_ROWS(OP_ADDRESS, M1X1) },
+		{ OP_ROWS(OP_ADDRESS, E1) },
+		{ OP_ROWS(OP_ADDRESS, M1X0) },
+		{ OP_ROWS(OP_ADDRESS, M0X1) },
+		{ OP_ROWS(OP_ADDRESS, M0X0) },
+		{ OP_ROWS(OP_ADDRESS, Slow) }
+	};
+
+	uint8					Op;
+	uint16					OpPC;
+	const struct SOpcodes	*Opcodes;
+	const struct SOpcodes	*Current = NULL;
+	void * const			*Labels = NULL;
+
+	// The first instruction is not preceded by an SA-1 slice
+	if (!S9xMainLoopEvents())
+		goto stop;
+	FETCH();
+
+	OP_ROWS(OP_LABEL, M1X1)
+	OP_ROWS(OP_LABEL, E1)
+	OP_ROWS(OP_LABEL, M1X0)
+	OP_ROWS(OP_LABEL, M0X1)
+	OP_ROWS(OP_LABEL, M0X0)
+	OP_ROWS(OP_LABEL, Slow)
+
+deadlock:
+	Settings.StopEmulation = true;
+	CPU.Flags |= HALTED_FLAG;
+	S9xMessage(S9X_FATAL_ERROR, 0, "CPU is deadlocked");
+	return;
+
+stop:
+	S9xPackStatus();
+}
+
+#undef OP_ROW
+#undef OP_ROWS
+#undef OP_ADDRESS
+#undef OP_LABEL
+#undef EVENTS_PENDING
+#undef NEXT
+#undef FETCH
+
+#endif
@@ -13,6 +13,8 @@
 #include "movie.h"
 #include "screenshot.h"
 #include "display.h"
+#include "renderthread.h"
+#include "../profiler.h"
 
 extern struct SCheatData		Cheat;
 extern struct SLineData			LineData[240];
@@ -103,6 +105,8 @@ bool8 S9xGraphicsInit (void)
 
 void S9xGraphicsDeinit (void)
 {
+	S9xRenderThreadDeinit();
+
 	if (GFX.ZERO)       { free(GFX.ZERO);       GFX.ZERO       = NULL; }
 	if (GFX.SubScreen)  { free(GFX.SubScreen);  GFX.SubScreen  = NULL; }
 	if (GFX.ZBuffer)    { free(GFX.ZBuffer);    GFX.ZBuffer    = NULL; }
@@ -178,6 +182,8 @@ void S9xStartScreenRefresh (void)
 
 		memset(GFX.ZBuffer, 0, GFX.ScreenSize);
 		memset(GFX.SubZBuffer, 0, GFX.ScreenSize);
+
+		S9xRenderThreadStartFrame();
 	}
 
 	if (++IPPU.FrameCount == (uint32)Memory.ROMFramesPerSecond)
@@ -198,6 +204,7 @@ void S9xEndScreenRefresh (void)
 	if (IPPU.RenderThisFrame)
 	{
 		FLUSH_REDRAW();
+		S9xRenderThreadFinishFrame();
 
 		if (GFX.DoInterlace && S9xInterlaceField() == 0)
 		{
@@ -266,6 +273,7 @@ void S9xEndScreenRefresh (void)
 
 void RenderLine (uint8 C)
 {
+	S9X_PROFILE_SCOPE(PPU);
 	if (IPPU.RenderThisFrame)
 	{
 		LineData[C].BG[0].VOffset = PPU.BG[0].VOffset + 1;
@@ -294,6 +302,7 @@ void RenderLine (uint8 C)
 		}
 
 		IPPU.CurrentLine = C + 1;
+		S9xRenderThreadLine();
 	}
 	else
 	{
@@ -435,6 +444,11 @@ static inline void RenderScreen (bool8 sub)
 
 void S9xUpdateScreen (void)
 {
+	S9X_PROFILE_SCOPE(PPU);
+	// With the render thread on the lines are queued for it, and only what
+	// emulation can see (OBJ range and time over, screen size) is kept here
+	bool8	draw = S9xRenderThreadQueue();
+
 	if (IPPU.OBJChanged || IPPU.InterlaceOBJ)
 		SetupOBJ();
 
@@ -452,14 +466,15 @@ void S9xUpdateScreen (void)
 
 		if (PPU.RecomputeClipWindows)
 		{
-			S9xComputeClipWindows();
+			if (draw)
+				S9xComputeClipWindows();
 			PPU.RecomputeClipWindows = FALSE;
 		}
 
 		if (!IPPU.DoubleWidthPixels && (PPU.BGMode == 5 || PPU.BGMode == 6 || IPPU.PseudoHires))
 		{
 			// Have to back out of the regular speed hack
-			for (uint32 y = 0; y < GFX.StartY; y++)
+			for (uint32 y = 0; draw && y < GFX.StartY; y++)
 			{
 				uint16	*p = GFX.Screen + y * GFX.PPL + 255;
 				uint16	*q = GFX.Screen + y * GFX.PPL + 510;
@@ -479,22 +494,28 @@ void S9xUpdateScreen (void)
 			GFX.PPL = GFX.RealPPL << 1;
 			GFX.DoInterlace = 2;
 
-			for (int32 y = (int32) GFX.StartY - 2; y >= 0; y--)
+			for (int32 y = (int32) GFX.StartY - 2; draw && y >= 0; y--)
 				memmove(GFX.Screen + (y + 1) * GFX.PPL, GFX.Screen + y * GFX.RealPPL, GFX.PPL * sizeof(uint16));
 		}
 
 		if ((Memory.FillRAM[0x2130] & 0x30) != 0x30 && (Memory.FillRAM[0x2131] & 0x3f))
 			GFX.FixedColour = BUILD_PIXEL(IPPU.XB[PPU.FixedColourRed], IPPU.XB[PPU.FixedColourGreen], IPPU.XB[PPU.FixedColourBlue]);
 
-		if (PPU.BGMode == 5 || PPU.BGMode == 6 || IPPU.PseudoHires ||
-			((Memory.FillRAM[0x2130] & 0x30) != 0x30 && (Memory.FillRAM[0x2130] & 2) && (Memory.FillRAM[0x2131] & 0x3f) && (Memory.FillRAM[0x212d] & 0x1f)))
-			// If hires (Mode 5/6 or pseudo-hires) or math is to be done
-			// involving the subscreen, then we need to render the subscreen...
-			RenderScreen(TRUE);
+		if (draw)
+		{
+			S9xInvalidateDirtyTiles();
+
+			if (PPU.BGMode == 5 || PPU.BGMode == 6 || IPPU.PseudoHires ||
+				((Memory.FillRAM[0x2130] & 0x30) != 0x30 && (Memory.FillRAM[0x2130] & 2) && (Memory.FillRAM[0x2131] & 0x3f) && (Memory.FillRAM[0x212d] & 0x1f)))
+				// If hires (Mode 5/6 or pseudo-hires) or math is to be done
+				// involving the subscreen, then we need to render the subscreen...
+				RenderScreen(TRUE);
 
-		RenderScreen(FALSE);
+			RenderScreen(FALSE);
+		}
 	}
 	else
+	if (draw)
 	{
 		const uint16	black = BUILD_PIXEL(0, 0, 0);
 
@@ -1550,6 +1550,18 @@ bool8 CMemory::LoadROMInt (int32 ROMfillSize)
 		}
 	}
 
+	if (CaptureROM)
+	{
+		// Past the image the ROM is only zeros left by the loaders
+		uint32	size = MAX_ROM_SIZE;
+		uint64	word;
+		while (size >= 8 && (memcpy(&word, ROM + size - 8, 8), word == 0))
+			size -= 8;
+		while (size > 0 && ROM[size - 1] == 0)
+			size--;
+		CapturedROM.assign(ROM, ROM + size);
+	}
+
 	memset(&SNESGameFixes, 0, sizeof(SNESGameFixes));
 	SNESGameFixes.SRAMInitialValue = 0x60;
 
@@ -1563,6 +1575,62 @@ bool8 CMemory::LoadROMInt (int32 ROMfillSize)
     return (TRUE);
 }
 
+void CMemory::DescribeROM (SROMAnalysis &analysis)
+{
+	analysis.ImageSize = CapturedROM.size();
+	analysis.CalculatedSize = CalculatedSize;
+	analysis.HiROM = HiROM;
+	analysis.ExtendedFormat = ExtendedFormat;
+	analysis.HeaderCount = HeaderCount;
+	memcpy(analysis.NSRTHeader, NSRTHeader, sizeof(NSRTHeader));
+	analysis.IsPatched = Settings.IsPatched;
+	analysis.ROMCRC32 = ROMCRC32;
+	memcpy(analysis.ROMSHA256, ROMSHA256, sizeof(ROMSHA256));
+}
+
+// Loads an image captured by LoadROMInt(): the file, the patches and the
+// header analysis are skipped, and InitROM() takes the checksums as given
+bool8 CMemory::LoadPreparedROM (const uint8 *image, const SROMAnalysis &analysis, const char *filename)
+{
+	if (!image || analysis.ImageSize > MAX_ROM_SIZE || analysis.CalculatedSize > MAX_ROM_SIZE)
+		return (FALSE);
+
+	S9xResetSaveTimer(FALSE);
+
+	ROMFilename = filename ? filename : "MemoryROM";
+	memset(&Multi, 0, sizeof(Multi));
+	memcpy(ROM, image, analysis.ImageSize);
+	memset(ROM + analysis.ImageSize, 0, MAX_ROM_SIZE - analysis.ImageSize);
+
+	HeaderCount = analysis.HeaderCount;
+	memcpy(NSRTHeader, analysis.NSRTHeader, sizeof(NSRTHeader));
+	Settings.IsPatched = analysis.IsPatched;
+
+	Settings.DisplayColor = BUILD_PIXEL(31, 31, 31);
+	SET_UI_COLOR(255, 255, 255);
+
+	CalculatedSize = analysis.CalculatedSize;
+	ExtendedFormat = analysis.ExtendedFormat;
+	HiROM = analysis.HiROM;
+	LoROM = !analysis.HiROM;
+
+	memset(&SNESGameFixes, 0, sizeof(SNESGameFixes));
+	SNESGameFixes.SRAMInitialValue = 0x60;
+
+	ROMCRC32 = analysis.ROMCRC32;
+	memcpy(ROMSHA256, analysis.ROMSHA256, sizeof(ROMSHA256));
+	ChecksumsKnown = TRUE;
+	InitROM();
+	ChecksumsKnown = FALSE;
+
+	S9xReset();
+
+	S9xDeleteCheats();
+	S9xLoadCheatFile(S9xGetFilename(".cht", CHEAT_DIR).c_str());
+
+	return (TRUE);
+}
+
 bool8 CMemory::LoadMultiCartMem (const uint8 *sourceA, uint32 sourceASize,
                                  const uint8 *sourceB, uint32 sourceBSize,
                                  const uint8 *bios, uint32 biosSize)
@@ -2320,7 +2388,11 @@ void CMemory::InitROM (void)
 	//// Build more ROM information
 
 	// CRC32
-	if (!Settings.BS || Settings.BSXItself) // Not BS Dump
+	if (ChecksumsKnown)
+	{
+		// Given by LoadPreparedROM()
+	}
+	else if (!Settings.BS || Settings.BSXItself) // Not BS Dump
 	{
 		ROMCRC32 = caCRC32(ROM, CalculatedSize);
 		sha256sum(ROM, CalculatedSize, ROMSHA256);
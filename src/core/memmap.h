@@ -16,6 +16,21 @@
 #include <vector>
 #include <cstdint>
 
+// What loading works out about a ROM image, so that the same image can be
+// loaded again without redoing it (CMemory::LoadPreparedROM())
+struct SROMAnalysis
+{
+	uint32	ImageSize;			// bytes of ROM that may be non-zero
+	uint32	CalculatedSize;
+	bool8	HiROM;
+	uint8	ExtendedFormat;
+	int32	HeaderCount;
+	uint8	NSRTHeader[32];
+	bool8	IsPatched;
+	uint32	ROMCRC32;
+	unsigned char ROMSHA256[32];
+};
+
 struct CMemory
 {
 	enum
@@ -101,6 +116,12 @@ struct CMemory
 	// ports can assign this to perform some custom action upon loading a ROM (such as adjusting controls)
 	void	(*PostRomInitFunc) (void);
 
+	// With CaptureROM set, LoadROMInt() keeps a copy of the ROM as it hands
+	// it to InitROM(); DescribeROM() then fills in the rest of the analysis
+	bool8	CaptureROM = FALSE;
+	std::vector<uint8_t> CapturedROM;
+	bool8	ChecksumsKnown = FALSE;	// InitROM() keeps ROMCRC32 and ROMSHA256
+
 	bool8	Init (void);
 	void	Deinit (void);
 
@@ -112,6 +133,8 @@ struct CMemory
     bool8   LoadROMMem (const uint8 *, uint32, const char* optional_rom_filename = NULL);
 	bool8	LoadROM (const char *);
     bool8	LoadROMInt (int32);
+	bool8	LoadPreparedROM (const uint8 *, const SROMAnalysis &, const char *);
+	void	DescribeROM (SROMAnalysis &);
     bool8   LoadMultiCartMem (const uint8 *, uint32, const uint8 *, uint32, const uint8 *, uint32);
 	bool8	LoadMultiCart (const char *, const char *);
     bool8	LoadMultiCartInt ();
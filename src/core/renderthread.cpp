@@ -0,0 +1,610 @@
+/*****************************************************************************\
+     Snes9x - Portable Super Nintendo Entertainment System (TM) emulator.
+                This file is licensed under the Snes9x License.
+   For further information, consult the LICENSE file in the root directory.
+\*****************************************************************************/
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "snes9x.h"
+#include "memmap.h"
+#include "ppu.h"
+#include "tile.h"
+#include "controls.h"
+#include "crosshairs.h"
+#include "cheats.h"
+#include "movie.h"
+#include "screenshot.h"
+#include "display.h"
+#include "renderthread.h"
+#include "../profiler.h"
+
+extern struct SLineData			LineData[240];
+extern struct SLineMatrixData	LineMatrixData[240];
+
+// Lines sent ahead of the next flush at a time
+#define RENDER_SPLIT_LINES	16
+
+#define VRAM_BLOCK_SIZE		1024
+#define VRAM_BLOCKS			(0x10000 / VRAM_BLOCK_SIZE)
+
+enum
+{
+	RENDER_BATCH_FRAME,
+	RENDER_BATCH_LINES
+};
+
+// What the worker needs to draw lines From to To - 1, as it was on the
+// emulation thread when they were queued
+struct SRenderBatch
+{
+	uint8	Kind;
+	bool8	ClearZ;				// lines drawn before, by an earlier split
+	int		From;
+	int		To;
+	struct SPPU			PPU;
+	struct InternalPPU	IPPU;
+	uint8	FillRAM[0x40];		// $2100-$213f
+	uint32	PPL;
+	uint8	DoInterlace;
+	uint16	*Screen;
+	int		VRAMBlocks;
+	uint8	VRAMIndex[VRAM_BLOCKS];
+	uint8	VRAM[0x10000];
+	struct SLineData		LineData[240];
+	struct SLineMatrixData	LineMatrixData[240];
+};
+
+// The worker's renderer: gfx.cpp, clip.cpp, tile.cpp and the tileimpl
+// instantiations built again against this namespace's PPU, IPPU, GFX, BG,
+// VRAM, line data and brightness_cap, so drawing never touches what the
+// emulation thread is changing. Only the read-only tables (mul_brightness,
+// BlackColourMap, GFX.ZERO) and Settings are shared.
+
+#undef S9X_PROFILE_SCOPE
+#define S9X_PROFILE_SCOPE(subsystem)
+
+namespace S9xRenderWorker
+{
+	struct SRenderMemory
+	{
+		uint8	VRAM[0x10000];
+		uint8	FillRAM[0x8000];
+		int32	ROMFramesPerSecond;
+	};
+
+	struct SPPU				PPU;
+	struct InternalPPU		IPPU;
+	struct SGFX				GFX;
+	struct SBG				BG;
+	struct SRenderMemory	Memory;
+	struct SLineData		LineData[240];
+	struct SLineMatrixData	LineMatrixData[240];
+	uint16					DirectColourMaps[8][256];
+	uint8					brightness_cap[64];
+	struct SCheatData		Cheat;
+
+	// gfx.h's, reading this namespace's brightness_cap; tileimpl.h is first
+	// included below, so its blend typedefs pick this one
+	struct COLOR_ADD_BRIGHTNESS
+	{
+		static alwaysinline uint16 fn(uint16 C1, uint16 C2)
+		{
+			return ((brightness_cap[ (C1 >> RED_SHIFT_BITS)           +  (C2 >> RED_SHIFT_BITS)          ] << RED_SHIFT_BITS)   |
+					(brightness_cap[((C1 >> GREEN_SHIFT_BITS) & 0x1f) + ((C2 >> GREEN_SHIFT_BITS) & 0x1f)] << GREEN_SHIFT_BITS) |
+		#if GREEN_SHIFT_BITS == 6
+				   ((brightness_cap[((C1 >> 6) & 0x1f) + ((C2 >> 6) & 0x1f)] & 0x10) << 1) |
+		#endif
+					(brightness_cap[ (C1                      & 0x1f) +  (C2                      & 0x1f)]      ));
+		}
+
+		static alwaysinline uint16 fn1_2(uint16 C1, uint16 C2)
+		{
+			return COLOR_ADD::fn1_2(C1, C2);
+		}
+	};
+
+	static inline bool S9xInterlaceField (void)
+	{
+		return (Memory.FillRAM[0x213f] & 0x80) >> 7;
+	}
+
+	static inline void S9xRenderThreadStartFrame (void) { }
+	static inline bool8 S9xRenderThreadQueue (void) { return (TRUE); }
+	static inline void S9xRenderThreadLine (void) { }
+	static inline void S9xRenderThreadFinishFrame (void) { }
+
+	#define _TILEIMPL_CPP_
+	#include "tile.cpp"
+	#include "tileimpl-n1x1.cpp"
+	#include "tileimpl-n2x1.cpp"
+	#include "tileimpl-h2x1.cpp"
+	#include "clip.cpp"
+
+	// Renamed so that lookup through its enum argument does not also find
+	// the emulation thread's one
+	#define S9xVariableDisplayString	S9xRenderWorkerDisplayString
+	#include "gfx.cpp"
+	#undef S9xVariableDisplayString
+	#undef _TILEIMPL_CPP_
+
+	static uint8	*BuiltXB;
+	static bool8	Started;
+
+	static bool8 Init (void)
+	{
+		static const int	tiles[7] = { MAX_2BIT_TILES, MAX_4BIT_TILES, MAX_8BIT_TILES, MAX_2BIT_TILES, MAX_2BIT_TILES, MAX_4BIT_TILES, MAX_4BIT_TILES };
+
+		for (int t = 0; t < 7; t++)
+		{
+			IPPU.TileCache[t]  = (uint8 *) malloc(tiles[t] * 64);
+			IPPU.TileCached[t] = (uint8 *) calloc(tiles[t], 1);
+		}
+
+		GFX.SubScreen  = (uint16 *) malloc(GFX.ScreenSize * sizeof(uint16));
+		GFX.ZBuffer    = (uint8 *)  calloc(GFX.ScreenSize, 1);
+		GFX.SubZBuffer = (uint8 *)  calloc(GFX.ScreenSize, 1);
+		GFX.ZERO = ::GFX.ZERO;
+		GFX.EndY = 0;
+		BuiltXB = NULL;
+		Started = TRUE;
+
+		S9xInitTileRenderer();
+
+		for (int t = 0; t < 7; t++)
+			if (!IPPU.TileCache[t] || !IPPU.TileCached[t])
+				return (FALSE);
+
+		return (GFX.SubScreen && GFX.ZBuffer && GFX.SubZBuffer);
+	}
+
+	static void Deinit (void)
+	{
+		for (int t = 0; t < 7; t++)
+		{
+			free(IPPU.TileCache[t]);
+			free(IPPU.TileCached[t]);
+			IPPU.TileCache[t] = IPPU.TileCached[t] = NULL;
+		}
+
+		free(GFX.SubScreen);
+		free(GFX.ZBuffer);
+		free(GFX.SubZBuffer);
+		GFX.SubScreen = NULL;
+		GFX.ZBuffer = GFX.SubZBuffer = NULL;
+		GFX.ZERO = NULL;
+	}
+
+	// A block is one word of IPPU.TileDirty; the tiles are dropped when the
+	// batch is drawn, S9xInvalidateDirtyTiles()
+	static void InvalidateTiles (int block)
+	{
+		IPPU.TileDirty[block] = ~(uint64) 0;
+	}
+
+	static void Render (const struct SRenderBatch *b)
+	{
+		for (int i = 0; i < b->VRAMBlocks; i++)
+		{
+			memcpy(Memory.VRAM + b->VRAMIndex[i] * VRAM_BLOCK_SIZE, b->VRAM + i * VRAM_BLOCK_SIZE, VRAM_BLOCK_SIZE);
+			InvalidateTiles(b->VRAMIndex[i]);
+		}
+
+		if (b->Kind == RENDER_BATCH_FRAME)
+		{
+			memset(GFX.ZBuffer, 0, GFX.ScreenSize);
+			memset(GFX.SubZBuffer, 0, GFX.ScreenSize);
+			return;
+		}
+
+		PPU = b->PPU;
+
+		IPPU.OBJChanged           = b->IPPU.OBJChanged;
+		IPPU.Interlace            = b->IPPU.Interlace;
+		IPPU.InterlaceOBJ         = b->IPPU.InterlaceOBJ;
+		IPPU.PseudoHires          = b->IPPU.PseudoHires;
+		IPPU.DoubleWidthPixels    = b->IPPU.DoubleWidthPixels;
+		IPPU.DoubleHeightPixels   = b->IPPU.DoubleHeightPixels;
+		IPPU.XB                   = b->IPPU.XB;
+		IPPU.MaxBrightness        = b->IPPU.MaxBrightness;
+		IPPU.RenderThisFrame      = b->IPPU.RenderThisFrame;
+		IPPU.RenderedScreenWidth  = b->IPPU.RenderedScreenWidth;
+		IPPU.RenderedScreenHeight = b->IPPU.RenderedScreenHeight;
+
+		// Sprites and windows were last set up by the emulation thread, the
+		// last time it drew
+		if (Started)
+		{
+			IPPU.OBJChanged = TRUE;
+			PPU.RecomputeClipWindows = TRUE;
+			Started = FALSE;
+		}
+
+		memcpy(IPPU.ScreenColors, b->IPPU.ScreenColors, sizeof(IPPU.ScreenColors));
+
+		memcpy(Memory.FillRAM + 0x2100, b->FillRAM, sizeof(b->FillRAM));
+		GFX.PPL = b->PPL;
+		GFX.DoInterlace = b->DoInterlace;
+		GFX.Screen = b->Screen;
+
+		if (IPPU.XB != BuiltXB)
+		{
+			// As S9xFixColourBrightness() builds the emulation thread's
+			for (int i = 0; i < 64; i++)
+				brightness_cap[i] = i > IPPU.XB[0x1f] ? IPPU.XB[0x1f] : i;
+			S9xBuildDirectColourMaps();
+			BuiltXB = IPPU.XB;
+		}
+
+		memcpy(LineData + b->From, b->LineData + b->From, (b->To - b->From) * sizeof(struct SLineData));
+		memcpy(LineMatrixData + b->From, b->LineMatrixData + b->From, (b->To - b->From) * sizeof(struct SLineMatrixData));
+
+		if (b->ClearZ)
+		{
+			memset(GFX.ZBuffer + b->From * GFX.PPL, 0, (b->To - b->From) * GFX.PPL);
+			memset(GFX.SubZBuffer + b->From * GFX.PPL, 0, (b->To - b->From) * GFX.PPL);
+		}
+
+		IPPU.PreviousLine = b->From;
+		IPPU.CurrentLine = b->To;
+		S9xUpdateScreen();
+	}
+}
+
+// What drawing the lines since the last flush depends on, to tell whether a
+// split batch is still good. Members that drawing does not read, or reads
+// from the line data, are left out.
+struct SRenderKey
+{
+	struct SPPU	PPU;
+	uint8	FillRAM[8];			// $212c-$2133
+	uint8	InterlaceField;
+	bool8	OBJChanged;
+	bool8	Interlace;
+	bool8	InterlaceOBJ;
+	bool8	PseudoHires;
+	bool8	DoubleWidthPixels;
+	bool8	DoubleHeightPixels;
+	uint8	*XB;
+	uint16	ScreenColors[256];
+};
+
+static struct
+{
+	std::thread					Thread;
+	std::mutex					Mutex;
+	std::condition_variable		Wake;
+	std::condition_variable		Idle;
+	std::deque<struct SRenderBatch *>	Queue;
+	std::vector<struct SRenderBatch *>	Free;
+	bool8	Running;
+	bool8	Stop;
+	bool8	Busy;
+
+	bool8	Active;				// this frame goes to the worker
+	bool8	Verify;
+	int		SentLine;			// lines before it are queued
+	bool8	Split;				// a split batch was queued since the last flush
+	struct SRenderKey	Key;	// as of that split
+
+	bool8	VRAMValid;			// the worker has all of VRAM
+	std::vector<uint16>	VerifyBuffer;
+
+	struct SRenderThreadStats	Stats;
+}	RT;
+
+static uint64 NanosSince (std::chrono::steady_clock::time_point start)
+{
+	return (std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+static void WorkerLoop (void)
+{
+	std::unique_lock<std::mutex>	lock(RT.Mutex);
+
+	for (;;)
+	{
+		RT.Wake.wait(lock, [] { return (RT.Stop || !RT.Queue.empty()); });
+		if (RT.Queue.empty())
+			break;
+
+		struct SRenderBatch	*b = RT.Queue.front();
+		RT.Queue.pop_front();
+		RT.Busy = TRUE;
+		lock.unlock();
+
+		std::chrono::steady_clock::time_point	start = std::chrono::steady_clock::now();
+		S9xRenderWorker::Render(b);
+		uint64	nanos = NanosSince(start);
+
+		lock.lock();
+		RT.Stats.RenderNanos += nanos;
+		RT.Free.push_back(b);
+		RT.Busy = FALSE;
+		if (RT.Queue.empty())
+			RT.Idle.notify_all();
+	}
+}
+
+static void Drain (void)
+{
+	std::chrono::steady_clock::time_point	start = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex>	lock(RT.Mutex);
+	RT.Idle.wait(lock, [] { return (RT.Queue.empty() && !RT.Busy); });
+	RT.Stats.WaitNanos += NanosSince(start);
+}
+
+static bool8 Start (void)
+{
+	if (!S9xRenderWorker::Init())
+	{
+		S9xRenderWorker::Deinit();
+		return (FALSE);
+	}
+
+	RT.Stop = FALSE;
+	RT.Busy = FALSE;
+	RT.VRAMValid = FALSE;
+	RT.Thread = std::thread(WorkerLoop);
+	RT.Running = TRUE;
+
+	return (TRUE);
+}
+
+static void Stop (void)
+{
+	{
+		std::lock_guard<std::mutex>	lock(RT.Mutex);
+		RT.Stop = TRUE;
+	}
+
+	RT.Wake.notify_one();
+	RT.Thread.join();
+	RT.Running = FALSE;
+	RT.Active = FALSE;
+
+	for (struct SRenderBatch *b : RT.Free)
+		delete b;
+	RT.Free.clear();
+	RT.VerifyBuffer.clear();
+	RT.VerifyBuffer.shrink_to_fit();
+
+	S9xRenderWorker::Deinit();
+}
+
+static struct SRenderBatch * Acquire (uint8 kind)
+{
+	struct SRenderBatch	*b = NULL;
+
+	{
+		std::lock_guard<std::mutex>	lock(RT.Mutex);
+		if (!RT.Free.empty())
+		{
+			b = RT.Free.back();
+			RT.Free.pop_back();
+		}
+	}
+
+	if (!b)
+		b = new struct SRenderBatch;
+
+	b->Kind = kind;
+	b->ClearZ = FALSE;
+	b->From = b->To = 0;
+	b->VRAMBlocks = 0;
+
+	// The blocks written since the last batch, as marked by S9xTileDirty
+	uint64	changed = RT.VRAMValid ? IPPU.VRAMChanged : ~(uint64) 0;
+	IPPU.VRAMChanged = 0;
+
+	for (int i = 0; changed; i++, changed >>= 1)
+	{
+		if (!(changed & 1))
+			continue;
+
+		memcpy(b->VRAM + b->VRAMBlocks * VRAM_BLOCK_SIZE, Memory.VRAM + i * VRAM_BLOCK_SIZE, VRAM_BLOCK_SIZE);
+		b->VRAMIndex[b->VRAMBlocks++] = i;
+	}
+
+	RT.VRAMValid = TRUE;
+
+	return (b);
+}
+
+// RT.Stats is read by S9xGetRenderThreadStats on other threads, so the
+// emulation thread only updates it under RT.Mutex too
+static void Submit (struct SRenderBatch *b)
+{
+	{
+		std::lock_guard<std::mutex>	lock(RT.Mutex);
+		RT.Queue.push_back(b);
+		RT.Stats.VRAMBlocks += b->VRAMBlocks;
+	}
+
+	RT.Wake.notify_one();
+}
+
+static void MakeKey (struct SRenderKey *k)
+{
+	memset(k, 0, sizeof(struct SRenderKey));
+	memcpy(&k->PPU, &PPU, sizeof(struct SPPU));
+
+	// Access latches, timers, counters and per-line values
+	memset(&k->PPU.VMA, 0, sizeof(k->PPU.VMA));
+	k->PPU.WRAM = 0;
+	for (int i = 0; i < 4; i++)
+		k->PPU.BG[i].HOffset = k->PPU.BG[i].VOffset = 0;
+	k->PPU.CGFLIP = k->PPU.CGFLIPRead = k->PPU.CGADD = k->PPU.CGSavedByte = 0;
+	k->PPU.SavedOAMAddr = k->PPU.OAMWriteRegister = 0;
+	k->PPU.OAMReadFlip = 0;
+	k->PPU.RangeTimeOver = 0;
+	k->PPU.HTimerEnabled = k->PPU.VTimerEnabled = FALSE;
+	k->PPU.HTimerPosition = k->PPU.VTimerPosition = 0;
+	k->PPU.IRQHBeamPos = k->PPU.IRQVBeamPos = 0;
+	k->PPU.HBeamFlip = k->PPU.VBeamFlip = 0;
+	k->PPU.HBeamPosLatched = k->PPU.VBeamPosLatched = 0;
+	k->PPU.GunHLatch = k->PPU.GunVLatch = 0;
+	k->PPU.HVBeamCounterLatched = 0;
+	k->PPU.MatrixA = k->PPU.MatrixB = k->PPU.MatrixC = k->PPU.MatrixD = 0;
+	k->PPU.CentreX = k->PPU.CentreY = k->PPU.M7HOFS = k->PPU.M7VOFS = 0;
+	k->PPU.Need16x8Mulitply = FALSE;
+	k->PPU.BGnxOFSbyte = k->PPU.M7byte = 0;
+	k->PPU.HDMA = k->PPU.HDMAEnded = 0;
+	k->PPU.OpenBus1 = k->PPU.OpenBus2 = 0;
+	k->PPU.VRAMReadBuffer = 0;
+
+	memcpy(k->FillRAM, Memory.FillRAM + 0x212c, sizeof(k->FillRAM));
+	k->InterlaceField = S9xInterlaceField();
+	k->OBJChanged = IPPU.OBJChanged;
+	k->Interlace = IPPU.Interlace;
+	k->InterlaceOBJ = IPPU.InterlaceOBJ;
+	k->PseudoHires = IPPU.PseudoHires;
+	k->DoubleWidthPixels = IPPU.DoubleWidthPixels;
+	k->DoubleHeightPixels = IPPU.DoubleHeightPixels;
+	k->XB = IPPU.XB;
+	memcpy(k->ScreenColors, IPPU.ScreenColors, sizeof(k->ScreenColors));
+}
+
+// Queues the lines since the last batch. A split must leave the lines it
+// draws as the next flush would have, so one is only made when that flush
+// has nothing to change about lines already drawn (the hires and interlace
+// switches in S9xUpdateScreen()); if the PPU still changes before it, the
+// lines since the last flush are drawn again.
+static void QueueLines (bool8 split)
+{
+	struct SRenderBatch	*b = Acquire(RENDER_BATCH_LINES);
+	struct SRenderKey	key;
+	int		from = RT.SentLine;
+	uint64	redrawn = 0;
+
+	if (RT.Split || split)
+		MakeKey(&key);
+
+	if (RT.Split && (b->VRAMBlocks || memcmp(&key, &RT.Key, sizeof(key))))
+	{
+		redrawn = RT.SentLine - IPPU.PreviousLine;
+		from = IPPU.PreviousLine;
+		b->ClearZ = TRUE;
+	}
+
+	b->From = from;
+	b->To = IPPU.CurrentLine;
+	b->PPU = PPU;
+	b->IPPU = IPPU;
+	memcpy(b->FillRAM, Memory.FillRAM + 0x2100, sizeof(b->FillRAM));
+	b->PPL = GFX.PPL;
+	b->DoInterlace = GFX.DoInterlace;
+	b->Screen = RT.Verify ? &RT.VerifyBuffer[GFX.Screen - &GFX.ScreenBuffer[0]] : GFX.Screen;
+	memcpy(b->LineData + from, LineData + from, (b->To - from) * sizeof(struct SLineData));
+	memcpy(b->LineMatrixData + from, LineMatrixData + from, (b->To - from) * sizeof(struct SLineMatrixData));
+
+	Submit(b);
+
+	RT.SentLine = IPPU.CurrentLine;
+	RT.Split = split;
+	if (split)
+		RT.Key = key;
+
+	std::lock_guard<std::mutex>	lock(RT.Mutex);
+	RT.Stats.Batches++;
+	if (split)
+		RT.Stats.SplitBatches++;
+	RT.Stats.RedrawnLines += redrawn;
+}
+
+void S9xRenderThreadStartFrame (void)
+{
+	if (RT.Running)
+		Drain();
+
+	if (Settings.RenderThread && !RT.Running)
+		Start();
+	else
+	if (!Settings.RenderThread && RT.Running)
+		Stop();
+
+	RT.Active = RT.Running;
+	RT.Verify = Settings.RenderThreadVerify;
+	if (!RT.Active)
+		return;
+
+	if (RT.Verify && RT.VerifyBuffer.size() != GFX.ScreenBuffer.size())
+		RT.VerifyBuffer.assign(GFX.ScreenBuffer.size(), 0);
+
+	RT.SentLine = 0;
+	RT.Split = FALSE;
+	Submit(Acquire(RENDER_BATCH_FRAME));
+}
+
+bool8 S9xRenderThreadQueue (void)
+{
+	if (!RT.Active)
+		return (TRUE);
+
+	if (IPPU.CurrentLine > RT.SentLine || RT.Split)
+		QueueLines(FALSE);
+
+	return (RT.Verify);
+}
+
+void S9xRenderThreadLine (void)
+{
+	if (!RT.Active || IPPU.CurrentLine - RT.SentLine < RENDER_SPLIT_LINES)
+		return;
+
+	if (!PPU.ForcedBlanking)
+	{
+		if (!IPPU.DoubleWidthPixels && (PPU.BGMode == 5 || PPU.BGMode == 6 || IPPU.PseudoHires))
+			return;
+		if (!IPPU.DoubleHeightPixels && IPPU.Interlace && (PPU.BGMode == 5 || PPU.BGMode == 6))
+			return;
+	}
+
+	QueueLines(TRUE);
+}
+
+void S9xRenderThreadFinishFrame (void)
+{
+	if (!RT.Active)
+		return;
+
+	Drain();
+
+	bool8	mismatched = FALSE;
+
+	if (RT.Verify)
+	{
+		for (int y = 0; y < IPPU.RenderedScreenHeight && !mismatched; y++)
+		{
+			size_t	offset = (GFX.Screen - &GFX.ScreenBuffer[0]) + y * GFX.RealPPL;
+
+			mismatched = memcmp(&GFX.ScreenBuffer[offset], &RT.VerifyBuffer[offset], IPPU.RenderedScreenWidth * sizeof(uint16)) != 0;
+		}
+	}
+
+	std::lock_guard<std::mutex>	lock(RT.Mutex);
+	RT.Stats.Frames++;
+	if (mismatched)
+		RT.Stats.MismatchedFrames++;
+}
+
+void S9xRenderThreadDeinit (void)
+{
+	if (RT.Running)
+	{
+		Drain();
+		Stop();
+	}
+}
+
+void S9xGetRenderThreadStats (struct SRenderThreadStats *stats)
+{
+	std::lock_guard<std::mutex>	lock(RT.Mutex);
+	*stats = RT.Stats;
+	stats->Running = RT.Running;
+	stats->Verify = RT.Running && Settings.RenderThreadVerify;
+}
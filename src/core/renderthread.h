@@ -0,0 +1,50 @@
+/*****************************************************************************\
+     Snes9x - Portable Super Nintendo Entertainment System (TM) emulator.
+                This file is licensed under the Snes9x License.
+   For further information, consult the LICENSE file in the root directory.
+\*****************************************************************************/
+
+#ifndef _RENDERTHREAD_H_
+#define _RENDERTHREAD_H_
+
+// Rendering on a worker thread (Settings.RenderThread).
+//
+// S9xUpdateScreen() normally draws the lines since the last flush right
+// away, on the emulation thread. With the render thread on it snapshots
+// what drawing reads instead (PPU and IPPU registers, the line scroll and
+// matrix data, the VRAM blocks changed since the previous batch) and queues
+// the range for a worker with its own copy of the renderer (renderthread.cpp),
+// then carries on emulating. Ranges are also sent every few lines between
+// flushes so the worker keeps up; one is drawn again if the PPU changed
+// under it without a flush. The frame is waited for in S9xEndScreenRefresh(),
+// so GFX.Screen holds it when S9xDeinitUpdate() runs, as without the thread.
+//
+// Settings.RenderThreadVerify draws inline as well, into GFX.Screen, and the
+// worker into a buffer of its own; frames are compared when they end.
+
+struct SRenderThreadStats
+{
+	bool8	Running;
+	bool8	Verify;
+	uint64	Frames;				// drawn by the worker
+	uint64	Batches;			// line ranges queued
+	uint64	SplitBatches;		// queued between flushes
+	uint64	RedrawnLines;		// drawn again after a change without a flush
+	uint64	VRAMBlocks;			// 1 KB VRAM blocks copied to the worker
+	uint64	MismatchedFrames;	// verify: worker frame differed from inline
+	uint64	RenderNanos;		// worker busy
+	uint64	WaitNanos;			// emulation thread waiting for the worker
+};
+
+// From the emulation thread: S9xStartScreenRefresh(), S9xUpdateScreen()
+// (TRUE if the lines must still be drawn inline), RenderLine() and
+// S9xEndScreenRefresh(). The worker is started and stopped at the start of
+// a frame as Settings.RenderThread says.
+void S9xRenderThreadStartFrame (void);
+bool8 S9xRenderThreadQueue (void);
+void S9xRenderThreadLine (void);
+void S9xRenderThreadFinishFrame (void);
+void S9xRenderThreadDeinit (void);
+void S9xGetRenderThreadStats (struct SRenderThreadStats *);
+
+#endif
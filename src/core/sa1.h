@@ -21,7 +21,7 @@ struct SSA1Registers
 
 struct SSA1
 {
-	struct SOpcodes	*S9xOpcodes;
+	const struct SOpcodes	*S9xOpcodes;
 	uint8	*S9xOpLengths;
 	uint8	_Carry;
 	uint8	_Zero;
@@ -75,10 +75,10 @@ struct SSA1
 extern struct SSA1Registers	SA1Registers;
 extern struct SSA1			SA1;
 extern uint8				SA1OpenBus;
-extern struct SOpcodes		S9xSA1OpcodesM1X1[256];
-extern struct SOpcodes		S9xSA1OpcodesM1X0[256];
-extern struct SOpcodes		S9xSA1OpcodesM0X1[256];
-extern struct SOpcodes		S9xSA1OpcodesM0X0[256];
+extern const struct SOpcodes		S9xSA1OpcodesM1X1[256];
+extern const struct SOpcodes		S9xSA1OpcodesM1X0[256];
+extern const struct SOpcodes		S9xSA1OpcodesM0X1[256];
+extern const struct SOpcodes		S9xSA1OpcodesM0X0[256];
 extern uint8				S9xOpLengthsM1X1[256];
 extern uint8				S9xOpLengthsM1X0[256];
 extern uint8				S9xOpLengthsM0X1[256];
@@ -6,6 +6,7 @@
 
 #include "snes9x.h"
 #include "memmap.h"
+#include "../profiler.h"
 
 #define CPU								SA1
 #define ICPU							SA1
@@ -59,6 +60,7 @@ static void S9xSA1UpdateTimer (void);
 
 void S9xSA1MainLoop (void)
 {
+	S9X_PROFILE_SCOPE(SA1);
 	if (Memory.FillRAM[0x2200] & 0x60)
 	{
 		SA1.Cycles += 6; // FIXME
@@ -138,7 +140,7 @@ void S9xSA1MainLoop (void)
 	#endif
 
 		uint8				Op;
-		struct SOpcodes	*Opcodes;
+		const struct SOpcodes	*Opcodes;
 
 		if (SA1.PCBase)
 		{
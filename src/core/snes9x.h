@@ -309,6 +309,10 @@ struct SSettings
 
     bool8   SeparateEchoBuffer;
 	uint32	SuperFXClockMultiplier;
+	bool8	ThreadedDispatch;
+	bool8	SkipIdleLoops;
+	bool8	RenderThread;
+	bool8	RenderThreadVerify;
     int OverclockMode;
 	int	OneClockCycle;
 	int	OneSlowClockCycle;
@@ -53,6 +53,13 @@ StateManager::StateManager()
     tmp_state = NULL;
     in_state = NULL;
     init_done = false;
+    first_pop = false;
+    top_ptr = 0;
+    bottom_ptr = 0;
+    buf_size = 0;
+    buf_size_mask = 0;
+    state_size = 0;
+    real_state_size = 0;
 }
 
 StateManager::~StateManager() {
@@ -65,6 +72,10 @@ bool StateManager::init(size_t buffer_size) {
 
     deallocate();
 
+    // A zero size only releases the buffers
+    if (!buffer_size)
+        return false;
+
     real_state_size = S9xFreezeSize();
     state_size = real_state_size / sizeof(uint32_t); // Works in multiple of 4.
 
@@ -75,8 +86,9 @@ bool StateManager::init(size_t buffer_size) {
         return false;
 
     top_ptr = 1;
+    bottom_ptr = 0;
+    first_pop = false;
 
-    
     buf_size = nearest_pow2_size(buffer_size) / sizeof(uint64_t); // Works in multiple of 8.
     buf_size_mask = buf_size - 1;
 
@@ -87,6 +99,8 @@ bool StateManager::init(size_t buffer_size) {
     if (!(in_state = new uint32_t[state_size]))
        return false;
 
+    // Zero words are delta sentinels, so the ring must start out zeroed
+    memset(buffer,0,buf_size * sizeof(uint64_t));
     memset(tmp_state,0,state_size * sizeof(uint32_t));
     memset(in_state,0,state_size * sizeof(uint32_t));
 
@@ -139,9 +153,10 @@ void StateManager::reassign_bottom()
       bottom_ptr = (bottom_ptr + 1) & buf_size_mask;
 }
 
-void StateManager::generate_delta(const void *data)
+size_t StateManager::generate_delta(const void *data)
 {
    bool crossed = false;
+   size_t words = 1;
    const uint32_t *old_state = tmp_state;
    const uint32_t *new_state = (const uint32_t*)data;
 
@@ -164,6 +179,7 @@ void StateManager::generate_delta(const void *data)
       {
          buffer[top_ptr] = (i << 32) | xor_;
          top_ptr = (top_ptr + 1) & buf_size_mask;
+         words++;
 
          if (top_ptr == bottom_ptr)
             crossed = true;
@@ -172,6 +188,8 @@ void StateManager::generate_delta(const void *data)
 
    if (crossed)
       reassign_bottom();
+
+   return words;
 }
 
 bool StateManager::push()
@@ -189,3 +207,48 @@ bool StateManager::push()
 
     return true;
 }
+
+size_t StateManager::push_state(const void *state)
+{
+    if(!init_done)
+        return 0;
+    size_t words = generate_delta(state);
+    memcpy(tmp_state,state,real_state_size);
+
+    first_pop = true;
+
+    return words;
+}
+
+bool StateManager::undo()
+{
+    if(!init_done)
+        return false;
+
+    size_t top = (top_ptr - 1) & buf_size_mask;
+    if (top == bottom_ptr)
+        return false;
+
+    while (buffer[top])
+    {
+      uint32_t addr = buffer[top] >> 32;
+      uint32_t xor_ = buffer[top] & 0xFFFFFFFFU;
+      tmp_state[addr] ^= xor_;
+
+      top = (top - 1) & buf_size_mask;
+    }
+
+    // The sentinel slot becomes the next free slot, as in pop()
+    top_ptr = top;
+    if (top == bottom_ptr)
+        top_ptr = (top + 1) & buf_size_mask;
+    first_pop = true;
+    return true;
+}
+
+int StateManager::restore()
+{
+    if(!init_done)
+        return 0;
+    return S9xUnfreezeGameMem((uint8 *)tmp_state,real_state_size);
+}
@@ -22,7 +22,7 @@ private:
     bool first_pop;
     
     void reassign_bottom();
-    void generate_delta(const void *data);
+    size_t generate_delta(const void *data);
     void deallocate();
 public:
     StateManager();
@@ -30,6 +30,17 @@ public:
     bool init(size_t buffer_size);
     int pop();
     bool push();
+
+    // Split-up variants for callers that freeze on one thread and delta
+    // on another. push_state() returns the delta size in 64-bit words, or
+    // 0 on failure; undo() steps the top state back by one delta without
+    // loading it, restore() loads the top state.
+    size_t push_state(const void *state);
+    bool undo();
+    int restore();
+
+    size_t capacity() const { return init_done ? buf_size * sizeof(uint64_t) : 0; }
+    size_t snapshot_size() const { return real_state_size; }
 };
 
 #endif // STATEMANAGER_H
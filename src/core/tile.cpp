@@ -235,6 +235,241 @@ namespace {
 
 	#undef DOBIT
 
+	// Vector converters. A tile row holds a byte per bitplane with the
+	// leftmost pixel in bit 7: each plane's row byte is spread over the row's
+	// eight pixel bytes, tested against the bit for each pixel, and the plane's
+	// bit set where it is. The hires converters take pixels 0-3 from the odd or
+	// even bits of the tile and pixels 4-7 from the tile after it.
+
+	enum
+	{
+		CONVERT_NORMAL,
+		CONVERT_ODD,
+		CONVERT_EVEN
+	};
+
+	#define CONVERT_BITS(mode) \
+		((mode) == CONVERT_NORMAL ? 0x0102040810204080ULL : (mode) == CONVERT_ODD ? 0x0104104001041040ULL : 0x0208208002082080ULL)
+
+	inline uint8 * NextTile (uint8 *tp, uint32 Tile, int shift)
+	{
+		return (Tile == 0x3ff ? tp - (0x3ff << shift) : tp + (1 << shift));
+	}
+
+#ifdef S9X_TILE_SSE2
+	inline __m128i PlaneSSE2 (__m128i spread, __m128i bits, __m128i plane)
+	{
+		return (_mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(spread, bits), bits), plane));
+	}
+
+	template<int DEPTH, int MODE>
+	uint8 ConvertTileSSE2 (uint8 *pCache, uint32 TileAddr, uint32 Tile)
+	{
+		uint8	*tp1  = &Memory.VRAM[TileAddr];
+		uint8	*tp2  = MODE == CONVERT_NORMAL ? tp1 : NextTile(tp1, Tile, DEPTH == 2 ? 4 : 5);
+		__m128i	bits  = _mm_set1_epi64x((long long) CONVERT_BITS(MODE));
+		__m128i	low   = _mm_set1_epi16(0x00ff);
+		__m128i	row[4];
+
+		for (int i = 0; i < 4; i++)
+			row[i] = _mm_setzero_si128();
+
+		for (int pair = 0; pair < DEPTH / 2; pair++)
+		{
+			// Rows of the even plane in the low half, the odd plane in the high half
+			__m128i	a = _mm_loadu_si128((__m128i *) (tp1 + pair * 16));
+			__m128i	b;
+
+			a = _mm_packus_epi16(_mm_and_si128(a, low), _mm_srli_epi16(a, 8));
+			b = a;
+			if (MODE != CONVERT_NORMAL)
+			{
+				b = _mm_loadu_si128((__m128i *) (tp2 + pair * 16));
+				b = _mm_packus_epi16(_mm_and_si128(b, low), _mm_srli_epi16(b, 8));
+			}
+
+			for (int half = 0; half < 2; half++)
+			{
+				__m128i	plane = _mm_set1_epi8(1 << (pair * 2 + half));
+				__m128i	x     = half ? _mm_unpackhi_epi8(a, b) : _mm_unpacklo_epi8(a, b);
+				__m128i	y0    = _mm_unpacklo_epi8(x, x);
+				__m128i	y1    = _mm_unpackhi_epi8(x, x);
+
+				row[0] = _mm_or_si128(row[0], PlaneSSE2(_mm_unpacklo_epi16(y0, y0), bits, plane));
+				row[1] = _mm_or_si128(row[1], PlaneSSE2(_mm_unpackhi_epi16(y0, y0), bits, plane));
+				row[2] = _mm_or_si128(row[2], PlaneSSE2(_mm_unpacklo_epi16(y1, y1), bits, plane));
+				row[3] = _mm_or_si128(row[3], PlaneSSE2(_mm_unpackhi_epi16(y1, y1), bits, plane));
+			}
+		}
+
+		for (int i = 0; i < 4; i++)
+			_mm_storeu_si128((__m128i *) pCache + i, row[i]);
+
+		__m128i	any = _mm_or_si128(_mm_or_si128(row[0], row[1]), _mm_or_si128(row[2], row[3]));
+
+		return (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xffff ? TRUE : BLANK_TILE);
+	}
+#endif
+
+#ifdef S9X_TILE_AVX2
+	// One shuffle spreads a plane over four rows. Plain tiles shuffle the row
+	// bytes as loaded; hires tiles first interleave them with the next tile's.
+	template<int DEPTH, int MODE>
+	__attribute__((target("avx2")))
+	uint8 ConvertTileAVX2 (uint8 *pCache, uint32 TileAddr, uint32 Tile)
+	{
+		uint8	*tp1  = &Memory.VRAM[TileAddr];
+		uint8	*tp2  = MODE == CONVERT_NORMAL ? tp1 : NextTile(tp1, Tile, DEPTH == 2 ? 4 : 5);
+		__m256i	bits   = _mm256_set1_epi64x((long long) CONVERT_BITS(MODE));
+		__m256i	top    = _mm256_setzero_si256();	// rows 0-3
+		__m256i	bottom = _mm256_setzero_si256();	// rows 4-7
+		__m256i	spread_lo, spread_hi;
+
+		if (MODE == CONVERT_NORMAL)
+		{
+			spread_lo = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2, 2, 2,
+										 4, 4, 4, 4, 4, 4, 4, 4, 6, 6, 6, 6, 6, 6, 6, 6);
+			spread_hi = _mm256_setr_epi8(8, 8, 8, 8, 8, 8, 8, 8, 10, 10, 10, 10, 10, 10, 10, 10,
+										 12, 12, 12, 12, 12, 12, 12, 12, 14, 14, 14, 14, 14, 14, 14, 14);
+		}
+		else
+		{
+			spread_lo = _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 4, 4, 4, 4, 5, 5, 5, 5,
+										 8, 8, 8, 8, 9, 9, 9, 9, 12, 12, 12, 12, 13, 13, 13, 13);
+			spread_hi = spread_lo;
+		}
+
+		for (int pair = 0; pair < DEPTH / 2; pair++)
+		{
+			__m128i	a = _mm_loadu_si128((__m128i *) (tp1 + pair * 16));
+			__m256i	lo, hi;
+
+			if (MODE == CONVERT_NORMAL)
+				lo = hi = _mm256_broadcastsi128_si256(a);
+			else
+			{
+				__m128i	b = _mm_loadu_si128((__m128i *) (tp2 + pair * 16));
+
+				lo = _mm256_broadcastsi128_si256(_mm_unpacklo_epi8(a, b));
+				hi = _mm256_broadcastsi128_si256(_mm_unpackhi_epi8(a, b));
+			}
+
+			for (int half = 0; half < 2; half++)
+			{
+				__m256i	plane = _mm256_set1_epi8(1 << (pair * 2 + half));
+				__m256i	shift = _mm256_set1_epi8(MODE == CONVERT_NORMAL ? half : half * 2);
+				__m256i	upper = _mm256_shuffle_epi8(lo, _mm256_add_epi8(spread_lo, shift));
+				__m256i	lower = _mm256_shuffle_epi8(hi, _mm256_add_epi8(spread_hi, shift));
+
+				top    = _mm256_or_si256(top, _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(upper, bits), bits), plane));
+				bottom = _mm256_or_si256(bottom, _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(lower, bits), bits), plane));
+			}
+		}
+
+		_mm256_storeu_si256((__m256i *) pCache, top);
+		_mm256_storeu_si256((__m256i *) pCache + 1, bottom);
+
+		__m256i	any = _mm256_or_si256(top, bottom);
+
+		return (!_mm256_testz_si256(any, any) ? TRUE : BLANK_TILE);
+	}
+#endif
+
+#ifdef S9X_TILE_NEON
+	template<int DEPTH, int MODE>
+	uint8 ConvertTileNEON (uint8 *pCache, uint32 TileAddr, uint32 Tile)
+	{
+		uint8		*tp1 = &Memory.VRAM[TileAddr];
+		uint8		*tp2 = MODE == CONVERT_NORMAL ? tp1 : NextTile(tp1, Tile, DEPTH == 2 ? 4 : 5);
+		uint8x16_t	bits = vreinterpretq_u8_u64(vdupq_n_u64(CONVERT_BITS(MODE)));
+		uint8x16_t	row[4];
+
+		for (int i = 0; i < 4; i++)
+			row[i] = vdupq_n_u8(0);
+
+		for (int pair = 0; pair < DEPTH / 2; pair++)
+		{
+			// val[0] the rows of the even plane, val[1] the odd plane
+			uint8x8x2_t	a = vld2_u8(tp1 + pair * 16);
+			uint8x8x2_t	b = MODE == CONVERT_NORMAL ? a : vld2_u8(tp2 + pair * 16);
+
+			for (int half = 0; half < 2; half++)
+			{
+				uint8x16_t	plane = vdupq_n_u8(1 << (pair * 2 + half));
+				uint8x8x2_t	x     = vzip_u8(a.val[half], b.val[half]);
+
+				for (int h = 0; h < 2; h++)
+				{
+					uint8x8x2_t	y = vzip_u8(x.val[h], x.val[h]);
+
+					for (int k = 0; k < 2; k++)
+					{
+						uint16x4x2_t	z = vzip_u16(vreinterpret_u16_u8(y.val[k]), vreinterpret_u16_u8(y.val[k]));
+						uint8x16_t		r = vcombine_u8(vreinterpret_u8_u16(z.val[0]), vreinterpret_u8_u16(z.val[1]));
+
+						row[h * 2 + k] = vorrq_u8(row[h * 2 + k], vandq_u8(vtstq_u8(r, bits), plane));
+					}
+				}
+			}
+		}
+
+		for (int i = 0; i < 4; i++)
+			vst1q_u8(pCache + i * 16, row[i]);
+
+		uint64x2_t	any = vreinterpretq_u64_u8(vorrq_u8(vorrq_u8(row[0], row[1]), vorrq_u8(row[2], row[3])));
+
+		return ((vgetq_lane_u64(any, 0) | vgetq_lane_u64(any, 1)) ? TRUE : BLANK_TILE);
+	}
+#endif
+
+	#undef CONVERT_BITS
+
+	// By tile cache, TILE_2BIT to TILE_4BIT_ODD
+	const S9xTileConverter	PlainConverters[7] =
+	{
+		ConvertTile2,
+		ConvertTile4,
+		ConvertTile8,
+		ConvertTile2h_even,
+		ConvertTile2h_odd,
+		ConvertTile4h_even,
+		ConvertTile4h_odd
+	};
+
+	S9xTileConverter	Converters[7];
+	const char			*ConverterName = "c";
+
+	#define SET_CONVERTERS(kernel, name) \
+		Converters[TILE_2BIT]      = kernel<2, CONVERT_NORMAL>; \
+		Converters[TILE_4BIT]      = kernel<4, CONVERT_NORMAL>; \
+		Converters[TILE_8BIT]      = kernel<8, CONVERT_NORMAL>; \
+		Converters[TILE_2BIT_EVEN] = kernel<2, CONVERT_EVEN>; \
+		Converters[TILE_2BIT_ODD]  = kernel<2, CONVERT_ODD>; \
+		Converters[TILE_4BIT_EVEN] = kernel<4, CONVERT_EVEN>; \
+		Converters[TILE_4BIT_ODD]  = kernel<4, CONVERT_ODD>; \
+		ConverterName = name;
+
+	void SelectConverters (void)
+	{
+		memcpy(Converters, PlainConverters, sizeof(Converters));
+
+	#ifdef S9X_TILE_AVX2
+		if (__builtin_cpu_supports("avx2"))
+		{
+			SET_CONVERTERS(ConvertTileAVX2, "avx2");
+			return;
+		}
+	#endif
+	#ifdef S9X_TILE_SSE2
+		SET_CONVERTERS(ConvertTileSSE2, "sse2");
+	#endif
+	#ifdef S9X_TILE_NEON
+		SET_CONVERTERS(ConvertTileNEON, "neon");
+	#endif
+	}
+
+	#undef SET_CONVERTERS
+
 } // anonymous namespace
 
 void S9xInitTileRenderer (void)
@@ -294,6 +529,80 @@ void S9xInitTileRenderer (void)
 		hrbit_odd[i]  = m;
 		hrbit_even[i] = s;
 	}
+
+	SelectConverters();
+}
+
+S9xTileConverter S9xGetTileConverter (int type, bool8 vector)
+{
+	return (vector ? Converters[type] : PlainConverters[type]);
+}
+
+const char * S9xTileConverterName (void)
+{
+	return (ConverterName);
+}
+
+// Drops the converted tiles that read VRAM written since the last draw
+// (S9xTileDirty() in ppu.h). A kilobyte written whole, as by a DMA, is
+// cleared a run at a time. Hires tiles also read the tile after them.
+void S9xInvalidateDirtyTiles (void)
+{
+	for (int block = 0; block < (0x10000 >> 10); block++)
+	{
+		uint64	dirty = IPPU.TileDirty[block];
+
+		if (!dirty)
+			continue;
+
+		IPPU.TileDirty[block] = 0;
+
+		if (dirty == ~(uint64) 0)
+		{
+			uint32	t2 = block << 6;
+			uint32	t4 = block << 5;
+
+			memset(IPPU.TileCached[TILE_2BIT] + t2, 0, 64);
+			memset(IPPU.TileCached[TILE_4BIT] + t4, 0, 32);
+			memset(IPPU.TileCached[TILE_8BIT] + (block << 4), 0, 16);
+
+			for (int t = TILE_2BIT_EVEN; t <= TILE_2BIT_ODD; t++)
+			{
+				memset(IPPU.TileCached[t] + t2, 0, 64);
+				IPPU.TileCached[t][(t2 - 1) & (MAX_2BIT_TILES - 1)] = FALSE;
+			}
+
+			for (int t = TILE_4BIT_EVEN; t <= TILE_4BIT_ODD; t++)
+			{
+				memset(IPPU.TileCached[t] + t4, 0, 32);
+				IPPU.TileCached[t][(t4 - 1) & (MAX_4BIT_TILES - 1)] = FALSE;
+			}
+
+			IPPU.TileInvalidations += 64;
+			continue;
+		}
+
+		for (uint32 t2 = block << 6; dirty; t2++, dirty >>= 1)
+		{
+			if (!(dirty & 1))
+				continue;
+
+			uint32	t4 = t2 >> 1;
+
+			IPPU.TileCached[TILE_2BIT][t2] = FALSE;
+			IPPU.TileCached[TILE_4BIT][t4] = FALSE;
+			IPPU.TileCached[TILE_8BIT][t2 >> 2] = FALSE;
+			IPPU.TileCached[TILE_2BIT_EVEN][t2] = FALSE;
+			IPPU.TileCached[TILE_2BIT_EVEN][(t2 - 1) & (MAX_2BIT_TILES - 1)] = FALSE;
+			IPPU.TileCached[TILE_2BIT_ODD] [t2] = FALSE;
+			IPPU.TileCached[TILE_2BIT_ODD] [(t2 - 1) & (MAX_2BIT_TILES - 1)] = FALSE;
+			IPPU.TileCached[TILE_4BIT_EVEN][t4] = FALSE;
+			IPPU.TileCached[TILE_4BIT_EVEN][(t4 - 1) & (MAX_4BIT_TILES - 1)] = FALSE;
+			IPPU.TileCached[TILE_4BIT_ODD] [t4] = FALSE;
+			IPPU.TileCached[TILE_4BIT_ODD] [(t4 - 1) & (MAX_4BIT_TILES - 1)] = FALSE;
+			IPPU.TileInvalidations++;
+		}
+	}
 }
 
 // Functions to select which converter and renderer to use.
@@ -481,7 +790,7 @@ void S9xSelectTileConverter (int depth, bool8 hires, bool8 sub, bool8 mosaic)
 	switch (depth)
 	{
 		case 8:
-			BG.ConvertTile      = BG.ConvertTileFlip = ConvertTile8;
+			BG.ConvertTile      = BG.ConvertTileFlip = Converters[TILE_8BIT];
 			BG.Buffer           = BG.BufferFlip      = IPPU.TileCache[TILE_8BIT];
 			BG.Buffered         = BG.BufferedFlip    = IPPU.TileCached[TILE_8BIT];
 			BG.TileShift        = 6;
@@ -496,26 +805,26 @@ void S9xSelectTileConverter (int depth, bool8 hires, bool8 sub, bool8 mosaic)
 			{
 				if (sub || mosaic)
 				{
-					BG.ConvertTile     = ConvertTile4h_even;
+					BG.ConvertTile     = Converters[TILE_4BIT_EVEN];
 					BG.Buffer          = IPPU.TileCache[TILE_4BIT_EVEN];
 					BG.Buffered        = IPPU.TileCached[TILE_4BIT_EVEN];
-					BG.ConvertTileFlip = ConvertTile4h_odd;
+					BG.ConvertTileFlip = Converters[TILE_4BIT_ODD];
 					BG.BufferFlip      = IPPU.TileCache[TILE_4BIT_ODD];
 					BG.BufferedFlip    = IPPU.TileCached[TILE_4BIT_ODD];
 				}
 				else
 				{
-					BG.ConvertTile     = ConvertTile4h_odd;
+					BG.ConvertTile     = Converters[TILE_4BIT_ODD];
 					BG.Buffer          = IPPU.TileCache[TILE_4BIT_ODD];
 					BG.Buffered        = IPPU.TileCached[TILE_4BIT_ODD];
-					BG.ConvertTileFlip = ConvertTile4h_even;
+					BG.ConvertTileFlip = Converters[TILE_4BIT_EVEN];
 					BG.BufferFlip      = IPPU.TileCache[TILE_4BIT_EVEN];
 					BG.BufferedFlip    = IPPU.TileCached[TILE_4BIT_EVEN];
 				}
 			}
 			else
 			{
-				BG.ConvertTile = BG.ConvertTileFlip = ConvertTile4;
+				BG.ConvertTile = BG.ConvertTileFlip = Converters[TILE_4BIT];
 				BG.Buffer      = BG.BufferFlip      = IPPU.TileCache[TILE_4BIT];
 				BG.Buffered    = BG.BufferedFlip    = IPPU.TileCached[TILE_4BIT];
 			}
@@ -532,26 +841,26 @@ void S9xSelectTileConverter (int depth, bool8 hires, bool8 sub, bool8 mosaic)
 			{
 				if (sub || mosaic)
 				{
-					BG.ConvertTile     = ConvertTile2h_even;
+					BG.ConvertTile     = Converters[TILE_2BIT_EVEN];
 					BG.Buffer          = IPPU.TileCache[TILE_2BIT_EVEN];
 					BG.Buffered        = IPPU.TileCached[TILE_2BIT_EVEN];
-					BG.ConvertTileFlip = ConvertTile2h_odd;
+					BG.ConvertTileFlip = Converters[TILE_2BIT_ODD];
 					BG.BufferFlip      = IPPU.TileCache[TILE_2BIT_ODD];
 					BG.BufferedFlip    = IPPU.TileCached[TILE_2BIT_ODD];
 				}
 				else
 				{
-					BG.ConvertTile     = ConvertTile2h_odd;
+					BG.ConvertTile     = Converters[TILE_2BIT_ODD];
 					BG.Buffer          = IPPU.TileCache[TILE_2BIT_ODD];
 					BG.Buffered        = IPPU.TileCached[TILE_2BIT_ODD];
-					BG.ConvertTileFlip = ConvertTile2h_even;
+					BG.ConvertTileFlip = Converters[TILE_2BIT_EVEN];
 					BG.BufferFlip      = IPPU.TileCache[TILE_2BIT_EVEN];
 					BG.BufferedFlip    = IPPU.TileCached[TILE_2BIT_EVEN];
 				}
 			}
 			else
 			{
-				BG.ConvertTile = BG.ConvertTileFlip = ConvertTile2;
+				BG.ConvertTile = BG.ConvertTileFlip = Converters[TILE_2BIT];
 				BG.Buffer      = BG.BufferFlip      = IPPU.TileCache[TILE_2BIT];
 				BG.Buffered    = BG.BufferedFlip    = IPPU.TileCached[TILE_2BIT];
 			}
@@ -7,8 +7,31 @@
 #ifndef _TILE_H_
 #define _TILE_H_
 
+// Vector tile converters. The intrinsics headers are included here rather
+// than in tile.cpp, which the render thread builds again inside a namespace.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define S9X_TILE_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define S9X_TILE_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define S9X_TILE_NEON
+#include <arm_neon.h>
+#endif
+
+typedef uint8 (*S9xTileConverter) (uint8 *, uint32, uint32);
+
 void S9xInitTileRenderer (void);
 void S9xSelectTileRenderers (int, bool8, bool8);
 void S9xSelectTileConverter (int, bool8, bool8, bool8);
+void S9xInvalidateDirtyTiles (void);
+
+// The converter drawing uses for a tile cache (TILE_2BIT to TILE_4BIT_ODD),
+// or the plain C one, and the name of the vector kernels ("avx2", "sse2",
+// "neon" or "c"); snes9x_bench --tiles times and compares them.
+S9xTileConverter S9xGetTileConverter (int, bool8);
+const char * S9xTileConverterName (void);
 
 #endif
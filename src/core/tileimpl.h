@@ -100,13 +100,19 @@ namespace TileImpl {
 			{
 				pCache = &BG.BufferFlip[TileNumber << 6];
 				if (!BG.BufferedFlip[TileNumber])
+				{
 					BG.BufferedFlip[TileNumber] = BG.ConvertTileFlip(pCache, TileAddr, Tile & 0x3ff);
+					IPPU.TileConversions++;
+				}
 			}
 			else
 			{
 				pCache = &BG.Buffer[TileNumber << 6];
 				if (!BG.Buffered[TileNumber])
+				{
 					BG.Buffered[TileNumber] = BG.ConvertTile(pCache, TileAddr, Tile & 0x3ff);
+					IPPU.TileConversions++;
+				}
 			}
 		}
 
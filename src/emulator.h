@@ -0,0 +1,434 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include "video_convert.h"
+#include "frame_pacer.h"
+#include "profiler.h"
+
+// Interface between the addon and the emulator core module.
+//
+// The Snes9x core keeps all machine state in process-wide globals, so each
+// emulator instance lives in its own copy of the core module (see
+// emulator_loader.h) and the addon only talks to it through this vtable.
+// Bump kEmulatorApiVersion whenever the interface or the structs below change.
+
+static const int kEmulatorApiVersion = 17;
+
+// Size of the SNES work RAM readable through readRAM()
+static const size_t kWorkRAMSize = 0x20000;
+
+// How frames are packed before they reach the video callback
+enum class VideoEncoding {
+    Raw,            // whole frame in the output pixel format
+    TileDelta,      // changed tiles only, see tile_delta.h
+    PaletteDeflate  // lossless palette indices + deflate, see palette_codec.h
+};
+
+// A converted video frame handed to the video callback.
+// data is only valid for the duration of the callback.
+struct VideoFrame {
+    const uint8_t* data;
+    size_t size;
+    int width;
+    int height;
+    int stride;         // bytes per row of data (of the tiles for TileDelta)
+    PixelFormat format;
+    double frame_rate;
+    VideoEncoding encoding;
+    bool keyframe;      // TileDelta: the packet carries every tile
+};
+
+// Video encoder counters
+struct VideoEncoderStats {
+    VideoEncoding encoding;
+    int tile_size;              // TileDelta
+    int keyframe_interval;      // TileDelta
+    int level;                  // PaletteDeflate: zlib level
+    uint64_t frames;
+    uint64_t keyframes;         // self-contained frames
+    uint64_t tiles_sent;        // TileDelta
+    uint64_t tiles_total;       // TileDelta: tiles in all encoded frames
+    uint64_t coalesced;         // PaletteDeflate: replaced before the codec thread took them
+    uint64_t direct_frames;     // PaletteDeflate: over 256 colours, sent as RGB565
+    double colors_mean;         // PaletteDeflate
+    uint64_t bytes_out;
+    uint64_t raw_bytes;         // what the same frames would take unencoded
+    double encode_us_mean;
+    double encode_us_max;
+};
+
+// Audio ring and packetizer counters. Sizes are in stereo sample frames.
+struct AudioStats {
+    int sample_rate;
+    int packet_ms;
+    int packet_frames;
+    size_t fill;            // frames currently queued in the ring
+    size_t capacity;
+    uint64_t packets;       // packets handed to the audio callback
+    uint64_t underruns;     // a packet was due but the ring ran dry
+    uint64_t overruns;      // the APU produced samples with the ring full
+    uint64_t overrun_frames;
+    uint64_t deferred;      // a packet was due but the consumer had no room
+};
+
+// Rewind buffer state and cost counters
+struct RewindStats {
+    bool enabled;
+    int interval_frames;
+    size_t budget_bytes;
+    size_t capacity_bytes;      // delta ring actually allocated (power of two)
+    size_t used_bytes;
+    size_t state_bytes;         // one full snapshot
+    int entries;
+    double span_seconds;        // wall-clock time covered by the entries
+    uint64_t captures;
+    uint64_t coalesced;         // captures replaced before the delta thread took them
+    uint64_t rewinds;
+    double capture_us_mean;     // emulation thread: snapshot into a capture buffer
+    double capture_us_max;
+    double delta_us_mean;       // delta thread: XOR delta into the ring
+    double delta_us_max;
+};
+
+// Transport an input event arrived on, for per-transport latency stats
+enum class InputSource : uint8_t {
+    Local,
+    WebSocket,
+    RabbitMQ
+};
+static const int kInputSourceCount = 3;
+
+// Sender metadata of an input event
+struct InputStamp {
+    InputSource source;
+    uint32_t sequence;      // increasing per sender and port; 0 if unsequenced
+    double client_time_ms;  // sender's wall clock (Date.now()); 0 if unknown
+
+    InputStamp() : source(InputSource::Local), sequence(0), client_time_ms(0) {}
+};
+
+// One input event from the queue to the screen
+struct InputRecord {
+    InputSource source;
+    int port;
+    uint32_t sequence;
+    double client_ms;       // received - client_time_ms; includes any clock offset
+    double queue_us;        // received -> applied at a frame boundary
+    double render_us;       // received -> end of the first rendered frame with it
+};
+
+// Input latency for one transport
+struct InputSourceStats {
+    uint64_t events;        // applied
+    uint64_t stale;         // sequence not newer than the last applied one
+    uint64_t overflows;     // queue full when the event was sent
+    double client_ms_mean;  // over events with a client timestamp
+    double queue_us_mean;
+    double queue_us_max;
+    double render_us_mean;
+    double render_us_p50;
+    double render_us_p99;
+    double render_us_max;
+};
+
+struct InputStats {
+    size_t queued;
+    size_t capacity;
+    uint64_t deferred;      // boundaries that left a second change of a port for the next frame
+    InputSourceStats sources[kInputSourceCount];
+    std::vector<InputRecord> recent;   // latest rendered events, oldest first
+};
+
+// Run-ahead cost counters. Times are per real frame (frame, save) or per
+// run of hidden frames (ahead, load).
+struct RunAheadStats {
+    int frames;                 // hidden frames per displayed frame, 0 = off
+    bool second_instance;
+    uint64_t runs;
+    uint64_t skipped;           // frames the pacer dropped, run without run-ahead
+    uint64_t coalesced;         // second instance: snapshot replaced while it was busy
+    uint64_t failed;            // snapshot could not be taken or restored
+    double frame_us_mean;       // the real frame, with audio and without rendering
+    double save_us_mean;        // snapshot after the real frame
+    double ahead_us_mean;       // all hidden frames of a run
+    double load_us_mean;        // restore (second instance: load of the snapshot)
+    double extra_frame_us_mean; // (save + ahead + load) / frames
+    double run_us_max;
+};
+
+// The frame shown by a run of hidden frames, in the running instance's
+// memory. Valid until that instance runs again.
+struct AheadFrame {
+    const uint16_t* screen;         // RGB565
+    int pitch;                      // pixels per row of screen
+    int width;
+    int height;
+    const uint16_t* screen_colors;  // IPPU.ScreenColors
+    uint64_t load_ns;
+
+    AheadFrame() : screen(nullptr), pitch(0), width(0), height(0), screen_colors(nullptr), load_ns(0) {}
+};
+
+// 65c816 interpreter counters. Idle loop figures are since the ROM was
+// loaded; a skip jumps over the remaining iterations of a loop until the
+// next event (S9xIdleLoopCheck)
+struct CPUStats {
+    bool threaded_dispatch;
+    bool skip_idle_loops;
+    uint64_t instructions;          // executed since init() while threaded dispatch or idle loop skipping is on; skipped ones are in idle_loop_instructions
+    uint64_t frames;                // since the ROM was loaded
+    uint64_t idle_loop_skips;
+    uint64_t idle_loop_cycles;      // master cycles skipped
+    uint64_t idle_loop_instructions;
+    double idle_cycle_share;        // of the master cycles of those frames
+};
+
+// PPU rendering on a worker thread (core/renderthread.h); counters are
+// since init()
+struct RenderThreadStats {
+    bool enabled;
+    bool verify;
+    uint64_t frames;                // drawn by the worker
+    uint64_t batches;               // line ranges queued
+    uint64_t split_batches;         // queued between PPU flushes
+    uint64_t redrawn_lines;         // drawn again after a change without a flush
+    uint64_t vram_blocks;           // 1 KB VRAM blocks copied to the worker
+    uint64_t mismatched_frames;     // verify: worker frame differed from the inline one
+    double render_us_mean;          // worker time per frame
+    double wait_us_mean;            // emulation thread waiting for the worker per frame
+};
+
+// Which frames of a runFrames() batch are rendered
+enum class BatchRender {
+    None,
+    Last,       // only the last one, returned in the result
+    Every       // every one, also delivered through the video callback
+};
+
+// Outcome of a runFrames() batch
+struct BatchResult {
+    int frames;                 // frames run; 0 without a ROM
+    uint64_t rendered;
+    double elapsed_ms;
+    double frames_per_second;
+    double frame_us_mean;
+    double frame_us_max;
+    std::vector<uint8_t> frame; // last rendered frame, raw in the output pixel format
+    int width;
+    int height;
+    int stride;
+    PixelFormat format;
+};
+
+// A ROM as the core maps it (decompressed, patched, without copier header,
+// deinterleaved) and what loading worked out about it. Loading it back with
+// loadPreparedROM() skips the file, the patches, the header analysis and
+// the checksums. See rom_cache.h.
+struct PreparedROM {
+    const uint8_t* image;
+    size_t size;                // bytes of image; the rest of the ROM is zero
+    uint32_t calculated_size;
+    bool hirom;
+    int extended_format;
+    int header_count;           // copier headers removed
+    uint8_t nsrt_header[32];
+    int patched;                // 0, or IPS 1, BPS 2, UPS 3
+    uint32_t crc32;
+    uint8_t sha256[32];
+    std::string patch_dir;      // patches were looked up here and next to the ROM
+
+    PreparedROM() : image(nullptr), size(0), calculated_size(0), hirom(false), extended_format(0),
+                    header_count(0), nsrt_header(), patched(0), crc32(0), sha256() {}
+};
+
+class Emulator {
+public:
+    virtual ~Emulator() {}
+
+    // Initialization
+    virtual bool init() = 0;
+    virtual void deinit() = 0;
+
+    // ROM management
+    virtual bool loadROM(const std::string& filename) = 0;
+    virtual bool loadROMMem(const uint8_t* data, size_t size, const std::string& name = "") = 0;
+    virtual bool isROMLoaded() const = 0;
+    // loadROM() (data nullptr) or loadROMMem() that also copies the prepared
+    // image into image and describes it in prepared (pointing into image)
+    virtual bool captureROM(const std::string& filename, const uint8_t* data, size_t size,
+                            std::vector<uint8_t>& image, PreparedROM& prepared) = 0;
+    // Loads a captured image; filename names the .srm and .cht files (empty
+    // as for loadROMMem() without a name)
+    virtual bool loadPreparedROM(const PreparedROM& prepared, const std::string& filename) = 0;
+
+    // Emulation control
+    virtual void runFrame() = 0;
+    virtual void reset() = 0;
+    virtual void softReset() = 0;
+    virtual void setPaused(bool paused) = 0;
+    virtual bool isPaused() const = 0;
+
+    // State management
+    virtual bool saveState(int slot) = 0;
+    virtual bool loadState(int slot) = 0;
+    virtual bool saveStateToFile(const std::string& filename) = 0;
+    virtual bool loadStateFromFile(const std::string& filename) = 0;
+    // Raw snapshots in caller memory. Not synchronized with the emulation
+    // thread: call from the frame callback or while the thread is stopped.
+    virtual size_t getStateSize() const = 0;
+    virtual bool saveStateToMemory(uint8_t* buffer, size_t size) = 0;
+    virtual bool loadStateFromMemory(const uint8_t* data, size_t size) = 0;
+
+    // Rewind. A snapshot is captured every interval_frames frames and
+    // delta-compressed into a ring of budget_bytes (0 disables). Not
+    // synchronized: call through runAtFrameBoundary(). The rewind calls
+    // return the number of frames actually stepped back.
+    virtual bool setRewind(size_t budget_bytes, int interval_frames) = 0;
+    virtual int rewindFrames(int frames) = 0;
+    virtual int rewindToTime(int64_t timestamp_ms) = 0;   // system clock, as Date.now()
+    virtual RewindStats getRewindStats() const = 0;
+
+    // Run-ahead. After every real frame the machine is snapshotted, runs
+    // frames more frames with the current input (audio discarded, only the
+    // last one rendered and shown) and is restored, which hides that many
+    // frames of the game's own input lag. With an ahead instance (another
+    // instance with the same ROM loaded) the hidden frames run there on a
+    // helper thread instead, from a snapshot of each real frame. Not
+    // synchronized: call through runAtFrameBoundary().
+    virtual bool setRunAhead(int frames, Emulator* ahead) = 0;
+    // Ahead instance side: load the snapshot and run frames hidden frames
+    virtual bool runAheadFrom(const uint8_t* state, size_t size, int frames, AheadFrame& frame) = 0;
+    virtual RunAheadStats getRunAheadStats() const = 0;
+    // An instance mirroring another (the ahead instance) must not write the
+    // game's .srm
+    virtual void setSRAMWrites(bool enabled) = 0;
+
+    // Control input. Events are queued (lock-free, one producer thread) and
+    // applied by the thread running frames right before the next frame; a
+    // port's buttons change at most once per frame, so a press and release
+    // sent between two frames both reach the game.
+    virtual void setButtonState(int port, uint16_t buttons, const InputStamp& stamp) = 0;
+    virtual void setAxisState(int port, int axis, int16_t value) = 0;
+    virtual void setMousePosition(int port, int16_t x, int16_t y, const InputStamp& stamp) = 0;
+    virtual void setMouseButtons(int port, bool left, bool right, const InputStamp& stamp) = 0;
+    virtual InputStats getInputStats() const = 0;
+    virtual void resetInputStats() = 0;
+
+    // Video/Audio callbacks
+    virtual void setVideoCallback(std::function<void(const VideoFrame&)> callback) = 0;
+    // Receives fixed-size packets of interleaved stereo s16 samples
+    // (data, sample frames) from the audio packet thread at a steady cadence.
+    // The thread starts with the first audible frame, whether it was run by
+    // the emulation thread, runFrame() or runFrames().
+    virtual void setAudioCallback(std::function<void(const int16_t*, int)> callback) = 0;
+    // Optional destination for audio packets, with the packet size in bytes.
+    // Returning nullptr leaves the packet in the ring until the next tick.
+    virtual void setAudioBufferProvider(std::function<int16_t*(size_t)> provider) = 0;
+    // Packet duration in milliseconds (1-50, default 10)
+    virtual void setAudioPacketDuration(int ms) = 0;
+    virtual AudioStats getAudioStats() const = 0;
+    // Optional destination for converted frames, e.g. a preallocated pool slot.
+    // Called on the emulation thread with the frame size in bytes; returning
+    // nullptr drops the frame. Without a provider an internal buffer is reused.
+    virtual void setVideoBufferProvider(std::function<uint8_t*(size_t)> provider) = 0;
+    virtual void setVideoFormat(PixelFormat format) = 0;
+    virtual PixelFormat getVideoFormat() const = 0;
+    // Raw frames, dirty-tile deltas with tile_size 8 or 16 and a keyframe
+    // every keyframe_interval frames (0: on request only), or palette +
+    // deflate frames at zlib level (1-9), encoded on a codec thread
+    virtual bool setVideoEncoding(VideoEncoding encoding, int tile_size, int keyframe_interval, int level) = 0;
+    // The next TileDelta frame carries every tile (late joiners, lost deltas)
+    virtual void requestKeyframe() = 0;
+    virtual VideoEncoderStats getVideoEncoderStats() const = 0;
+    // Runs frames back to back as fast as the CPU allows: no pacing, no
+    // rendering but for the frames asked for, and with audio false no
+    // resampling or mixing (the APU still runs). Run-ahead and rewind
+    // captures are left out. Not synchronized: call through
+    // runAtFrameBoundary().
+    virtual BatchResult runFrames(int frames, BatchRender render, bool audio) = 0;
+
+    // Training environment step, for instances without a running emulation
+    // thread: sets the joypads of the first ports ports (bypassing the input
+    // queue), runs frames frames with audio discarded and only the last one
+    // rendered, and writes that frame as a convertObservation() observation
+    // unless observation is nullptr
+    virtual bool stepEnvironment(const uint16_t* buttons, int ports, int frames, int scale, bool greyscale, uint8_t* observation) = 0;
+    // Copies work RAM (Memory.RAM, kWorkRAMSize bytes) from offset; false
+    // out of range or without a ROM. Not synchronized, like stepEnvironment()
+    virtual bool readRAM(uint32_t offset, uint8_t* out, size_t size) const = 0;
+
+    // 65c816 interpreter dispatch: computed goto (S9xMainLoopThreaded) or
+    // the opcode tables (the default); false when asking for the former in a
+    // build without it (S9X_THREADED_DISPATCH). Takes effect at the next
+    // frame boundary.
+    virtual bool setThreadedDispatch(bool enabled) = 0;
+    virtual bool getThreadedDispatch() const = 0;
+    // Skipping idle loops: exact, the machine state is the same as without
+    // it. Takes effect at the next frame boundary
+    virtual void setSkipIdleLoops(bool enabled) = 0;
+    // Not synchronized
+    virtual CPUStats getCPUStats() const = 0;
+
+    // PPU rendering on a worker thread while emulation carries on: exact,
+    // frames are the same as drawn inline. verify draws inline as well and
+    // counts frames that differ. Off by default; takes effect at the next
+    // frame boundary
+    virtual void setRenderThread(bool enabled, bool verify) = 0;
+    virtual RenderThreadStats getRenderThreadStats() const = 0;
+
+    // Subsystem profiler (see profiler.h); false when enabling it in a build
+    // without SNES9X_PROFILER. Frames of runFrame() and runFrames() are
+    // profiled, and up to trace_events timeline segments are kept for
+    // takeProfileTrace(). Not synchronized: call setProfiling() and
+    // takeProfileTrace() through runAtFrameBoundary().
+    virtual bool setProfiling(bool enabled, size_t trace_events) = 0;
+    virtual ProfileStats getProfileStats() const = 0;
+    virtual void resetProfileStats() = 0;
+    virtual void takeProfileTrace(ProfileTrace& trace) = 0;
+    // Called on the thread running frames after every frame, i.e. at a
+    // point where the machine state is consistent
+    virtual void setFrameCallback(std::function<void()> callback) = 0;
+    // Runs task on the emulation thread right before its next frame (also
+    // while paused), or at once on the calling thread when the thread is not
+    // running. Tasks submitted while such a task runs (e.g. a runFrames()
+    // batch on a helper thread) are queued behind it instead of waiting for
+    // it. Tasks run in submission order, under the lock that file
+    // savestates and resets take, so they must not call those.
+    virtual void runAtFrameBoundary(std::function<void()> task) = 0;
+
+    // Frame info
+    virtual int getFrameWidth() const = 0;
+    virtual int getFrameHeight() const = 0;
+    virtual double getFrameRate() const = 0;
+
+    // Thread management. A start while a runAtFrameBoundary() task runs on
+    // another thread returns at once; the thread launches when it is done.
+    virtual void startEmulationThread() = 0;
+    virtual void stopEmulationThread() = 0;
+    virtual bool isRunning() const = 0;
+
+    // Pacing of the emulation thread (mode, spin window, catch-up limit, stats)
+    virtual FramePacer& getFramePacer() = 0;
+};
+
+// Entry points exported by the core module
+#if defined(_WIN32)
+#define EMULATOR_EXPORT __declspec(dllexport)
+#else
+#define EMULATOR_EXPORT __attribute__((visibility("default")))
+#endif
+
+#define EMULATOR_API_VERSION_SYMBOL "snes9x_emulator_api_version"
+#define EMULATOR_CREATE_SYMBOL "snes9x_create_emulator"
+
+extern "C" {
+typedef int (*EmulatorApiVersionFn)();
+typedef Emulator* (*CreateEmulatorFn)();
+}
+
+#endif // EMULATOR_H
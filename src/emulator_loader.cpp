@@ -0,0 +1,225 @@
+#include "emulator_loader.h"
+#include <mutex>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HMODULE ModuleHandle;
+#else
+#include <dlfcn.h>
+#include <unistd.h>
+typedef void* ModuleHandle;
+#endif
+
+// Built by the snes9x_core target next to the addon
+static const char* kCoreModuleName = "snes9x_core.node";
+
+struct LoadedModule {
+    ModuleHandle handle;
+    Emulator* emulator;
+    bool is_copy;
+    std::string temp_path;  // Windows keeps the copy until it is unloaded
+};
+
+static std::mutex modules_mutex;
+static std::vector<LoadedModule> modules;
+
+static std::string addonDirectory() {
+    std::string path;
+#ifdef _WIN32
+    HMODULE self = nullptr;
+    char buffer[MAX_PATH];
+    if (GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                           reinterpret_cast<LPCSTR>(&addonDirectory), &self)) {
+        DWORD length = GetModuleFileNameA(self, buffer, MAX_PATH);
+        path.assign(buffer, length);
+    }
+#else
+    Dl_info info;
+    if (dladdr(reinterpret_cast<void*>(&addonDirectory), &info) && info.dli_fname) {
+        path = info.dli_fname;
+    }
+#endif
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+// Copies the module to a new temporary file; the loader identifies objects
+// by file, so the copy is mapped separately from the original
+static bool makeTemporaryCopy(const std::string& source, std::string& copy, std::string& error) {
+#ifdef _WIN32
+    char directory[MAX_PATH];
+    char name[MAX_PATH];
+    if (!GetTempPathA(MAX_PATH, directory) || !GetTempFileNameA(directory, "s9x", 0, name)) {
+        error = "Failed to create a temporary core module path";
+        return false;
+    }
+    if (!CopyFileA(source.c_str(), name, FALSE)) {
+        DeleteFileA(name);
+        error = "Failed to copy core module " + source;
+        return false;
+    }
+    copy = name;
+    return true;
+#else
+    const char* tmpdir = getenv("TMPDIR");
+    std::string pattern = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp") + "/snes9x_core-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+
+    int fd = mkstemp(name.data());
+    if (fd < 0) {
+        error = "Failed to create a temporary core module file";
+        return false;
+    }
+
+    FILE* in = fopen(source.c_str(), "rb");
+    bool ok = in != nullptr;
+    char buffer[65536];
+    while (ok) {
+        size_t count = fread(buffer, 1, sizeof(buffer), in);
+        if (count == 0) {
+            ok = !ferror(in);
+            break;
+        }
+        ok = write(fd, buffer, count) == (ssize_t)count;
+    }
+    if (in) fclose(in);
+    close(fd);
+
+    if (!ok) {
+        unlink(name.data());
+        error = "Failed to copy core module " + source;
+        return false;
+    }
+    copy = name.data();
+    return true;
+#endif
+}
+
+static ModuleHandle openModule(const std::string& path, std::string& error) {
+#ifdef _WIN32
+    ModuleHandle handle = LoadLibraryA(path.c_str());
+    if (!handle) {
+        error = "Failed to load core module " + path;
+    }
+#else
+    // Lazy binding like Node uses for addons: some frontend hooks the core
+    // references are never called by this port and stay unresolved
+    ModuleHandle handle = dlopen(path.c_str(), RTLD_LAZY | RTLD_LOCAL);
+    if (!handle) {
+        const char* message = dlerror();
+        error = message ? message : "Failed to load core module " + path;
+    }
+#endif
+    return handle;
+}
+
+static void* moduleSymbol(ModuleHandle handle, const char* name) {
+#ifdef _WIN32
+    return reinterpret_cast<void*>(GetProcAddress(handle, name));
+#else
+    return dlsym(handle, name);
+#endif
+}
+
+static void closeModule(ModuleHandle handle, const std::string& temp_path) {
+#ifdef _WIN32
+    if (handle) {
+        FreeLibrary(handle);
+    }
+    if (!temp_path.empty()) {
+        DeleteFileA(temp_path.c_str());
+    }
+#else
+    // The copy was unlinked right after dlopen(); temp_path stays empty
+    (void)temp_path;
+    if (handle) {
+        dlclose(handle);
+    }
+#endif
+}
+
+Emulator* createEmulator(std::string& error) {
+    std::lock_guard<std::mutex> lock(modules_mutex);
+
+    std::string original = addonDirectory() + "/" + kCoreModuleName;
+
+    // The original module holds at most one instance; loading it again
+    // would only return the same handle and the same globals
+    LoadedModule module;
+    module.is_copy = false;
+    for (const LoadedModule& loaded : modules) {
+        if (!loaded.is_copy) {
+            module.is_copy = true;
+            break;
+        }
+    }
+
+    std::string path = original;
+    if (module.is_copy && !makeTemporaryCopy(original, path, error)) {
+        return nullptr;
+    }
+
+    module.handle = openModule(path, error);
+    if (module.is_copy) {
+#ifdef _WIN32
+        module.temp_path = path;
+#else
+        // The mapping stays valid; nothing is left behind on disk
+        unlink(path.c_str());
+#endif
+    }
+    if (!module.handle) {
+        closeModule(nullptr, module.temp_path);
+        return nullptr;
+    }
+
+    EmulatorApiVersionFn version = reinterpret_cast<EmulatorApiVersionFn>(moduleSymbol(module.handle, EMULATOR_API_VERSION_SYMBOL));
+    CreateEmulatorFn create = reinterpret_cast<CreateEmulatorFn>(moduleSymbol(module.handle, EMULATOR_CREATE_SYMBOL));
+    if (!version || !create || version() != kEmulatorApiVersion) {
+        error = "Core module " + original + " does not match this addon; rebuild both";
+        closeModule(module.handle, module.temp_path);
+        return nullptr;
+    }
+
+    module.emulator = create();
+    if (!module.emulator) {
+        error = "Failed to create emulator instance";
+        closeModule(module.handle, module.temp_path);
+        return nullptr;
+    }
+
+    modules.push_back(module);
+    return module.emulator;
+}
+
+void destroyEmulator(Emulator* emulator) {
+    if (!emulator) {
+        return;
+    }
+
+    // Held throughout so a concurrent createEmulator() cannot pick up the
+    // original module while this instance is still tearing down
+    std::lock_guard<std::mutex> lock(modules_mutex);
+    for (size_t i = 0; i < modules.size(); i++) {
+        if (modules[i].emulator != emulator) {
+            continue;
+        }
+
+        // The instance's code lives in the module, so it must be gone (and
+        // its threads joined) before the module is unloaded
+        emulator->stopEmulationThread();
+        delete emulator;
+        closeModule(modules[i].handle, modules[i].temp_path);
+        modules.erase(modules.begin() + i);
+        return;
+    }
+}
+
+int loadedEmulatorModules() {
+    std::lock_guard<std::mutex> lock(modules_mutex);
+    return (int)modules.size();
+}
@@ -0,0 +1,26 @@
+#ifndef EMULATOR_LOADER_H
+#define EMULATOR_LOADER_H
+
+#include <string>
+#include "emulator.h"
+
+// Creates emulator instances, each in a private copy of the core module.
+//
+// The Snes9x core is not reentrant: CPU, PPU, APU, memory map and settings
+// are globals. Instead of routing every access through a context pointer,
+// the core is built as a separate module with hidden symbols and loaded
+// once per instance. The first instance uses the module next to the addon;
+// further concurrent instances load a temporary copy of it, which the
+// dynamic loader maps as an independent object with its own globals. The
+// emulation hot path is unchanged and instances run in parallel.
+
+// Returns nullptr and sets error on failure
+Emulator* createEmulator(std::string& error);
+
+// Deletes the instance and unloads its module copy
+void destroyEmulator(Emulator* emulator);
+
+// Number of module copies currently loaded
+int loadedEmulatorModules();
+
+#endif // EMULATOR_LOADER_H
@@ -12,6 +12,9 @@
 #include "./core/cheats.h"
 #include "./core/movie.h"
 #include "./core/messages.h"
+#include "./core/cpuexec.h"
+#include "./core/renderthread.h"
+#include "util.h"
 #include <cstring>
 #include <cstdio>
 #include <chrono>
@@ -20,13 +23,24 @@
 // Global instance for callbacks
 static EmulatorWrapper* g_emulator = nullptr;
 
+// Audio ring size in s16 samples (~340 ms of 48 kHz stereo)
+static const size_t kAudioRingSamples = 32768;
+// Packets buffered before the packet thread starts, or resumes after an underrun
+static const int kAudioPrebufferPackets = 2;
+// Backlog (in packets above the prebuffer level) at which an extra packet is sent per tick
+static const int kAudioCatchUpPackets = 4;
+
+static uint64_t nanosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
 // Video output callback
 bool8 S9xDeinitUpdate(int width, int height) {
     if (!g_emulator) return true;
     
     auto& gfx = GFX;
     if (gfx.Screen && width >= 256 && height >= 224) {
-        g_emulator->processVideoFrame();
+        g_emulator->processVideoFrame(width, height);
     }
     
     return true;
@@ -85,6 +99,7 @@ void S9xSyncSpeed(void) {
 
 // Auto-save SRAM callback - required by Snes9x core
 void S9xAutoSaveSRAM(void) {
+    if (g_emulator && !g_emulator->writesSRAM()) return;
     Memory.SaveSRAM(S9xGetFilename(".srm", SRAM_DIR).c_str());
 }
 
@@ -92,11 +107,54 @@ EmulatorWrapper::EmulatorWrapper()
     : rom_loaded(false)
     , emulation_running(false)
     , should_stop(false)
+    , boundary_pending(false)
+    , boundary_busy(false)
+    , state_size(0)
+    , load_frame(0)
+    , sram_writes(true)
+    , run_ahead_frames(0)
+    , run_ahead_instance(nullptr)
+    , ahead_capture(nullptr)
+    , ahead_pending(-1)
+    , ahead_busy(-1)
+    , ahead_stop(false)
+    , run_ahead_runs(0)
+    , run_ahead_skipped(0)
+    , run_ahead_coalesced(0)
+    , run_ahead_failed(0)
+    , run_ahead_real_frames(0)
+    , frame_ns_sum(0)
+    , save_ns_sum(0)
+    , ahead_ns_sum(0)
+    , load_ns_sum(0)
+    , run_ns_max(0)
+    , batch_capture(nullptr)
+    , batch_copy(false)
+    , batch_deliver(false)
+    , batch_ran(false)
+    , audio_ring(kAudioRingSamples)
+    , audio_thread_stop(false)
+    , audio_packet_ms(10)
+    , audio_packets(0)
+    , audio_underruns(0)
+    , audio_overruns(0)
+    , audio_overrun_frames(0)
+    , audio_deferred(0)
+    , audio_discarding(false)
+    , video_format(PixelFormat::RGB565)
+    , video_encoding(VideoEncoding::Raw)
     , frame_width(256)
     , frame_height(224)
     , frame_rate(60.0)
 {
     g_emulator = this;
+
+    // Palette frames are encoded and delivered on the codec thread
+    palette_codec.setOutput(
+        [this](size_t size) { return acquireVideoBuffer(size); },
+        [this](uint8_t* data, size_t size, int width, int height, PixelFormat format) {
+            deliverVideoFrame(data, size, width, height, format, VideoEncoding::PaletteDeflate, true);
+        });
 }
 
 EmulatorWrapper::~EmulatorWrapper() {
@@ -179,6 +237,8 @@ bool EmulatorWrapper::init() {
 
 void EmulatorWrapper::deinit() {
     stopEmulationThread();
+    stopAheadThread();
+    stopAudioThread();
 
     std::lock_guard<std::mutex> lock(emulation_mutex);
 
@@ -193,18 +253,16 @@ void EmulatorWrapper::deinit() {
     rom_loaded = false;
 }
 
-bool EmulatorWrapper::loadROM(const std::string& filename) {
-    std::lock_guard<std::mutex> lock(emulation_mutex);
-
+void EmulatorWrapper::beginLoad() {
     if (rom_loaded) {
         S9xAutoSaveSRAM();
     }
 
     Settings.StopEmulation = true;
     rom_loaded = false;
+}
 
-    bool loaded = Memory.LoadROM(filename.c_str());
-    
+bool EmulatorWrapper::finishLoad(bool loaded) {
     if (loaded) {
         rom_loaded = true;
         Settings.StopEmulation = false;
@@ -214,35 +272,77 @@ bool EmulatorWrapper::loadROM(const std::string& filename) {
         frame_width = SNES_WIDTH;
         frame_height = SNES_HEIGHT;
         frame_rate = Settings.PAL ? 50.006977968 : 60.09881389744051;
+        state_size = S9xFreezeSize();
+        rewind_buffer.reset();
+        load_frame = ICPU.Frame;
+        ICPU.IdleLoopSkips = 0;
+        ICPU.IdleLoopCycles = 0;
+        ICPU.IdleLoopInstructions = 0;
     }
 
     return loaded;
 }
 
+bool EmulatorWrapper::loadROM(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(emulation_mutex);
+    beginLoad();
+    return finishLoad(Memory.LoadROM(filename.c_str()));
+}
+
 bool EmulatorWrapper::loadROMMem(const uint8_t* data, size_t size, const std::string& name) {
     std::lock_guard<std::mutex> lock(emulation_mutex);
+    beginLoad();
+    return finishLoad(Memory.LoadROMMem(data, size, name.empty() ? nullptr : name.c_str()));
+}
 
-    if (rom_loaded) {
-        S9xAutoSaveSRAM();
-    }
+bool EmulatorWrapper::captureROM(const std::string& filename, const uint8_t* data, size_t size,
+                                 std::vector<uint8_t>& image, PreparedROM& prepared) {
+    std::lock_guard<std::mutex> lock(emulation_mutex);
+    beginLoad();
 
-    Settings.StopEmulation = true;
-    rom_loaded = false;
+    Memory.CaptureROM = TRUE;
+    bool loaded = data ? Memory.LoadROMMem(data, size, filename.empty() ? nullptr : filename.c_str())
+                       : Memory.LoadROM(filename.c_str());
+    Memory.CaptureROM = FALSE;
 
-    bool loaded = Memory.LoadROMMem(data, size, name.empty() ? nullptr : name.c_str());
-    
     if (loaded) {
-        rom_loaded = true;
-        Settings.StopEmulation = false;
-        Memory.LoadSRAM(S9xGetFilename(".srm", SRAM_DIR).c_str());
-        
-        // Update frame info
-        frame_width = SNES_WIDTH;
-        frame_height = SNES_HEIGHT;
-        frame_rate = Settings.PAL ? 50.006977968 : 60.09881389744051;
+        SROMAnalysis analysis;
+        Memory.DescribeROM(analysis);
+        image.swap(Memory.CapturedROM);
+        prepared.image = image.data();
+        prepared.size = image.size();
+        prepared.calculated_size = analysis.CalculatedSize;
+        prepared.hirom = analysis.HiROM;
+        prepared.extended_format = analysis.ExtendedFormat;
+        prepared.header_count = analysis.HeaderCount;
+        memcpy(prepared.nsrt_header, analysis.NSRTHeader, sizeof(prepared.nsrt_header));
+        prepared.patched = analysis.IsPatched;
+        prepared.crc32 = analysis.ROMCRC32;
+        memcpy(prepared.sha256, analysis.ROMSHA256, sizeof(prepared.sha256));
+        prepared.patch_dir = S9xGetDirectory(PATCH_DIR);
     }
+    Memory.CapturedROM.clear();
+    Memory.CapturedROM.shrink_to_fit();
 
-    return loaded;
+    return finishLoad(loaded);
+}
+
+bool EmulatorWrapper::loadPreparedROM(const PreparedROM& prepared, const std::string& filename) {
+    std::lock_guard<std::mutex> lock(emulation_mutex);
+    beginLoad();
+
+    SROMAnalysis analysis;
+    analysis.ImageSize = (uint32)prepared.size;
+    analysis.CalculatedSize = prepared.calculated_size;
+    analysis.HiROM = prepared.hirom;
+    analysis.ExtendedFormat = (uint8)prepared.extended_format;
+    analysis.HeaderCount = prepared.header_count;
+    memcpy(analysis.NSRTHeader, prepared.nsrt_header, sizeof(analysis.NSRTHeader));
+    analysis.IsPatched = (bool8)prepared.patched;
+    analysis.ROMCRC32 = prepared.crc32;
+    memcpy(analysis.ROMSHA256, prepared.sha256, sizeof(analysis.ROMSHA256));
+
+    return finishLoad(Memory.LoadPreparedROM(prepared.image, analysis, filename.empty() ? nullptr : filename.c_str()));
 }
 
 void EmulatorWrapper::runFrame() {
@@ -250,7 +350,21 @@ void EmulatorWrapper::runFrame() {
         return;
     }
 
-    S9xMainLoop();
+    // Input applies between frames, never at an arbitrary scanline
+    input_queue.drain([this](const InputEvent& event) { applyInput(event); });
+    S9xProfiler.frameBegin();
+    if (run_ahead_frames > 0) {
+        runFrameAhead();
+    } else {
+        S9xMainLoop();
+    }
+    rewind_buffer.frameDone();
+
+    if (frame_callback) {
+        S9X_PROFILE_SCOPE(Output);
+        frame_callback();
+    }
+    S9xProfiler.frameEnd();
 }
 
 void EmulatorWrapper::reset() {
@@ -324,11 +438,227 @@ bool EmulatorWrapper::loadStateFromFile(const std::string& filename) {
     return S9xUnfreezeGame(filename.c_str());
 }
 
-void EmulatorWrapper::setButtonState(int port, uint16_t buttons) {
+bool EmulatorWrapper::saveStateToMemory(uint8_t* buffer, size_t size) {
+    if (!rom_loaded || !buffer || size < state_size) return false;
+    return S9xFreezeGameMem(buffer, (uint32)size);
+}
+
+bool EmulatorWrapper::loadStateFromMemory(const uint8_t* data, size_t size) {
+    if (!rom_loaded || !data || size == 0) return false;
+    return S9xUnfreezeGameMem(data, (uint32)size) == SUCCESS;
+}
+
+bool EmulatorWrapper::setRewind(size_t budget_bytes, int interval_frames) {
+    // Without a ROM the snapshot size is unknown; allocate on the next load
+    return rewind_buffer.configure(budget_bytes, interval_frames, rom_loaded);
+}
+
+bool EmulatorWrapper::setRunAhead(int frames, Emulator* ahead) {
+    // An ahead instance without the ROM yet only counts failed runs until it gets it
+    if (frames < 0 || frames > kMaxRunAheadFrames || ahead == this) {
+        return false;
+    }
+
+    // The ahead thread also delivers video, so it stops before the mode changes
+    stopAheadThread();
+    run_ahead_frames = frames;
+    run_ahead_instance = frames > 0 ? ahead : nullptr;
+
+    run_ahead_runs = 0;
+    run_ahead_skipped = 0;
+    run_ahead_coalesced = 0;
+    run_ahead_failed = 0;
+    run_ahead_real_frames = 0;
+    frame_ns_sum = 0;
+    save_ns_sum = 0;
+    ahead_ns_sum = 0;
+    load_ns_sum = 0;
+    run_ns_max = 0;
+
+    if (run_ahead_instance) {
+        ahead_stop = false;
+        ahead_pending = -1;
+        ahead_busy = -1;
+        ahead_thread = std::thread(&EmulatorWrapper::aheadLoop, this);
+    }
+    return true;
+}
+
+void EmulatorWrapper::stopAheadThread() {
+    {
+        std::lock_guard<std::mutex> lock(ahead_mutex);
+        ahead_stop = true;
+        ahead_pending = -1;
+    }
+    ahead_cv.notify_one();
+    if (ahead_thread.joinable()) {
+        ahead_thread.join();
+    }
+}
+
+void EmulatorWrapper::runFrameAhead() {
+    // A frame the pacer (or turbo) skips is not shown, so nothing to run ahead
+    if (!IPPU.RenderThisFrame || !state_size) {
+        run_ahead_skipped++;
+        S9xMainLoop();
+        return;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // The real frame: its audio goes out, its picture is never seen.
+    // Samples not landed yet are flushed so the restore cannot lose them.
+    IPPU.RenderThisFrame = false;
+    S9xMainLoop();
+    processAudioSamples();
+    frame_ns_sum += nanosSince(start);
+    run_ahead_real_frames++;
+
+    if (run_ahead_instance) {
+        handOffAhead();
+        return;
+    }
+
+    std::vector<uint8_t>& state = run_ahead_state[0];
+    state.resize(state_size);
+    std::chrono::steady_clock::time_point save_start = std::chrono::steady_clock::now();
+    if (!S9xFreezeGameMem(state.data(), (uint32)state.size())) {
+        run_ahead_failed++;
+        return;
+    }
+    save_ns_sum += nanosSince(save_start);
+
+    std::chrono::steady_clock::time_point ahead_start = std::chrono::steady_clock::now();
+    runHiddenFrames(run_ahead_frames);
+    ahead_ns_sum += nanosSince(ahead_start);
+
+    std::chrono::steady_clock::time_point load_start = std::chrono::steady_clock::now();
+    if (S9xUnfreezeGameMem(state.data(), (uint32)state.size()) != SUCCESS) {
+        run_ahead_failed++;
+    }
+    load_ns_sum += nanosSince(load_start);
+
+    run_ahead_runs++;
+    recordMax(run_ns_max, nanosSince(start));
+}
+
+void EmulatorWrapper::runHiddenFrames(int frames) {
+    // Hidden frames' audio never reaches the ring, leftovers included
+    audio_discarding = true;
+    for (int i = 0; i < frames; i++) {
+        IPPU.RenderThisFrame = i == frames - 1;
+        S9xMainLoop();
+    }
+    processAudioSamples();
+    audio_discarding = false;
+}
+
+void EmulatorWrapper::handOffAhead() {
+    int target;
+    {
+        std::lock_guard<std::mutex> lock(ahead_mutex);
+        target = 0;
+        while (target == ahead_pending || target == ahead_busy) target++;
+    }
+
+    std::vector<uint8_t>& state = run_ahead_state[target];
+    state.resize(state_size);
+    std::chrono::steady_clock::time_point save_start = std::chrono::steady_clock::now();
+    if (!S9xFreezeGameMem(state.data(), (uint32)state.size())) {
+        run_ahead_failed++;
+        return;
+    }
+    save_ns_sum += nanosSince(save_start);
+
+    {
+        std::lock_guard<std::mutex> lock(ahead_mutex);
+        if (ahead_pending >= 0) {
+            run_ahead_coalesced++;
+        }
+        ahead_pending = target;
+    }
+    ahead_cv.notify_one();
+}
+
+void EmulatorWrapper::aheadLoop() {
+    std::unique_lock<std::mutex> lock(ahead_mutex);
+    while (true) {
+        ahead_cv.wait(lock, [this]() { return ahead_stop || ahead_pending >= 0; });
+        if (ahead_stop) {
+            break;
+        }
+        ahead_busy = ahead_pending;
+        ahead_pending = -1;
+        lock.unlock();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const std::vector<uint8_t>& state = run_ahead_state[ahead_busy];
+        AheadFrame frame;
+        if (run_ahead_instance->runAheadFrom(state.data(), state.size(), run_ahead_frames, frame)) {
+            uint64_t nanos = nanosSince(start);
+            outputFrame(frame.screen, frame.pitch, frame.width, frame.height, frame.screen_colors);
+            load_ns_sum += frame.load_ns;
+            ahead_ns_sum += nanos - frame.load_ns;
+            run_ahead_runs++;
+            recordMax(run_ns_max, nanos);
+        } else {
+            run_ahead_failed++;
+        }
+
+        lock.lock();
+        ahead_busy = -1;
+    }
+}
+
+bool EmulatorWrapper::runAheadFrom(const uint8_t* state, size_t size, int frames, AheadFrame& frame) {
+    std::lock_guard<std::mutex> lock(emulation_mutex);
+    if (!rom_loaded || frames < 1) {
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (S9xUnfreezeGameMem(state, (uint32)size) != SUCCESS) {
+        return false;
+    }
+    frame.load_ns = nanosSince(start);
+
+    // The rendered frame is left in GFX.Screen for the caller
+    ahead_capture = &frame;
+    runHiddenFrames(frames);
+    ahead_capture = nullptr;
+    return frame.screen != nullptr;
+}
+
+RunAheadStats EmulatorWrapper::getRunAheadStats() const {
+    RunAheadStats stats = RunAheadStats();
+    stats.frames = run_ahead_frames;
+    stats.second_instance = run_ahead_instance != nullptr;
+    stats.runs = run_ahead_runs;
+    stats.skipped = run_ahead_skipped;
+    stats.coalesced = run_ahead_coalesced;
+    stats.failed = run_ahead_failed;
+
+    uint64_t real_frames = run_ahead_real_frames;
+    stats.frame_us_mean = real_frames ? (double)frame_ns_sum.load() / real_frames / 1000.0 : 0.0;
+    stats.save_us_mean = real_frames ? (double)save_ns_sum.load() / real_frames / 1000.0 : 0.0;
+    stats.ahead_us_mean = stats.runs ? (double)ahead_ns_sum.load() / stats.runs / 1000.0 : 0.0;
+    stats.load_us_mean = stats.runs ? (double)load_ns_sum.load() / stats.runs / 1000.0 : 0.0;
+    if (stats.frames > 0) {
+        stats.extra_frame_us_mean = (stats.save_us_mean + stats.ahead_us_mean + stats.load_us_mean) / stats.frames;
+    }
+    stats.run_us_max = (double)run_ns_max.load() / 1000.0;
+    return stats;
+}
+
+void EmulatorWrapper::setButtonState(int port, uint16_t buttons, const InputStamp& stamp) {
     if (port < 0 || port >= 8) return;
     
-    // Map buttons to SNES format
-    MovieSetJoypad(port, buttons);
+    InputEvent event = InputEvent();
+    event.kind = InputEvent::Kind::Buttons;
+    event.port = port;
+    event.buttons = buttons;
+    event.stamp = stamp;
+    input_queue.push(event);
 }
 
 void EmulatorWrapper::setAxisState(int port, int axis, int16_t value) {
@@ -336,7 +666,7 @@ void EmulatorWrapper::setAxisState(int port, int axis, int16_t value) {
     // For now, SNES controllers are digital only
 }
 
-void EmulatorWrapper::setMousePosition(int port, int16_t x, int16_t y) {
+void EmulatorWrapper::setMousePosition(int port, int16_t x, int16_t y, const InputStamp& stamp) {
     if (port < 0 || port >= 2) return;
     
     // Clamp to SNES screen coordinates
@@ -345,26 +675,312 @@ void EmulatorWrapper::setMousePosition(int port, int16_t x, int16_t y) {
     if (y < 0) y = 0;
     if (y > 223) y = 223;
     
-    S9xReportPointer(PseudoPointerBase - port, x, y);
+    InputEvent event = InputEvent();
+    event.kind = InputEvent::Kind::Pointer;
+    event.port = port;
+    event.x = x;
+    event.y = y;
+    event.stamp = stamp;
+    input_queue.push(event);
 }
 
-void EmulatorWrapper::setMouseButtons(int port, bool left, bool right) {
+void EmulatorWrapper::setMouseButtons(int port, bool left, bool right, const InputStamp& stamp) {
     if (port < 0 || port >= 2) return;
     
-    // Mouse button handling would go here
-    // This requires mapping to the appropriate control IDs
+    InputEvent event = InputEvent();
+    event.kind = InputEvent::Kind::MouseButtons;
+    event.port = port;
+    event.left = left;
+    event.right = right;
+    event.stamp = stamp;
+    input_queue.push(event);
 }
 
-void EmulatorWrapper::setVideoCallback(std::function<void(const uint16_t*, int, int, int, double)> callback) {
+void EmulatorWrapper::applyInput(const InputEvent& event) {
+    switch (event.kind) {
+        case InputEvent::Kind::Buttons:
+            // Map buttons to SNES format
+            MovieSetJoypad(event.port, event.buttons);
+            break;
+        case InputEvent::Kind::Pointer:
+            S9xReportPointer(PseudoPointerBase - event.port, event.x, event.y);
+            break;
+        case InputEvent::Kind::MouseButtons:
+            // Mouse button handling would go here
+            // This requires mapping to the appropriate control IDs
+            break;
+    }
+}
+
+void EmulatorWrapper::setVideoCallback(std::function<void(const VideoFrame&)> callback) {
     std::lock_guard<std::mutex> lock(emulation_mutex);
     video_callback = callback;
 }
 
+void EmulatorWrapper::setVideoBufferProvider(std::function<uint8_t*(size_t)> provider) {
+    std::lock_guard<std::mutex> lock(emulation_mutex);
+    video_buffer_provider = provider;
+}
+
+void EmulatorWrapper::setVideoFormat(PixelFormat format) {
+    video_format = format;
+}
+
+bool EmulatorWrapper::setVideoEncoding(VideoEncoding encoding, int tile_size, int keyframe_interval, int level) {
+    // Picked up by the next frame; a new setting always starts with a keyframe
+    if (encoding == VideoEncoding::TileDelta && !tile_encoder.configure(tile_size, keyframe_interval)) {
+        return false;
+    }
+    if (encoding == VideoEncoding::PaletteDeflate && !palette_codec.setLevel(level)) {
+        return false;
+    }
+    video_encoding = encoding;
+    return true;
+}
+
+VideoEncoderStats EmulatorWrapper::getVideoEncoderStats() const {
+    VideoEncoding encoding = video_encoding;
+    VideoEncoderStats stats = encoding == VideoEncoding::PaletteDeflate ? palette_codec.getStats() : tile_encoder.getStats();
+    stats.encoding = encoding;
+    return stats;
+}
+
+BatchResult EmulatorWrapper::runFrames(int frames, BatchRender render, bool audio) {
+    BatchResult result = BatchResult();
+    result.format = video_format;
+    if (!rom_loaded || Settings.StopEmulation || frames <= 0) {
+        return result;
+    }
+
+    batch_capture = render != BatchRender::None ? &result : nullptr;
+    batch_deliver = render == BatchRender::Every;
+    audio_discarding = !audio;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t frame_ns_max = 0;
+    for (int i = 0; i < frames; i++) {
+        std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+        input_queue.drain([this](const InputEvent& event) { applyInput(event); });
+        batch_copy = i == frames - 1;
+        IPPU.RenderThisFrame = render == BatchRender::Every || (render == BatchRender::Last && batch_copy);
+        S9xProfiler.frameBegin();
+        S9xMainLoop();
+        if (frame_callback) {
+            S9X_PROFILE_SCOPE(Output);
+            frame_callback();
+        }
+        S9xProfiler.frameEnd();
+        uint64_t nanos = nanosSince(frame_start);
+        if (nanos > frame_ns_max) frame_ns_max = nanos;
+    }
+    uint64_t elapsed_ns = nanosSince(start);
+
+    processAudioSamples();
+    audio_discarding = false;
+    batch_capture = nullptr;
+    batch_copy = false;
+    batch_deliver = false;
+    batch_ran = true;
+
+    result.frames = frames;
+    result.elapsed_ms = elapsed_ns / 1e6;
+    result.frames_per_second = elapsed_ns ? frames * 1e9 / elapsed_ns : 0.0;
+    result.frame_us_mean = elapsed_ns / 1000.0 / frames;
+    result.frame_us_max = frame_ns_max / 1000.0;
+    return result;
+}
+
+bool EmulatorWrapper::stepEnvironment(const uint16_t* buttons, int ports, int frames, int scale, bool greyscale,
+                                      uint8_t* observation) {
+    if (!rom_loaded || Settings.StopEmulation || frames <= 0) {
+        return false;
+    }
+
+    for (int port = 0; port < ports && port < 8; port++) {
+        MovieSetJoypad(port, buttons[port]);
+    }
+
+    // The last frame stays in GFX.Screen instead of going to the video callback
+    AheadFrame frame;
+    ahead_capture = &frame;
+    audio_discarding = true;
+    for (int i = 0; i < frames; i++) {
+        IPPU.RenderThisFrame = observation && i == frames - 1;
+        S9xMainLoop();
+    }
+    processAudioSamples();
+    audio_discarding = false;
+    ahead_capture = nullptr;
+
+    if (observation) {
+        convertObservation(frame.screen, frame.pitch, frame.width, frame.height, scale, greyscale, observation);
+    }
+    return true;
+}
+
+bool EmulatorWrapper::readRAM(uint32_t offset, uint8_t* out, size_t size) const {
+    if (!rom_loaded || offset > kWorkRAMSize || size > kWorkRAMSize - offset) {
+        return false;
+    }
+    memcpy(out, Memory.RAM + offset, size);
+    return true;
+}
+
+bool EmulatorWrapper::setThreadedDispatch(bool enabled) {
+#ifdef S9X_THREADED_DISPATCH
+    // S9xMainLoop() picks the loop when it is entered, once per frame
+    runAtFrameBoundary([enabled]() { Settings.ThreadedDispatch = enabled; });
+    return true;
+#else
+    return !enabled;
+#endif
+}
+
+bool EmulatorWrapper::getThreadedDispatch() const {
+    return Settings.ThreadedDispatch;
+}
+
+void EmulatorWrapper::setSkipIdleLoops(bool enabled) {
+    runAtFrameBoundary([enabled]() { Settings.SkipIdleLoops = enabled; });
+}
+
+CPUStats EmulatorWrapper::getCPUStats() const {
+    CPUStats stats = CPUStats();
+    stats.threaded_dispatch = Settings.ThreadedDispatch;
+    stats.skip_idle_loops = Settings.SkipIdleLoops;
+    stats.instructions = ICPU.Instructions;
+    stats.frames = rom_loaded ? ICPU.Frame - load_frame : 0;
+    stats.idle_loop_skips = ICPU.IdleLoopSkips;
+    stats.idle_loop_cycles = ICPU.IdleLoopCycles;
+    stats.idle_loop_instructions = ICPU.IdleLoopInstructions;
+    uint64_t cycles = stats.frames * (uint64_t)Timings.H_Max * Timings.V_Max;
+    stats.idle_cycle_share = cycles ? (double)stats.idle_loop_cycles / cycles : 0.0;
+    return stats;
+}
+
+void EmulatorWrapper::setRenderThread(bool enabled, bool verify) {
+    // The worker is started and stopped by the next S9xStartScreenRefresh()
+    runAtFrameBoundary([enabled, verify]() {
+        Settings.RenderThread = enabled || verify;
+        Settings.RenderThreadVerify = verify;
+    });
+}
+
+RenderThreadStats EmulatorWrapper::getRenderThreadStats() const {
+    SRenderThreadStats core;
+    S9xGetRenderThreadStats(&core);
+    RenderThreadStats stats = RenderThreadStats();
+    stats.enabled = core.Running;
+    stats.verify = core.Verify;
+    stats.frames = core.Frames;
+    stats.batches = core.Batches;
+    stats.split_batches = core.SplitBatches;
+    stats.redrawn_lines = core.RedrawnLines;
+    stats.vram_blocks = core.VRAMBlocks;
+    stats.mismatched_frames = core.MismatchedFrames;
+    stats.render_us_mean = core.Frames ? core.RenderNanos / 1000.0 / core.Frames : 0.0;
+    stats.wait_us_mean = core.Frames ? core.WaitNanos / 1000.0 / core.Frames : 0.0;
+    return stats;
+}
+
+bool EmulatorWrapper::setProfiling(bool enabled, size_t trace_events) {
+#ifdef SNES9X_PROFILER
+    S9xProfiler.setEnabled(enabled, trace_events);
+    return true;
+#else
+    return !enabled;
+#endif
+}
+
+void EmulatorWrapper::setFrameCallback(std::function<void()> callback) {
+    // Not synchronized with a running emulation thread; set it before starting
+    frame_callback = callback;
+}
+
+void EmulatorWrapper::runAtFrameBoundary(std::function<void()> task) {
+    std::unique_lock<std::mutex> lock(boundary_mutex);
+    if (emulation_running || boundary_busy) {
+        boundary_tasks.push_back(std::move(task));
+        boundary_pending.store(true, std::memory_order_release);
+        return;
+    }
+
+    // The task may be a long runFrames() batch, so boundary_mutex is only
+    // held to mark it in flight. Tasks submitted meanwhile queue up and run
+    // here after it; a thread start waits for it and takes over the queue.
+    boundary_busy = true;
+    std::vector<std::function<void()>> tasks;
+    tasks.push_back(std::move(task));
+    while (!tasks.empty()) {
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> emulation_lock(emulation_mutex);
+            for (std::function<void()>& queued : tasks) {
+                queued();
+            }
+        }
+        tasks.clear();
+        lock.lock();
+        if (!emulation_running) {
+            tasks.swap(boundary_tasks);
+            boundary_pending.store(false, std::memory_order_relaxed);
+        }
+    }
+    boundary_busy = false;
+    if (emulation_running) {
+        launchEmulationThread();
+    }
+}
+
+void EmulatorWrapper::runBoundaryTasks() {
+    if (!boundary_pending.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(boundary_mutex);
+        tasks.swap(boundary_tasks);
+        boundary_pending.store(false, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(emulation_mutex);
+    for (std::function<void()>& task : tasks) {
+        task();
+    }
+}
+
 void EmulatorWrapper::setAudioCallback(std::function<void(const int16_t*, int)> callback) {
     std::lock_guard<std::mutex> lock(audio_mutex);
     audio_callback = callback;
 }
 
+void EmulatorWrapper::setAudioBufferProvider(std::function<int16_t*(size_t)> provider) {
+    std::lock_guard<std::mutex> lock(audio_mutex);
+    audio_buffer_provider = provider;
+}
+
+void EmulatorWrapper::setAudioPacketDuration(int ms) {
+    if (ms < 1) ms = 1;
+    if (ms > 50) ms = 50;
+    audio_packet_ms = ms;
+}
+
+AudioStats EmulatorWrapper::getAudioStats() const {
+    AudioStats stats;
+    stats.sample_rate = Settings.SoundPlaybackRate;
+    stats.packet_ms = audio_packet_ms;
+    stats.packet_frames = Settings.SoundPlaybackRate * stats.packet_ms / 1000;
+    stats.fill = audio_ring.readAvailable() / 2;
+    stats.capacity = audio_ring.capacity() / 2;
+    stats.packets = audio_packets;
+    stats.underruns = audio_underruns;
+    stats.overruns = audio_overruns;
+    stats.overrun_frames = audio_overrun_frames;
+    stats.deferred = audio_deferred;
+    return stats;
+}
+
 int EmulatorWrapper::getFrameWidth() const {
     return frame_width;
 }
@@ -383,7 +999,16 @@ void EmulatorWrapper::startEmulationThread() {
     }
 
     should_stop = false;
+    std::lock_guard<std::mutex> lock(boundary_mutex);
     emulation_running = true;
+    // A task running on another thread launches it when done
+    if (!boundary_busy) {
+        launchEmulationThread();
+    }
+}
+
+void EmulatorWrapper::launchEmulationThread() {
+    palette_codec.start();
     emulation_thread = std::thread(&EmulatorWrapper::emulationLoop, this);
 }
 
@@ -392,59 +1017,297 @@ void EmulatorWrapper::stopEmulationThread() {
         return;
     }
 
+    // Not launched yet: the task still running takes back its queue
+    {
+        std::lock_guard<std::mutex> lock(boundary_mutex);
+        if (boundary_busy) {
+            emulation_running = false;
+            return;
+        }
+    }
+
     should_stop = true;
     if (emulation_thread.joinable()) {
         emulation_thread.join();
     }
+
+    stopAudioThread();
+    palette_codec.stop();
+
+    // Tasks queued after the loop's last check run here instead
+    std::lock_guard<std::mutex> lock(boundary_mutex);
     emulation_running = false;
+    std::lock_guard<std::mutex> emulation_lock(emulation_mutex);
+    for (std::function<void()>& task : boundary_tasks) {
+        task();
+    }
+    boundary_tasks.clear();
+    boundary_pending = false;
 }
 
 void EmulatorWrapper::emulationLoop() {
-    auto last_frame_time = std::chrono::steady_clock::now();
-    const auto frame_duration = std::chrono::microseconds(16639); // ~60 FPS
+    frame_pacer.restart();
+    bool render = true;
 
     while (!should_stop) {
-        if (rom_loaded && !Settings.Paused && !Settings.StopEmulation) {
-            runFrame();
+        runBoundaryTasks();
+        // A batch kept the thread busy; do not try to make up that time
+        if (batch_ran.exchange(false)) {
+            frame_pacer.restart();
         }
 
-        // Throttle to maintain frame rate
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - last_frame_time);
-        if (elapsed < frame_duration) {
-            std::this_thread::sleep_for(frame_duration - elapsed);
+        if (!rom_loaded || Settings.Paused || Settings.StopEmulation) {
+            // Keep the controller state current while no frames run
+            if (rom_loaded) {
+                input_queue.drain([this](const InputEvent& event) { applyInput(event); });
+            }
+            frame_pacer.idle();
+            render = true;
+            continue;
+        }
+
+        // Only force a skip; S9xSyncSpeed still handles turbo frame skipping
+        if (!render) {
+            IPPU.RenderThisFrame = false;
+        }
+        runFrame();
+
+        // Deadlines follow the loaded ROM's region (50 Hz PAL, 60 Hz NTSC)
+        frame_pacer.setFrameRate(frame_rate);
+        if (frame_pacer.getMode() == FramePacer::Mode::Audio) {
+            size_t packet_frames = (size_t)Settings.SoundPlaybackRate * audio_packet_ms / 1000;
+            frame_pacer.setAudioFill(audio_ring.readAvailable() / 2, packet_frames * (kAudioPrebufferPackets + 1));
         }
-        last_frame_time = std::chrono::steady_clock::now();
+        render = frame_pacer.frameDone();
     }
 }
 
-void EmulatorWrapper::processVideoFrame() {
-    if (!video_callback || !GFX.Screen) {
+void EmulatorWrapper::processVideoFrame(int width, int height) {
+    S9X_PROFILE_SCOPE(Output);
+
+    // Hi-res and interlaced modes render 512 wide / up to 478 high,
+    // rows are always GFX.RealPPL pixels apart in GFX.Screen
+    if (ahead_capture) {
+        ahead_capture->screen = GFX.Screen;
+        ahead_capture->pitch = GFX.RealPPL;
+        ahead_capture->width = width;
+        ahead_capture->height = height;
+        ahead_capture->screen_colors = IPPU.ScreenColors;
         return;
     }
+    if (batch_capture) {
+        // Raw, whatever the stream encoding, so the result stands alone
+        BatchResult& result = *batch_capture;
+        result.rendered++;
+        if (batch_copy) {
+            result.width = width;
+            result.height = height;
+            result.stride = width * pixelFormatBytesPerPixel(result.format);
+            result.frame.resize((size_t)result.stride * height);
+            convertFrame(GFX.Screen, GFX.RealPPL, width, height, result.frame.data(), result.stride, result.format);
+        }
+        if (!batch_deliver) {
+            return;
+        }
+    }
+    outputFrame(GFX.Screen, GFX.RealPPL, width, height, IPPU.ScreenColors);
+}
 
-    int width = frame_width;
-    int height = frame_height;
-    int stride = GFX.RealPPL * sizeof(uint16_t);
-    
-    video_callback(GFX.Screen, width, height, stride, frame_rate);
+void EmulatorWrapper::outputFrame(const uint16_t* screen, int pitch, int width, int height,
+                                  const uint16_t* screen_colors) {
+    // First rendered frame for input applied since the last one
+    input_queue.frameRendered();
+
+    if (!video_callback || !screen) {
+        return;
+    }
+
+    frame_width = width;
+    frame_height = height;
+
+    PixelFormat format = video_format;
+    VideoEncoding encoding = video_encoding;
+    if (encoding == VideoEncoding::PaletteDeflate) {
+        // Only the copy happens here; the codec thread encodes and delivers
+        palette_codec.submit(screen, pitch, width, height, screen_colors, format);
+        return;
+    }
+
+    int stride = width * pixelFormatBytesPerPixel(format);
+    size_t size = encoding == VideoEncoding::TileDelta ? tile_encoder.maxEncodedSize(width, height, format) : (size_t)stride * height;
+
+    uint8_t* destination = acquireVideoBuffer(size);
+    if (!destination) {
+        return;
+    }
+
+    // A frame dropped for want of a buffer is never encoded, so the next
+    // delta still applies to what the consumer last received
+    bool keyframe = true;
+    if (encoding == VideoEncoding::TileDelta) {
+        size = tile_encoder.encode(screen, pitch, width, height, format, destination, keyframe);
+    } else {
+        convertFrame(screen, pitch, width, height, destination, stride, format);
+    }
+
+    deliverVideoFrame(destination, size, width, height, format, encoding, keyframe);
+}
+
+uint8_t* EmulatorWrapper::acquireVideoBuffer(size_t size) {
+    if (video_buffer_provider) {
+        return video_buffer_provider(size);
+    }
+    if (video_buffer.size() < size) {
+        video_buffer.resize(size);
+    }
+    return video_buffer.data();
+}
+
+void EmulatorWrapper::deliverVideoFrame(uint8_t* data, size_t size, int width, int height,
+                                        PixelFormat format, VideoEncoding encoding, bool keyframe) {
+    VideoFrame frame;
+    frame.data = data;
+    frame.size = size;
+    frame.width = width;
+    frame.height = height;
+    frame.stride = width * pixelFormatBytesPerPixel(format);
+    frame.format = format;
+    frame.frame_rate = frame_rate;
+    frame.encoding = encoding;
+    frame.keyframe = keyframe;
+    video_callback(frame);
 }
 
 void EmulatorWrapper::processAudioSamples() {
-    std::lock_guard<std::mutex> lock(audio_mutex);
-    
-    if (!audio_callback) {
+    S9X_PROFILE_SCOPE(Output);
+
+    // Whole stereo frames only
+    int samples_available = S9xGetSampleCount() & ~1;
+    if (samples_available <= 0) {
         return;
     }
 
-    // Get audio samples from APU
-    int samples_available = S9xGetSampleCount();
-    if (samples_available > 0) {
-        // Allocate buffer for stereo samples (16-bit each)
-        audio_buffer.resize(samples_available * 2);
-        // Mix samples into buffer (S9xMixSamples expects bytes, stereo = samples * 2 * 2 bytes)
-        S9xMixSamples((uint8_t*)audio_buffer.data(), samples_available);
-        audio_callback(audio_buffer.data(), samples_available);
+    // Unheard frames (run-ahead, batches): drop the samples unresampled
+    if (audio_discarding) {
+        S9xClearSamples();
+        return;
+    }
+
+    // Frames run from runFrame() or runFrames() without the emulation
+    // thread get the packet thread here
+    if (!audio_thread.joinable()) {
+        startAudioThread();
+    }
+
+    // Mix straight into the ring; no lock, the packet thread is the only reader
+    size_t room = audio_ring.writeAvailable() & ~(size_t)1;
+    size_t to_ring = (size_t)samples_available < room ? samples_available : room;
+    if (to_ring) {
+        audio_ring.produce(to_ring, [](int16_t* dest, size_t count) {
+            S9xMixSamples((uint8_t*)dest, (int)count);
+        });
     }
+
+    // Ring full: still drain the resampler so the APU keeps running
+    int overflow = samples_available - (int)to_ring;
+    if (overflow > 0) {
+        audio_overruns++;
+        audio_overrun_frames += overflow / 2;
+        if (audio_discard.size() < (size_t)overflow) {
+            audio_discard.resize(overflow);
+        }
+        S9xMixSamples((uint8_t*)audio_discard.data(), overflow);
+    }
+}
+
+void EmulatorWrapper::startAudioThread() {
+    // Neither side of the audio ring is active yet, so it can be reset here
+    audio_ring.clear();
+    audio_thread_stop = false;
+    audio_thread = std::thread(&EmulatorWrapper::audioPacketLoop, this);
 }
 
+void EmulatorWrapper::stopAudioThread() {
+    audio_thread_stop = true;
+    if (audio_thread.joinable()) {
+        audio_thread.join();
+    }
+}
+
+void EmulatorWrapper::audioPacketLoop() {
+    auto next_packet = std::chrono::steady_clock::now();
+    bool prebuffering = true;
+
+    while (!audio_thread_stop) {
+        int packet_ms = audio_packet_ms;
+        size_t packet_samples = (size_t)Settings.SoundPlaybackRate * packet_ms / 1000 * 2;
+
+        if (prebuffering) {
+            prebuffering = audio_ring.readAvailable() < packet_samples * kAudioPrebufferPackets;
+        }
+
+        if (!prebuffering) {
+            // One packet per tick, plus one more while a backlog builds up
+            int due = 1;
+            if (audio_ring.readAvailable() >= packet_samples * (kAudioPrebufferPackets + kAudioCatchUpPackets)) {
+                due = 2;
+            }
+
+            for (int i = 0; i < due; i++) {
+                if (audio_ring.readAvailable() < packet_samples) {
+                    audio_underruns++;
+                    prebuffering = true;
+                    break;
+                }
+                if (!emitAudioPacket(packet_samples)) {
+                    break;
+                }
+            }
+        }
+
+        // Absolute deadlines keep the cadence steady; resync after a long stall
+        auto now = std::chrono::steady_clock::now();
+        next_packet += std::chrono::milliseconds(packet_ms);
+        if (next_packet + std::chrono::milliseconds(packet_ms * 4) < now) {
+            next_packet = now;
+        }
+        std::this_thread::sleep_until(next_packet);
+    }
+}
+
+bool EmulatorWrapper::emitAudioPacket(size_t packet_samples) {
+    std::lock_guard<std::mutex> lock(audio_mutex);
+
+    int16_t* destination;
+    if (audio_buffer_provider) {
+        destination = audio_buffer_provider(packet_samples * sizeof(int16_t));
+        if (!destination) {
+            // Consumer is behind; keep the samples in the ring for now
+            audio_deferred++;
+            return false;
+        }
+    } else {
+        if (audio_packet.size() < packet_samples) {
+            audio_packet.resize(packet_samples);
+        }
+        destination = audio_packet.data();
+    }
+
+    audio_ring.readExact(destination, packet_samples);
+    audio_packets++;
+
+    if (audio_callback) {
+        audio_callback(destination, (int)(packet_samples / 2));
+    }
+    return true;
+}
+
+// Core module entry points; everything else in the module is hidden so each
+// loaded copy binds only to its own globals
+extern "C" EMULATOR_EXPORT int snes9x_emulator_api_version() {
+    return kEmulatorApiVersion;
+}
+
+extern "C" EMULATOR_EXPORT Emulator* snes9x_create_emulator() {
+    return new EmulatorWrapper();
+}
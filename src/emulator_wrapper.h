@@ -8,80 +8,227 @@
 #include <atomic>
 #include <vector>
 #include <queue>
+#include <condition_variable>
+#include "emulator.h"
+#include "audio_ring.h"
+#include "rewind_buffer.h"
+#include "tile_delta.h"
+#include "palette_codec.h"
+#include "input_queue.h"
 
 // Forward declarations
 struct SGFX;
 
-class EmulatorWrapper {
+// The Emulator implementation inside the core module. The core's globals
+// allow a single EmulatorWrapper per loaded copy of the module.
+class EmulatorWrapper : public Emulator {
 public:
     EmulatorWrapper();
-    ~EmulatorWrapper();
+    ~EmulatorWrapper() override;
 
     // Initialization
-    bool init();
-    void deinit();
+    bool init() override;
+    void deinit() override;
 
     // ROM management
-    bool loadROM(const std::string& filename);
-    bool loadROMMem(const uint8_t* data, size_t size, const std::string& name = "");
-    bool isROMLoaded() const { return rom_loaded; }
+    bool loadROM(const std::string& filename) override;
+    bool loadROMMem(const uint8_t* data, size_t size, const std::string& name = "") override;
+    bool isROMLoaded() const override { return rom_loaded; }
+    bool captureROM(const std::string& filename, const uint8_t* data, size_t size,
+                    std::vector<uint8_t>& image, PreparedROM& prepared) override;
+    bool loadPreparedROM(const PreparedROM& prepared, const std::string& filename) override;
 
     // Emulation control
-    void runFrame();
-    void reset();
-    void softReset();
-    void setPaused(bool paused);
-    bool isPaused() const;
+    void runFrame() override;
+    void reset() override;
+    void softReset() override;
+    void setPaused(bool paused) override;
+    bool isPaused() const override;
 
     // State management
-    bool saveState(int slot);
-    bool loadState(int slot);
-    bool saveStateToFile(const std::string& filename);
-    bool loadStateFromFile(const std::string& filename);
+    bool saveState(int slot) override;
+    bool loadState(int slot) override;
+    bool saveStateToFile(const std::string& filename) override;
+    bool loadStateFromFile(const std::string& filename) override;
+    size_t getStateSize() const override { return state_size; }
+    bool saveStateToMemory(uint8_t* buffer, size_t size) override;
+    bool loadStateFromMemory(const uint8_t* data, size_t size) override;
+    bool setRewind(size_t budget_bytes, int interval_frames) override;
+    int rewindFrames(int frames) override { return rewind_buffer.rewindFrames(frames); }
+    int rewindToTime(int64_t timestamp_ms) override { return rewind_buffer.rewindTo(timestamp_ms); }
+    RewindStats getRewindStats() const override { return rewind_buffer.getStats(); }
+    bool setRunAhead(int frames, Emulator* ahead) override;
+    bool runAheadFrom(const uint8_t* state, size_t size, int frames, AheadFrame& frame) override;
+    RunAheadStats getRunAheadStats() const override;
+    void setSRAMWrites(bool enabled) override { sram_writes = enabled; }
+    bool writesSRAM() const { return sram_writes; }
 
     // Control input
-    void setButtonState(int port, uint16_t buttons);
-    void setAxisState(int port, int axis, int16_t value);
-    void setMousePosition(int port, int16_t x, int16_t y);
-    void setMouseButtons(int port, bool left, bool right);
+    void setButtonState(int port, uint16_t buttons, const InputStamp& stamp) override;
+    void setAxisState(int port, int axis, int16_t value) override;
+    void setMousePosition(int port, int16_t x, int16_t y, const InputStamp& stamp) override;
+    void setMouseButtons(int port, bool left, bool right, const InputStamp& stamp) override;
+    InputStats getInputStats() const override { return input_queue.getStats(); }
+    void resetInputStats() override { input_queue.resetStats(); }
 
     // Video/Audio callbacks
-    void setVideoCallback(std::function<void(const uint16_t*, int, int, int, double)> callback);
-    void setAudioCallback(std::function<void(const int16_t*, int)> callback);
+    void setVideoCallback(std::function<void(const VideoFrame&)> callback) override;
+    void setAudioCallback(std::function<void(const int16_t*, int)> callback) override;
+    void setAudioBufferProvider(std::function<int16_t*(size_t)> provider) override;
+    void setAudioPacketDuration(int ms) override;
+    AudioStats getAudioStats() const override;
+    void setVideoBufferProvider(std::function<uint8_t*(size_t)> provider) override;
+    void setVideoFormat(PixelFormat format) override;
+    PixelFormat getVideoFormat() const override { return video_format; }
+    bool setVideoEncoding(VideoEncoding encoding, int tile_size, int keyframe_interval, int level) override;
+    void requestKeyframe() override { tile_encoder.requestKeyframe(); }
+    VideoEncoderStats getVideoEncoderStats() const override;
+    BatchResult runFrames(int frames, BatchRender render, bool audio) override;
+    bool stepEnvironment(const uint16_t* buttons, int ports, int frames, int scale, bool greyscale, uint8_t* observation) override;
+    bool readRAM(uint32_t offset, uint8_t* out, size_t size) const override;
+    bool setThreadedDispatch(bool enabled) override;
+    bool getThreadedDispatch() const override;
+    void setSkipIdleLoops(bool enabled) override;
+    CPUStats getCPUStats() const override;
+    void setRenderThread(bool enabled, bool verify) override;
+    RenderThreadStats getRenderThreadStats() const override;
+    bool setProfiling(bool enabled, size_t trace_events) override;
+    ProfileStats getProfileStats() const override { return S9xProfiler.getStats(); }
+    void resetProfileStats() override { S9xProfiler.reset(); }
+    void takeProfileTrace(ProfileTrace& trace) override { S9xProfiler.takeTrace(trace); }
+    void setFrameCallback(std::function<void()> callback) override;
+    void runAtFrameBoundary(std::function<void()> task) override;
 
     // Frame info
-    int getFrameWidth() const;
-    int getFrameHeight() const;
-    double getFrameRate() const;
+    int getFrameWidth() const override;
+    int getFrameHeight() const override;
+    double getFrameRate() const override;
 
     // Thread management
-    void startEmulationThread();
-    void stopEmulationThread();
-    bool isRunning() const { return emulation_running; }
+    void startEmulationThread() override;
+    void stopEmulationThread() override;
+    bool isRunning() const override { return emulation_running; }
+
+    FramePacer& getFramePacer() override { return frame_pacer; }
 
     // Public for C callbacks
-    void processVideoFrame();
+    void processVideoFrame(int width, int height);
     void processAudioSamples();
 
 private:
+    void beginLoad();
+    bool finishLoad(bool loaded);
+    void launchEmulationThread();
     void emulationLoop();
+    void runFrameAhead();
+    void runHiddenFrames(int frames);
+    void handOffAhead();
+    void aheadLoop();
+    void stopAheadThread();
+    void outputFrame(const uint16_t* screen, int pitch, int width, int height, const uint16_t* screen_colors);
+    void startAudioThread();
+    void stopAudioThread();
+    void audioPacketLoop();
+    bool emitAudioPacket(size_t packet_samples);
+    void runBoundaryTasks();
+    void applyInput(const InputEvent& event);
+    uint8_t* acquireVideoBuffer(size_t size);
+    void deliverVideoFrame(uint8_t* data, size_t size, int width, int height,
+                           PixelFormat format, VideoEncoding encoding, bool keyframe);
 
     std::atomic<bool> rom_loaded;
     std::atomic<bool> emulation_running;
     std::atomic<bool> should_stop;
     std::thread emulation_thread;
     std::mutex emulation_mutex;
+    FramePacer frame_pacer;
 
-    std::function<void(const uint16_t*, int, int, int, double)> video_callback;
+    std::function<void(const VideoFrame&)> video_callback;
+    std::function<uint8_t*(size_t)> video_buffer_provider;
     std::function<void(const int16_t*, int)> audio_callback;
-
-    // Audio buffer
-    std::vector<int16_t> audio_buffer;
+    std::function<int16_t*(size_t)> audio_buffer_provider;
+    std::function<void()> frame_callback;
+
+    // Work queued for the next frame boundary; the flag keeps the common
+    // empty case off the lock. boundary_busy (under boundary_mutex) is set
+    // while a task runs on its caller's thread with the emulation thread
+    // stopped.
+    std::mutex boundary_mutex;
+    std::vector<std::function<void()>> boundary_tasks;
+    std::atomic<bool> boundary_pending;
+    bool boundary_busy;
+
+    // Input events wait here for the next frame boundary
+    InputQueue input_queue;
+
+    // Snapshot size of the loaded ROM (S9xFreezeSize runs a full freeze)
+    std::atomic<size_t> state_size;
+    uint32_t load_frame;        // ICPU.Frame when the ROM was loaded
+    RewindBuffer rewind_buffer;
+    std::atomic<bool> sram_writes;
+
+    // Run-ahead. The snapshot slots follow the palette codec's capture
+    // scheme: one being filled, one pending, one being run by the ahead
+    // thread.
+    static const int kMaxRunAheadFrames = 8;
+    int run_ahead_frames;
+    Emulator* run_ahead_instance;
+    std::vector<uint8_t> run_ahead_state[3];
+    AheadFrame* ahead_capture;          // set while this is the ahead instance or stepping an environment
+
+    std::thread ahead_thread;
+    std::mutex ahead_mutex;
+    std::condition_variable ahead_cv;
+    int ahead_pending;
+    int ahead_busy;
+    bool ahead_stop;
+    std::atomic<uint64_t> run_ahead_runs;
+    std::atomic<uint64_t> run_ahead_skipped;
+    std::atomic<uint64_t> run_ahead_coalesced;
+    std::atomic<uint64_t> run_ahead_failed;
+    std::atomic<uint64_t> run_ahead_real_frames;
+    std::atomic<uint64_t> frame_ns_sum;
+    std::atomic<uint64_t> save_ns_sum;
+    std::atomic<uint64_t> ahead_ns_sum;
+    std::atomic<uint64_t> load_ns_sum;
+    std::atomic<uint64_t> run_ns_max;
+
+    // runFrames(): result counting rendered frames, whether the frame
+    // being run is copied into it and whether frames also go to the video
+    // callback
+    BatchResult* batch_capture;
+    bool batch_copy;
+    bool batch_deliver;
+    std::atomic<bool> batch_ran;        // the pacer restarts after a batch
+
+    // Audio: the APU mixes straight into a lock-free SPSC ring (producer is
+    // whichever thread runs frames), the packet thread drains it in fixed
+    // packets. It starts with the first samples and stops with the
+    // emulation thread.
+    SpscRing<int16_t> audio_ring;
+    std::vector<int16_t> audio_packet;      // used without a buffer provider
+    std::vector<int16_t> audio_discard;     // overrun samples are mixed here
+    std::thread audio_thread;
+    std::atomic<bool> audio_thread_stop;
+    std::atomic<int> audio_packet_ms;
+    std::atomic<uint64_t> audio_packets;
+    std::atomic<uint64_t> audio_underruns;
+    std::atomic<uint64_t> audio_overruns;
+    std::atomic<uint64_t> audio_overrun_frames;
+    std::atomic<uint64_t> audio_deferred;
+    bool audio_discarding;                  // hidden run-ahead frames
     std::mutex audio_mutex;
 
+    // Converted video frame, reused across frames
+    std::vector<uint8_t> video_buffer;
+    std::atomic<PixelFormat> video_format;
+    std::atomic<VideoEncoding> video_encoding;
+    TileDeltaEncoder tile_encoder;
+    PaletteCodec palette_codec;
+
     // Video frame info
-    int frame_width;
-    int frame_height;
+    std::atomic<int> frame_width;
+    std::atomic<int> frame_height;
     double frame_rate;
 };
 
@@ -0,0 +1,351 @@
+#include "env_pool.h"
+#include "emulator_loader.h"
+#include "rom_cache.h"
+#include "util.h"
+#include <chrono>
+#include <cstring>
+
+static uint64_t nanosSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool validRamValue(const RamValue& value) {
+    return value.size >= 1 && value.size <= 4 && value.address < kWorkRAMSize &&
+           value.size <= (int)(kWorkRAMSize - value.address);
+}
+
+static bool compareValue(DoneTerm::Compare compare, int64_t value, int64_t operand) {
+    switch (compare) {
+        case DoneTerm::Compare::Equal:        return value == operand;
+        case DoneTerm::Compare::NotEqual:     return value != operand;
+        case DoneTerm::Compare::Less:         return value < operand;
+        case DoneTerm::Compare::LessEqual:    return value <= operand;
+        case DoneTerm::Compare::Greater:      return value > operand;
+        case DoneTerm::Compare::GreaterEqual: return value >= operand;
+    }
+    return false;
+}
+
+EnvPool::EnvPool()
+    : job_generation(0)
+    , stopping(false)
+{
+    config.ports = 1;
+    config.frame_skip = 1;
+    config.scale = 1;
+    config.greyscale = false;
+    resetStats();
+}
+
+EnvPool::~EnvPool() {
+    destroy();
+}
+
+bool EnvPool::create(int count, int threads, std::string& error) {
+    if (count < 1 || count > kMaxEnvs) {
+        error = "Environment count out of range";
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        Env env;
+        env.emulator = createEmulator(error);
+        if (!env.emulator) {
+            destroy();
+            return false;
+        }
+        envs.push_back(env);
+        if (!env.emulator->init()) {
+            error = "Emulator init failed";
+            destroy();
+            return false;
+        }
+        // Every instance runs the same game; none of them owns its .srm
+        env.emulator->setSRAMWrites(false);
+    }
+
+    if (threads <= 0) {
+        threads = (int)std::thread::hardware_concurrency();
+    }
+    if (threads > count) threads = count;
+    if (threads < 1) threads = 1;
+
+    stopping = false;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(&EnvPool::workerLoop, this);
+    }
+    return true;
+}
+
+void EnvPool::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    job.reset();
+
+    for (Env& env : envs) {
+        env.emulator->deinit();
+        destroyEmulator(env.emulator);
+    }
+    envs.clear();
+    reset_state.clear();
+}
+
+void EnvPool::workerLoop() {
+    uint64_t seen = 0;
+    for (;;) {
+        std::shared_ptr<Job> current;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this, seen]() { return stopping || job_generation != seen; });
+            // A job queued before destroy() still runs to completion
+            if (job_generation == seen) {
+                return;
+            }
+            seen = job_generation;
+            current = job;
+        }
+
+        int item;
+        while ((item = current->next.fetch_add(1)) < current->count) {
+            current->work(item);
+            if (current->remaining.fetch_sub(1) == 1 && current->completion) {
+                current->completion();
+            }
+        }
+    }
+}
+
+void EnvPool::dispatch(int count, std::function<void(int)> work, std::function<void()> completion) {
+    if (count <= 0 || workers.empty()) {
+        for (int i = 0; i < count; i++) {
+            work(i);
+        }
+        if (completion) completion();
+        return;
+    }
+
+    std::shared_ptr<Job> next = std::make_shared<Job>();
+    next->work = std::move(work);
+    next->completion = std::move(completion);
+    next->count = count;
+    next->next = 0;
+    next->remaining = count;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = next;
+        job_generation++;
+    }
+    cv.notify_all();
+}
+
+void EnvPool::runAll(int count, std::function<void(int)> work) {
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    bool done = false;
+    dispatch(count, std::move(work), [&]() {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        done = true;
+        done_cv.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done_cv.wait(lock, [&done]() { return done; });
+}
+
+bool EnvPool::loadROM(const std::string& filename) {
+    std::vector<char> loaded(envs.size(), 0);
+    runAll(size(), [this, &filename, &loaded](int i) {
+        loaded[i] = RomCache::instance().loadROM(envs[i].emulator, filename);
+    });
+
+    // A snapshot of another game does not apply
+    reset_state.clear();
+    bool all = true;
+    for (size_t i = 0; i < envs.size(); i++) {
+        all = all && loaded[i];
+        updateBaseline(envs[i]);
+    }
+    return all;
+}
+
+bool EnvPool::configure(const EnvConfig& next) {
+    if (next.ports < 1 || next.ports > kMaxPorts || next.frame_skip < 1 || !isObservationScale(next.scale)) {
+        return false;
+    }
+    for (const RewardTerm& term : next.rewards) {
+        if (!validRamValue(term.value)) return false;
+    }
+    for (const DoneTerm& term : next.done) {
+        if (!validRamValue(term.value)) return false;
+    }
+
+    config = next;
+    for (Env& env : envs) {
+        updateBaseline(env);
+    }
+    return true;
+}
+
+size_t EnvPool::observationSize() const {
+    return ::observationSize(config.scale, config.greyscale);
+}
+
+bool EnvPool::captureResetState(int index) {
+    if (index < 0 || index >= size()) {
+        return false;
+    }
+    Emulator* emulator = envs[index].emulator;
+    size_t state_size = emulator->getStateSize();
+    if (!emulator->isROMLoaded() || !state_size) {
+        return false;
+    }
+    std::vector<uint8_t> state(state_size);
+    if (!emulator->saveStateToMemory(state.data(), state.size())) {
+        return false;
+    }
+    reset_state.swap(state);
+    return true;
+}
+
+bool EnvPool::setResetState(const uint8_t* data, size_t size) {
+    if (!size) {
+        reset_state.clear();
+        return true;
+    }
+    reset_state.assign(data, data + size);
+    return true;
+}
+
+bool EnvPool::readValue(Emulator* emulator, const RamValue& value, int64_t& out) const {
+    uint8_t bytes[4];
+    if (!emulator->readRAM(value.address, bytes, value.size)) {
+        return false;
+    }
+    uint32_t raw = 0;
+    for (int i = 0; i < value.size; i++) {
+        raw |= (uint32_t)bytes[i] << (8 * i);
+    }
+    if (value.is_signed) {
+        int shift = 32 - 8 * value.size;
+        out = (int32_t)(raw << shift) >> shift;
+    } else {
+        out = raw;
+    }
+    return true;
+}
+
+void EnvPool::updateBaseline(Env& env) {
+    env.last.assign(config.rewards.size(), 0);
+    for (size_t t = 0; t < config.rewards.size(); t++) {
+        if (config.rewards[t].delta) {
+            readValue(env.emulator, config.rewards[t].value, env.last[t]);
+        }
+    }
+}
+
+void EnvPool::resetEnv(Env& env, uint8_t* observation) {
+    if (reset_state.empty() || !env.emulator->loadStateFromMemory(reset_state.data(), reset_state.size())) {
+        env.emulator->reset();
+    }
+    uint16_t idle[kMaxPorts] = {};
+    if (!env.emulator->stepEnvironment(idle, config.ports, 1, config.scale, config.greyscale, observation) && observation) {
+        memset(observation, 0, observationSize());
+    }
+    updateBaseline(env);
+}
+
+void EnvPool::step(const uint16_t* actions, uint8_t* observations, double* rewards, uint8_t* dones,
+                   std::function<void()> completion) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t observation_size = observationSize();
+
+    dispatch(size(), [this, actions, observations, rewards, dones, observation_size](int i) {
+        std::chrono::steady_clock::time_point env_start = std::chrono::steady_clock::now();
+        Env& env = envs[i];
+        uint8_t* observation = observations ? observations + i * observation_size : nullptr;
+        bool ran = env.emulator->stepEnvironment(actions + i * config.ports, config.ports, config.frame_skip,
+                                                 config.scale, config.greyscale, observation);
+        if (!ran && observation) {
+            memset(observation, 0, observation_size);
+        }
+
+        double reward = 0.0;
+        for (size_t t = 0; t < config.rewards.size(); t++) {
+            const RewardTerm& term = config.rewards[t];
+            int64_t value;
+            if (!readValue(env.emulator, term.value, value)) {
+                continue;
+            }
+            if (term.delta) {
+                reward += term.scale * (double)(value - env.last[t]);
+                env.last[t] = value;
+            } else {
+                reward += term.scale * (double)value;
+            }
+        }
+
+        bool done = !ran;
+        for (const DoneTerm& term : config.done) {
+            int64_t value;
+            if (readValue(env.emulator, term.value, value) && compareValue(term.compare, value, term.operand)) {
+                done = true;
+                break;
+            }
+        }
+
+        rewards[i] = reward;
+        dones[i] = done ? 1 : 0;
+        env_step_ns_sum += nanosSince(env_start);
+    }, [this, start, completion]() {
+        uint64_t nanos = nanosSince(start);
+        steps++;
+        env_steps += envs.size();
+        step_ns_sum += nanos;
+        recordMax(step_ns_max, nanos);
+        completion();
+    });
+}
+
+void EnvPool::reset(const std::vector<int>& indices, uint8_t* observations, std::function<void()> completion) {
+    std::vector<int> targets = indices;
+    if (targets.empty()) {
+        for (int i = 0; i < size(); i++) targets.push_back(i);
+    }
+    size_t observation_size = observationSize();
+
+    int count = (int)targets.size();
+    resets += count;
+    dispatch(count, [this, targets, observations, observation_size](int item) {
+        resetEnv(envs[targets[item]], observations ? observations + item * observation_size : nullptr);
+    }, std::move(completion));
+}
+
+EnvPool::Stats EnvPool::getStats() const {
+    Stats stats = Stats();
+    stats.envs = (int)envs.size();
+    stats.threads = (int)workers.size();
+    stats.steps = steps;
+    stats.env_steps = env_steps;
+    stats.resets = resets;
+    uint64_t step_ns = step_ns_sum;
+    stats.env_steps_per_second = step_ns ? stats.env_steps * 1e9 / step_ns : 0.0;
+    stats.step_us_mean = stats.steps ? step_ns / 1000.0 / stats.steps : 0.0;
+    stats.step_us_max = step_ns_max / 1000.0;
+    stats.env_step_us_mean = stats.env_steps ? env_step_ns_sum / 1000.0 / stats.env_steps : 0.0;
+    return stats;
+}
+
+void EnvPool::resetStats() {
+    steps = 0;
+    env_steps = 0;
+    resets = 0;
+    step_ns_sum = 0;
+    step_ns_max = 0;
+    env_step_ns_sum = 0;
+}
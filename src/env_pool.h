@@ -0,0 +1,161 @@
+#ifndef ENV_POOL_H
+#define ENV_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "emulator.h"
+
+// A value in work RAM, little-endian, 1 to 4 bytes
+struct RamValue {
+    uint32_t address;       // offset into Memory.RAM (0x7E0000 maps to 0)
+    int size;
+    bool is_signed;
+};
+
+// reward += scale * value, or scale * (value - value after the last step)
+struct RewardTerm {
+    RamValue value;
+    double scale;
+    bool delta;
+};
+
+// The episode is over when the comparison holds
+struct DoneTerm {
+    enum class Compare {
+        Equal,
+        NotEqual,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual
+    };
+
+    RamValue value;
+    Compare compare;
+    int64_t operand;
+};
+
+struct EnvConfig {
+    int ports;              // controllers per environment, actions per step
+    int frame_skip;         // frames per step with the same action
+    int scale;              // observation downscale, see convertObservation()
+    bool greyscale;
+    std::vector<RewardTerm> rewards;
+    std::vector<DoneTerm> done;
+};
+
+// Batched training environments over independent core instances.
+//
+// Every environment is its own emulator instance (its own copy of the core
+// module, see emulator_loader.h) with no emulation thread: a pool of worker
+// threads steps them directly. A step hands out environment indices from an
+// atomic counter, so workers that finish early take the next environment
+// instead of waiting on a fixed partition, and the worker finishing the
+// last one calls the completion. Observations of all environments land in
+// one contiguous buffer, environment i at i * observationSize().
+//
+// Rewards and done flags are read from work RAM after each step. Reset
+// loads an in-memory snapshot (or power-cycles without one) and renders one
+// frame with no input, so the observation is current.
+//
+// One step or reset at a time; the other calls must not overlap one.
+class EnvPool {
+public:
+    static const int kMaxEnvs = 256;
+    static const int kMaxPorts = 8;
+
+    struct Stats {
+        int envs;
+        int threads;
+        uint64_t steps;             // batched steps
+        uint64_t env_steps;         // steps of single environments
+        uint64_t resets;            // environments reset
+        double env_steps_per_second;    // over the time spent stepping
+        double step_us_mean;        // one batched step, wall clock
+        double step_us_max;
+        double env_step_us_mean;    // one environment on a worker
+    };
+
+    EnvPool();
+    ~EnvPool();
+
+    // Creates count instances and threads workers (0: one per core, at
+    // most count)
+    bool create(int count, int threads, std::string& error);
+    void destroy();
+
+    // Loads the ROM into every instance, in parallel; blocks
+    bool loadROM(const std::string& filename);
+
+    bool configure(const EnvConfig& config);
+    const EnvConfig& getConfig() const { return config; }
+    size_t observationSize() const;
+    int size() const { return (int)envs.size(); }
+
+    // Reset snapshot: taken from an environment's current state, or given
+    bool captureResetState(int index);
+    bool setResetState(const uint8_t* data, size_t size);
+
+    // actions: ports buttons masks per environment. observations:
+    // size() * observationSize() bytes; rewards and dones: size() entries.
+    // The buffers must stay valid until completion runs, on a worker thread.
+    void step(const uint16_t* actions, uint8_t* observations, double* rewards, uint8_t* dones,
+              std::function<void()> completion);
+    // Resets the given environments (all when empty); observations: one
+    // per reset environment, in the order given
+    void reset(const std::vector<int>& indices, uint8_t* observations, std::function<void()> completion);
+
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    struct Env {
+        Emulator* emulator;
+        std::vector<int64_t> last;      // delta rewards: value after the last step
+    };
+
+    // One parallel job: items handed out in order to whichever worker asks
+    struct Job {
+        std::function<void(int)> work;
+        std::function<void()> completion;
+        int count;
+        std::atomic<int> next;
+        std::atomic<int> remaining;
+    };
+
+    void dispatch(int count, std::function<void(int)> work, std::function<void()> completion);
+    void runAll(int count, std::function<void(int)> work);
+    void workerLoop();
+
+    bool readValue(Emulator* emulator, const RamValue& value, int64_t& out) const;
+    void resetEnv(Env& env, uint8_t* observation);
+    void updateBaseline(Env& env);
+
+    std::vector<Env> envs;
+    EnvConfig config;
+    std::vector<uint8_t> reset_state;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::shared_ptr<Job> job;
+    uint64_t job_generation;
+    bool stopping;
+
+    std::atomic<uint64_t> steps;
+    std::atomic<uint64_t> env_steps;
+    std::atomic<uint64_t> resets;
+    std::atomic<uint64_t> step_ns_sum;
+    std::atomic<uint64_t> step_ns_max;
+    std::atomic<uint64_t> env_step_ns_sum;
+};
+
+#endif // ENV_POOL_H
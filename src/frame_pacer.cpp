@@ -0,0 +1,207 @@
+#include "frame_pacer.h"
+#include "util.h"
+#include <thread>
+
+// Longest run of frames emulated without rendering while catching up
+static const int kMaxConsecutiveSkips = 3;
+// Largest audio-clock speed correction (0.5%, inaudible as pitch change)
+static const double kMaxAudioCorrection = 0.005;
+// Smoothing factor applied to the audio fill error every frame
+static const double kAudioCorrectionSmoothing = 0.05;
+
+FramePacer::FramePacer()
+    : target_fps(60.0)
+    , mode(Mode::Clock)
+    , spin_us(300)
+    , max_catch_up_frames(5)
+    , audio_fill(0)
+    , audio_target(0)
+    , timeline_valid(false)
+    , timeline_mode(Mode::Clock)
+    , consecutive_skips(0)
+    , audio_correction(0.0)
+    , period_us(1000000.0 / 60.0)
+{
+    resetStats();
+}
+
+void FramePacer::setFrameRate(double fps) {
+    if (fps > 0) {
+        target_fps = fps;
+    }
+}
+
+void FramePacer::setMode(Mode new_mode) {
+    mode = new_mode;
+}
+
+void FramePacer::setSpinMicros(int micros) {
+    if (micros < 0) micros = 0;
+    if (micros > 5000) micros = 5000;
+    spin_us = micros;
+}
+
+void FramePacer::setMaxCatchUpFrames(int count) {
+    if (count < 0) count = 0;
+    max_catch_up_frames = count;
+}
+
+void FramePacer::setAudioFill(size_t fill, size_t target) {
+    audio_fill.store(fill, std::memory_order_relaxed);
+    audio_target.store(target, std::memory_order_relaxed);
+}
+
+void FramePacer::restart() {
+    timeline_valid = false;
+    consecutive_skips = 0;
+    audio_correction = 0.0;
+}
+
+bool FramePacer::frameDone() {
+    Clock::time_point now = Clock::now();
+    double period = 1000000.0 / target_fps.load();
+    Mode current = mode.load();
+
+    if (current != timeline_mode) {
+        // Deadlines (or their absence, unthrottled) do not carry over
+        timeline_valid = false;
+        timeline_mode = current;
+    }
+
+    if (current == Mode::Audio) {
+        // Ring fuller than the target means emulation runs ahead of the
+        // consumer, so stretch the period (and shrink it when running dry)
+        size_t target = audio_target.load(std::memory_order_relaxed);
+        if (target > 0) {
+            double error = ((double)audio_fill.load(std::memory_order_relaxed) - (double)target) / (double)target;
+            if (error > 1.0) error = 1.0;
+            if (error < -1.0) error = -1.0;
+            audio_correction += (error * kMaxAudioCorrection - audio_correction) * kAudioCorrectionSmoothing;
+        }
+        period *= 1.0 + audio_correction;
+    } else {
+        audio_correction = 0.0;
+    }
+    period_us = period;
+
+    if (current == Mode::Unthrottled) {
+        Clock::time_point start = Clock::now();
+        if (timeline_valid) {
+            recordInterval(std::chrono::duration_cast<std::chrono::microseconds>(start - last_frame).count());
+        }
+        last_frame = start;
+        timeline_valid = true;
+        frames++;
+        return true;
+    }
+
+    Clock::duration step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(period));
+    if (!timeline_valid) {
+        deadline = now;
+    }
+
+    bool render = true;
+    Clock::time_point next = deadline + step;
+    if (now < next) {
+        consecutive_skips = 0;
+        deadline = next;
+        waitUntil(deadline);
+    } else {
+        late_frames++;
+        Clock::duration behind = now - next;
+        if (behind > step * max_catch_up_frames.load()) {
+            // Too far behind to catch up; drop the backlog and start over
+            resyncs++;
+            consecutive_skips = 0;
+            deadline = now;
+        } else {
+            // Run the next frame immediately, and skip its rendering while
+            // more than a whole frame behind
+            deadline = next;
+            if (behind >= step && consecutive_skips < kMaxConsecutiveSkips) {
+                consecutive_skips++;
+                skipped_renders++;
+                render = false;
+            } else {
+                consecutive_skips = 0;
+            }
+        }
+    }
+
+    Clock::time_point start = Clock::now();
+    if (timeline_valid) {
+        recordInterval(std::chrono::duration_cast<std::chrono::microseconds>(start - last_frame).count());
+    }
+    last_frame = start;
+    timeline_valid = true;
+    frames++;
+    return render;
+}
+
+void FramePacer::idle() {
+    double period = 1000000.0 / target_fps.load();
+    std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(period));
+    // The gap is not a frame interval; resume on a fresh timeline
+    restart();
+}
+
+void FramePacer::waitUntil(Clock::time_point target) {
+    // sleep_until wakes up late by up to a scheduler tick, so only sleep
+    // until spin_us before the deadline and spin for the rest
+    Clock::time_point wake = target - std::chrono::microseconds(spin_us.load());
+    if (Clock::now() < wake) {
+        std::this_thread::sleep_until(wake);
+    }
+    while (Clock::now() < target) {
+        std::this_thread::yield();
+    }
+}
+
+void FramePacer::recordInterval(int64_t micros) {
+    if (micros < 0) micros = 0;
+    int bucket = (int)(micros / kBucketMicros);
+    if (bucket > kBuckets) bucket = kBuckets;
+    histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    interval_sum_us.fetch_add(micros, std::memory_order_relaxed);
+    recordMax(interval_max_us, (uint64_t)micros);
+}
+
+FramePacer::Stats FramePacer::getStats() const {
+    Stats stats;
+    stats.mode = mode;
+    stats.target_fps = target_fps;
+    stats.period_us = period_us;
+    stats.spin_us = spin_us;
+    stats.max_catch_up_frames = max_catch_up_frames;
+    stats.frames = frames;
+    stats.late_frames = late_frames;
+    stats.skipped_renders = skipped_renders;
+    stats.resyncs = resyncs;
+    stats.max_interval_us = (double)interval_max_us.load();
+
+    stats.histogram.resize(kBuckets + 1);
+    uint64_t total = 0;
+    for (int i = 0; i <= kBuckets; i++) {
+        stats.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+        total += stats.histogram[i];
+    }
+    stats.mean_interval_us = total ? (double)interval_sum_us.load() / total : 0.0;
+
+    const uint64_t* histogram = stats.histogram.data();
+    stats.p50_interval_us = histogramPercentile(histogram, kBuckets, total, 0.50, kBucketMicros, stats.max_interval_us);
+    stats.p90_interval_us = histogramPercentile(histogram, kBuckets, total, 0.90, kBucketMicros, stats.max_interval_us);
+    stats.p99_interval_us = histogramPercentile(histogram, kBuckets, total, 0.99, kBucketMicros, stats.max_interval_us);
+    return stats;
+}
+
+void FramePacer::resetStats() {
+    frames = 0;
+    late_frames = 0;
+    skipped_renders = 0;
+    resyncs = 0;
+    interval_sum_us = 0;
+    interval_max_us = 0;
+    for (int i = 0; i <= kBuckets; i++) {
+        histogram[i] = 0;
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Paces the emulation thread to the ROM's frame rate.
+//
+// Deadlines are absolute (start + n * period), so sleep error never
+// accumulates. The thread sleeps until shortly before each deadline and
+// spins for the remainder. When the thread falls behind it runs the next
+// frames back to back without rendering them; after a long stall it
+// resynchronizes instead of trying to make up the lost time.
+//
+// In audio-clock mode the period is nudged so the audio ring stays near a
+// target fill, which locks emulation speed to the audio consumer.
+class FramePacer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum class Mode {
+        Clock,      // frame rate from the wall clock
+        Audio,      // wall clock corrected by audio ring fill
+        Unthrottled // run frames back to back (benchmarks, training)
+    };
+
+    // Frame interval histogram: 250 us buckets up to 50 ms, plus overflow
+    static const int kBucketMicros = 250;
+    static const int kBuckets = 200;
+
+    struct Stats {
+        Mode mode;
+        double target_fps;
+        double period_us;           // current period, including audio correction
+        int spin_us;
+        int max_catch_up_frames;
+        uint64_t frames;
+        uint64_t late_frames;       // started after their deadline
+        uint64_t skipped_renders;   // run without rendering to catch up
+        uint64_t resyncs;           // fell too far behind and dropped the backlog
+        double mean_interval_us;
+        double p50_interval_us;
+        double p90_interval_us;
+        double p99_interval_us;
+        double max_interval_us;
+        std::vector<uint64_t> histogram;    // kBuckets + 1 entries
+    };
+
+    FramePacer();
+
+    void setFrameRate(double fps);
+    void setMode(Mode mode);
+    Mode getMode() const { return mode; }
+    // Spin for the last spin_us before a deadline instead of sleeping
+    void setSpinMicros(int spin_us);
+    // Behind by more than this many frames: resync instead of catching up
+    void setMaxCatchUpFrames(int frames);
+
+    // Audio-clock mode input: current and target ring fill in sample frames
+    void setAudioFill(size_t fill, size_t target);
+
+    // Starts a new timeline at the current time, e.g. after a pause
+    void restart();
+
+    // Call after every emulated frame. Waits for the next deadline and
+    // returns whether the next frame should be rendered.
+    bool frameDone();
+
+    // Call instead of frameDone() while nothing is emulated (paused, no ROM)
+    void idle();
+
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    void waitUntil(Clock::time_point deadline);
+    void recordInterval(int64_t micros);
+
+    std::atomic<double> target_fps;
+    std::atomic<Mode> mode;
+    std::atomic<int> spin_us;
+    std::atomic<int> max_catch_up_frames;
+    std::atomic<size_t> audio_fill;
+    std::atomic<size_t> audio_target;
+
+    // Emulation thread only
+    Clock::time_point deadline;
+    Clock::time_point last_frame;
+    bool timeline_valid;
+    Mode timeline_mode;         // mode the timeline was started in
+    int consecutive_skips;
+    double audio_correction;
+    std::atomic<double> period_us;
+
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> late_frames;
+    std::atomic<uint64_t> skipped_renders;
+    std::atomic<uint64_t> resyncs;
+    std::atomic<uint64_t> interval_sum_us;
+    std::atomic<uint64_t> interval_max_us;
+    std::atomic<uint64_t> histogram[kBuckets + 1];
+};
+
+#endif // FRAME_PACER_H
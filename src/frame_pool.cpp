@@ -0,0 +1,220 @@
+#include "frame_pool.h"
+#include <cstdlib>
+#include <new>
+
+// Each slot is laid out as [header][payload]; the header stores the owning
+// Slot* so a bare data pointer (all a Buffer finalizer gets) leads back to it.
+static const size_t kSlotHeader = 64;
+
+FramePool* FramePool::create(int slot_count, size_t slot_size) {
+    if (slot_count < 1) slot_count = 1;
+    if (slot_count > kMaxSlots) slot_count = kMaxSlots;
+
+    FramePool* pool = new (std::nothrow) FramePool(slot_count, slot_size);
+    if (pool && !pool->storage) {
+        delete pool;
+        return nullptr;
+    }
+    return pool;
+}
+
+FramePool::FramePool(int slot_count, size_t slot_size)
+    : slot_count(slot_count)
+    , slot_size(slot_size)
+    , slot_stride((kSlotHeader + slot_size + 63) & ~(size_t)63)
+    , storage(nullptr)
+    , slots(nullptr)
+    , free_mask(slot_count == 32 ? 0xFFFFFFFFu : ((1u << slot_count) - 1))
+    , refs(1)
+    , queue_head(0)
+    , queue_count(0)
+    , queue_depth(1)
+    , policy(DropPolicy::Coalesce)
+    , wake_pending(false)
+    , slot_allocations(0)
+    , frames_acquired(0)
+    , frames_dropped(0)
+    , frames_released(0)
+    , frames_delivered(0)
+    , frames_evicted(0)
+    , frames_coalesced(0)
+{
+    storage = static_cast<uint8_t*>(malloc(slot_stride * slot_count));
+    slots = new (std::nothrow) Slot[slot_count];
+    if (!storage || !slots) {
+        free(storage);
+        storage = nullptr;
+        return;
+    }
+
+    for (int i = 0; i < slot_count; i++) {
+        Slot& slot = slots[i];
+        slot.pool = this;
+        slot.index = i;
+        slot.generation = 0;
+        slot.frame = VideoFrame();
+        slot.sample_frames = 0;
+        slot.stream = 0;
+        slot.data = storage + slot_stride * i + kSlotHeader;
+        *reinterpret_cast<Slot**>(storage + slot_stride * i) = &slot;
+    }
+    slot_allocations = slot_count;
+}
+
+FramePool::~FramePool() {
+    free(storage);
+    delete[] slots;
+}
+
+void FramePool::destroy() {
+    unref();
+}
+
+void FramePool::ref() {
+    refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FramePool::unref() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+FramePool::Slot* FramePool::acquire(size_t size) {
+    if (size > slot_size) {
+        frames_dropped++;
+        return nullptr;
+    }
+
+    uint32_t mask = free_mask.load(std::memory_order_acquire);
+    while (mask) {
+        uint32_t bit = mask & (~mask + 1);
+        if (free_mask.compare_exchange_weak(mask, mask & ~bit, std::memory_order_acq_rel)) {
+            int index = 0;
+            while (!(bit & (1u << index))) index++;
+            refs.fetch_add(1, std::memory_order_relaxed);
+            frames_acquired++;
+            return &slots[index];
+        }
+    }
+
+    frames_dropped++;
+    return nullptr;
+}
+
+void FramePool::setPolicy(DropPolicy new_policy, int new_depth) {
+    if (new_policy == DropPolicy::Coalesce || new_depth < 1) new_depth = 1;
+    if (new_depth > slot_count || new_policy == DropPolicy::None) new_depth = slot_count;
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    policy = new_policy;
+    queue_depth = new_depth;
+}
+
+bool FramePool::push(Slot* slot) {
+    Slot* evicted = nullptr;
+    bool coalesce;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        coalesce = policy == DropPolicy::Coalesce;
+        if (queue_count >= queue_depth) {
+            evicted = queue[queue_head];
+            queue_head = (queue_head + 1) % kMaxSlots;
+            queue_count--;
+        }
+        queue[(queue_head + queue_count) % kMaxSlots] = slot;
+        queue_count++;
+    }
+
+    if (evicted) {
+        if (coalesce) {
+            frames_coalesced++;
+        } else {
+            frames_evicted++;
+        }
+        release(evicted);
+    }
+
+    return !wake_pending.exchange(true, std::memory_order_acq_rel);
+}
+
+void FramePool::beginDrain() {
+    // Cleared before popping so a frame pushed after the last pop always
+    // schedules another wake-up
+    wake_pending.store(false, std::memory_order_release);
+}
+
+FramePool::Slot* FramePool::pop() {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (queue_count == 0) {
+        return nullptr;
+    }
+    Slot* slot = queue[queue_head];
+    queue_head = (queue_head + 1) % kMaxSlots;
+    queue_count--;
+    frames_delivered++;
+    return slot;
+}
+
+void FramePool::release(Slot* slot) {
+    slot->generation.fetch_add(1, std::memory_order_relaxed);
+    frames_released++;
+    free_mask.fetch_or(1u << slot->index, std::memory_order_release);
+    unref();
+}
+
+FramePool::Slot* FramePool::slotFromData(const uint8_t* data) const {
+    if (data < storage || data >= storage + slot_stride * slot_count) {
+        return nullptr;
+    }
+    size_t offset = data - storage;
+    if (offset % slot_stride != kSlotHeader) {
+        return nullptr;
+    }
+    return &slots[offset / slot_stride];
+}
+
+uint32_t FramePool::retain(Slot* slot) {
+    ref();
+    return slot->generation.load(std::memory_order_relaxed);
+}
+
+bool FramePool::release(Slot* slot, uint32_t generation) {
+    if (slot->generation.load(std::memory_order_relaxed) != generation) {
+        return false;
+    }
+    release(slot);
+    return true;
+}
+
+void FramePool::finalize(uint8_t* data, uint32_t generation) {
+    // The Buffer's reference keeps the storage, header included, alive
+    Slot* slot = *reinterpret_cast<Slot**>(data - kSlotHeader);
+    FramePool* pool = slot->pool;
+    pool->release(slot, generation);
+    pool->unref();
+}
+
+FramePool::Stats FramePool::getStats() const {
+    Stats stats;
+    uint32_t mask = free_mask.load(std::memory_order_relaxed);
+    int free_slots = 0;
+    for (int i = 0; i < slot_count; i++) {
+        if (mask & (1u << i)) free_slots++;
+    }
+    stats.slots = slot_count;
+    stats.slots_in_use = slot_count - free_slots;
+    stats.slot_allocations = slot_allocations;
+    stats.frames_acquired = frames_acquired;
+    stats.frames_dropped = frames_dropped;
+    stats.frames_released = frames_released;
+    stats.frames_delivered = frames_delivered;
+    stats.frames_evicted = frames_evicted;
+    stats.frames_coalesced = frames_coalesced;
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    stats.queued = queue_count;
+    stats.queue_depth = queue_depth;
+    stats.policy = policy;
+    return stats;
+}
@@ -0,0 +1,139 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include "emulator.h"
+
+// Fixed pool of preallocated video frame (or audio packet) slots shared
+// between a native producer thread and the JS thread (consumer).
+//
+// The emulation thread acquires a free slot and converts the frame straight
+// into it. The slot memory is then handed to JS as an external Buffer, and
+// goes back to the pool either when JS releases it explicitly or when the
+// Buffer is garbage collected, whichever comes first. An explicit release
+// only means JS is done with the contents: the Buffer keeps the pool's
+// storage alive until it is collected.
+//
+// Free slots are tracked in an atomic bitmask. Filled slots wait in a bounded
+// pending queue until the JS thread drains it; when the queue is full the
+// oldest pending frame is dropped (or replaced, when coalescing), so the
+// producer never waits for the consumer.
+class FramePool {
+public:
+    // MAX_SNES_WIDTH x MAX_SNES_HEIGHT at 4 bytes per pixel, plus the
+    // header and tile list of a tile-delta keyframe (8x8 tiles)
+    static const size_t kMaxFrameBytes = 512 * 478 * 4 + 8192;
+    static const int kMaxSlots = 32;
+
+    enum class DropPolicy {
+        DropOldest,     // keep up to queue_depth frames, evict the oldest
+        Coalesce,       // keep only the latest frame
+        None            // never evict; the producer sees a full pool instead
+    };
+
+    struct Slot {
+        FramePool* pool;
+        uint32_t index;
+        std::atomic<uint32_t> generation;   // bumped every time the slot is freed
+        VideoFrame frame;                   // metadata of the frame held in data
+        int sample_frames;                  // audio packets: sample frames in data
+        int stream;                         // audio packets: rendition id, 0 for the mixed stream
+        uint8_t* data;
+    };
+
+    struct Stats {
+        int slots;
+        int slots_in_use;
+        uint64_t slot_allocations;  // native allocations made by the pool
+        uint64_t frames_acquired;
+        uint64_t frames_dropped;    // no free slot when a frame was produced
+        uint64_t frames_released;
+        uint64_t frames_delivered;  // popped by the consumer
+        uint64_t frames_evicted;    // dropped from a full pending queue
+        uint64_t frames_coalesced;  // replaced by a newer frame
+        int queued;
+        int queue_depth;
+        DropPolicy policy;
+    };
+
+    // The pool deletes itself once destroy() has been called, every slot
+    // has been returned and every Buffer made over a slot (see retain()) has
+    // been collected, so Buffers may safely outlive the addon object.
+    static FramePool* create(int slot_count, size_t slot_size = kMaxFrameBytes);
+    void destroy();
+
+    // Producer side - returns nullptr when every slot is in use
+    Slot* acquire(size_t size);
+
+    // Producer side - queue a filled slot for the consumer. Returns true when
+    // the consumer has to be woken up (no wake-up is outstanding yet).
+    bool push(Slot* slot);
+
+    // Consumer side - call beginDrain() once per wake-up, then pop() until
+    // it returns nullptr
+    void beginDrain();
+    Slot* pop();
+
+    void setPolicy(DropPolicy policy, int queue_depth);
+
+    // Consumer side
+    void release(Slot* slot);
+
+    // Consumer side, for slots handed to JS: retain() takes the pool
+    // reference a Buffer over the slot holds until finalize() and returns
+    // the slot's generation. release(slot, generation) returns the slot
+    // unless it was already released since; the storage stays valid.
+    uint32_t retain(Slot* slot);
+    bool release(Slot* slot, uint32_t generation);
+
+    // Finalizer entry point: returns the slot if it was not released since
+    // the Buffer was created, then drops the Buffer's pool reference
+    static void finalize(uint8_t* data, uint32_t generation);
+
+    Slot* slotFromData(const uint8_t* data) const;
+    Stats getStats() const;
+    // Frames evicted or coalesced from the pending queue so far
+    uint64_t queueDrops() const { return frames_evicted + frames_coalesced; }
+    size_t slotSize() const { return slot_size; }
+    int slotCount() const { return slot_count; }
+
+    // Extra references, e.g. held by an outstanding consumer wake-up
+    void ref();
+    void unref();
+
+private:
+    FramePool(int slot_count, size_t slot_size);
+    ~FramePool();
+
+    int slot_count;
+    size_t slot_size;
+    size_t slot_stride;
+    uint8_t* storage;
+    Slot* slots;
+
+    std::atomic<uint32_t> free_mask;
+    std::atomic<int> refs;
+
+    // Pending queue; the lock only guards a few pointer moves and is never
+    // held across a JS call
+    mutable std::mutex queue_mutex;
+    Slot* queue[kMaxSlots];
+    int queue_head;
+    int queue_count;
+    int queue_depth;
+    DropPolicy policy;
+    std::atomic<bool> wake_pending;
+
+    std::atomic<uint64_t> slot_allocations;
+    std::atomic<uint64_t> frames_acquired;
+    std::atomic<uint64_t> frames_dropped;
+    std::atomic<uint64_t> frames_released;
+    std::atomic<uint64_t> frames_delivered;
+    std::atomic<uint64_t> frames_evicted;
+    std::atomic<uint64_t> frames_coalesced;
+};
+
+#endif // FRAME_POOL_H
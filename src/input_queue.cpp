@@ -0,0 +1,207 @@
+#include "input_queue.h"
+#include "util.h"
+#include <chrono>
+
+static int64_t steadyNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double systemMillis() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+InputQueue::InputQueue()
+    : ring(kCapacity)
+    , deferred(0)
+    , recent_next(0)
+    , recent_count(0)
+{
+    for (int port = 0; port < kMaxPorts; port++) {
+        last_sequence[port] = 0;
+        last_client_ms[port] = 0;
+    }
+    in_flight.reserve(kCapacity);
+    resetStats();
+}
+
+bool InputQueue::push(InputEvent event) {
+    int source = (int)event.stamp.source;
+    if (source < 0 || source >= kInputSourceCount) {
+        source = 0;
+        event.stamp.source = InputSource::Local;
+    }
+    event.received_ns = steadyNanos();
+    event.received_ms = systemMillis();
+    if (ring.write(&event, 1) == 0) {
+        counters[source].overflows++;
+        return false;
+    }
+    return true;
+}
+
+bool InputQueue::isStale(const InputEvent& event) {
+    const InputStamp& stamp = event.stamp;
+    if (stamp.sequence == 0 || event.port >= kMaxPorts) {
+        return false;
+    }
+
+    uint32_t last = last_sequence[event.port];
+    bool older = last != 0 && (int32_t)(stamp.sequence - last) <= 0 &&
+                 (stamp.client_time_ms == 0 || stamp.client_time_ms <= last_client_ms[event.port]);
+    if (!older) {
+        last_sequence[event.port] = stamp.sequence;
+        last_client_ms[event.port] = stamp.client_time_ms;
+    }
+    return older;
+}
+
+void InputQueue::drain(const std::function<void(const InputEvent&)>& apply) {
+    uint32_t changed_ports = 0;
+    int64_t now = 0;
+
+    const InputEvent* event;
+    while ((event = ring.peek()) != nullptr) {
+        int source = (int)event->stamp.source;
+        bool buttons = event->kind == InputEvent::Kind::Buttons && event->port < kMaxPorts;
+        if (buttons && (changed_ports & (1u << event->port))) {
+            deferred++;
+            break;
+        }
+
+        if (isStale(*event)) {
+            counters[source].stale++;
+            ring.pop();
+            continue;
+        }
+        if (buttons) {
+            changed_ports |= 1u << event->port;
+        }
+
+        apply(*event);
+        if (!now) {
+            now = steadyNanos();
+        }
+
+        SourceCounters& counter = counters[source];
+        uint64_t queue_ns = now > event->received_ns ? now - event->received_ns : 0;
+        counter.events++;
+        counter.queue_ns_sum += queue_ns;
+        recordMax(counter.queue_ns_max, queue_ns);
+
+        Applied applied;
+        applied.source = event->stamp.source;
+        applied.port = event->port;
+        applied.sequence = event->stamp.sequence;
+        applied.client_ms = 0;
+        if (event->stamp.client_time_ms != 0) {
+            applied.client_ms = event->received_ms - event->stamp.client_time_ms;
+            counter.client_events++;
+            counter.client_us_sum += (int64_t)(applied.client_ms * 1000.0);
+        }
+        applied.received_ns = event->received_ns;
+        applied.applied_ns = now;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (in_flight.size() < kCapacity) {
+                in_flight.push_back(applied);
+            }
+        }
+        ring.pop();
+    }
+}
+
+void InputQueue::frameRendered() {
+    int64_t now = steadyNanos();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (in_flight.empty()) {
+        return;
+    }
+
+    for (const Applied& applied : in_flight) {
+        SourceCounters& counter = counters[(int)applied.source];
+        uint64_t render_ns = now > applied.received_ns ? now - applied.received_ns : 0;
+        counter.rendered++;
+        counter.render_ns_sum += render_ns;
+        recordMax(counter.render_ns_max, render_ns);
+        int bucket = (int)(render_ns / 1000 / kBucketMicros);
+        if (bucket > kBuckets) bucket = kBuckets;
+        counter.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+        InputRecord& record = recent[recent_next];
+        record.source = applied.source;
+        record.port = applied.port;
+        record.sequence = applied.sequence;
+        record.client_ms = applied.client_ms;
+        record.queue_us = (applied.applied_ns - applied.received_ns) / 1000.0;
+        record.render_us = render_ns / 1000.0;
+        recent_next = (recent_next + 1) % kRecentRecords;
+        if (recent_count < kRecentRecords) recent_count++;
+    }
+    in_flight.clear();
+}
+
+InputStats InputQueue::getStats() const {
+    InputStats stats = InputStats();
+    stats.queued = ring.readAvailable();
+    stats.capacity = ring.capacity();
+    stats.deferred = deferred;
+
+    for (int source = 0; source < kInputSourceCount; source++) {
+        const SourceCounters& counter = counters[source];
+        InputSourceStats& out = stats.sources[source];
+        out.events = counter.events;
+        out.stale = counter.stale;
+        out.overflows = counter.overflows;
+        uint64_t client_events = counter.client_events;
+        out.client_ms_mean = client_events ? (double)counter.client_us_sum.load() / client_events / 1000.0 : 0.0;
+        out.queue_us_mean = out.events ? (double)counter.queue_ns_sum.load() / out.events / 1000.0 : 0.0;
+        out.queue_us_max = (double)counter.queue_ns_max.load() / 1000.0;
+
+        uint64_t rendered = counter.rendered;
+        out.render_us_mean = rendered ? (double)counter.render_ns_sum.load() / rendered / 1000.0 : 0.0;
+        out.render_us_max = (double)counter.render_ns_max.load() / 1000.0;
+
+        uint64_t total = 0;
+        uint64_t histogram[kBuckets + 1];
+        for (int i = 0; i <= kBuckets; i++) {
+            histogram[i] = counter.histogram[i].load(std::memory_order_relaxed);
+            total += histogram[i];
+        }
+        out.render_us_p50 = histogramPercentile(histogram, kBuckets, total, 0.50, kBucketMicros, out.render_us_max);
+        out.render_us_p99 = histogramPercentile(histogram, kBuckets, total, 0.99, kBucketMicros, out.render_us_max);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.recent.reserve(recent_count);
+    size_t first = (recent_next + kRecentRecords - recent_count) % kRecentRecords;
+    for (size_t i = 0; i < recent_count; i++) {
+        stats.recent.push_back(recent[(first + i) % kRecentRecords]);
+    }
+    return stats;
+}
+
+void InputQueue::resetStats() {
+    for (int source = 0; source < kInputSourceCount; source++) {
+        SourceCounters& counter = counters[source];
+        counter.events = 0;
+        counter.stale = 0;
+        counter.overflows = 0;
+        counter.client_events = 0;
+        counter.client_us_sum = 0;
+        counter.queue_ns_sum = 0;
+        counter.queue_ns_max = 0;
+        counter.rendered = 0;
+        counter.render_ns_sum = 0;
+        counter.render_ns_max = 0;
+        for (int i = 0; i <= kBuckets; i++) {
+            counter.histogram[i] = 0;
+        }
+    }
+    deferred = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    recent_next = 0;
+    recent_count = 0;
+}
@@ -0,0 +1,111 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "audio_ring.h"
+#include "emulator.h"
+
+// A controller or mouse event waiting for the next frame boundary
+struct InputEvent {
+    enum class Kind : uint8_t {
+        Buttons,
+        Pointer,
+        MouseButtons
+    };
+
+    Kind kind;
+    uint8_t port;
+    uint16_t buttons;
+    int16_t x;
+    int16_t y;
+    bool left;
+    bool right;
+    InputStamp stamp;
+    int64_t received_ns;    // steady clock, set by push()
+    double received_ms;     // system clock, set by push()
+};
+
+// Frame-accurate input queue with end-to-end latency stats.
+//
+// Senders push events into a lock-free SPSC ring (the producer is the JS
+// thread, which receives WebSocket and RabbitMQ input alike). The thread
+// running frames drains it right before each frame, so input never lands
+// mid-frame. A second buttons change for a port stops the drain until the
+// next boundary, so every change is seen by at least one frame. Events
+// older than the last one applied for their port, by both sequence number
+// and client timestamp, are dropped as stale: one transport delivered them
+// after a newer event sent over another.
+//
+// Each applied event is timed from push() to the drain (queue) and to the
+// end of the first rendered frame after it (render), per transport.
+class InputQueue {
+public:
+    static const size_t kCapacity = 1024;
+    static const int kMaxPorts = 8;
+
+    // Render latency histogram: 250 us buckets up to 100 ms, plus overflow
+    static const int kBucketMicros = 250;
+    static const int kBuckets = 400;
+    static const size_t kRecentRecords = 64;
+
+    InputQueue();
+
+    // Producer thread; returns false (and counts an overflow) when full
+    bool push(InputEvent event);
+
+    // Thread running frames, at a frame boundary
+    void drain(const std::function<void(const InputEvent&)>& apply);
+    // Thread rendering frames (with a run-ahead instance, its helper thread)
+    void frameRendered();
+
+    InputStats getStats() const;
+    void resetStats();
+
+private:
+    struct SourceCounters {
+        std::atomic<uint64_t> events;
+        std::atomic<uint64_t> stale;
+        std::atomic<uint64_t> overflows;
+        std::atomic<uint64_t> client_events;
+        std::atomic<int64_t> client_us_sum;
+        std::atomic<uint64_t> queue_ns_sum;
+        std::atomic<uint64_t> queue_ns_max;
+        std::atomic<uint64_t> rendered;
+        std::atomic<uint64_t> render_ns_sum;
+        std::atomic<uint64_t> render_ns_max;
+        std::atomic<uint64_t> histogram[kBuckets + 1];
+    };
+
+    struct Applied {
+        InputSource source;
+        int port;
+        uint32_t sequence;
+        double client_ms;
+        int64_t received_ns;
+        int64_t applied_ns;
+    };
+
+    bool isStale(const InputEvent& event);
+
+    SpscRing<InputEvent> ring;
+
+    // Thread running frames only
+    uint32_t last_sequence[kMaxPorts];
+    double last_client_ms[kMaxPorts];
+
+    SourceCounters counters[kInputSourceCount];
+    std::atomic<uint64_t> deferred;
+
+    mutable std::mutex mutex;
+    std::vector<Applied> in_flight;     // applied, not rendered yet
+    InputRecord recent[kRecentRecords];
+    size_t recent_next;
+    size_t recent_count;
+};
+
+#endif // INPUT_QUEUE_H
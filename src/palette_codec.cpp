@@ -0,0 +1,297 @@
+#include "palette_codec.h"
+#include "util.h"
+#include <chrono>
+#include <cstring>
+
+// color_stamp entries: generation << 9 | assigned << 8 | palette index
+static const uint32_t kStampAssigned = 0x100;
+static const int kStampGenerationShift = 9;
+static const uint32_t kMaxGeneration = (1u << (32 - kStampGenerationShift)) - 1;
+
+PaletteCodec::PaletteCodec()
+    : stream_ready(false)
+    , level(1)
+    , stream_level(0)
+    , color_stamp(65536, 0)
+    , generation(0)
+    , sequence(0)
+    , pending(-1)
+    , in_encode(-1)
+    , thread_stop(false)
+    , frames(0)
+    , coalesced(0)
+    , direct_frames(0)
+    , colors_sum(0)
+    , bytes_out(0)
+    , raw_bytes(0)
+    , encode_ns_sum(0)
+    , encode_ns_max(0)
+{
+    memset(&stream, 0, sizeof(stream));
+    first_seen.reserve(257);
+}
+
+PaletteCodec::~PaletteCodec() {
+    stop();
+    if (stream_ready) {
+        deflateEnd(&stream);
+    }
+}
+
+bool PaletteCodec::setLevel(int value) {
+    if (value < 1 || value > 9) {
+        return false;
+    }
+    level = value;
+    return true;
+}
+
+void PaletteCodec::setOutput(Provider frame_provider, Sink frame_sink) {
+    provider = frame_provider;
+    sink = frame_sink;
+}
+
+void PaletteCodec::start() {
+    stop();
+    pending = -1;
+    in_encode = -1;
+    thread_stop = false;
+    codec_thread = std::thread(&PaletteCodec::encodeLoop, this);
+}
+
+void PaletteCodec::stop() {
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        thread_stop = true;
+        // A frame not yet encoded is dropped
+        pending = -1;
+    }
+    capture_cv.notify_one();
+    if (codec_thread.joinable()) {
+        codec_thread.join();
+    }
+}
+
+size_t PaletteCodec::maxEncodedSize(int width, int height, PixelFormat format) {
+    return kHeaderBytes + 256 * pixelFormatBytesPerPixel(format) + compressBound((uLong)width * height * sizeof(uint16_t));
+}
+
+void PaletteCodec::submit(const uint16_t* src, int src_pitch, int width, int height,
+                          const uint16_t* screen_colors, PixelFormat format) {
+    int target;
+    bool threaded;
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        threaded = codec_thread.joinable() && !thread_stop;
+        target = 0;
+        while (target == pending || target == in_encode) target++;
+    }
+
+    Capture& capture = captures[target];
+    capture.pixels.resize((size_t)width * height);
+    for (int y = 0; y < height; y++) {
+        memcpy(&capture.pixels[(size_t)y * width], src + (size_t)y * src_pitch, width * sizeof(uint16_t));
+    }
+    capture.seeded = screen_colors != nullptr;
+    if (capture.seeded) {
+        memcpy(capture.colors, screen_colors, sizeof(capture.colors));
+    }
+    capture.width = width;
+    capture.height = height;
+    capture.format = format;
+
+    if (!threaded) {
+        deliver(capture);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        if (pending >= 0) {
+            coalesced++;
+        }
+        pending = target;
+    }
+    capture_cv.notify_one();
+}
+
+void PaletteCodec::encodeLoop() {
+    std::unique_lock<std::mutex> lock(capture_mutex);
+    while (true) {
+        capture_cv.wait(lock, [this]() { return thread_stop || pending >= 0; });
+        if (thread_stop) {
+            break;
+        }
+        in_encode = pending;
+        pending = -1;
+        lock.unlock();
+
+        deliver(captures[in_encode]);
+
+        lock.lock();
+        in_encode = -1;
+    }
+}
+
+void PaletteCodec::deliver(Capture& capture) {
+    if (!provider || !sink) {
+        return;
+    }
+
+    uint8_t* destination = provider(maxEncodedSize(capture.width, capture.height, capture.format));
+    if (!destination) {
+        return;
+    }
+
+    // A zero size (zlib could not allocate its state) still goes to the sink
+    // so the destination is handed back
+    size_t size = encode(capture.pixels.data(), capture.width, capture.width, capture.height,
+                         capture.seeded ? capture.colors : nullptr, capture.format, destination);
+    sink(destination, size, capture.width, capture.height, capture.format);
+}
+
+size_t PaletteCodec::encode(const uint16_t* src, int src_pitch, int width, int height,
+                            const uint16_t* screen_colors, PixelFormat format, uint8_t* dst) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    int wanted_level = level;
+    if (stream_ready && stream_level != wanted_level) {
+        deflateEnd(&stream);
+        stream_ready = false;
+    }
+    if (!stream_ready) {
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit(&stream, wanted_level) != Z_OK) {
+            return 0;
+        }
+        stream_ready = true;
+        stream_level = wanted_level;
+    } else {
+        deflateReset(&stream);
+    }
+
+    if (++generation > kMaxGeneration) {
+        std::fill(color_stamp.begin(), color_stamp.end(), 0);
+        generation = 1;
+    }
+    uint32_t seen = generation << kStampGenerationShift;
+
+    // Pass 1: distinct colours in first-seen order, up to one more than fits
+    first_seen.clear();
+    bool direct = false;
+    for (int y = 0; y < height && !direct; y++) {
+        const uint16_t* line = src + (size_t)y * src_pitch;
+        for (int x = 0; x < width; x++) {
+            uint32_t& stamp = color_stamp[line[x]];
+            if ((stamp & ~(kStampAssigned | 0xFF)) != seen) {
+                stamp = seen;
+                first_seen.push_back(line[x]);
+                if (first_seen.size() > 256) {
+                    direct = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    uint8_t* out = dst + kHeaderBytes;
+    int bpp = pixelFormatBytesPerPixel(format);
+    size_t palette_size = 0;
+    const uint8_t* input;
+    size_t input_size;
+
+    if (direct) {
+        // Colour math produced too many colours: deflate RGB565 as is
+        indices.resize((size_t)width * height * sizeof(uint16_t));
+        for (int y = 0; y < height; y++) {
+            memcpy(&indices[(size_t)y * width * sizeof(uint16_t)], src + (size_t)y * src_pitch, width * sizeof(uint16_t));
+        }
+        input = indices.data();
+        input_size = indices.size();
+        direct_frames++;
+    } else {
+        // CGRAM colours on screen take the first indices in CGRAM order, the
+        // rest (colour math, fixed colour) follow in first-seen order
+        uint16_t order[256];
+        size_t count = 0;
+        if (screen_colors) {
+            for (int i = 0; i < 256; i++) {
+                uint32_t& stamp = color_stamp[screen_colors[i]];
+                if (stamp == seen) {
+                    stamp = seen | kStampAssigned | (uint32_t)count;
+                    order[count++] = screen_colors[i];
+                }
+            }
+        }
+        for (uint16_t color : first_seen) {
+            uint32_t& stamp = color_stamp[color];
+            if (stamp == seen) {
+                stamp = seen | kStampAssigned | (uint32_t)count;
+                order[count++] = color;
+            }
+        }
+        palette_size = count;
+
+        convertFrame(order, (int)count, (int)count, 1, out, (int)count * bpp, format);
+        out += count * bpp;
+
+        // Pass 2: indices
+        indices.resize((size_t)width * height);
+        uint8_t* index = indices.data();
+        for (int y = 0; y < height; y++) {
+            const uint16_t* line = src + (size_t)y * src_pitch;
+            for (int x = 0; x < width; x++) {
+                *index++ = (uint8_t)color_stamp[line[x]];
+            }
+        }
+        input = indices.data();
+        input_size = indices.size();
+    }
+
+    stream.next_in = const_cast<Bytef*>(input);
+    stream.avail_in = (uInt)input_size;
+    stream.next_out = out;
+    stream.avail_out = (uInt)compressBound((uLong)input_size);
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+        return 0;
+    }
+    size_t deflated = stream.total_out;
+
+    sequence++;
+    dst[0] = kPalettePacketType;
+    dst[1] = direct ? kPaletteDirect : 0;
+    dst[2] = (uint8_t)bpp;
+    dst[3] = 0;
+    writeU16(dst + 4, width);
+    writeU16(dst + 6, height);
+    writeU32(dst + 8, sequence);
+    writeU16(dst + 12, (uint32_t)palette_size);
+    writeU16(dst + 14, 0);
+    writeU32(dst + 16, (uint32_t)deflated);
+
+    size_t encoded = out + deflated - dst;
+    uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    frames++;
+    colors_sum += direct ? 257 : palette_size;
+    bytes_out += encoded;
+    raw_bytes += (uint64_t)width * height * bpp;
+    encode_ns_sum += nanos;
+    recordMax(encode_ns_max, nanos);
+    return encoded;
+}
+
+VideoEncoderStats PaletteCodec::getStats() const {
+    VideoEncoderStats stats = VideoEncoderStats();
+    stats.encoding = VideoEncoding::PaletteDeflate;
+    stats.level = level;
+    stats.frames = frames;
+    stats.keyframes = frames;
+    stats.coalesced = coalesced;
+    stats.direct_frames = direct_frames;
+    stats.colors_mean = stats.frames ? (double)colors_sum.load() / stats.frames : 0.0;
+    stats.bytes_out = bytes_out;
+    stats.raw_bytes = raw_bytes;
+    stats.encode_us_mean = stats.frames ? (double)encode_ns_sum.load() / stats.frames / 1000.0 : 0.0;
+    stats.encode_us_max = (double)encode_ns_max.load() / 1000.0;
+    return stats;
+}
@@ -0,0 +1,125 @@
+#ifndef PALETTE_CODEC_H
+#define PALETTE_CODEC_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+#include "emulator.h"
+
+// Lossless palette + deflate video codec.
+//
+// A SNES frame rarely holds more than a few dozen colours. Each frame gets
+// its own palette: the colours of IPPU.ScreenColors (CGRAM after
+// brightness) that appear on screen come first, in CGRAM order, so indices
+// stay stable from frame to frame; colours produced by colour math are
+// appended in first-seen order through a direct-mapped colour table. Pixels
+// are then written as 8-bit indices and deflated. A frame with more than
+// 256 colours is deflated as raw RGB565 instead.
+//
+// Packet layout, little-endian:
+//   0  u8   kPalettePacketType (0x04)
+//   1  u8   flags (kPaletteDirect: no palette, pixels are RGB565)
+//   2  u8   bytes per pixel of the palette entries
+//   3  u8   reserved
+//   4  u16  frame width
+//   6  u16  frame height
+//   8  u32  sequence number
+//   12 u16  palette entries
+//   14 u16  reserved
+//   16 u32  deflated size
+//   20      palette in the output pixel format
+//   ..      zlib stream of width * height indices (or RGB565 pixels)
+//
+// The emulation thread only copies the frame with submit(); a codec thread
+// encodes it into a buffer from the provider and hands it to the sink. When
+// the codec thread falls behind, an unencoded frame is replaced by the
+// newer one. Between start() and stop() frames are encoded on the codec
+// thread, otherwise submit() encodes inline.
+class PaletteCodec {
+public:
+    static const uint8_t kPalettePacketType = 0x04;
+    static const uint8_t kPaletteDirect = 0x01;
+    static const size_t kHeaderBytes = 20;
+
+    // Destination for a packet of the given size; nullptr drops the frame
+    typedef std::function<uint8_t*(size_t)> Provider;
+    typedef std::function<void(uint8_t* packet, size_t size, int width, int height, PixelFormat format)> Sink;
+
+    PaletteCodec();
+    ~PaletteCodec();
+
+    // zlib level 1-9 (default 1)
+    bool setLevel(int level);
+
+    // Set before submitting frames; not synchronized with the codec thread
+    void setOutput(Provider provider, Sink sink);
+    void start();
+    void stop();
+
+    // Emulation thread: queue a RGB565 frame (src_pitch in pixels) with the
+    // 256 CGRAM colours used to seed its palette (may be null)
+    void submit(const uint16_t* src, int src_pitch, int width, int height,
+                const uint16_t* screen_colors, PixelFormat format);
+
+    static size_t maxEncodedSize(int width, int height, PixelFormat format);
+
+    // Encode one frame into dst (maxEncodedSize() bytes); returns the packet
+    // size, or 0 when deflate failed. Not thread-safe.
+    size_t encode(const uint16_t* src, int src_pitch, int width, int height,
+                  const uint16_t* screen_colors, PixelFormat format, uint8_t* dst);
+
+    VideoEncoderStats getStats() const;
+
+private:
+    struct Capture {
+        std::vector<uint16_t> pixels;   // tightly packed
+        uint16_t colors[256];
+        bool seeded;
+        int width;
+        int height;
+        PixelFormat format;
+    };
+
+    void encodeLoop();
+    void deliver(Capture& capture);
+
+    // Encoder state, codec thread (or submit() without a thread)
+    z_stream stream;
+    bool stream_ready;
+    std::atomic<int> level;
+    int stream_level;
+    std::vector<uint32_t> color_stamp;  // per RGB565 colour, see palette_codec.cpp
+    uint32_t generation;
+    std::vector<uint16_t> first_seen;   // distinct colours of the frame
+    std::vector<uint8_t> indices;
+    uint32_t sequence;
+
+    // Capture handoff, as in RewindBuffer: pending waits for the codec
+    // thread, in_encode is being encoded, the third buffer takes the next frame
+    Capture captures[3];
+    std::mutex capture_mutex;
+    std::condition_variable capture_cv;
+    int pending;
+    int in_encode;
+    bool thread_stop;
+    std::thread codec_thread;
+    Provider provider;
+    Sink sink;
+
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> coalesced;
+    std::atomic<uint64_t> direct_frames;
+    std::atomic<uint64_t> colors_sum;
+    std::atomic<uint64_t> bytes_out;
+    std::atomic<uint64_t> raw_bytes;
+    std::atomic<uint64_t> encode_ns_sum;
+    std::atomic<uint64_t> encode_ns_max;
+};
+
+#endif // PALETTE_CODEC_H
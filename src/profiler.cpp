@@ -0,0 +1,257 @@
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PROFILER_RDTSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+Profiler S9xProfiler;
+
+static int64_t steadyNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t profileTicks() {
+#ifdef PROFILER_RDTSC
+    return __rdtsc();
+#else
+    return (uint64_t)steadyNanos();
+#endif
+}
+
+const char* profileSubsystemName(ProfileSubsystem subsystem) {
+    switch (subsystem) {
+        case ProfileSubsystem::CPU:     return "cpu";
+        case ProfileSubsystem::SMP:     return "smp";
+        case ProfileSubsystem::DSP:     return "dsp";
+        case ProfileSubsystem::PPU:     return "ppu";
+        case ProfileSubsystem::SuperFX: return "superfx";
+        case ProfileSubsystem::SA1:     return "sa1";
+        case ProfileSubsystem::Output:  return "output";
+    }
+    return "cpu";
+}
+
+Profiler::Profiler()
+    : active(false)
+    , enabled(false)
+    , current(ProfileSubsystem::CPU)
+    , last(0)
+    , frame_start(0)
+    , trace_capacity(0)
+    , trace_size(0)
+    , trace_dropped(0)
+    , frames(0)
+    , calibration_ticks(profileTicks())
+    , calibration_ns(steadyNanos())
+{
+    for (int s = 0; s < kProfileSubsystems; s++) {
+        frame_ticks[s] = 0;
+    }
+    reset();
+}
+
+void Profiler::setEnabled(bool enable, size_t trace_events) {
+    enabled = enable;
+    active = false;
+    trace_capacity = enable ? trace_events : 0;
+    trace.clear();
+    trace.shrink_to_fit();
+    trace.reserve(trace_capacity);
+    trace_size = 0;
+    trace_dropped = 0;
+}
+
+void Profiler::frameBegin() {
+    if (!enabled) {
+        return;
+    }
+    for (int s = 0; s < kProfileSubsystems; s++) {
+        frame_ticks[s] = 0;
+    }
+    current = ProfileSubsystem::CPU;
+    frame_start = last = profileTicks();
+    active = true;
+}
+
+void Profiler::frameEnd() {
+    if (!active) {
+        return;
+    }
+    uint64_t now = profileTicks();
+    charge(now);
+    active = false;
+
+    uint64_t frame = frames.load(std::memory_order_relaxed);
+    std::atomic<uint64_t>* slot = window[frame % kWindowFrames];
+    for (int s = 0; s < kProfileSubsystems; s++) {
+        slot[s].store(frame_ticks[s], std::memory_order_relaxed);
+    }
+    slot[kProfileSubsystems].store(now - frame_start, std::memory_order_relaxed);
+    frames.store(frame + 1, std::memory_order_release);
+
+    if (trace_capacity) {
+        if (trace.size() < trace_capacity) {
+            ProfileEvent event = { frame_start, now - frame_start, kProfileFrameEvent };
+            trace.push_back(event);
+            trace_size = trace.size();
+        } else {
+            trace_dropped++;
+        }
+    }
+}
+
+void Profiler::charge(uint64_t now) {
+    uint64_t elapsed = now - last;
+    frame_ticks[(int)current] += elapsed;
+    if (trace_capacity && elapsed) {
+        if (trace.size() < trace_capacity) {
+            ProfileEvent event = { last, elapsed, (uint8_t)current };
+            trace.push_back(event);
+            trace_size = trace.size();
+        } else {
+            trace_dropped++;
+        }
+    }
+    last = now;
+}
+
+ProfileSubsystem Profiler::enter(ProfileSubsystem subsystem) {
+    ProfileSubsystem previous = current;
+    if (subsystem != current) {
+        charge(profileTicks());
+        current = subsystem;
+    }
+    return previous;
+}
+
+void Profiler::leave(ProfileSubsystem previous) {
+    if (previous != current) {
+        charge(profileTicks());
+        current = previous;
+    }
+}
+
+void Profiler::takeTrace(ProfileTrace& out) {
+    out.events.swap(trace);
+    out.ticks_per_us = ticksPerMicro();
+    out.dropped = trace_dropped;
+    trace.clear();
+    trace.reserve(trace_capacity);
+    trace_size = 0;
+    trace_dropped = 0;
+}
+
+double Profiler::ticksPerMicro() const {
+#ifdef PROFILER_RDTSC
+    int64_t ns = steadyNanos() - calibration_ns;
+    uint64_t ticks = profileTicks() - calibration_ticks;
+    return ns > 0 ? ticks * 1000.0 / ns : 1000.0;
+#else
+    return 1000.0;
+#endif
+}
+
+static ProfileTimes summarize(std::vector<uint64_t>& values, double ticks_per_us) {
+    ProfileTimes times = ProfileTimes();
+    if (values.empty()) {
+        return times;
+    }
+    std::sort(values.begin(), values.end());
+    uint64_t sum = 0;
+    for (uint64_t value : values) sum += value;
+    size_t last = values.size() - 1;
+    times.us_mean = sum / ticks_per_us / values.size();
+    times.us_p50 = values[last * 50 / 100] / ticks_per_us;
+    times.us_p95 = values[last * 95 / 100] / ticks_per_us;
+    times.us_p99 = values[last * 99 / 100] / ticks_per_us;
+    times.us_max = values[last] / ticks_per_us;
+    return times;
+}
+
+ProfileStats Profiler::getStats() const {
+    ProfileStats stats = ProfileStats();
+#ifdef SNES9X_PROFILER
+    stats.compiled = true;
+#endif
+    stats.enabled = enabled;
+#ifdef PROFILER_RDTSC
+    stats.clock = "rdtsc";
+#else
+    stats.clock = "steady_clock";
+#endif
+    stats.frames = frames.load(std::memory_order_acquire);
+    stats.window = (int)std::min<uint64_t>(stats.frames, kWindowFrames);
+    stats.trace_events = trace_size;
+    stats.trace_dropped = trace_dropped;
+
+    // Frames being written meanwhile are at worst mixed with their neighbours
+    double ticks_per_us = ticksPerMicro();
+    std::vector<uint64_t> values(stats.window);
+    uint64_t subsystem_sum[kProfileSubsystems] = {};
+    uint64_t frame_sum = 0;
+    for (int s = 0; s <= kProfileSubsystems; s++) {
+        for (int f = 0; f < stats.window; f++) {
+            values[f] = window[f][s].load(std::memory_order_relaxed);
+            if (s < kProfileSubsystems) {
+                subsystem_sum[s] += values[f];
+            } else {
+                frame_sum += values[f];
+            }
+        }
+        ProfileTimes times = summarize(values, ticks_per_us);
+        if (s < kProfileSubsystems) {
+            stats.subsystems[s] = times;
+        } else {
+            stats.frame = times;
+        }
+    }
+    for (int s = 0; s < kProfileSubsystems; s++) {
+        stats.share[s] = frame_sum ? (double)subsystem_sum[s] / frame_sum : 0.0;
+    }
+    return stats;
+}
+
+void Profiler::reset() {
+    frames.store(0, std::memory_order_relaxed);
+    for (int f = 0; f < kWindowFrames; f++) {
+        for (int s = 0; s <= kProfileSubsystems; s++) {
+            window[f][s].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::string chromeTraceJSON(const ProfileTrace& trace) {
+    std::string json;
+    json.reserve(trace.events.size() * 80 + 256);
+    json += "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"droppedEvents\":";
+    json += std::to_string(trace.dropped);
+    json += "},\"traceEvents\":[";
+    json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"frames\"}},";
+    json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"subsystems\"}}";
+
+    uint64_t origin = trace.events.empty() ? 0 : trace.events.front().start;
+    for (const ProfileEvent& event : trace.events) {
+        if (event.start < origin) origin = event.start;
+    }
+    double ticks_per_us = trace.ticks_per_us > 0 ? trace.ticks_per_us : 1000.0;
+
+    char line[160];
+    for (const ProfileEvent& event : trace.events) {
+        bool frame = event.subsystem == kProfileFrameEvent;
+        snprintf(line, sizeof(line), ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                 frame ? "frame" : profileSubsystemName((ProfileSubsystem)event.subsystem), frame ? 0 : 1,
+                 (event.start - origin) / ticks_per_us, event.duration / ticks_per_us);
+        json += line;
+    }
+    json += "]}";
+    return json;
+}
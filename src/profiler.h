@@ -0,0 +1,155 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-frame subsystem profiler.
+//
+// Scopes placed in the core's hot functions (S9X_PROFILE_SCOPE) switch the
+// subsystem the current time is charged to; time outside every scope within
+// a frame is the 65c816 (CPU), so the subsystems add up to the frame. Each
+// switch reads the TSC (steady_clock off x86) and charges the time since the
+// previous switch, which makes the figures exclusive: SMP time inside a CPU
+// port read is not CPU time.
+//
+// The scopes compile to nothing unless SNES9X_PROFILER is defined, and cost
+// one predictable branch while profiling is off. Per-frame totals go into a
+// rolling window of atomics written by the emulation thread, so stats can
+// be read from any thread. With a trace buffer every segment between two
+// switches is kept as well, for Chrome's trace viewer (chromeTraceJSON()).
+//
+// Each core module copy has its own profiler, like the rest of the core.
+
+enum class ProfileSubsystem : uint8_t {
+    CPU,        // 65c816 and everything not below (DMA, HDMA, memory map)
+    SMP,        // S9xAPUExecute
+    DSP,        // SNES::dsp.synchronize
+    PPU,        // RenderLine, S9xUpdateScreen
+    SuperFX,    // S9xSuperFXExec
+    SA1,        // S9xSA1MainLoop
+    Output      // video conversion/delivery and audio mixing
+};
+static const int kProfileSubsystems = 7;
+
+const char* profileSubsystemName(ProfileSubsystem subsystem);
+
+struct ProfileTimes {
+    double us_mean;
+    double us_p50;
+    double us_p95;
+    double us_p99;
+    double us_max;
+};
+
+struct ProfileStats {
+    bool compiled;              // built with SNES9X_PROFILER
+    bool enabled;
+    const char* clock;          // "rdtsc" or "steady_clock"
+    uint64_t frames;            // profiled since the last reset
+    int window;                 // frames the percentiles cover
+    ProfileTimes frame;
+    ProfileTimes subsystems[kProfileSubsystems];
+    double share[kProfileSubsystems];   // of the frame time in the window
+    size_t trace_events;
+    uint64_t trace_dropped;     // trace buffer full
+};
+
+// One segment of the timeline in ticks; frames use kProfileFrameEvent
+struct ProfileEvent {
+    uint64_t start;
+    uint64_t duration;
+    uint8_t subsystem;
+};
+static const uint8_t kProfileFrameEvent = 0xFF;
+
+struct ProfileTrace {
+    std::vector<ProfileEvent> events;
+    double ticks_per_us;
+    uint64_t dropped;
+};
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto): frames on thread 0,
+// subsystem segments on thread 1, timestamps in microseconds
+std::string chromeTraceJSON(const ProfileTrace& trace);
+
+class Profiler {
+public:
+    static const int kWindowFrames = 600;
+
+    Profiler();
+
+    // Emulation thread, between frames. trace_events 0 keeps no trace.
+    void setEnabled(bool enabled, size_t trace_events);
+    void frameBegin();
+    void frameEnd();
+    void takeTrace(ProfileTrace& trace);
+
+    // Any thread
+    ProfileStats getStats() const;
+    void reset();
+
+    ProfileSubsystem enter(ProfileSubsystem subsystem);
+    void leave(ProfileSubsystem previous);
+
+    bool active;        // enabled and inside a frame
+
+private:
+    void charge(uint64_t now);
+    double ticksPerMicro() const;
+
+    bool enabled;
+    ProfileSubsystem current;
+    uint64_t last;
+    uint64_t frame_start;
+    uint64_t frame_ticks[kProfileSubsystems];
+
+    std::vector<ProfileEvent> trace;
+    size_t trace_capacity;
+    std::atomic<size_t> trace_size;
+    std::atomic<uint64_t> trace_dropped;
+
+    // Rolling window: per frame, the subsystems then the whole frame
+    std::atomic<uint64_t> window[kWindowFrames][kProfileSubsystems + 1];
+    std::atomic<uint64_t> frames;
+
+    // Tick rate from two (ticks, steady_clock) readings
+    uint64_t calibration_ticks;
+    int64_t calibration_ns;
+};
+
+extern Profiler S9xProfiler;
+
+uint64_t profileTicks();
+
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileSubsystem subsystem)
+        : entered(S9xProfiler.active)
+        , previous(ProfileSubsystem::CPU)
+    {
+        if (entered) {
+            previous = S9xProfiler.enter(subsystem);
+        }
+    }
+    ~ProfileScope() {
+        if (entered) {
+            S9xProfiler.leave(previous);
+        }
+    }
+
+private:
+    bool entered;
+    ProfileSubsystem previous;
+};
+
+#ifdef SNES9X_PROFILER
+#define S9X_PROFILE_SCOPE(subsystem) ProfileScope profile_scope(ProfileSubsystem::subsystem)
+#else
+#define S9X_PROFILE_SCOPE(subsystem)
+#endif
+
+#endif // PROFILER_H
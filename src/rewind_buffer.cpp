@@ -0,0 +1,249 @@
+#include "rewind_buffer.h"
+#include "./core/snapshot.h"
+#include "util.h"
+#include <chrono>
+
+static int64_t nowMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t elapsedMicros(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+RewindBuffer::RewindBuffer()
+    : used_words(0)
+    , pending(-1)
+    , in_delta(-1)
+    , thread_stop(false)
+    , active(false)
+    , interval(1)
+    , budget(0)
+    , state_bytes(0)
+    , frame(0)
+    , captures_taken(0)
+    , coalesced(0)
+    , rewinds(0)
+    , capture_us_sum(0)
+    , capture_us_max(0)
+    , delta_us_sum(0)
+    , delta_us_max(0)
+    , deltas(0)
+{
+}
+
+RewindBuffer::~RewindBuffer() {
+    stopThread();
+}
+
+bool RewindBuffer::configure(size_t budget_bytes, int interval_frames, bool allocate) {
+    stopThread();
+    active = false;
+
+    std::lock_guard<std::mutex> lock(manager_mutex);
+    entries.clear();
+    used_words = 0;
+    frame = 0;
+    pending = -1;
+    in_delta = -1;
+    budget = budget_bytes;
+    interval = interval_frames < 1 ? 1 : interval_frames;
+
+    captures_taken = 0;
+    coalesced = 0;
+    rewinds = 0;
+    capture_us_sum = 0;
+    capture_us_max = 0;
+    delta_us_sum = 0;
+    delta_us_max = 0;
+    deltas = 0;
+
+    // init() frees the previous ring first, so a zero budget just releases it
+    if (!manager.init(allocate ? budget_bytes : 0)) {
+        state_bytes = 0;
+        for (Capture& capture : captures) {
+            std::vector<uint8_t>().swap(capture.data);
+        }
+        return budget_bytes == 0 || !allocate;
+    }
+
+    state_bytes = manager.snapshot_size();
+    for (Capture& capture : captures) {
+        capture.data.resize(state_bytes);
+    }
+
+    thread_stop = false;
+    delta_thread = std::thread(&RewindBuffer::deltaLoop, this);
+    active = true;
+    return true;
+}
+
+void RewindBuffer::reset() {
+    if (budget > 0) {
+        configure(budget, interval);
+    }
+}
+
+void RewindBuffer::stopThread() {
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        thread_stop = true;
+    }
+    capture_cv.notify_all();
+    if (delta_thread.joinable()) {
+        delta_thread.join();
+    }
+}
+
+void RewindBuffer::frameDone() {
+    if (!active) {
+        return;
+    }
+
+    frame++;
+    if (frame % interval != 0) {
+        return;
+    }
+
+    int target;
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        target = 0;
+        while (target == pending || target == in_delta) target++;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Capture& capture = captures[target];
+    if (!S9xFreezeGameMem(capture.data.data(), (uint32)capture.data.size())) {
+        return;
+    }
+    capture.frame = frame;
+    capture.timestamp_ms = nowMillis();
+
+    uint64_t micros = elapsedMicros(start);
+    capture_us_sum.fetch_add(micros, std::memory_order_relaxed);
+    recordMax(capture_us_max, micros);
+    captures_taken++;
+
+    {
+        std::lock_guard<std::mutex> lock(capture_mutex);
+        if (pending >= 0) {
+            coalesced++;
+        }
+        pending = target;
+    }
+    capture_cv.notify_all();
+}
+
+void RewindBuffer::deltaLoop() {
+    std::unique_lock<std::mutex> lock(capture_mutex);
+    while (true) {
+        capture_cv.wait(lock, [this]() { return thread_stop || pending >= 0; });
+        if (thread_stop) {
+            break;
+        }
+        in_delta = pending;
+        pending = -1;
+        lock.unlock();
+
+        const Capture& capture = captures[in_delta];
+        {
+            std::lock_guard<std::mutex> manager_lock(manager_mutex);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            size_t words = manager.push_state(capture.data.data());
+            if (words) {
+                entries.push_back({ capture.frame, capture.timestamp_ms, words });
+                used_words += words;
+
+                // Mirror the ring overwriting its oldest deltas
+                size_t capacity_words = manager.capacity() / sizeof(uint64_t);
+                while (entries.size() > 1 && used_words >= capacity_words) {
+                    used_words -= entries.front().words;
+                    entries.pop_front();
+                }
+            }
+            uint64_t micros = elapsedMicros(start);
+            delta_us_sum.fetch_add(micros, std::memory_order_relaxed);
+            recordMax(delta_us_max, micros);
+            deltas++;
+        }
+
+        lock.lock();
+        in_delta = -1;
+        capture_cv.notify_all();
+    }
+}
+
+template <typename Newer>
+int RewindBuffer::rewindWhile(Newer newer) {
+    if (!active) {
+        return 0;
+    }
+
+    // Captures not yet in the ring are from the future being discarded: a
+    // pending one is dropped, one being pushed is waited for so it is undone
+    // below instead of landing on top of the restored state
+    {
+        std::unique_lock<std::mutex> lock(capture_mutex);
+        pending = -1;
+        capture_cv.wait(lock, [this]() { return in_delta < 0; });
+    }
+
+    std::lock_guard<std::mutex> lock(manager_mutex);
+    if (entries.empty()) {
+        return 0;
+    }
+
+    // The oldest delta is against an empty state and cannot be undone
+    while (entries.size() > 1 && newer(entries.back())) {
+        if (!manager.undo()) {
+            break;
+        }
+        used_words -= entries.back().words;
+        entries.pop_back();
+    }
+
+    if (manager.restore() != SUCCESS) {
+        return 0;
+    }
+
+    uint64_t restored = entries.back().frame;
+    int rewound = frame > restored ? (int)(frame - restored) : 0;
+    frame = restored;
+    rewinds++;
+    return rewound;
+}
+
+int RewindBuffer::rewindFrames(int frames) {
+    uint64_t target = frames < 0 || (uint64_t)frames >= frame ? 0 : frame - frames;
+    return rewindWhile([target](const Entry& entry) { return entry.frame > target; });
+}
+
+int RewindBuffer::rewindTo(int64_t timestamp_ms) {
+    return rewindWhile([timestamp_ms](const Entry& entry) { return entry.timestamp_ms > timestamp_ms; });
+}
+
+RewindStats RewindBuffer::getStats() const {
+    RewindStats stats;
+    stats.enabled = active;
+    stats.interval_frames = interval;
+    stats.budget_bytes = budget;
+
+    std::lock_guard<std::mutex> lock(manager_mutex);
+    stats.capacity_bytes = manager.capacity();
+    stats.used_bytes = used_words * sizeof(uint64_t);
+    stats.state_bytes = state_bytes;
+    stats.entries = (int)entries.size();
+    stats.span_seconds = entries.size() > 1 ? (entries.back().timestamp_ms - entries.front().timestamp_ms) / 1000.0 : 0.0;
+
+    stats.captures = captures_taken;
+    stats.coalesced = coalesced;
+    stats.rewinds = rewinds;
+    stats.capture_us_mean = stats.captures ? (double)capture_us_sum.load() / stats.captures : 0.0;
+    stats.capture_us_max = (double)capture_us_max.load();
+    uint64_t delta_count = deltas;
+    stats.delta_us_mean = delta_count ? (double)delta_us_sum.load() / delta_count : 0.0;
+    stats.delta_us_max = (double)delta_us_max.load();
+    return stats;
+}
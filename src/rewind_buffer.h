@@ -0,0 +1,99 @@
+#ifndef REWIND_BUFFER_H
+#define REWIND_BUFFER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "emulator.h"
+#include "./core/statemanager.h"
+
+// Rewind history built on the core's StateManager (XOR deltas between
+// consecutive snapshots in a power-of-two ring, oldest overwritten first).
+//
+// The emulation thread only freezes the machine into one of three capture
+// buffers every interval frames; a delta thread turns the latest capture
+// into a delta, so the per-frame cost on the emulation thread is a single
+// snapshot. When the delta thread falls behind, an unprocessed capture is
+// replaced by the newer one.
+//
+// configure(), frameDone() and the rewind calls belong to the emulation
+// thread (or any thread while it is stopped); getStats() may be called from
+// anywhere.
+class RewindBuffer {
+public:
+    RewindBuffer();
+    ~RewindBuffer();
+
+    // budget_bytes 0 disables and frees the buffers. Allocating needs a
+    // loaded ROM; without allocate the settings only take effect at the
+    // next reset().
+    bool configure(size_t budget_bytes, int interval_frames, bool allocate = true);
+    // Starts over with the current settings, e.g. after loading a ROM
+    void reset();
+    bool enabled() const { return active; }
+
+    // After every emulated frame
+    void frameDone();
+
+    int rewindFrames(int frames);
+    int rewindTo(int64_t timestamp_ms);
+
+    RewindStats getStats() const;
+
+private:
+    struct Entry {
+        uint64_t frame;
+        int64_t timestamp_ms;
+        size_t words;           // ring words used by the delta
+    };
+
+    struct Capture {
+        std::vector<uint8_t> data;
+        uint64_t frame;
+        int64_t timestamp_ms;
+    };
+
+    template <typename Newer>
+    int rewindWhile(Newer newer);
+    void deltaLoop();
+    void stopThread();
+
+    // Ring and entry list, shared with the delta thread
+    StateManager manager;
+    mutable std::mutex manager_mutex;
+    std::deque<Entry> entries;
+    size_t used_words;
+
+    // Capture handoff: pending waits for the delta thread, in_delta is
+    // being processed; the third buffer is always free for the next capture.
+    // The delta thread and a rewind waiting for it share capture_cv.
+    Capture captures[3];
+    std::mutex capture_mutex;
+    std::condition_variable capture_cv;
+    int pending;
+    int in_delta;
+    bool thread_stop;
+    std::thread delta_thread;
+
+    std::atomic<bool> active;
+    std::atomic<int> interval;
+    std::atomic<size_t> budget;
+    size_t state_bytes;
+    uint64_t frame;
+
+    std::atomic<uint64_t> captures_taken;
+    std::atomic<uint64_t> coalesced;
+    std::atomic<uint64_t> rewinds;
+    std::atomic<uint64_t> capture_us_sum;
+    std::atomic<uint64_t> capture_us_max;
+    std::atomic<uint64_t> delta_us_sum;
+    std::atomic<uint64_t> delta_us_max;
+    std::atomic<uint64_t> deltas;
+};
+
+#endif // REWIND_BUFFER_H
@@ -0,0 +1,362 @@
+#include "rom_cache.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+static const size_t kDefaultMaxBytes = 256 * 1024 * 1024;
+
+// Read-only once filled; shared by every entry with the same content
+struct RomCache::Image {
+    uint8_t* data;
+    size_t size;
+    uint64_t hash;
+
+    Image() : data(nullptr), size(0), hash(0) {}
+    ~Image() {
+        if (!data) return;
+#ifdef _WIN32
+        VirtualFree(data, 0, MEM_RELEASE);
+#else
+        munmap(data, size ? size : 1);
+#endif
+    }
+};
+
+struct RomCache::Entry {
+    std::shared_ptr<Image> image;
+    PreparedROM prepared;       // image points into image->data
+    Stamp stamp;                // file loads
+    std::vector<uint8_t> source;    // buffer loads whose buffer is not the image (header, patch)
+    uint64_t last_used;
+
+    // Buffer loads: the key is only a hash, so a hit compares the bytes
+    bool matches(const uint8_t* data, size_t size) const {
+        const uint8_t* expected = source.empty() ? image->data : source.data();
+        size_t expected_size = source.empty() ? image->size : source.size();
+        return expected_size == size && memcmp(expected, data, size) == 0;
+    }
+};
+
+// Two 64-bit lanes over 8-byte words (murmur3 style mixing, not
+// cryptographic); image and buffer hashes are confirmed by comparing the bytes
+static inline uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t fmix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static void hashBytes(const uint8_t* data, size_t size, uint64_t out[2]) {
+    uint64_t h1 = 0x9e3779b97f4a7c15ULL ^ size;
+    uint64_t h2 = 0x6a09e667f3bcc909ULL ^ size;
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; i++) {
+        uint64_t w;
+        memcpy(&w, data + i * 8, 8);
+        h1 = rotl64(h1 ^ (rotl64(w * 0x87c37b91114253d5ULL, 31) * 0x4cf5ad432745937fULL), 27) * 5 + 0x52dce729;
+        h2 = rotl64(h2 ^ (rotl64(w * 0x4cf5ad432745937fULL, 33) * 0x87c37b91114253d5ULL), 31) * 5 + 0x38495ab5;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + words * 8, size - words * 8);
+    h1 = fmix64(h1 ^ tail);
+    h2 = fmix64(h2 ^ rotl64(tail, 17) ^ h1);
+    out[0] = h1;
+    out[1] = h2;
+}
+
+static int64_t modifiedNanos(const struct stat& st) {
+#if defined(__APPLE__)
+    return (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    return (int64_t)st.st_mtime * 1000000000;
+#else
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+static std::string directoryOf(const std::string& filename) {
+    size_t slash = filename.find_last_of("/\\");
+    if (slash == std::string::npos) return ".";
+    return slash == 0 ? "/" : filename.substr(0, slash);
+}
+
+static double millisSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool RomCache::Stamp::operator==(const Stamp& other) const {
+    return device == other.device && inode == other.inode && size == other.size &&
+           mtime_ns == other.mtime_ns && directory_ns == other.directory_ns &&
+           patch_directory_ns == other.patch_directory_ns;
+}
+
+RomCache& RomCache::instance() {
+    static RomCache cache;
+    return cache;
+}
+
+RomCache::RomCache()
+    : enabled(true)
+    , max_bytes(kDefaultMaxBytes)
+    , use_clock(0)
+    , hits(0)
+    , misses(0)
+    , shared(0)
+    , evictions(0)
+    , uncached(0)
+    , cold_ms_sum(0.0)
+    , warm_ms_sum(0.0)
+    , last_ms(0.0)
+{
+}
+
+void RomCache::configure(bool enable, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    enabled = enable;
+    if (bytes) {
+        max_bytes = bytes;
+    }
+    if (!enabled) {
+        entries.clear();
+    }
+    evictLocked();
+}
+
+void RomCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    images.clear();
+}
+
+RomCache::Stats RomCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats = Stats();
+    stats.enabled = enabled;
+    stats.entries = (int)entries.size();
+    std::set<const Image*> held;
+    for (const auto& entry : entries) {
+        if (held.insert(entry.second->image.get()).second) {
+            stats.image_bytes += entry.second->image->size;
+        }
+        stats.image_bytes += entry.second->source.size();
+    }
+    stats.images = (int)held.size();
+    stats.max_bytes = max_bytes;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.shared = shared;
+    stats.evictions = evictions;
+    stats.uncached = uncached;
+    stats.cold_ms_mean = misses ? cold_ms_sum / misses : 0.0;
+    stats.warm_ms_mean = hits ? warm_ms_sum / hits : 0.0;
+    stats.last_ms = last_ms;
+    return stats;
+}
+
+bool RomCache::stampFile(const std::string& filename, const std::string& patch_dir, Stamp& stamp) const {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+    stamp.device = (uint64_t)st.st_dev;
+    stamp.inode = (uint64_t)st.st_ino;
+    stamp.size = (uint64_t)st.st_size;
+    stamp.mtime_ns = modifiedNanos(st);
+    // Patches are found by name next to the ROM and in the patch directory
+    stamp.directory_ns = stat(directoryOf(filename).c_str(), &st) == 0 ? modifiedNanos(st) : 0;
+    stamp.patch_directory_ns = !patch_dir.empty() && stat(patch_dir.c_str(), &st) == 0 ? modifiedNanos(st) : 0;
+    return true;
+}
+
+bool RomCache::loadROM(Emulator* emulator, const std::string& filename) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!enabled) {
+            return emulator->loadROM(filename);
+        }
+    }
+    return load(emulator, "file:" + filename, filename, nullptr, 0);
+}
+
+bool RomCache::loadROMMem(Emulator* emulator, const uint8_t* data, size_t size, const std::string& name) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!enabled || !data) {
+            return emulator->loadROMMem(data, size, name);
+        }
+    }
+    uint64_t hash[2];
+    hashBytes(data, size, hash);
+    char key[64];
+    snprintf(key, sizeof(key), "mem:%016llx%016llx:%llu", (unsigned long long)hash[0],
+             (unsigned long long)hash[1], (unsigned long long)size);
+    return load(emulator, key, name, data, size);
+}
+
+bool RomCache::load(Emulator* emulator, const std::string& key, const std::string& filename,
+                    const uint8_t* data, size_t size) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool is_file = data == nullptr;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    loading_cv.wait(lock, [this, &key]() { return loading.count(key) == 0; });
+
+    auto it = entries.find(key);
+    Stamp stamp = Stamp();
+    bool stamped = !is_file || stampFile(filename, it != entries.end() ? it->second->prepared.patch_dir : "", stamp);
+    if (it != entries.end() && stamped && (!is_file || stamp == it->second->stamp)) {
+        std::shared_ptr<Entry> entry = it->second;
+        entry->last_used = ++use_clock;
+        lock.unlock();
+        // A different buffer with the same hash and size loads uncached
+        if (!is_file && !entry->matches(data, size)) {
+            lock.lock();
+            uncached++;
+            lock.unlock();
+            return emulator->loadROMMem(data, size, filename);
+        }
+        bool loaded = emulator->loadPreparedROM(entry->prepared, filename);
+        recordLoad(true, millisSince(start));
+        return loaded;
+    }
+    if (it != entries.end()) {
+        entries.erase(it);
+    }
+    if (!stamped) {
+        uncached++;
+        lock.unlock();
+        return emulator->loadROM(filename);
+    }
+    loading.insert(key);
+    lock.unlock();
+
+    std::vector<uint8_t> image;
+    PreparedROM prepared;
+    bool loaded = emulator->captureROM(filename, data, size, image, prepared);
+
+    // Only keep the image if the file did not change while it was read
+    bool keep = loaded;
+    if (keep && is_file) {
+        Stamp after = Stamp();
+        keep = stampFile(filename, prepared.patch_dir, after);
+        stamp.patch_directory_ns = after.patch_directory_ns;
+        keep = keep && after == stamp;
+    }
+    uint64_t hash[2] = { 0, 0 };
+    if (keep) {
+        hashBytes(image.data(), image.size(), hash);
+    }
+
+    lock.lock();
+    loading.erase(key);
+    loading_cv.notify_all();
+    if (keep && enabled) {
+        std::shared_ptr<Image> held = internLocked(image, hash[0]);
+        if (held) {
+            std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+            entry->image = held;
+            entry->prepared = prepared;
+            entry->prepared.image = held->data;
+            entry->stamp = stamp;
+            if (!is_file && !entry->matches(data, size)) {
+                entry->source.assign(data, data + size);
+            }
+            entry->last_used = ++use_clock;
+            entries[key] = entry;
+            evictLocked();
+        }
+    }
+    lock.unlock();
+
+    recordLoad(false, millisSince(start));
+    return loaded;
+}
+
+std::shared_ptr<RomCache::Image> RomCache::internLocked(const std::vector<uint8_t>& image, uint64_t hash) {
+    auto range = images.equal_range(hash);
+    for (auto it = range.first; it != range.second;) {
+        std::shared_ptr<Image> existing = it->second.lock();
+        if (!existing) {
+            it = images.erase(it);
+            continue;
+        }
+        if (existing->size == image.size() && memcmp(existing->data, image.data(), image.size()) == 0) {
+            shared++;
+            return existing;
+        }
+        ++it;
+    }
+
+    std::shared_ptr<Image> held = std::make_shared<Image>();
+    size_t bytes = image.size() ? image.size() : 1;
+#ifdef _WIN32
+    void* pages = VirtualAlloc(nullptr, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!pages) return nullptr;
+    memcpy(pages, image.data(), image.size());
+    DWORD previous;
+    VirtualProtect(pages, bytes, PAGE_READONLY, &previous);
+#else
+    void* pages = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED) return nullptr;
+    memcpy(pages, image.data(), image.size());
+    mprotect(pages, bytes, PROT_READ);
+#endif
+    held->data = (uint8_t*)pages;
+    held->size = image.size();
+    held->hash = hash;
+    images.insert(std::make_pair(hash, std::weak_ptr<Image>(held)));
+    return held;
+}
+
+void RomCache::evictLocked() {
+    for (;;) {
+        std::set<const Image*> held;
+        size_t bytes = 0;
+        auto oldest = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (held.insert(it->second->image.get()).second) {
+                bytes += it->second->image->size;
+            }
+            bytes += it->second->source.size();
+            if (oldest == entries.end() || it->second->last_used < oldest->second->last_used) {
+                oldest = it;
+            }
+        }
+        // The newest entry stays even when it alone is over budget
+        if (bytes <= max_bytes || entries.size() <= 1) {
+            break;
+        }
+        entries.erase(oldest);
+        evictions++;
+    }
+    for (auto it = images.begin(); it != images.end();) {
+        it = it->second.expired() ? images.erase(it) : std::next(it);
+    }
+}
+
+void RomCache::recordLoad(bool hit, double ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hit) {
+        hits++;
+        warm_ms_sum += ms;
+    } else {
+        misses++;
+        cold_ms_sum += ms;
+    }
+    last_ms = ms;
+}
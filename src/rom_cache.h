@@ -0,0 +1,106 @@
+#ifndef ROM_CACHE_H
+#define ROM_CACHE_H
+
+#include "emulator.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Process-wide cache of prepared ROMs (PreparedROM, emulator.h).
+//
+// Every instance is its own copy of the core, so each load of a game used to
+// read the file (unzip or JMA), look for and apply patches, score the header
+// and hash the whole image; SHA-256 alone is ~24 ms of a ~32 ms load of a
+// 2.5 MB ROM. The first load now captures the prepared image and its
+// analysis, and later loads, in any instance, copy the image into the
+// instance's ROM and skip the rest.
+//
+// File loads are keyed by the file's identity (path, device, inode, size,
+// modification time) plus the modification times of its directory and of
+// the patch directory, so adding or removing a patch starts over. Buffer
+// loads are keyed by a hash of the buffer, and a hit is confirmed against
+// the buffer bytes (kept next to the image when they differ). Images are stored once per
+// content (hash of the prepared image) in read-only anonymous mappings that
+// every entry and instance using them shares. Least recently used entries
+// are dropped past the byte budget.
+//
+// Concurrent loads of the same key wait for the first one instead of
+// preparing the image again.
+class RomCache {
+public:
+    struct Stats {
+        bool enabled;
+        int entries;
+        int images;             // distinct images held
+        size_t image_bytes;
+        size_t max_bytes;
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t shared;        // misses whose image was already held
+        uint64_t evictions;
+        uint64_t uncached;      // file loads that could not be keyed (stat failed), buffer hash collisions
+        double cold_ms_mean;    // loads on a miss, including the capture
+        double warm_ms_mean;    // loads on a hit
+        double last_ms;
+    };
+
+    static RomCache& instance();
+
+    // max_bytes 0 keeps the current budget
+    void configure(bool enabled, size_t max_bytes);
+    void clear();
+    Stats getStats() const;
+
+    // Emulator::loadROM() and loadROMMem() through the cache
+    bool loadROM(Emulator* emulator, const std::string& filename);
+    bool loadROMMem(Emulator* emulator, const uint8_t* data, size_t size, const std::string& name);
+
+private:
+    struct Image;
+    struct Entry;
+    struct Stamp {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtime_ns;
+        int64_t directory_ns;
+        int64_t patch_directory_ns;
+
+        bool operator==(const Stamp& other) const;
+    };
+
+    RomCache();
+
+    bool load(Emulator* emulator, const std::string& key, const std::string& filename,
+              const uint8_t* data, size_t size);
+    std::shared_ptr<Image> internLocked(const std::vector<uint8_t>& image, uint64_t hash);
+    bool stampFile(const std::string& filename, const std::string& patch_dir, Stamp& stamp) const;
+    void evictLocked();
+    void recordLoad(bool hit, double ms);
+
+    mutable std::mutex mutex;
+    std::condition_variable loading_cv;
+    std::set<std::string> loading;
+    std::map<std::string, std::shared_ptr<Entry>> entries;
+    std::multimap<uint64_t, std::weak_ptr<Image>> images;   // by content hash
+    bool enabled;
+    size_t max_bytes;
+    uint64_t use_clock;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t shared;
+    uint64_t evictions;
+    uint64_t uncached;
+    double cold_ms_sum;
+    double warm_ms_sum;
+    double last_ms;
+};
+
+#endif // ROM_CACHE_H
@@ -0,0 +1,512 @@
+#include "shared_memory.h"
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <chrono>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+// Shared atomics must not fall back to a process-local lock
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "32-bit atomics must be lock-free");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "64-bit atomics must be lock-free");
+
+static const uint32_t kRingMagic = 0x53394652;      // "S9FR"
+static const uint32_t kSnapshotMagic = 0x53395353;  // "S9SS"
+static const uint32_t kLayoutVersion = 1;
+static const uint32_t kNoSnapshot = 0xFFFFFFFFu;
+
+enum SlotState : uint32_t {
+    kSlotFree = 0,
+    kSlotWriting,
+    kSlotReady,
+    kSlotReading
+};
+
+struct SharedRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t reserved;
+    uint64_t slot_size;
+    uint64_t slot_stride;
+
+    alignas(64) std::atomic<uint32_t> doorbell;
+    std::atomic<uint32_t> consumer_waiting;
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> busy;
+
+    alignas(64) std::atomic<uint32_t> queue_head;   // written by the producer
+    alignas(64) std::atomic<uint32_t> queue_tail;   // written by the consumer
+    std::atomic<uint64_t> delivered;
+    alignas(64) uint32_t queue[SharedRing::kMaxSlots];
+};
+
+struct alignas(64) SharedSlotHeader {
+    std::atomic<uint32_t> state;
+    std::atomic<uint32_t> generation;
+    SharedRing::SlotInfo info;
+};
+
+struct SharedSnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;      // per buffer
+    std::atomic<uint32_t> current;
+    uint64_t size[2];
+    uint64_t frame[2];
+};
+
+static size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static size_t ringHeaderSize() {
+    return alignUp(sizeof(SharedRingHeader), 64);
+}
+
+static size_t snapshotHeaderSize() {
+    return alignUp(sizeof(SharedSnapshotHeader), 64);
+}
+
+static std::string shmName(const std::string& name) {
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+#ifdef __linux__
+static void futexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeout_ms) {
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+    // Not FUTEX_PRIVATE: the word is shared between processes
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+#else
+static void futexWait(std::atomic<uint32_t>* word, uint32_t expected, int timeout_ms) {
+    // No cross-process futex; poll at a rate well above the frame rate
+    int slept = 0;
+    while (word->load() == expected && slept < timeout_ms) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        slept++;
+    }
+}
+
+static void futexWake(std::atomic<uint32_t>*) {
+}
+#endif
+
+#ifndef _WIN32
+static void* mapSegment(const std::string& name, bool create, size_t min_length, size_t& length, bool& created, std::string& error) {
+    std::string path = shmName(name);
+    created = false;
+
+    int fd = -1;
+    if (create) {
+        fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            // Left behind by a front-end that did not shut down cleanly
+            shm_unlink(path.c_str());
+            fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        }
+        created = fd >= 0;
+    } else {
+        fd = shm_open(path.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        error = "shm_open failed for " + path + ": " + strerror(errno);
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        error = std::string("fstat failed: ") + strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    length = (size_t)st.st_size;
+    if (length < min_length) {
+        if (ftruncate(fd, (off_t)min_length) != 0) {
+            error = std::string("ftruncate failed: ") + strerror(errno);
+            close(fd);
+            if (created) shm_unlink(path.c_str());
+            return nullptr;
+        }
+        length = min_length;
+    }
+
+    void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        error = std::string("mmap failed: ") + strerror(errno);
+        if (created) shm_unlink(path.c_str());
+        return nullptr;
+    }
+    return base;
+}
+#else
+static void* mapSegment(const std::string&, bool, size_t, size_t&, bool&, std::string& error) {
+    error = "Shared memory transport is not supported on this platform";
+    return nullptr;
+}
+#endif
+
+static void unmapSegment(void* base, size_t length) {
+#ifndef _WIN32
+    if (base) munmap(base, length);
+#endif
+}
+
+// SharedRing
+
+SharedRing* SharedRing::create(const std::string& name, int slot_count, size_t slot_size, std::string& error) {
+    if (slot_count < 1 || slot_count > kMaxSlots) {
+        error = "Slot count out of range";
+        return nullptr;
+    }
+
+    size_t stride = alignUp(sizeof(SharedSlotHeader) + slot_size, 64);
+    size_t length = ringHeaderSize() + stride * slot_count;
+    bool created;
+    void* base = mapSegment(name, true, length, length, created, error);
+    if (!base) {
+        return nullptr;
+    }
+
+    SharedRingHeader* header = new (base) SharedRingHeader();
+    header->magic = kRingMagic;
+    header->version = kLayoutVersion;
+    header->slot_count = slot_count;
+    header->slot_size = slot_size;
+    header->slot_stride = stride;
+    header->doorbell = 0;
+    header->consumer_waiting = 0;
+    header->published = 0;
+    header->busy = 0;
+    header->queue_head = 0;
+    header->queue_tail = 0;
+    header->delivered = 0;
+
+    uint8_t* slots = static_cast<uint8_t*>(base) + ringHeaderSize();
+    for (int i = 0; i < slot_count; i++) {
+        SharedSlotHeader* slot = new (slots + stride * i) SharedSlotHeader();
+        slot->state = kSlotFree;
+        slot->generation = 0;
+    }
+
+    return new SharedRing(name, true, base, length);
+}
+
+SharedRing* SharedRing::open(const std::string& name, std::string& error) {
+    size_t length;
+    bool created;
+    void* base = mapSegment(name, false, 0, length, created, error);
+    if (!base) {
+        return nullptr;
+    }
+
+    SharedRingHeader* header = static_cast<SharedRingHeader*>(base);
+    if (length < ringHeaderSize() || header->magic != kRingMagic || header->version != kLayoutVersion ||
+        length < ringHeaderSize() + header->slot_stride * header->slot_count) {
+        error = "Shared ring " + name + " has an unexpected layout";
+        unmapSegment(base, length);
+        return nullptr;
+    }
+
+    return new SharedRing(name, false, base, length);
+}
+
+SharedRing::SharedRing(const std::string& name, bool owner, void* base, size_t length)
+    : name(name)
+    , owner(owner)
+    , base(base)
+    , length(length)
+    , header(static_cast<SharedRingHeader*>(base))
+    , refs(1)
+    , notify_pending(false)
+    , next_slot(0)
+{
+}
+
+SharedRing::~SharedRing() {
+    unmapSegment(base, length);
+}
+
+void SharedRing::destroy() {
+#ifndef _WIN32
+    // Existing mappings stay valid after the name is gone
+    if (owner) {
+        shm_unlink(shmName(name).c_str());
+    }
+#endif
+    unref();
+}
+
+void SharedRing::ref() {
+    refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SharedRing::unref() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+SharedSlotHeader* SharedRing::slot(int index) const {
+    uint8_t* slots = static_cast<uint8_t*>(base) + ringHeaderSize();
+    return reinterpret_cast<SharedSlotHeader*>(slots + header->slot_stride * index);
+}
+
+size_t SharedRing::slotSize() const {
+    return header->slot_size;
+}
+
+uint8_t* SharedRing::acquire(size_t size) {
+    uint32_t count = header->slot_count;
+    if (size > header->slot_size) {
+        header->busy++;
+        return nullptr;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t index = (next_slot + i) % count;
+        SharedSlotHeader* candidate = slot(index);
+        uint32_t expected = kSlotFree;
+        if (candidate->state.compare_exchange_strong(expected, kSlotWriting, std::memory_order_acquire)) {
+            next_slot = (index + 1) % count;
+            return reinterpret_cast<uint8_t*>(candidate) + sizeof(SharedSlotHeader);
+        }
+    }
+
+    header->busy++;
+    return nullptr;
+}
+
+void SharedRing::publish(uint8_t* data, const SlotInfo& info) {
+    size_t offset = (data - sizeof(SharedSlotHeader)) - (static_cast<uint8_t*>(base) + ringHeaderSize());
+    uint32_t index = (uint32_t)(offset / header->slot_stride);
+    SharedSlotHeader* published_slot = slot(index);
+
+    published_slot->info = info;
+    published_slot->info.sequence = header->published.fetch_add(1, std::memory_order_relaxed) + 1;
+    published_slot->state.store(kSlotReady, std::memory_order_relaxed);
+
+    uint32_t head = header->queue_head.load(std::memory_order_relaxed);
+    header->queue[head % kMaxSlots] = index;
+    header->queue_head.store(head + 1, std::memory_order_release);
+
+    // Pairs with the consumer setting consumer_waiting before re-reading the
+    // doorbell, so a publish never slips past a consumer going to sleep
+    header->doorbell.fetch_add(1, std::memory_order_seq_cst);
+    if (header->consumer_waiting.load(std::memory_order_seq_cst)) {
+        futexWake(&header->doorbell);
+    }
+}
+
+void SharedRing::recoverProducer() {
+    // A Ready slot missing from the queue was marked by a producer that died
+    // before queueing it. pop() runs on the caller's thread, so the queue
+    // holds still meanwhile.
+    uint64_t queued = 0;
+    uint32_t head = header->queue_head.load(std::memory_order_acquire);
+    for (uint32_t i = header->queue_tail.load(std::memory_order_relaxed); i != head; i++) {
+        queued |= (uint64_t)1 << header->queue[i % kMaxSlots];
+    }
+
+    for (uint32_t i = 0; i < header->slot_count; i++) {
+        uint32_t expected = kSlotWriting;
+        if (!slot(i)->state.compare_exchange_strong(expected, kSlotFree) &&
+            expected == kSlotReady && !(queued & ((uint64_t)1 << i))) {
+            slot(i)->state.store(kSlotFree, std::memory_order_release);
+        }
+    }
+}
+
+uint32_t SharedRing::wait(uint32_t seen, int timeout_ms) {
+    uint32_t current = header->doorbell.load(std::memory_order_acquire);
+    if (current != seen) {
+        return current;
+    }
+
+    header->consumer_waiting.store(1, std::memory_order_seq_cst);
+    if (header->doorbell.load(std::memory_order_seq_cst) == seen) {
+        futexWait(&header->doorbell, seen, timeout_ms);
+    }
+    header->consumer_waiting.store(0, std::memory_order_relaxed);
+    return header->doorbell.load(std::memory_order_acquire);
+}
+
+int SharedRing::pop(SlotInfo& info, uint8_t*& data) {
+    uint32_t tail = header->queue_tail.load(std::memory_order_relaxed);
+    if (tail == header->queue_head.load(std::memory_order_acquire)) {
+        return -1;
+    }
+
+    uint32_t index = header->queue[tail % kMaxSlots];
+    header->queue_tail.store(tail + 1, std::memory_order_release);
+
+    SharedSlotHeader* popped = slot(index);
+    popped->state.store(kSlotReading, std::memory_order_relaxed);
+    info = popped->info;
+    data = reinterpret_cast<uint8_t*>(popped) + sizeof(SharedSlotHeader);
+    header->delivered++;
+    ref();
+    return (int)index;
+}
+
+void SharedRing::release(int index) {
+    SharedSlotHeader* released = slot(index);
+    released->generation.fetch_add(1, std::memory_order_relaxed);
+    released->state.store(kSlotFree, std::memory_order_release);
+    unref();
+}
+
+bool SharedRing::requestNotify() {
+    return !notify_pending.exchange(true, std::memory_order_acq_rel);
+}
+
+void SharedRing::beginDrain() {
+    notify_pending.store(false, std::memory_order_release);
+}
+
+SharedRing::Stats SharedRing::getStats() const {
+    Stats stats;
+    stats.slots = (int)header->slot_count;
+    stats.slots_in_use = 0;
+    for (uint32_t i = 0; i < header->slot_count; i++) {
+        if (slot(i)->state.load(std::memory_order_relaxed) != kSlotFree) stats.slots_in_use++;
+    }
+    stats.published = header->published;
+    stats.busy = header->busy;
+    stats.delivered = header->delivered;
+    stats.queued = (int)(header->queue_head.load() - header->queue_tail.load());
+    return stats;
+}
+
+// SharedSnapshot
+
+SharedSnapshot* SharedSnapshot::attach(const std::string& name, size_t capacity, std::string& error) {
+    size_t needed = snapshotHeaderSize() + alignUp(capacity, 64) * 2;
+    size_t length;
+    bool created;
+
+#ifndef _WIN32
+    // Create-or-open: the segment outlives the worker that wrote it
+    std::string path = shmName(name);
+    int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+        error = "shm_open failed for " + path + ": " + strerror(errno);
+        return nullptr;
+    }
+    close(fd);
+#endif
+
+    void* base = mapSegment(name, false, snapshotHeaderSize(), length, created, error);
+    if (!base) {
+        return nullptr;
+    }
+
+    SharedSnapshotHeader* header = static_cast<SharedSnapshotHeader*>(base);
+    bool valid = header->magic == kSnapshotMagic && header->version == kLayoutVersion;
+    if (!valid || header->capacity < capacity) {
+        // New segment, or too small for this ROM: start over with room for
+        // two snapshots of the requested size
+        unmapSegment(base, length);
+        base = mapSegment(name, false, needed, length, created, error);
+        if (!base) {
+            return nullptr;
+        }
+        header = new (base) SharedSnapshotHeader();
+        header->magic = kSnapshotMagic;
+        header->version = kLayoutVersion;
+        header->capacity = alignUp(capacity, 64);
+        header->current = kNoSnapshot;
+    }
+
+    return new SharedSnapshot(base, length);
+}
+
+void SharedSnapshot::remove(const std::string& name) {
+#ifndef _WIN32
+    shm_unlink(shmName(name).c_str());
+#endif
+}
+
+SharedSnapshot::SharedSnapshot(void* base, size_t length)
+    : base(base)
+    , length(length)
+    , header(static_cast<SharedSnapshotHeader*>(base))
+{
+}
+
+SharedSnapshot::~SharedSnapshot() {
+    unmapSegment(base, length);
+}
+
+void SharedSnapshot::destroy() {
+    delete this;
+}
+
+size_t SharedSnapshot::capacity() const {
+    return header->capacity;
+}
+
+uint8_t* SharedSnapshot::beginWrite() {
+    uint32_t current = header->current.load(std::memory_order_acquire);
+    uint32_t target = current == 0 ? 1 : 0;
+    return static_cast<uint8_t*>(base) + snapshotHeaderSize() + header->capacity * target;
+}
+
+void SharedSnapshot::commitWrite(size_t size, uint64_t frame) {
+    uint32_t current = header->current.load(std::memory_order_relaxed);
+    uint32_t target = current == 0 ? 1 : 0;
+    header->size[target] = size;
+    header->frame[target] = frame;
+    // A crash before this store leaves the previous snapshot current
+    header->current.store(target, std::memory_order_release);
+}
+
+void SharedSnapshot::discard() {
+    header->current.store(kNoSnapshot, std::memory_order_release);
+}
+
+bool SharedSnapshot::latest(const uint8_t*& data, size_t& size, uint64_t& frame) const {
+    uint32_t current = header->current.load(std::memory_order_acquire);
+    if (current > 1) {
+        return false;
+    }
+    data = static_cast<const uint8_t*>(base) + snapshotHeaderSize() + header->capacity * current;
+    size = header->size[current];
+    frame = header->frame[current];
+    return true;
+}
+
+bool setCurrentThreadAffinity(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
@@ -0,0 +1,142 @@
+#ifndef SHARED_MEMORY_H
+#define SHARED_MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Named shared memory used by supervisor mode, where every emulator runs in
+// its own worker process. POSIX only (shm_open); the doorbell is a futex on
+// Linux and a short poll elsewhere.
+
+struct SharedRingHeader;
+struct SharedSlotHeader;
+struct SharedSnapshotHeader;
+
+// Fixed-slot ring carrying video frames or audio packets from a worker
+// process (producer) to the front-end process (consumer) without copies.
+//
+// The front-end creates the ring and owns its name; the worker opens it.
+// Slots move Free -> Writing (producer) -> Ready (queued) -> Reading
+// (consumer) -> Free. Ready slot indices travel through a single-producer/
+// single-consumer queue in the shared header, and a futex word doubles as
+// the doorbell: the producer bumps it after every publish and only makes a
+// system call when the consumer is asleep.
+class SharedRing {
+public:
+    static const int kMaxSlots = 64;
+
+    enum Kind : uint32_t {
+        Video = 1,
+        Audio = 2
+    };
+
+    // Metadata stored next to each slot's payload
+    struct SlotInfo {
+        uint32_t kind;
+        uint64_t size;
+        int32_t width;
+        int32_t height;
+        int32_t stride;
+        int32_t format;         // PixelFormat
+        double frame_rate;
+        int32_t sample_frames;
+        uint64_t sequence;      // set by publish()
+    };
+
+    struct Stats {
+        int slots;
+        int slots_in_use;
+        uint64_t published;
+        uint64_t busy;          // acquire() found no free slot
+        uint64_t delivered;
+        int queued;
+    };
+
+    static SharedRing* create(const std::string& name, int slot_count, size_t slot_size, std::string& error);
+    static SharedRing* open(const std::string& name, std::string& error);
+
+    // Unmaps once every popped slot has been released; the creator also
+    // removes the name
+    void destroy();
+
+    // Producer side - acquire returns nullptr when every slot is busy
+    uint8_t* acquire(size_t size);
+    void publish(uint8_t* data, const SlotInfo& info);
+
+    // Creator side, on the consumer's thread, after the producer process
+    // died: frees the slots it left half-written or never queued.
+    // Published slots stay queued.
+    void recoverProducer();
+
+    // Consumer side. wait() blocks until the doorbell differs from seen (or
+    // the timeout expires) and returns its current value.
+    uint32_t wait(uint32_t seen, int timeout_ms);
+    int pop(SlotInfo& info, uint8_t*& data);    // -1 when nothing is queued
+    void release(int index);
+
+    // Local wake-up bookkeeping for the thread that forwards doorbells:
+    // requestNotify() returns true when no wake-up is outstanding yet, and
+    // beginDrain() is called once per wake-up before popping
+    bool requestNotify();
+    void beginDrain();
+
+    Stats getStats() const;
+    size_t slotSize() const;
+
+    // Local references, e.g. held by Buffers that point into the mapping
+    void ref();
+    void unref();
+
+private:
+    SharedRing(const std::string& name, bool owner, void* base, size_t length);
+    ~SharedRing();
+
+    SharedSlotHeader* slot(int index) const;
+
+    std::string name;
+    bool owner;
+    void* base;
+    size_t length;
+    SharedRingHeader* header;
+    std::atomic<int> refs;
+    std::atomic<bool> notify_pending;
+    uint32_t next_slot;     // producer's scan start
+};
+
+// Double-buffered savestate in shared memory. A worker writes a snapshot at
+// regular frame boundaries; after a crash its replacement maps the same
+// name and resumes from the last complete snapshot.
+class SharedSnapshot {
+public:
+    // Creates the segment, or maps an existing one and grows it if needed
+    static SharedSnapshot* attach(const std::string& name, size_t capacity, std::string& error);
+    static void remove(const std::string& name);
+    void destroy();
+
+    // Writer: buffer that is not currently published, then publish it
+    uint8_t* beginWrite();
+    void commitWrite(size_t size, uint64_t frame);
+
+    // Latest committed snapshot; false if none was written yet
+    bool latest(const uint8_t*& data, size_t& size, uint64_t& frame) const;
+
+    // Forgets the committed snapshot, e.g. when another game is loaded
+    void discard();
+
+    size_t capacity() const;
+
+private:
+    SharedSnapshot(void* base, size_t length);
+    ~SharedSnapshot();
+
+    void* base;
+    size_t length;
+    SharedSnapshotHeader* header;
+};
+
+// Pins the calling thread, and the threads it creates afterwards, to a CPU
+bool setCurrentThreadAffinity(int cpu);
+
+#endif // SHARED_MEMORY_H
@@ -0,0 +1,173 @@
+#include "tile_delta.h"
+#include "util.h"
+#include <chrono>
+#include <cstring>
+
+// Smallest supported tile, used to bound the index list independently of
+// a tile size change racing with encode()
+static const int kMinTileSize = 8;
+
+TileDeltaEncoder::TileDeltaEncoder()
+    : tile_size(16)
+    , keyframe_interval(120)
+    , keyframe_requested(true)
+    , previous_width(0)
+    , previous_height(0)
+    , previous_tile_size(0)
+    , previous_format(PixelFormat::RGB565)
+    , sequence(0)
+    , frames_since_keyframe(0)
+    , frames(0)
+    , keyframes(0)
+    , tiles_sent(0)
+    , tiles_total(0)
+    , bytes_out(0)
+    , raw_bytes(0)
+    , encode_ns_sum(0)
+    , encode_ns_max(0)
+{
+}
+
+bool TileDeltaEncoder::configure(int size, int interval) {
+    if ((size != 8 && size != 16) || interval < 0) {
+        return false;
+    }
+    tile_size = size;
+    keyframe_interval = interval;
+    keyframe_requested = true;
+    return true;
+}
+
+void TileDeltaEncoder::requestKeyframe() {
+    keyframe_requested.store(true, std::memory_order_relaxed);
+}
+
+size_t TileDeltaEncoder::maxEncodedSize(int width, int height, PixelFormat format) const {
+    size_t tiles = (size_t)((width + kMinTileSize - 1) / kMinTileSize) * ((height + kMinTileSize - 1) / kMinTileSize);
+    return kHeaderBytes + tiles * sizeof(uint16_t) + (size_t)width * height * pixelFormatBytesPerPixel(format);
+}
+
+size_t TileDeltaEncoder::encode(const uint16_t* src, int src_pitch, int width, int height,
+                                PixelFormat format, uint8_t* dst, bool& keyframe) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    int size = tile_size;
+    int interval = keyframe_interval;
+    int tiles_x = (width + size - 1) / size;
+    int tiles_y = (height + size - 1) / size;
+    int bpp = pixelFormatBytesPerPixel(format);
+
+    keyframe = keyframe_requested.exchange(false, std::memory_order_relaxed)
+        || width != previous_width || height != previous_height
+        || size != previous_tile_size || format != previous_format
+        || (interval > 0 && frames_since_keyframe + 1 >= interval);
+
+    uint32_t base = sequence;
+    sequence++;
+    dirty_tiles.clear();
+
+    if (keyframe) {
+        previous.resize((size_t)width * height);
+        for (int y = 0; y < height; y++) {
+            memcpy(&previous[(size_t)y * width], src + (size_t)y * src_pitch, width * sizeof(uint16_t));
+        }
+        for (int i = 0; i < tiles_x * tiles_y; i++) {
+            dirty_tiles.push_back((uint16_t)i);
+        }
+        previous_width = width;
+        previous_height = height;
+        previous_tile_size = size;
+        previous_format = format;
+        frames_since_keyframe = 0;
+        base = sequence;
+    } else {
+        // Most scanlines are unchanged; only lines that differ are split
+        // into tiles. Changed lines are copied whole, since the unchanged
+        // parts of them already match what the client has.
+        row_dirty.resize(tiles_x);
+        for (int ty = 0; ty < tiles_y; ty++) {
+            memset(row_dirty.data(), 0, tiles_x);
+            int y_end = ty * size + size < height ? ty * size + size : height;
+            for (int y = ty * size; y < y_end; y++) {
+                const uint16_t* line = src + (size_t)y * src_pitch;
+                uint16_t* old_line = &previous[(size_t)y * width];
+                if (memcmp(line, old_line, width * sizeof(uint16_t)) == 0) {
+                    continue;
+                }
+                for (int tx = 0; tx < tiles_x; tx++) {
+                    if (row_dirty[tx]) {
+                        continue;
+                    }
+                    int x = tx * size;
+                    int w = x + size < width ? size : width - x;
+                    if (memcmp(line + x, old_line + x, w * sizeof(uint16_t)) != 0) {
+                        row_dirty[tx] = 1;
+                    }
+                }
+                memcpy(old_line, line, width * sizeof(uint16_t));
+            }
+            for (int tx = 0; tx < tiles_x; tx++) {
+                if (row_dirty[tx]) {
+                    dirty_tiles.push_back((uint16_t)(ty * tiles_x + tx));
+                }
+            }
+        }
+        frames_since_keyframe++;
+    }
+
+    size_t count = dirty_tiles.size();
+    dst[0] = kTileDeltaPacketType;
+    dst[1] = keyframe ? kTileDeltaKeyframe : 0;
+    dst[2] = (uint8_t)size;
+    dst[3] = (uint8_t)bpp;
+    writeU16(dst + 4, width);
+    writeU16(dst + 6, height);
+    writeU32(dst + 8, sequence);
+    writeU32(dst + 12, base);
+    writeU16(dst + 16, (uint32_t)count);
+
+    uint8_t* out = dst + kHeaderBytes;
+    for (size_t i = 0; i < count; i++) {
+        writeU16(out, dirty_tiles[i]);
+        out += sizeof(uint16_t);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        int x = (dirty_tiles[i] % tiles_x) * size;
+        int y = (dirty_tiles[i] / tiles_x) * size;
+        int w = x + size < width ? size : width - x;
+        int h = y + size < height ? size : height - y;
+        convertFrame(src + (size_t)y * src_pitch + x, src_pitch, w, h, out, w * bpp, format);
+        out += (size_t)w * h * bpp;
+    }
+
+    size_t encoded = out - dst;
+    uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    frames++;
+    if (keyframe) {
+        keyframes++;
+    }
+    tiles_sent += count;
+    tiles_total += (uint64_t)tiles_x * tiles_y;
+    bytes_out += encoded;
+    raw_bytes += (uint64_t)width * height * bpp;
+    encode_ns_sum += nanos;
+    recordMax(encode_ns_max, nanos);
+    return encoded;
+}
+
+VideoEncoderStats TileDeltaEncoder::getStats() const {
+    VideoEncoderStats stats = VideoEncoderStats();
+    stats.encoding = VideoEncoding::TileDelta;
+    stats.tile_size = tile_size;
+    stats.keyframe_interval = keyframe_interval;
+    stats.frames = frames;
+    stats.keyframes = keyframes;
+    stats.tiles_sent = tiles_sent;
+    stats.tiles_total = tiles_total;
+    stats.bytes_out = bytes_out;
+    stats.raw_bytes = raw_bytes;
+    stats.encode_us_mean = stats.frames ? (double)encode_ns_sum.load() / stats.frames / 1000.0 : 0.0;
+    stats.encode_us_max = (double)encode_ns_max.load() / 1000.0;
+    return stats;
+}
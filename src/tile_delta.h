@@ -0,0 +1,83 @@
+#ifndef TILE_DELTA_H
+#define TILE_DELTA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "emulator.h"
+
+// Dirty-tile delta encoder for the video stream.
+//
+// Every frame GFX.Screen is compared against the previous frame in square
+// tiles (8 or 16 pixels); only the tiles that changed are converted to the
+// output pixel format and written out, together with their positions. A
+// keyframe carries every tile and is sent every keyframe_interval frames,
+// when the frame geometry or format changes, and on request (late joiners,
+// frames lost after encoding).
+//
+// Packet layout, little-endian:
+//   0  u8   kTileDeltaPacketType (0x03)
+//   1  u8   flags (kTileDeltaKeyframe)
+//   2  u8   tile size in pixels
+//   3  u8   bytes per pixel of the tile data
+//   4  u16  frame width
+//   6  u16  frame height
+//   8  u32  sequence number of this frame
+//   12 u32  sequence number the delta applies to (== sequence for keyframes)
+//   16 u16  tile count
+//   18 u16  tile indices (row * tiles per row + column), tile count entries
+//   ..      tile pixels in index order, rows tightly packed; tiles on the
+//           right and bottom edges are clipped to the frame
+//
+// encode() belongs to the emulation thread; configure(), requestKeyframe()
+// and getStats() may be called from anywhere.
+class TileDeltaEncoder {
+public:
+    static const uint8_t kTileDeltaPacketType = 0x03;
+    static const uint8_t kTileDeltaKeyframe = 0x01;
+    static const size_t kHeaderBytes = 18;
+
+    TileDeltaEncoder();
+
+    // tile_size 8 or 16; keyframe_interval in frames (0 only on request)
+    bool configure(int tile_size, int keyframe_interval);
+    void requestKeyframe();
+
+    // Largest packet encode() can produce for the current settings
+    size_t maxEncodedSize(int width, int height, PixelFormat format) const;
+
+    // Encode a RGB565 frame (src_pitch in pixels) into dst, which must hold
+    // maxEncodedSize() bytes. Returns the packet size.
+    size_t encode(const uint16_t* src, int src_pitch, int width, int height,
+                  PixelFormat format, uint8_t* dst, bool& keyframe);
+
+    VideoEncoderStats getStats() const;
+
+private:
+    std::atomic<int> tile_size;
+    std::atomic<int> keyframe_interval;
+    std::atomic<bool> keyframe_requested;
+
+    // Last encoded frame, tightly packed; emulation thread only
+    std::vector<uint16_t> previous;
+    std::vector<uint16_t> dirty_tiles;
+    std::vector<uint8_t> row_dirty;
+    int previous_width;
+    int previous_height;
+    int previous_tile_size;
+    PixelFormat previous_format;
+    uint32_t sequence;
+    int frames_since_keyframe;
+
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> keyframes;
+    std::atomic<uint64_t> tiles_sent;
+    std::atomic<uint64_t> tiles_total;
+    std::atomic<uint64_t> bytes_out;
+    std::atomic<uint64_t> raw_bytes;
+    std::atomic<uint64_t> encode_ns_sum;
+    std::atomic<uint64_t> encode_ns_max;
+};
+
+#endif // TILE_DELTA_H
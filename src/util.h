@@ -0,0 +1,49 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <atomic>
+#include <cstdint>
+
+// Small helpers shared by the stats counters and the packet writers.
+
+// Raises max to value. Each counter has a single writer, so a plain
+// load/store is enough; readers may see the previous maximum.
+inline void recordMax(std::atomic<uint64_t>& max, uint64_t value) {
+    if (value > max.load(std::memory_order_relaxed)) {
+        max.store(value, std::memory_order_relaxed);
+    }
+}
+
+// Percentile (rank 0-1) of a histogram of buckets fixed-width buckets plus
+// one open-ended bucket, total samples in all. Resolves to the upper edge of
+// the bucket that crosses the rank, and to overflow (the recorded maximum)
+// for the open-ended one; 0 without samples.
+inline double histogramPercentile(const uint64_t* histogram, int buckets, uint64_t total,
+                                  double rank, double bucket_width, double overflow) {
+    if (!total) {
+        return 0.0;
+    }
+    uint64_t needed = (uint64_t)(rank * total + 0.5);
+    if (needed < 1) needed = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i <= buckets; i++) {
+        seen += histogram[i];
+        if (seen >= needed) {
+            return i < buckets ? (i + 1) * bucket_width : overflow;
+        }
+    }
+    return overflow;
+}
+
+// Little-endian packet header fields
+inline void writeU16(uint8_t* dst, uint32_t value) {
+    dst[0] = value & 0xFF;
+    dst[1] = (value >> 8) & 0xFF;
+}
+
+inline void writeU32(uint8_t* dst, uint32_t value) {
+    writeU16(dst, value & 0xFFFF);
+    writeU16(dst + 2, value >> 16);
+}
+
+#endif // UTIL_H
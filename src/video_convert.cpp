@@ -0,0 +1,370 @@
+#include "video_convert.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VIDEO_CONVERT_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VIDEO_CONVERT_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VIDEO_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+typedef void (*ConvertRowFn)(const uint16_t* src, uint8_t* dst, int width);
+
+int pixelFormatBytesPerPixel(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::RGB565:   return 2;
+        case PixelFormat::RGB24:    return 3;
+        case PixelFormat::RGBA8888: return 4;
+        case PixelFormat::BGRA8888: return 4;
+    }
+    return 2;
+}
+
+const char* pixelFormatName(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::RGB565:   return "rgb565";
+        case PixelFormat::RGB24:    return "rgb24";
+        case PixelFormat::RGBA8888: return "rgba";
+        case PixelFormat::BGRA8888: return "bgra";
+    }
+    return "rgb565";
+}
+
+bool parsePixelFormat(const std::string& name, PixelFormat& format) {
+    if (name == "rgb565") {
+        format = PixelFormat::RGB565;
+    } else if (name == "rgb24") {
+        format = PixelFormat::RGB24;
+    } else if (name == "rgba" || name == "rgba8888") {
+        format = PixelFormat::RGBA8888;
+    } else if (name == "bgra" || name == "bgra8888") {
+        format = PixelFormat::BGRA8888;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Scalar kernels - also used for the tail of every SIMD row
+
+static inline void convertPixelsScalarRGB24(const uint16_t* src, uint8_t* dst, int count) {
+    for (int x = 0; x < count; x++) {
+        uint16_t pixel = src[x];
+        dst[0] = ((pixel >> 11) & 0x1F) << 3;
+        dst[1] = ((pixel >> 5) & 0x3F) << 2;
+        dst[2] = (pixel & 0x1F) << 3;
+        dst += 3;
+    }
+}
+
+static inline void convertPixelsScalarRGBA(const uint16_t* src, uint8_t* dst, int count) {
+    for (int x = 0; x < count; x++) {
+        uint16_t pixel = src[x];
+        dst[0] = ((pixel >> 11) & 0x1F) << 3;
+        dst[1] = ((pixel >> 5) & 0x3F) << 2;
+        dst[2] = (pixel & 0x1F) << 3;
+        dst[3] = 0xFF;
+        dst += 4;
+    }
+}
+
+static inline void convertPixelsScalarBGRA(const uint16_t* src, uint8_t* dst, int count) {
+    for (int x = 0; x < count; x++) {
+        uint16_t pixel = src[x];
+        dst[0] = (pixel & 0x1F) << 3;
+        dst[1] = ((pixel >> 5) & 0x3F) << 2;
+        dst[2] = ((pixel >> 11) & 0x1F) << 3;
+        dst[3] = 0xFF;
+        dst += 4;
+    }
+}
+
+#if !defined(VIDEO_CONVERT_SSE2) && !defined(VIDEO_CONVERT_NEON)
+// Whole rows when there are no vector kernels
+static void convertRowScalarRGB24(const uint16_t* src, uint8_t* dst, int width) {
+    convertPixelsScalarRGB24(src, dst, width);
+}
+
+static void convertRowScalarRGBA(const uint16_t* src, uint8_t* dst, int width) {
+    convertPixelsScalarRGBA(src, dst, width);
+}
+
+static void convertRowScalarBGRA(const uint16_t* src, uint8_t* dst, int width) {
+    convertPixelsScalarBGRA(src, dst, width);
+}
+#endif
+
+#ifdef VIDEO_CONVERT_SSE2
+// 8 pixels per iteration. Each pixel is expanded to two 16-bit halves
+// (lo = first two output bytes, hi = last two) and interleaved into 32-bit words.
+static inline void expandSSE2(__m128i pixels, bool bgra, __m128i& out_lo, __m128i& out_hi) {
+    const __m128i mask_rb = _mm_set1_epi16(0xF8);
+    const __m128i mask_g = _mm_set1_epi16(0xFC);
+    const __m128i alpha = _mm_set1_epi16((short)0xFF00);
+
+    __m128i r = _mm_and_si128(_mm_srli_epi16(pixels, 8), mask_rb);
+    __m128i g = _mm_and_si128(_mm_srli_epi16(pixels, 3), mask_g);
+    __m128i b = _mm_and_si128(_mm_slli_epi16(pixels, 3), mask_rb);
+
+    __m128i first = _mm_or_si128(bgra ? b : r, _mm_slli_epi16(g, 8));
+    __m128i second = _mm_or_si128(bgra ? r : b, alpha);
+
+    out_lo = _mm_unpacklo_epi16(first, second);
+    out_hi = _mm_unpackhi_epi16(first, second);
+}
+
+template <bool BGRA>
+static void convertRowSSE2Quad(const uint16_t* src, uint8_t* dst, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i lo, hi;
+        expandSSE2(_mm_loadu_si128((const __m128i*)(src + x)), BGRA, lo, hi);
+        _mm_storeu_si128((__m128i*)(dst + x * 4), lo);
+        _mm_storeu_si128((__m128i*)(dst + x * 4 + 16), hi);
+    }
+    if (BGRA) {
+        convertPixelsScalarBGRA(src + x, dst + x * 4, width - x);
+    } else {
+        convertPixelsScalarRGBA(src + x, dst + x * 4, width - x);
+    }
+}
+
+// SSE2 has no byte shuffle, so RGB24 is written as overlapping 4-byte stores
+// advancing by 3. The spare byte lands on the next pixel of the same row, which
+// is why the vector loop always leaves at least one pixel for the scalar tail.
+static void convertRowSSE2RGB24(const uint16_t* src, uint8_t* dst, int width) {
+    int x = 0;
+    for (; x + 8 < width; x += 8) {
+        __m128i lo, hi;
+        expandSSE2(_mm_loadu_si128((const __m128i*)(src + x)), false, lo, hi);
+
+        alignas(16) uint32_t words[8];
+        _mm_store_si128((__m128i*)words, lo);
+        _mm_store_si128((__m128i*)(words + 4), hi);
+
+        uint8_t* out = dst + x * 3;
+        for (int i = 0; i < 8; i++) {
+            memcpy(out + i * 3, &words[i], 4);
+        }
+    }
+    convertPixelsScalarRGB24(src + x, dst + x * 3, width - x);
+}
+#endif
+
+#ifdef VIDEO_CONVERT_AVX2
+// 16 pixels per iteration; same expansion as SSE2 with a lane fix-up so the
+// two output registers hold pixels 0-7 and 8-15 in order.
+__attribute__((target("avx2")))
+static inline void expandAVX2(__m256i pixels, bool bgra, __m256i& out0, __m256i& out1) {
+    const __m256i mask_rb = _mm256_set1_epi16(0xF8);
+    const __m256i mask_g = _mm256_set1_epi16(0xFC);
+    const __m256i alpha = _mm256_set1_epi16((short)0xFF00);
+
+    __m256i r = _mm256_and_si256(_mm256_srli_epi16(pixels, 8), mask_rb);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi16(pixels, 3), mask_g);
+    __m256i b = _mm256_and_si256(_mm256_slli_epi16(pixels, 3), mask_rb);
+
+    __m256i first = _mm256_or_si256(bgra ? b : r, _mm256_slli_epi16(g, 8));
+    __m256i second = _mm256_or_si256(bgra ? r : b, alpha);
+
+    __m256i lo = _mm256_unpacklo_epi16(first, second);
+    __m256i hi = _mm256_unpackhi_epi16(first, second);
+    out0 = _mm256_permute2x128_si256(lo, hi, 0x20);
+    out1 = _mm256_permute2x128_si256(lo, hi, 0x31);
+}
+
+template <bool BGRA>
+__attribute__((target("avx2")))
+static void convertRowAVX2Quad(const uint16_t* src, uint8_t* dst, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i out0, out1;
+        expandAVX2(_mm256_loadu_si256((const __m256i*)(src + x)), BGRA, out0, out1);
+        _mm256_storeu_si256((__m256i*)(dst + x * 4), out0);
+        _mm256_storeu_si256((__m256i*)(dst + x * 4 + 32), out1);
+    }
+    if (BGRA) {
+        convertPixelsScalarBGRA(src + x, dst + x * 4, width - x);
+    } else {
+        convertPixelsScalarRGBA(src + x, dst + x * 4, width - x);
+    }
+}
+
+// Each 128-bit lane is packed from 4 RGBA pixels down to 12 RGB bytes and
+// stored with a 16-byte store; the last store spills 4 bytes into the next
+// two pixels of the row, so the loop keeps those for the scalar tail.
+__attribute__((target("avx2")))
+static void convertRowAVX2RGB24(const uint16_t* src, uint8_t* dst, int width) {
+    const __m256i pack = _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    int x = 0;
+    for (; x + 18 <= width; x += 16) {
+        __m256i out0, out1;
+        expandAVX2(_mm256_loadu_si256((const __m256i*)(src + x)), false, out0, out1);
+        out0 = _mm256_shuffle_epi8(out0, pack);
+        out1 = _mm256_shuffle_epi8(out1, pack);
+
+        uint8_t* out = dst + x * 3;
+        _mm_storeu_si128((__m128i*)(out), _mm256_castsi256_si128(out0));
+        _mm_storeu_si128((__m128i*)(out + 12), _mm256_extracti128_si256(out0, 1));
+        _mm_storeu_si128((__m128i*)(out + 24), _mm256_castsi256_si128(out1));
+        _mm_storeu_si128((__m128i*)(out + 36), _mm256_extracti128_si256(out1, 1));
+    }
+    convertPixelsScalarRGB24(src + x, dst + x * 3, width - x);
+}
+#endif
+
+#ifdef VIDEO_CONVERT_NEON
+static inline void expandNEON(uint16x8_t pixels, uint8x8_t& r, uint8x8_t& g, uint8x8_t& b) {
+    r = vand_u8(vshrn_n_u16(pixels, 8), vdup_n_u8(0xF8));
+    g = vand_u8(vshrn_n_u16(pixels, 3), vdup_n_u8(0xFC));
+    b = vshl_n_u8(vmovn_u16(pixels), 3);
+}
+
+static void convertRowNEONRGB24(const uint16_t* src, uint8_t* dst, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint8x8x3_t out;
+        expandNEON(vld1q_u16(src + x), out.val[0], out.val[1], out.val[2]);
+        vst3_u8(dst + x * 3, out);
+    }
+    convertPixelsScalarRGB24(src + x, dst + x * 3, width - x);
+}
+
+template <bool BGRA>
+static void convertRowNEONQuad(const uint16_t* src, uint8_t* dst, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint8x8x4_t out;
+        uint8x8_t r, g, b;
+        expandNEON(vld1q_u16(src + x), r, g, b);
+        out.val[0] = BGRA ? b : r;
+        out.val[1] = g;
+        out.val[2] = BGRA ? r : b;
+        out.val[3] = vdup_n_u8(0xFF);
+        vst4_u8(dst + x * 4, out);
+    }
+    if (BGRA) {
+        convertPixelsScalarBGRA(src + x, dst + x * 4, width - x);
+    } else {
+        convertPixelsScalarRGBA(src + x, dst + x * 4, width - x);
+    }
+}
+#endif
+
+struct ConvertKernels {
+    const char* name;
+    ConvertRowFn rgb24;
+    ConvertRowFn rgba;
+    ConvertRowFn bgra;
+};
+
+static ConvertKernels selectKernels() {
+#ifdef VIDEO_CONVERT_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return { "avx2", convertRowAVX2RGB24, convertRowAVX2Quad<false>, convertRowAVX2Quad<true> };
+    }
+#endif
+#ifdef VIDEO_CONVERT_SSE2
+    return { "sse2", convertRowSSE2RGB24, convertRowSSE2Quad<false>, convertRowSSE2Quad<true> };
+#elif defined(VIDEO_CONVERT_NEON)
+    return { "neon", convertRowNEONRGB24, convertRowNEONQuad<false>, convertRowNEONQuad<true> };
+#else
+    return { "scalar", convertRowScalarRGB24, convertRowScalarRGBA, convertRowScalarBGRA };
+#endif
+}
+
+static const ConvertKernels& kernels() {
+    static const ConvertKernels selected = selectKernels();
+    return selected;
+}
+
+void convertFrame(const uint16_t* src, int src_pitch, int width, int height,
+                  uint8_t* dst, int dst_pitch, PixelFormat format) {
+    if (!src || !dst || width <= 0 || height <= 0) {
+        return;
+    }
+
+    ConvertRowFn row = nullptr;
+    switch (format) {
+        case PixelFormat::RGB565:
+            for (int y = 0; y < height; y++) {
+                memcpy(dst + y * dst_pitch, src + y * src_pitch, width * sizeof(uint16_t));
+            }
+            return;
+        case PixelFormat::RGB24:    row = kernels().rgb24; break;
+        case PixelFormat::RGBA8888: row = kernels().rgba; break;
+        case PixelFormat::BGRA8888: row = kernels().bgra; break;
+    }
+
+    for (int y = 0; y < height; y++) {
+        row(src + y * src_pitch, dst + y * dst_pitch, width);
+    }
+}
+
+bool isObservationScale(int scale) {
+    return scale == 1 || scale == 2 || scale == 4 || scale == 8;
+}
+
+size_t observationSize(int scale, bool greyscale) {
+    return (size_t)(kObservationWidth / scale) * (kObservationHeight / scale) * (greyscale ? 1 : 3);
+}
+
+void convertObservation(const uint16_t* src, int src_pitch, int width, int height,
+                        int scale, bool greyscale, uint8_t* dst) {
+    int out_width = kObservationWidth / scale;
+    int out_height = kObservationHeight / scale;
+    int channels = greyscale ? 1 : 3;
+    if (!src || width <= 0 || height <= 0) {
+        memset(dst, 0, observationSize(scale, greyscale));
+        return;
+    }
+
+    // Hi-res (512 wide) and interlaced (448+ high) frames show the same
+    // picture with twice the pixels
+    int box_width = scale * (width > kObservationWidth ? 2 : 1);
+    int box_height = scale * (height >= kObservationHeight * 2 ? 2 : 1);
+    int area = box_width * box_height;
+
+    for (int oy = 0; oy < out_height; oy++) {
+        int y0 = oy * box_height;
+        int rows = height - y0 < box_height ? height - y0 : box_height;
+        uint8_t* out = dst + (size_t)oy * out_width * channels;
+        for (int ox = 0; ox < out_width; ox++) {
+            // Channel sums; missing rows count as black
+            uint32_t r = 0, g = 0, b = 0;
+            for (int y = 0; y < rows; y++) {
+                const uint16_t* pixel = src + (size_t)(y0 + y) * src_pitch + ox * box_width;
+                for (int x = 0; x < box_width; x++) {
+                    r += (pixel[x] >> 11) & 0x1F;
+                    g += (pixel[x] >> 5) & 0x3F;
+                    b += pixel[x] & 0x1F;
+                }
+            }
+            // Same expansion as convertFrame()
+            uint32_t r8 = (r << 3) / area;
+            uint32_t g8 = (g << 2) / area;
+            uint32_t b8 = (b << 3) / area;
+            if (greyscale) {
+                out[ox] = (uint8_t)((77 * r8 + 150 * g8 + 29 * b8) >> 8);
+            } else {
+                out[ox * 3] = (uint8_t)r8;
+                out[ox * 3 + 1] = (uint8_t)g8;
+                out[ox * 3 + 2] = (uint8_t)b8;
+            }
+        }
+    }
+}
+
+const char* videoConvertKernel() {
+    return kernels().name;
+}
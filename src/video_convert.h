@@ -0,0 +1,43 @@
+#ifndef VIDEO_CONVERT_H
+#define VIDEO_CONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Output pixel formats for frames leaving the addon.
+// GFX.Screen is always RGB565; everything else is produced by convertFrame().
+enum class PixelFormat {
+    RGB565,     // passthrough, 2 bytes per pixel
+    RGB24,      // R, G, B
+    RGBA8888,   // R, G, B, 0xFF
+    BGRA8888    // B, G, R, 0xFF
+};
+
+int pixelFormatBytesPerPixel(PixelFormat format);
+const char* pixelFormatName(PixelFormat format);
+bool parsePixelFormat(const std::string& name, PixelFormat& format);
+
+// Convert a RGB565 frame into the requested format.
+// src_pitch is in pixels (GFX.RealPPL for GFX.Screen), dst_pitch in bytes.
+// Channel expansion matches the previous JS converter: 5-bit channels are
+// shifted left by 3, the 6-bit green channel by 2.
+void convertFrame(const uint16_t* src, int src_pitch, int width, int height,
+                  uint8_t* dst, int dst_pitch, PixelFormat format);
+
+// Training observations: the 256x224 picture averaged over scale x scale
+// boxes (scale 1, 2, 4 or 8) into RGB24 or 8-bit luma, rows packed. Hi-res
+// and interlaced frames are averaged down to 256x224 as well; rows past
+// the frame's height are black.
+static const int kObservationWidth = 256;
+static const int kObservationHeight = 224;
+
+bool isObservationScale(int scale);
+size_t observationSize(int scale, bool greyscale);
+void convertObservation(const uint16_t* src, int src_pitch, int width, int height,
+                        int scale, bool greyscale, uint8_t* dst);
+
+// Name of the kernel selected at runtime ("avx2", "sse2", "neon" or "scalar")
+const char* videoConvertKernel();
+
+#endif // VIDEO_CONVERT_H